@@ -0,0 +1,105 @@
+#include "avatar_cache.h"
+#include "abstractclient.h"
+#include "pb/response_get_avatar.pb.h"
+#include "pb/serverinfo_user.pb.h"
+#include "pb/session_commands.pb.h"
+#include "pending_command.h"
+#include "settingscache.h"
+#include <QCryptographicHash>
+#include <QFile>
+
+const int AvatarCache::maxDiskCacheFiles = 2000;
+
+AvatarCache::AvatarCache(QObject *parent)
+    : QObject(parent), cacheDir(settingsCache->getDataPath() + "/avatars"), pixmaps(32 * 1024 * 1024)
+{
+    if (!cacheDir.exists())
+        cacheDir.mkpath(".");
+    pruneDiskCache();
+}
+
+QString AvatarCache::getFileName(const QByteArray &hash) const
+{
+    return cacheDir.filePath(QString::fromLatin1(hash.toHex()));
+}
+
+void AvatarCache::pruneDiskCache()
+{
+    // the files of avatars that haven't been received for the longest time are removed
+    const QFileInfoList files = cacheDir.entryInfoList(QDir::Files, QDir::Time);
+    for (int i = maxDiskCacheFiles; i < files.size(); ++i)
+        QFile::remove(files[i].absoluteFilePath());
+}
+
+QPixmap AvatarCache::insertPixmap(const QByteArray &hash, const QByteArray &avatarBmp)
+{
+    QPixmap *pixmap = new QPixmap;
+    if (!pixmap->loadFromData(avatarBmp)) {
+        delete pixmap;
+        return QPixmap();
+    }
+    const QPixmap result = *pixmap;
+    pixmaps.insert(hash, pixmap, result.width() * result.height() * result.depth() / 8);
+    return result;
+}
+
+QPixmap AvatarCache::getAvatar(const ServerInfo_User &user, AbstractClient *client)
+{
+    const std::string &bmp = user.avatar_bmp();
+    const QByteArray avatarBmp = QByteArray::fromRawData(bmp.data(), static_cast<int>(bmp.size()));
+    if (!user.has_avatar_hash()) {
+        // older servers only send the image
+        QPixmap pixmap;
+        pixmap.loadFromData(avatarBmp);
+        return pixmap;
+    }
+
+    const QByteArray hash = QByteArray::fromStdString(user.avatar_hash());
+    if (QPixmap *pixmap = pixmaps.object(hash))
+        return *pixmap;
+
+    if (!avatarBmp.isEmpty())
+        return insertPixmap(hash, avatarBmp);
+
+    QFile file(getFileName(hash));
+    if (file.open(QIODevice::ReadOnly)) {
+        const QPixmap pixmap = insertPixmap(hash, file.readAll());
+        if (!pixmap.isNull())
+            return pixmap;
+        file.remove();
+    }
+
+    if (client && !pendingHashes.contains(hash)) {
+        pendingHashes.insert(hash);
+
+        Command_GetAvatar cmd;
+        cmd.set_avatar_hash(user.avatar_hash());
+        cmd.set_user_name(user.name());
+
+        PendingCommand *pend = client->prepareSessionCommand(cmd);
+        connect(pend, SIGNAL(finished(Response, CommandContainer, QVariant)), this,
+                SLOT(getAvatarFinished(const Response &, const CommandContainer &)));
+        client->sendCommand(pend);
+    }
+    return QPixmap();
+}
+
+void AvatarCache::getAvatarFinished(const Response &response, const CommandContainer &commandContainer)
+{
+    const Command_GetAvatar &cmd = commandContainer.session_command(0).GetExtension(Command_GetAvatar::ext);
+    const QByteArray hash = QByteArray::fromStdString(cmd.avatar_hash());
+    pendingHashes.remove(hash);
+    if (response.response_code() != Response::RespOk)
+        return;
+
+    const std::string &bmp = response.GetExtension(Response_GetAvatar::ext).avatar_bmp();
+    const QByteArray avatarBmp(bmp.data(), static_cast<int>(bmp.size()));
+    if (QCryptographicHash::hash(avatarBmp, QCryptographicHash::Sha1) != hash || insertPixmap(hash, avatarBmp).isNull())
+        return;
+
+    QFile file(getFileName(hash));
+    if (file.open(QIODevice::WriteOnly))
+        file.write(avatarBmp);
+
+    emit avatarReceived(hash);
+}
@@ -0,0 +1,53 @@
+#ifndef AVATAR_CACHE_H
+#define AVATAR_CACHE_H
+
+#include <QByteArray>
+#include <QCache>
+#include <QDir>
+#include <QObject>
+#include <QPixmap>
+#include <QSet>
+
+class AbstractClient;
+class CommandContainer;
+class Response;
+class ServerInfo_User;
+
+/*
+ * Avatars are identified by the hash of their image. Servers that support it leave the image out of the user infos
+ * they send, the client fetches every avatar by its hash once and keeps it on disk, so that it is not transferred
+ * again until the user changes it.
+ *
+ * The decoded avatars are kept in memory as well, as the same avatar is shown in many places (user info boxes,
+ * every game the user is in).
+ */
+class AvatarCache : public QObject
+{
+    Q_OBJECT
+signals:
+    void avatarReceived(const QByteArray &hash);
+private slots:
+    void getAvatarFinished(const Response &response, const CommandContainer &commandContainer);
+
+private:
+    static const int maxDiskCacheFiles;
+
+    QDir cacheDir;
+    QCache<QByteArray, QPixmap> pixmaps;
+    QSet<QByteArray> pendingHashes;
+
+    QString getFileName(const QByteArray &hash) const;
+    QPixmap insertPixmap(const QByteArray &hash, const QByteArray &avatarBmp);
+    void pruneDiskCache();
+
+public:
+    AvatarCache(QObject *parent = nullptr);
+
+    // Returns the avatar of the user, or a null pixmap if the user has none. If the avatar is not cached yet, it is
+    // requested from the server through the client and avatarReceived() is emitted with its hash once it arrived.
+    QPixmap getAvatar(const ServerInfo_User &user, AbstractClient *client);
+};
+
+extern AvatarCache *avatarCache;
+
+#endif
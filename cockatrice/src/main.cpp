@@ -20,6 +20,7 @@
 
 #include "main.h"
 #include "QtNetwork/QNetworkInterface"
+#include "avatar_cache.h"
 #include "carddatabase.h"
 #include "dlg_settings.h"
 #include "featureset.h"
@@ -52,6 +53,7 @@ RNG_Abstract *rng;
 SoundEngine *soundEngine;
 QSystemTrayIcon *trayIcon;
 ThemeManager *themeManager;
+AvatarCache *avatarCache;
 
 const QString translationPrefix = "cockatrice";
 QString translationPath;
@@ -118,6 +120,7 @@ int main(int argc, char *argv[])
     settingsCache = new SettingsCache;
     themeManager = new ThemeManager;
     soundEngine = new SoundEngine;
+    avatarCache = new AvatarCache;
     db = new CardDatabase;
 
     qtTranslator = new QTranslator;
@@ -147,6 +150,7 @@ int main(int argc, char *argv[])
     app.exec();
 
     qDebug("Event loop finished, terminating...");
+    delete avatarCache;
     delete db;
     delete settingsCache;
     delete rng;
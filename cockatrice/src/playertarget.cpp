@@ -1,7 +1,10 @@
 #include "playertarget.h"
+#include "avatar_cache.h"
 #include "pb/serverinfo_user.pb.h"
 #include "pixmapgenerator.h"
 #include "player.h"
+#include "tab_game.h"
+#include "tab_supervisor.h"
 #include <QDebug>
 #include <QPainter>
 #include <QPixmapCache>
@@ -53,9 +56,8 @@ PlayerTarget::PlayerTarget(Player *_owner, QGraphicsItem *parentItem)
 {
     setCacheMode(DeviceCoordinateCache);
 
-    const std::string &bmp = _owner->getUserInfo()->avatar_bmp();
-    if (!fullPixmap.loadFromData((const uchar *)bmp.data(), bmp.size()))
-        fullPixmap = QPixmap();
+    connect(avatarCache, SIGNAL(avatarReceived(QByteArray)), this, SLOT(avatarReceived(const QByteArray &)));
+    loadAvatar();
 }
 
 PlayerTarget::~PlayerTarget()
@@ -65,6 +67,19 @@ PlayerTarget::~PlayerTarget()
     delete playerCounter;
 }
 
+void PlayerTarget::loadAvatar()
+{
+    fullPixmap = avatarCache->getAvatar(*owner->getUserInfo(), owner->getGame()->getTabSupervisor()->getClient());
+}
+
+void PlayerTarget::avatarReceived(const QByteArray &hash)
+{
+    if (hash.toStdString() != owner->getUserInfo()->avatar_hash())
+        return;
+    loadAvatar();
+    update();
+}
+
 QRectF PlayerTarget::boundingRect() const
 {
     return QRectF(0, 0, 160, 64);
@@ -23,8 +23,12 @@ class PlayerTarget : public ArrowTarget
 private:
     QPixmap fullPixmap;
     PlayerCounter *playerCounter;
+
+    void loadAvatar();
 public slots:
     void counterDeleted();
+private slots:
+    void avatarReceived(const QByteArray &hash);
 
 public:
     enum
@@ -10,6 +10,7 @@
 #include "pending_command.h"
 
 const int RemoteReplayList_TreeModel::numberOfColumns = 6;
+const int RemoteReplayList_TreeModel::pageSize = 50;
 
 RemoteReplayList_TreeModel::MatchNode::MatchNode(const ServerInfo_ReplayMatch &_matchInfo)
     : RemoteReplayList_TreeModel::Node(QString::fromStdString(_matchInfo.game_name())), matchInfo(_matchInfo)
@@ -30,7 +31,7 @@ void RemoteReplayList_TreeModel::MatchNode::updateMatchInfo(const ServerInfo_Rep
 }
 
 RemoteReplayList_TreeModel::RemoteReplayList_TreeModel(AbstractClient *_client, QObject *parent)
-    : QAbstractItemModel(parent), client(_client)
+    : QAbstractItemModel(parent), client(_client), nextPageBeforeGameId(-1), moreMatches(false), fetchingPage(false)
 {
     QFileIconProvider fip;
     dirIcon = fip.icon(QFileIconProvider::Folder);
@@ -236,11 +237,32 @@ void RemoteReplayList_TreeModel::clearTree()
     replayMatches.clear();
 }
 
+bool RemoteReplayList_TreeModel::canFetchMore(const QModelIndex &parent) const
+{
+    return !parent.isValid() && moreMatches && !fetchingPage;
+}
+
+void RemoteReplayList_TreeModel::fetchMore(const QModelIndex &parent)
+{
+    if (canFetchMore(parent))
+        requestPage(nextPageBeforeGameId);
+}
+
 void RemoteReplayList_TreeModel::refreshTree()
 {
-    PendingCommand *pend = client->prepareSessionCommand(Command_ReplayList());
+    requestPage(-1);
+}
+
+void RemoteReplayList_TreeModel::requestPage(int beforeGameId)
+{
+    Command_ReplayList cmd;
+    cmd.set_before_game_id(beforeGameId);
+    cmd.set_page_size(pageSize);
+
+    fetchingPage = true;
+    PendingCommand *pend = client->prepareSessionCommand(cmd);
     connect(pend, SIGNAL(finished(Response, CommandContainer, QVariant)), this,
-            SLOT(replayListFinished(const Response &)));
+            SLOT(replayListFinished(Response, CommandContainer)));
 
     client->sendCommand(pend);
 }
@@ -276,17 +298,31 @@ void RemoteReplayList_TreeModel::removeMatchInfo(int gameId)
         }
 }
 
-void RemoteReplayList_TreeModel::replayListFinished(const Response &r)
+void RemoteReplayList_TreeModel::replayListFinished(const Response &r, const CommandContainer &commandContainer)
 {
-    const Response_ReplayList &resp = r.GetExtension(Response_ReplayList::ext);
-
-    beginResetModel();
-    clearTree();
-
-    for (int i = 0; i < resp.match_list_size(); ++i)
-        replayMatches.append(new MatchNode(resp.match_list(i)));
+    const int beforeGameId = commandContainer.session_command(0).GetExtension(Command_ReplayList::ext).before_game_id();
+    // a page requested before the list was refreshed
+    if (beforeGameId != -1 && beforeGameId != nextPageBeforeGameId)
+        return;
 
-    endResetModel();
+    const Response_ReplayList &resp = r.GetExtension(Response_ReplayList::ext);
+    fetchingPage = false;
+    moreMatches = resp.more_matches();
+    if (resp.match_list_size() > 0)
+        nextPageBeforeGameId = resp.match_list(resp.match_list_size() - 1).game_id();
+
+    if (beforeGameId == -1) {
+        beginResetModel();
+        clearTree();
+        for (int i = 0; i < resp.match_list_size(); ++i)
+            replayMatches.append(new MatchNode(resp.match_list(i)));
+        endResetModel();
+    } else if (resp.match_list_size() > 0) {
+        beginInsertRows(QModelIndex(), replayMatches.size(), replayMatches.size() + resp.match_list_size() - 1);
+        for (int i = 0; i < resp.match_list_size(); ++i)
+            replayMatches.append(new MatchNode(resp.match_list(i)));
+        endInsertRows();
+    }
     emit treeRefreshed();
 }
 
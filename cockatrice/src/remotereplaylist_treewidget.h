@@ -8,6 +8,7 @@
 #include <QTreeView>
 
 class Response;
+class CommandContainer;
 class AbstractClient;
 class QSortFilterProxyModel;
 
@@ -70,15 +71,20 @@ private:
 
     AbstractClient *client;
     QList<MatchNode *> replayMatches;
+    // game id the next page of matches starts below, the matches are listed newest first
+    int nextPageBeforeGameId;
+    bool moreMatches, fetchingPage;
 
     QIcon dirIcon, fileIcon, lockIcon;
     void clearTree();
+    void requestPage(int beforeGameId);
 
     static const int numberOfColumns;
+    static const int pageSize;
 signals:
     void treeRefreshed();
 private slots:
-    void replayListFinished(const Response &r);
+    void replayListFinished(const Response &r, const CommandContainer &commandContainer);
 
 public:
     RemoteReplayList_TreeModel(AbstractClient *_client, QObject *parent = 0);
@@ -93,6 +99,8 @@ public:
     QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const;
     QModelIndex parent(const QModelIndex &index) const;
     Qt::ItemFlags flags(const QModelIndex &index) const;
+    bool canFetchMore(const QModelIndex &parent) const;
+    void fetchMore(const QModelIndex &parent);
     void refreshTree();
     ServerInfo_Replay const *getReplay(const QModelIndex &index) const;
     ServerInfo_ReplayMatch const *getReplayMatch(const QModelIndex &index) const;
@@ -0,0 +1,135 @@
+#include "replay_download.h"
+#include "abstractclient.h"
+#include "pending_command.h"
+
+#include "pb/command_replay_download.pb.h"
+#include "pb/game_replay.pb.h"
+#include "pb/response_replay_download.pb.h"
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/wire_format_lite.h>
+
+const int ReplayDownload::chunkSize = 256 * 1024;
+
+ReplayDownload::ReplayDownload(AbstractClient *_client, int _replayId, QObject *parent)
+    : QObject(parent), client(_client), replayId(_replayId), offset(0), replay(nullptr), ownsReplay(false)
+{
+}
+
+ReplayDownload::~ReplayDownload()
+{
+    if (ownsReplay)
+        delete replay;
+}
+
+bool ReplayDownload::saveToFile(const QString &filePath)
+{
+    file.setFileName(filePath);
+    return file.open(QIODevice::WriteOnly);
+}
+
+void ReplayDownload::parseReplay()
+{
+    if (!replay) {
+        replay = new GameReplay;
+        ownsReplay = true;
+    }
+}
+
+GameReplay *ReplayDownload::takeReplay()
+{
+    ownsReplay = false;
+    return replay;
+}
+
+void ReplayDownload::start()
+{
+    requestChunk();
+}
+
+void ReplayDownload::requestChunk()
+{
+    Command_ReplayDownload cmd;
+    cmd.set_replay_id(replayId);
+    cmd.set_offset(offset);
+    cmd.set_length(chunkSize);
+
+    PendingCommand *pend = client->prepareSessionCommand(cmd);
+    connect(pend, SIGNAL(finished(Response, CommandContainer, QVariant)), this,
+            SLOT(chunkFinished(const Response &)));
+    client->sendCommand(pend);
+}
+
+void ReplayDownload::chunkFinished(const Response &response)
+{
+    if (response.response_code() != Response::RespOk) {
+        fail();
+        return;
+    }
+
+    const Response_ReplayDownload &resp = response.GetExtension(Response_ReplayDownload::ext);
+    const std::string &data = resp.replay_data();
+    if (!processData(QByteArray::fromRawData(data.data(), static_cast<int>(data.size())))) {
+        fail();
+        return;
+    }
+    offset += static_cast<quint32>(data.size());
+
+    // servers that don't support chunks send the whole replay at once
+    if (resp.has_total_size() && !data.empty() && offset < resp.total_size()) {
+        requestChunk();
+        return;
+    }
+
+    if (replay && (!parseBuffer.isEmpty() || !replay->has_game_info())) {
+        fail();
+        return;
+    }
+    file.close();
+    emit finished();
+}
+
+void ReplayDownload::fail()
+{
+    // don't leave an incomplete replay file behind
+    if (file.isOpen())
+        file.remove();
+    emit failed();
+}
+
+bool ReplayDownload::processData(const QByteArray &data)
+{
+    if (file.isOpen() && file.write(data) != data.size())
+        return false;
+    if (replay && !parseData(data))
+        return false;
+    return true;
+}
+
+bool ReplayDownload::parseData(const QByteArray &data)
+{
+    parseBuffer.append(data);
+
+    // every complete top level field of the replay is merged into it on its own; what is left of the buffer
+    // is the beginning of a field whose remaining data is still to come
+    const bool hadGameInfo = replay->has_game_info();
+    const int eventCount = replay->event_list_size();
+    const auto *buffer = reinterpret_cast<const google::protobuf::uint8 *>(parseBuffer.constData());
+    google::protobuf::io::CodedInputStream input(buffer, parseBuffer.size());
+    int parsed = 0;
+    for (google::protobuf::uint32 tag = input.ReadTag(); tag != 0; tag = input.ReadTag()) {
+        if (!google::protobuf::internal::WireFormatLite::SkipField(&input, tag))
+            break;
+        const int fieldEnd = input.CurrentPosition();
+        google::protobuf::io::CodedInputStream fieldInput(buffer + parsed, fieldEnd - parsed);
+        if (!replay->MergeFromCodedStream(&fieldInput))
+            return false;
+        parsed = fieldEnd;
+    }
+    parseBuffer.remove(0, parsed);
+
+    if (!hadGameInfo && replay->has_game_info())
+        emit replayStarted();
+    else if (hadGameInfo && replay->event_list_size() > eventCount)
+        emit eventsAdded();
+    return true;
+}
@@ -0,0 +1,58 @@
+#ifndef REPLAY_DOWNLOAD_H
+#define REPLAY_DOWNLOAD_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QObject>
+
+class AbstractClient;
+class GameReplay;
+class Response;
+
+/*
+ * Downloads a replay from the server in chunks, one command per chunk, so that other traffic is not held up
+ * behind a big replay and the replay never has to be kept in memory as a whole.
+ *
+ * The chunks can be written to a file and/or parsed as they arrive. While parsing, the events become available
+ * one by one, so that playback can start before the whole replay has been received.
+ */
+class ReplayDownload : public QObject
+{
+    Q_OBJECT
+signals:
+    // the game info of the parsed replay has been received
+    void replayStarted();
+    void eventsAdded();
+    void finished();
+    void failed();
+private slots:
+    void chunkFinished(const Response &response);
+
+private:
+    static const int chunkSize;
+
+    AbstractClient *client;
+    int replayId;
+    quint32 offset;
+    QFile file;
+    GameReplay *replay;
+    bool ownsReplay;
+    // data of the replay that doesn't form a complete field yet
+    QByteArray parseBuffer;
+
+    void requestChunk();
+    void fail();
+    bool processData(const QByteArray &data);
+    bool parseData(const QByteArray &data);
+
+public:
+    ReplayDownload(AbstractClient *_client, int _replayId, QObject *parent = nullptr);
+    ~ReplayDownload();
+    bool saveToFile(const QString &filePath);
+    void parseReplay();
+    // passes the ownership of the parsed replay to the caller, its events keep being added while downloading
+    GameReplay *takeReplay();
+    void start();
+};
+
+#endif
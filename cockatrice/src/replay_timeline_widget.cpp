@@ -8,7 +8,8 @@
 #endif /* _WIN32 */
 
 ReplayTimelineWidget::ReplayTimelineWidget(QWidget *parent)
-    : QWidget(parent), maxBinValue(1), maxTime(1), timeScaleFactor(1.0), currentTime(0), currentEvent(0)
+    : QWidget(parent), maxBinValue(1), maxTime(1), timeScaleFactor(1.0), currentTime(0), currentEvent(0),
+      timelineComplete(true)
 {
     replayTimer = new QTimer(this);
     connect(replayTimer, SIGNAL(timeout()), this, SLOT(replayTimerTimeout()));
@@ -43,6 +44,15 @@ void ReplayTimelineWidget::setTimeline(const QList<int> &_replayTimeline)
     update();
 }
 
+void ReplayTimelineWidget::setTimelineComplete(bool _timelineComplete)
+{
+    timelineComplete = _timelineComplete;
+    if (timelineComplete && replayTimer->isActive() && (currentEvent == replayTimeline.size())) {
+        emit replayFinished();
+        replayTimer->stop();
+    }
+}
+
 void ReplayTimelineWidget::paintEvent(QPaintEvent * /* event */)
 {
     QPainter painter(this);
@@ -57,6 +67,9 @@ void ReplayTimelineWidget::paintEvent(QPaintEvent * /* event */)
     path.lineTo(0, height() - 1);
     painter.fillPath(path, Qt::black);
 
+    // all events of a replay may have happened within its first second
+    if (maxTime <= 0)
+        return;
     const QColor barColor = QColor::fromHsv(120, 255, 255, 100);
     quint64 w = (quint64)(width() - 1) * (quint64)currentTime / maxTime;
     painter.fillRect(0, 0, w, height() - 1, barColor);
@@ -74,12 +87,16 @@ QSize ReplayTimelineWidget::minimumSizeHint() const
 
 void ReplayTimelineWidget::replayTimerTimeout()
 {
+    // playback waits at the end of what has been downloaded so far
+    if ((currentEvent == replayTimeline.size()) && !timelineComplete)
+        return;
+
     currentTime += 200;
     while ((currentEvent < replayTimeline.size()) && (replayTimeline[currentEvent] < currentTime)) {
         emit processNextEvent();
         ++currentEvent;
     }
-    if (currentEvent == replayTimeline.size()) {
+    if ((currentEvent == replayTimeline.size()) && timelineComplete) {
         emit replayFinished();
         replayTimer->stop();
     }
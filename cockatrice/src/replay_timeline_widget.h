@@ -23,12 +23,15 @@ private:
     qreal timeScaleFactor;
     int currentTime;
     int currentEvent;
+    // false while the events of the replay are still being downloaded
+    bool timelineComplete;
 private slots:
     void replayTimerTimeout();
 
 public:
     ReplayTimelineWidget(QWidget *parent = 0);
     void setTimeline(const QList<int> &_replayTimeline);
+    void setTimelineComplete(bool _timelineComplete);
     QSize sizeHint() const;
     QSize minimumSizeHint() const;
     void setTimeScaleFactor(qreal _timeScaleFactor);
@@ -31,6 +31,7 @@
 #include "pictureloader.h"
 #include "player.h"
 #include "playerlistwidget.h"
+#include "replay_download.h"
 #include "replay_timeline_widget.h"
 #include "settingscache.h"
 #include "tab_game.h"
@@ -336,24 +337,7 @@ TabGame::TabGame(TabSupervisor *_tabSupervisor, GameReplay *_replay)
     gameInfo.CopyFrom(replay->game_info());
     gameInfo.set_spectators_omniscient(true);
 
-    // Create list: event number -> time [ms]
-    // Distribute simultaneous events evenly across 1 second.
-    unsigned int lastEventTimestamp = 0;
-    const int eventCount = replay->event_list_size();
-    for (int i = 0; i < eventCount; ++i) {
-        int j = i + 1;
-        while ((j < eventCount) && (replay->event_list(j).seconds_elapsed() == lastEventTimestamp))
-            ++j;
-
-        const int numberEventsThisSecond = j - i;
-        for (int k = 0; k < numberEventsThisSecond; ++k)
-            replayTimeline.append(replay->event_list(i + k).seconds_elapsed() * 1000 +
-                                  (int)((qreal)k / (qreal)numberEventsThisSecond * 1000));
-
-        if (j < eventCount)
-            lastEventTimestamp = replay->event_list(j).seconds_elapsed();
-        i += numberEventsThisSecond - 1;
-    }
+    updateReplayTimeline();
 
     createCardInfoDock(true);
     createPlayerListDock(true);
@@ -383,6 +367,49 @@ TabGame::TabGame(TabSupervisor *_tabSupervisor, GameReplay *_replay)
     QTimer::singleShot(0, this, SLOT(loadLayout()));
 }
 
+void TabGame::updateReplayTimeline()
+{
+    // Create list: event number -> time [ms]
+    // Distribute simultaneous events evenly across 1 second.
+    replayTimeline.clear();
+    unsigned int lastEventTimestamp = 0;
+    const int eventCount = replay->event_list_size();
+    for (int i = 0; i < eventCount; ++i) {
+        int j = i + 1;
+        while ((j < eventCount) && (replay->event_list(j).seconds_elapsed() == lastEventTimestamp))
+            ++j;
+
+        const int numberEventsThisSecond = j - i;
+        for (int k = 0; k < numberEventsThisSecond; ++k)
+            replayTimeline.append(replay->event_list(i + k).seconds_elapsed() * 1000 +
+                                  (int)((qreal)k / (qreal)numberEventsThisSecond * 1000));
+
+        if (j < eventCount)
+            lastEventTimestamp = replay->event_list(j).seconds_elapsed();
+        i += numberEventsThisSecond - 1;
+    }
+}
+
+void TabGame::setReplayDownload(ReplayDownload *download)
+{
+    download->setParent(this);
+    connect(download, SIGNAL(eventsAdded()), this, SLOT(replayEventsAdded()));
+    connect(download, SIGNAL(finished()), this, SLOT(replayDownloadFinished()));
+    connect(download, SIGNAL(failed()), this, SLOT(replayDownloadFinished()));
+    timelineWidget->setTimelineComplete(false);
+}
+
+void TabGame::replayEventsAdded()
+{
+    updateReplayTimeline();
+    timelineWidget->setTimeline(replayTimeline);
+}
+
+void TabGame::replayDownloadFinished()
+{
+    timelineWidget->setTimelineComplete(true);
+}
+
 TabGame::TabGame(TabSupervisor *_tabSupervisor,
                  QList<AbstractClient *> &_clients,
                  const Event_GameJoined &event,
@@ -27,6 +27,7 @@ class ZoneViewWidget;
 class PhasesToolbar;
 class PlayerListWidget;
 class ReplayTimelineWidget;
+class ReplayDownload;
 class Response;
 class GameEventContainer;
 class GameEventContext;
@@ -202,6 +203,7 @@ private:
     void createPlayAreaWidget(bool bReplay = false);
     void createDeckViewContainerWidget(bool bReplay = false);
     void createReplayDock();
+    void updateReplayTimeline();
     QString getLeaveReason(Event_Leave::LeaveReason reason);
 signals:
     void gameClosing(TabGame *tab);
@@ -218,6 +220,8 @@ private slots:
     void replayStartButtonClicked();
     void replayPauseButtonClicked();
     void replayFastForwardButtonToggled(bool checked);
+    void replayEventsAdded();
+    void replayDownloadFinished();
 
     void incrementGameTime();
     void adminLockChanged(bool lock);
@@ -258,6 +262,8 @@ public:
             const QMap<int, QString> &_roomGameTypes);
     TabGame(TabSupervisor *_tabSupervisor, GameReplay *replay);
     ~TabGame();
+    // keeps the timeline up to date with the events of a replay that is still being downloaded
+    void setReplayDownload(ReplayDownload *download);
     void retranslateUi();
     void updatePlayerListDockTitle();
     void closeRequest();
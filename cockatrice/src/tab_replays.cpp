@@ -1,6 +1,7 @@
 #include "tab_replays.h"
 #include "abstractclient.h"
 #include "remotereplaylist_treewidget.h"
+#include "replay_download.h"
 #include "settingscache.h"
 #include "tab_game.h"
 #include <QAction>
@@ -16,12 +17,10 @@
 #include <QVBoxLayout>
 
 #include "pb/command_replay_delete_match.pb.h"
-#include "pb/command_replay_download.pb.h"
 #include "pb/command_replay_modify_match.pb.h"
 #include "pb/event_replay_added.pb.h"
 #include "pb/game_replay.pb.h"
 #include "pb/response.pb.h"
-#include "pb/response_replay_download.pb.h"
 #include "pending_command.h"
 
 TabReplays::TabReplays(TabSupervisor *_tabSupervisor, AbstractClient *_client) : Tab(_tabSupervisor), client(_client)
@@ -159,25 +158,18 @@ void TabReplays::actOpenRemoteReplay()
     if (!curRight)
         return;
 
-    Command_ReplayDownload cmd;
-    cmd.set_replay_id(curRight->replay_id());
-
-    PendingCommand *pend = client->prepareSessionCommand(cmd);
-    connect(pend, SIGNAL(finished(Response, CommandContainer, QVariant)), this,
-            SLOT(openRemoteReplayFinished(const Response &)));
-    client->sendCommand(pend);
+    // the replay tab is opened as soon as the beginning of the replay has arrived
+    ReplayDownload *download = new ReplayDownload(client, curRight->replay_id(), this);
+    download->parseReplay();
+    connect(download, SIGNAL(replayStarted()), this, SLOT(remoteReplayStarted()));
+    connect(download, SIGNAL(finished()), download, SLOT(deleteLater()));
+    connect(download, SIGNAL(failed()), download, SLOT(deleteLater()));
+    download->start();
 }
 
-void TabReplays::openRemoteReplayFinished(const Response &r)
+void TabReplays::remoteReplayStarted()
 {
-    if (r.response_code() != Response::RespOk)
-        return;
-
-    const Response_ReplayDownload &resp = r.GetExtension(Response_ReplayDownload::ext);
-    GameReplay *replay = new GameReplay;
-    replay->ParseFromString(resp.replay_data());
-
-    emit openReplay(replay);
+    emit openReplayDownload(static_cast<ReplayDownload *>(sender()));
 }
 
 void TabReplays::actDownload()
@@ -202,31 +194,14 @@ void TabReplays::actDownload()
 
     filePath += QString("/replay_%1.cor").arg(curRight->replay_id());
 
-    Command_ReplayDownload cmd;
-    cmd.set_replay_id(curRight->replay_id());
-
-    PendingCommand *pend = client->prepareSessionCommand(cmd);
-    pend->setExtraData(filePath);
-    connect(pend, SIGNAL(finished(Response, CommandContainer, QVariant)), this,
-            SLOT(downloadFinished(Response, CommandContainer, QVariant)));
-    client->sendCommand(pend);
-}
-
-void TabReplays::downloadFinished(const Response &r,
-                                  const CommandContainer & /* commandContainer */,
-                                  const QVariant &extraData)
-{
-    if (r.response_code() != Response::RespOk)
+    ReplayDownload *download = new ReplayDownload(client, curRight->replay_id(), this);
+    if (!download->saveToFile(filePath)) {
+        delete download;
         return;
-
-    const Response_ReplayDownload &resp = r.GetExtension(Response_ReplayDownload::ext);
-    QString filePath = extraData.toString();
-
-    const std::string &data = resp.replay_data();
-    QFile f(filePath);
-    f.open(QIODevice::WriteOnly);
-    f.write((const char *)data.data(), data.size());
-    f.close();
+    }
+    connect(download, SIGNAL(finished()), download, SLOT(deleteLater()));
+    connect(download, SIGNAL(failed()), download, SLOT(deleteLater()));
+    download->start();
 }
 
 void TabReplays::actKeepRemoteReplay()
@@ -11,6 +11,7 @@ class QToolBar;
 class QGroupBox;
 class RemoteReplayList_TreeWidget;
 class GameReplay;
+class ReplayDownload;
 class Event_ReplayAdded;
 class CommandContainer;
 
@@ -32,10 +33,9 @@ private slots:
     void actDeleteLocalReplay();
 
     void actOpenRemoteReplay();
-    void openRemoteReplayFinished(const Response &r);
+    void remoteReplayStarted();
 
     void actDownload();
-    void downloadFinished(const Response &r, const CommandContainer &commandContainer, const QVariant &extraData);
 
     void actKeepRemoteReplay();
     void keepRemoteReplayFinished(const Response &r, const CommandContainer &commandContainer);
@@ -46,6 +46,7 @@ private slots:
     void replayAddedEventReceived(const Event_ReplayAdded &event);
 signals:
     void openReplay(GameReplay *replay);
+    void openReplayDownload(ReplayDownload *download);
 
 public:
     TabReplays(TabSupervisor *_tabSupervisor, AbstractClient *_client);
@@ -8,7 +8,9 @@
 #include "pb/event_join_room.pb.h"
 #include "pb/event_leave_room.pb.h"
 #include "pb/event_list_games.pb.h"
+#include "pb/event_room_chat_history.pb.h"
 #include "pb/event_room_say.pb.h"
+#include "pb/response_list_room_contents.pb.h"
 #include "pb/room_commands.pb.h"
 #include "pb/serverinfo_room.pb.h"
 #include "pending_command.h"
@@ -34,7 +36,7 @@ TabRoom::TabRoom(TabSupervisor *_tabSupervisor,
                  ServerInfo_User *_ownUser,
                  const ServerInfo_Room &info)
     : Tab(_tabSupervisor), client(_client), roomId(info.room_id()), roomName(QString::fromStdString(info.name())),
-      ownUser(_ownUser)
+      ownUser(_ownUser), lastListedGame(-1)
 {
     const int gameTypeListSize = info.gametype_list_size();
     for (int i = 0; i < gameTypeListSize; ++i)
@@ -109,10 +111,14 @@ TabRoom::TabRoom(TabSupervisor *_tabSupervisor,
         autocompleteUserList.append("@" + QString::fromStdString(info.user_list(i).name()));
     }
     userList->sortItems();
+    if (userListSize > 0)
+        lastListedUser = QString::fromStdString(info.user_list(userListSize - 1).name());
 
     const int gameListSize = info.game_list_size();
     for (int i = 0; i < gameListSize; ++i)
         gameSelector->processGameInfo(info.game_list(i));
+    if (gameListSize > 0)
+        lastListedGame = info.game_list(gameListSize - 1).game_id();
 
     completer = new QCompleter(autocompleteUserList, sayEdit);
     completer->setCaseSensitivity(Qt::CaseInsensitive);
@@ -207,6 +213,51 @@ void TabRoom::sayFinished(const Response &response)
         chatView->appendMessage(tr("You are flooding the chat. Please wait a couple of seconds."));
 }
 
+void TabRoom::requestRoomContents(bool users, bool games)
+{
+    Command_ListRoomContents cmd;
+    cmd.set_list_users(users);
+    cmd.set_users_after(lastListedUser.toStdString());
+    cmd.set_list_games(games);
+    cmd.set_games_after(lastListedGame);
+    cmd.set_page_size(contentsPageSize);
+
+    PendingCommand *pend = prepareRoomCommand(cmd);
+    connect(pend, SIGNAL(finished(Response, CommandContainer, QVariant)), this,
+            SLOT(listRoomContentsFinished(const Response &)));
+    sendRoomCommand(pend);
+}
+
+void TabRoom::listRoomContentsFinished(const Response &response)
+{
+    if (response.response_code() != Response::RespOk)
+        return;
+    const Response_ListRoomContents &resp = response.GetExtension(Response_ListRoomContents::ext);
+
+    // users and games that joined since the previous page are already known from the room events
+    const int userListSize = resp.user_list_size();
+    for (int i = 0; i < userListSize; ++i) {
+        userList->processUserInfo(resp.user_list(i), true);
+        const QString mention = "@" + QString::fromStdString(resp.user_list(i).name());
+        if (!autocompleteUserList.contains(mention))
+            autocompleteUserList.append(mention);
+    }
+    if (userListSize > 0) {
+        userList->sortItems();
+        sayEdit->setCompletionList(autocompleteUserList);
+        lastListedUser = QString::fromStdString(resp.user_list(userListSize - 1).name());
+    }
+
+    const int gameListSize = resp.game_list_size();
+    for (int i = 0; i < gameListSize; ++i)
+        gameSelector->processGameInfo(resp.game_list(i));
+    if (gameListSize > 0)
+        lastListedGame = resp.game_list(gameListSize - 1).game_id();
+
+    if (resp.more_users() || resp.more_games())
+        requestRoomContents(resp.more_users(), resp.more_games());
+}
+
 void TabRoom::actLeaveRoom()
 {
     sendRoomCommand(prepareRoomCommand(Command_LeaveRoom()));
@@ -245,6 +296,9 @@ void TabRoom::processRoomEvent(const RoomEvent &event)
         case RoomEvent::ROOM_SAY:
             processRoomSayEvent(event.GetExtension(Event_RoomSay::ext));
             break;
+        case RoomEvent::ROOM_CHAT_HISTORY:
+            processRoomChatHistoryEvent(event.GetExtension(Event_RoomChatHistory::ext));
+            break;
         default:;
     }
 }
@@ -304,6 +358,13 @@ void TabRoom::processRoomSayEvent(const Event_RoomSay &event)
     emit userEvent(false);
 }
 
+void TabRoom::processRoomChatHistoryEvent(const Event_RoomChatHistory &event)
+{
+    const int messageCount = event.messages_size();
+    for (int i = 0; i < messageCount; ++i)
+        processRoomSayEvent(event.messages(i));
+}
+
 void TabRoom::refreshShortcuts()
 {
     aClearChat->setShortcuts(settingsCache->shortcuts().getShortcut("tab_room/aClearChat"));
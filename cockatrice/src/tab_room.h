@@ -31,6 +31,7 @@ class Event_ListGames;
 class Event_JoinRoom;
 class Event_LeaveRoom;
 class Event_RoomSay;
+class Event_RoomChatHistory;
 class GameSelector;
 class Response;
 class PendingCommand;
@@ -62,6 +63,10 @@ private:
 
     QStringList autocompleteUserList;
     QCompleter *completer;
+
+    // the last user and game of the room contents received so far, when joined with a page size
+    QString lastListedUser;
+    int lastListedGame;
 signals:
     void roomClosing(TabRoom *tab);
     void openMessageDialog(const QString &userName, bool focus);
@@ -70,6 +75,7 @@ signals:
 private slots:
     void sendMessage();
     void sayFinished(const Response &response);
+    void listRoomContentsFinished(const Response &response);
     void actLeaveRoom();
     void actClearChat();
     void actOpenChatSettings();
@@ -82,9 +88,13 @@ private slots:
     void processJoinRoomEvent(const Event_JoinRoom &event);
     void processLeaveRoomEvent(const Event_LeaveRoom &event);
     void processRoomSayEvent(const Event_RoomSay &event);
+    void processRoomChatHistoryEvent(const Event_RoomChatHistory &event);
     void refreshShortcuts();
 
 public:
+    // users and games requested per page when joining a room
+    static const int contentsPageSize = 200;
+
     TabRoom(TabSupervisor *_tabSupervisor,
             AbstractClient *_client,
             ServerInfo_User *_ownUser,
@@ -94,6 +104,7 @@ public:
     void closeRequest();
     void tabActivated();
     void processRoomEvent(const RoomEvent &event);
+    void requestRoomContents(bool users, bool games);
     int getRoomId() const
     {
         return roomId;
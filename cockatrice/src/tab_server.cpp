@@ -1,5 +1,6 @@
 #include "tab_server.h"
 #include "abstractclient.h"
+#include "tab_room.h"
 #include "tab_supervisor.h"
 #include "userlist.h"
 #include <QCheckBox>
@@ -183,6 +184,8 @@ void TabServer::joinRoom(int id, bool setCurrent)
     if (!room) {
         Command_JoinRoom cmd;
         cmd.set_room_id(id);
+        cmd.set_batched_chat_history(true);
+        cmd.set_list_page_size(TabRoom::contentsPageSize);
 
         PendingCommand *pend = client->prepareSessionCommand(cmd);
         pend->setExtraData(setCurrent);
@@ -223,5 +226,5 @@ void TabServer::joinRoomFinished(const Response &r,
     }
 
     const Response_JoinRoom &resp = r.GetExtension(Response_JoinRoom::ext);
-    emit roomJoined(resp.room_info(), extraData.toBool());
+    emit roomJoined(resp, extraData.toBool());
 }
@@ -15,6 +15,7 @@ class QPushButton;
 class Event_ListRooms;
 class Event_ServerMessage;
 class Response;
+class Response_JoinRoom;
 class ServerInfo_Room;
 class CommandContainer;
 
@@ -41,7 +42,7 @@ class TabServer : public Tab
 {
     Q_OBJECT
 signals:
-    void roomJoined(const ServerInfo_Room &info, bool setCurrent);
+    void roomJoined(const Response_JoinRoom &resp, bool setCurrent);
 private slots:
     void processServerMessageEvent(const Event_ServerMessage &event);
     void joinRoom(int id, bool setCurrent);
@@ -1,6 +1,7 @@
 #include "tab_supervisor.h"
 #include "abstractclient.h"
 #include "pixmapgenerator.h"
+#include "replay_download.h"
 #include "settingscache.h"
 #include "tab_admin.h"
 #include "tab_deck_editor.h"
@@ -23,6 +24,7 @@
 #include "pb/event_user_message.pb.h"
 #include "pb/game_event_container.pb.h"
 #include "pb/moderator_commands.pb.h"
+#include "pb/response_join_room.pb.h"
 #include "pb/room_commands.pb.h"
 #include "pb/room_event.pb.h"
 #include "pb/serverinfo_room.pb.h"
@@ -93,7 +95,7 @@ void CloseButton::paintEvent(QPaintEvent * /*event*/)
 
 TabSupervisor::TabSupervisor(AbstractClient *_client, QWidget *parent)
     : QTabWidget(parent), userInfo(0), client(_client), tabServer(0), tabUserLists(0), tabDeckStorage(0), tabReplays(0),
-      tabAdmin(0), tabLog(0)
+      tabAdmin(0), tabLog(0), userListSnapshot(new UserListSnapshot)
 {
     setElideMode(Qt::ElideRight);
     setMovable(true);
@@ -124,6 +126,7 @@ TabSupervisor::TabSupervisor(AbstractClient *_client, QWidget *parent)
 TabSupervisor::~TabSupervisor()
 {
     stop();
+    delete userListSnapshot;
 }
 
 void TabSupervisor::retranslateUi()
@@ -212,8 +215,8 @@ void TabSupervisor::start(const ServerInfo_User &_userInfo)
     userInfo = new ServerInfo_User(_userInfo);
 
     tabServer = new TabServer(this, client);
-    connect(tabServer, SIGNAL(roomJoined(const ServerInfo_Room &, bool)), this,
-            SLOT(addRoomTab(const ServerInfo_Room &, bool)));
+    connect(tabServer, SIGNAL(roomJoined(const Response_JoinRoom &, bool)), this,
+            SLOT(addRoomTab(const Response_JoinRoom &, bool)));
     myAddTab(tabServer);
 
     tabUserLists = new TabUserLists(this, client, *userInfo);
@@ -233,6 +236,8 @@ void TabSupervisor::start(const ServerInfo_User &_userInfo)
 
         tabReplays = new TabReplays(this, client);
         connect(tabReplays, SIGNAL(openReplay(GameReplay *)), this, SLOT(openReplay(GameReplay *)));
+        connect(tabReplays, SIGNAL(openReplayDownload(ReplayDownload *)), this,
+                SLOT(openReplayDownload(ReplayDownload *)));
         myAddTab(tabReplays);
     } else {
         tabDeckStorage = 0;
@@ -398,9 +403,12 @@ void TabSupervisor::gameLeft(TabGame *tab)
         stop();
 }
 
-void TabSupervisor::addRoomTab(const ServerInfo_Room &info, bool setCurrent)
+void TabSupervisor::addRoomTab(const Response_JoinRoom &resp, bool setCurrent)
 {
+    const ServerInfo_Room &info = resp.room_info();
     TabRoom *tab = new TabRoom(this, client, userInfo, info);
+    if (resp.more_users() || resp.more_games())
+        tab->requestRoomContents(resp.more_users(), resp.more_games());
     connect(tab, SIGNAL(maximizeClient()), this, SLOT(maximizeMainWindow()));
     connect(tab, SIGNAL(roomClosing(TabRoom *)), this, SLOT(roomLeft(TabRoom *)));
     connect(tab, SIGNAL(openMessageDialog(const QString &, bool)), this, SLOT(addMessageTab(const QString &, bool)));
@@ -422,7 +430,18 @@ void TabSupervisor::roomLeft(TabRoom *tab)
 
 void TabSupervisor::openReplay(GameReplay *replay)
 {
-    TabGame *replayTab = new TabGame(this, replay);
+    addReplayTab(new TabGame(this, replay));
+}
+
+void TabSupervisor::openReplayDownload(ReplayDownload *download)
+{
+    TabGame *replayTab = new TabGame(this, download->takeReplay());
+    replayTab->setReplayDownload(download);
+    addReplayTab(replayTab);
+}
+
+void TabSupervisor::addReplayTab(TabGame *replayTab)
+{
     connect(replayTab, SIGNAL(gameClosing(TabGame *)), this, SLOT(replayLeft(TabGame *)));
     int tabIndex = myAddTab(replayTab);
     addCloseButtonToTab(replayTab, tabIndex);
@@ -27,10 +27,13 @@ class GameEventContainer;
 class Event_GameJoined;
 class Event_UserMessage;
 class Event_NotifyUser;
+class Response_JoinRoom;
 class ServerInfo_Room;
 class ServerInfo_User;
 class GameReplay;
+class ReplayDownload;
 class DeckList;
+struct UserListSnapshot;
 
 class MacOSTabFixStyle : public QProxyStyle
 {
@@ -74,7 +77,9 @@ private:
     QList<TabGame *> replayTabs;
     QMap<QString, TabMessage *> messageTabs;
     QList<TabDeckEditor *> deckEditorTabs;
+    UserListSnapshot *userListSnapshot;
     int myAddTab(Tab *tab);
+    void addReplayTab(TabGame *replayTab);
     void addCloseButtonToTab(Tab *tab, int tabIndex);
     QString sanitizeTabName(QString dirty) const;
     QString sanitizeHtml(QString dirty) const;
@@ -103,6 +108,10 @@ public:
     {
         return userInfo;
     }
+    UserListSnapshot *getUserListSnapshot() const
+    {
+        return userListSnapshot;
+    }
     AbstractClient *getClient() const;
     const QMap<int, TabRoom *> &getRoomTabs() const
     {
@@ -123,6 +132,7 @@ signals:
 public slots:
     TabDeckEditor *addDeckEditorTab(const DeckLoader *deckToOpen);
     void openReplay(GameReplay *replay);
+    void openReplayDownload(ReplayDownload *download);
     void maximizeMainWindow();
 private slots:
     void closeButtonPressed();
@@ -131,7 +141,7 @@ private slots:
     void gameJoined(const Event_GameJoined &event);
     void localGameJoined(const Event_GameJoined &event);
     void gameLeft(TabGame *tab);
-    void addRoomTab(const ServerInfo_Room &info, bool setCurrent);
+    void addRoomTab(const Response_JoinRoom &resp, bool setCurrent);
     void roomLeft(TabRoom *tab);
     TabMessage *addMessageTab(const QString &userName, bool focus);
     void replayLeft(TabGame *tab);
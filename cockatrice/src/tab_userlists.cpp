@@ -1,6 +1,7 @@
 #include "tab_userlists.h"
 #include "abstractclient.h"
 #include "soundengine.h"
+#include "tab_supervisor.h"
 #include "userinfobox.h"
 #include "userlist.h"
 #include <QHBoxLayout>
@@ -20,7 +21,7 @@ TabUserLists::TabUserLists(TabSupervisor *_tabSupervisor,
                            AbstractClient *_client,
                            const ServerInfo_User &userInfo,
                            QWidget *parent)
-    : Tab(_tabSupervisor, parent), client(_client)
+    : Tab(_tabSupervisor, parent), client(_client), userListSnapshot(_tabSupervisor->getUserListSnapshot())
 {
     allUsersList = new UserList(_tabSupervisor, client, UserList::AllUsersList);
     buddyList = new UserList(_tabSupervisor, client, UserList::BuddyList);
@@ -48,7 +49,12 @@ TabUserLists::TabUserLists(TabSupervisor *_tabSupervisor,
     connect(client, SIGNAL(removeFromListEventReceived(const Event_RemoveFromList &)), this,
             SLOT(processRemoveFromListEvent(const Event_RemoveFromList &)));
 
-    PendingCommand *pend = client->prepareSessionCommand(Command_ListUsers());
+    Command_ListUsers cmd;
+    if (userListSnapshot->directoryId) {
+        cmd.set_directory_id(userListSnapshot->directoryId);
+        cmd.set_since_version(userListSnapshot->version);
+    }
+    PendingCommand *pend = client->prepareSessionCommand(cmd);
     connect(pend, SIGNAL(finished(Response, CommandContainer, QVariant)), this,
             SLOT(processListUsersResponse(const Response &)));
     client->sendCommand(pend);
@@ -138,11 +144,18 @@ void TabUserLists::processListUsersResponse(const Response &response)
 {
     const Response_ListUsers &resp = response.GetExtension(Response_ListUsers::ext);
 
-    const int userListSize = resp.user_list_size();
-    for (int i = 0; i < userListSize; ++i) {
-        const ServerInfo_User &info = resp.user_list(i);
-        const QString userName = QString::fromStdString(info.name());
-        allUsersList->processUserInfo(info, true);
+    // servers without a user directory send neither an id nor deltas, so the snapshot is never reused with them
+    if (!resp.delta())
+        userListSnapshot->users.clear();
+    for (int i = 0; i < resp.removed_users_size(); ++i)
+        userListSnapshot->users.remove(QString::fromStdString(resp.removed_users(i)));
+    for (int i = 0; i < resp.user_list_size(); ++i)
+        userListSnapshot->users.insert(QString::fromStdString(resp.user_list(i).name()), resp.user_list(i));
+    userListSnapshot->directoryId = resp.directory_id();
+    userListSnapshot->version = resp.version();
+
+    allUsersList->processUserInfos(userListSnapshot->users.values(), true);
+    for (const QString &userName : userListSnapshot->users.keys()) {
         ignoreList->setUserOnline(userName, true);
         buddyList->setUserOnline(userName, true);
     }
@@ -157,6 +170,9 @@ void TabUserLists::processUserJoinedEvent(const Event_UserJoined &event)
     const ServerInfo_User &info = event.user_info();
     const QString userName = QString::fromStdString(info.name());
 
+    userListSnapshot->users.insert(userName, info);
+    updateSnapshotVersion(event.has_directory_version(), event.directory_version());
+
     allUsersList->processUserInfo(info, true);
     ignoreList->setUserOnline(userName, true);
     buddyList->setUserOnline(userName, true);
@@ -175,6 +191,9 @@ void TabUserLists::processUserLeftEvent(const Event_UserLeft &event)
 {
     QString userName = QString::fromStdString(event.name());
 
+    userListSnapshot->users.remove(userName);
+    updateSnapshotVersion(event.has_directory_version(), event.directory_version());
+
     if (buddyList->getUsers().keys().contains(userName))
         soundEngine->playSound("buddy_leave");
 
@@ -188,17 +207,23 @@ void TabUserLists::processUserLeftEvent(const Event_UserLeft &event)
     }
 }
 
+void TabUserLists::updateSnapshotVersion(bool hasVersion, quint64 version)
+{
+    // a change was missed, the next connection has to start over with the complete list
+    if (!hasVersion || version != userListSnapshot->version + 1)
+        userListSnapshot->directoryId = 0;
+    userListSnapshot->version = version;
+}
+
 void TabUserLists::buddyListReceived(const QList<ServerInfo_User> &_buddyList)
 {
-    for (int i = 0; i < _buddyList.size(); ++i)
-        buddyList->processUserInfo(_buddyList[i], false);
+    buddyList->processUserInfos(_buddyList, false);
     buddyList->sortItems();
 }
 
 void TabUserLists::ignoreListReceived(const QList<ServerInfo_User> &_ignoreList)
 {
-    for (int i = 0; i < _ignoreList.size(); ++i)
-        ignoreList->processUserInfo(_ignoreList[i], false);
+    ignoreList->processUserInfos(_ignoreList, false);
     ignoreList->sortItems();
 }
 
@@ -4,6 +4,7 @@
 #include "pb/serverinfo_user.pb.h"
 #include "tab.h"
 #include <QLineEdit>
+#include <QMap>
 
 class AbstractClient;
 class UserList;
@@ -17,6 +18,17 @@ class ServerInfo_User;
 class Event_AddToList;
 class Event_RemoveFromList;
 
+/*
+ * The user list as of a version of the server's user directory. It is kept by the tab supervisor across
+ * connections, so that after a reconnect only the changes since then have to be requested.
+ */
+struct UserListSnapshot
+{
+    quint64 directoryId = 0; // 0 if the list is not known to be in sync with the server
+    quint64 version = 0;
+    QMap<QString, ServerInfo_User> users;
+};
+
 class TabUserLists : public Tab
 {
     Q_OBJECT
@@ -43,7 +55,9 @@ private:
     UserInfoBox *userInfoBox;
     QLineEdit *addBuddyEdit;
     QLineEdit *addIgnoreEdit;
+    UserListSnapshot *userListSnapshot;
     void addToList(const std::string &listName, const QString &userName);
+    void updateSnapshotVersion(bool hasVersion, quint64 version);
 
 public:
     TabUserLists(TabSupervisor *_tabSupervisor,
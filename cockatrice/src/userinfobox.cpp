@@ -1,5 +1,6 @@
 #include "userinfobox.h"
 #include "abstractclient.h"
+#include "avatar_cache.h"
 #include "dlg_edit_avatar.h"
 #include "dlg_edit_password.h"
 #include "dlg_edit_user.h"
@@ -57,6 +58,8 @@ UserInfoBox::UserInfoBox(AbstractClient *_client, bool _editable, QWidget *paren
         connect(&avatarButton, SIGNAL(clicked()), this, SLOT(actAvatar()));
     }
 
+    connect(avatarCache, SIGNAL(avatarReceived(QByteArray)), this, SLOT(avatarReceived(const QByteArray &)));
+
     setWindowTitle(tr("User information"));
     setLayout(mainLayout);
     retranslateUi();
@@ -74,16 +77,27 @@ void UserInfoBox::retranslateUi()
     avatarButton.setText(tr("Change avatar"));
 }
 
+void UserInfoBox::updateAvatar()
+{
+    QPixmap avatarPixmap = avatarCache->getAvatar(shownUser, client);
+    if (avatarPixmap.isNull())
+        avatarPixmap = UserLevelPixmapGenerator::generatePixmap(64, UserLevelFlags(shownUser.user_level()), false,
+                                                                QString::fromStdString(shownUser.privlevel()));
+    avatarLabel.setPixmap(avatarPixmap.scaled(avatarLabel.size(), Qt::KeepAspectRatio, Qt::SmoothTransformation));
+}
+
+void UserInfoBox::avatarReceived(const QByteArray &hash)
+{
+    if (hash.toStdString() == shownUser.avatar_hash())
+        updateAvatar();
+}
+
 void UserInfoBox::updateInfo(const ServerInfo_User &user)
 {
     const UserLevelFlags userLevel(user.user_level());
 
-    QPixmap avatarPixmap;
-    const std::string bmp = user.avatar_bmp();
-    if (!avatarPixmap.loadFromData((const uchar *)bmp.data(), bmp.size()))
-        avatarPixmap =
-            UserLevelPixmapGenerator::generatePixmap(64, userLevel, false, QString::fromStdString(user.privlevel()));
-    avatarLabel.setPixmap(avatarPixmap.scaled(avatarLabel.size(), Qt::KeepAspectRatio, Qt::SmoothTransformation));
+    shownUser.CopyFrom(user);
+    updateAvatar();
 
     nameLabel.setText(QString::fromStdString(user.name()));
     realNameLabel2.setText(QString::fromStdString(user.real_name()));
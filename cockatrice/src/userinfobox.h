@@ -1,11 +1,11 @@
 #ifndef USERINFOBOX_H
 #define USERINFOBOX_H
 
+#include "pb/serverinfo_user.pb.h"
 #include <QLabel>
 #include <QPushButton>
 #include <QWidget>
 
-class ServerInfo_User;
 class AbstractClient;
 class Response;
 
@@ -18,6 +18,10 @@ private:
     QLabel avatarLabel, nameLabel, realNameLabel1, realNameLabel2, countryLabel1, countryLabel2, countryLabel3,
         userLevelLabel1, userLevelLabel2, userLevelLabel3, accountAgeLebel1, accountAgeLabel2;
     QPushButton editButton, passwordButton, avatarButton;
+    // the user whose info is shown, to show their avatar once it has been fetched
+    ServerInfo_User shownUser;
+
+    void updateAvatar();
 
 public:
     UserInfoBox(AbstractClient *_client, bool editable, QWidget *parent = 0, Qt::WindowFlags flags = 0);
@@ -27,6 +31,7 @@ private slots:
     void processEditResponse(const Response &r);
     void processPasswordResponse(const Response &r);
     void processAvatarResponse(const Response &r);
+    void avatarReceived(const QByteArray &hash);
 
     void actEdit();
     void actEditInternal(const Response &r);
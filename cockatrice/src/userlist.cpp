@@ -375,6 +375,31 @@ void UserList::processUserInfo(const ServerInfo_User &user, bool online)
     item->setOnline(online);
 }
 
+void UserList::processUserInfos(const QList<ServerInfo_User> &userList, bool online)
+{
+    // new users are added to the tree in one go, which is a lot faster than one at a time for long lists
+    QList<QTreeWidgetItem *> newItems;
+    for (const ServerInfo_User &user : userList) {
+        const QString userName = QString::fromStdString(user.name());
+        UserListTWI *item = users.value(userName);
+        if (item)
+            item->setUserInfo(user);
+        else {
+            item = new UserListTWI(user);
+            users.insert(userName, item);
+            newItems.append(item);
+            if (online)
+                ++onlineCount;
+        }
+        item->setOnline(online);
+    }
+
+    if (!newItems.isEmpty()) {
+        userTree->addTopLevelItems(newItems);
+        updateCount();
+    }
+}
+
 bool UserList::deleteUser(const QString &userName)
 {
     UserListTWI *twi = users.value(userName);
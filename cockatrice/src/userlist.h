@@ -125,6 +125,7 @@ public:
     UserList(TabSupervisor *_tabSupervisor, AbstractClient *_client, UserListType _type, QWidget *parent = 0);
     void retranslateUi();
     void processUserInfo(const ServerInfo_User &user, bool online);
+    void processUserInfos(const QList<ServerInfo_User> &userList, bool online);
     bool deleteUser(const QString &userName);
     void setUserOnline(const QString &userName, bool online);
     const QMap<QString, UserListTWI *> &getUsers() const
@@ -377,11 +377,14 @@ void MainWindow::loginError(Response::ResponseCode r,
                 this, tr("Error"),
                 tr("Incorrect username or password. Please check your authentication information and try again."));
             break;
-        case Response::RespWouldOverwriteOldSession:
-            QMessageBox::critical(this, tr("Error"),
-                                  tr("There is already an active session using this user name.\nPlease close that "
-                                     "session first and re-login."));
+        case Response::RespWouldOverwriteOldSession: {
+            QString sessionStr = tr("There is already an active session using this user name.\nPlease close that "
+                                    "session first and re-login.");
+            if (!reasonStr.isEmpty())
+                sessionStr.append("\n\n" + reasonStr);
+            QMessageBox::critical(this, tr("Error"), sessionStr);
             break;
+        }
         case Response::RespUserIsBanned: {
             QString bannedStr;
             if (endTime)
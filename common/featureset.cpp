@@ -23,6 +23,7 @@ void FeatureSet::initalizeFeatureList(QMap<QString, bool> &featureList)
     featureList.insert("mod_log_lookup", false);
     featureList.insert("idle_client", false);
     featureList.insert("forgot_password", false);
+    featureList.insert("avatar_hash", false);
     featureList.insert("2.6.1_min_version", false); // This is temp to force users onto a newer client
 }
 
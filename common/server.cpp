@@ -33,11 +33,20 @@
 #include "server_protocolhandler.h"
 #include "server_remoteuserinterface.h"
 #include "server_room.h"
+#include "server_spectatorrelay.h"
+#include "server_timerwheel.h"
 #include <QCoreApplication>
 #include <QDebug>
 #include <QThread>
 
-Server::Server(QObject *parent) : QObject(parent), nextLocalGameId(0), tcpUserCount(0), webSocketUserCount(0)
+Server::Server(QObject *parent)
+    : QObject(parent), clientsLock("clients", Server_LockProfiler::ClientsRank),
+      roomsLock("rooms", Server_LockProfiler::RoomsRank),
+      persistentPlayersLock("persistent_players", Server_LockProfiler::LeafRank), gamesCount(0), gamesClosed(0),
+      nextLocalGameId(0), tcpUserCount(0), webSocketUserCount(0), messageCountLimiter("message_count"),
+      messageSizeLimiter("message_size"), addressMessageCountLimiter("address_message_count"),
+      gameCommandLimiter("game_command_count"), addressGameCommandLimiter("address_game_command_count"),
+      spectatorRelay(nullptr)
 {
     qRegisterMetaType<ServerInfo_Ban>("ServerInfo_Ban");
     qRegisterMetaType<ServerInfo_Game>("ServerInfo_Game");
@@ -47,15 +56,25 @@ Server::Server(QObject *parent) : QObject(parent), nextLocalGameId(0), tcpUserCo
     qRegisterMetaType<Response>("Response");
     qRegisterMetaType<GameEventContainer>("GameEventContainer");
     qRegisterMetaType<IslMessage>("IslMessage");
+    qRegisterMetaType<IslResync>("IslResync");
     qRegisterMetaType<Command_JoinGame>("Command_JoinGame");
 
+    clientsLock.setMetrics(&metrics, Server_Metrics::ClientsLock);
+    roomsLock.setMetrics(&metrics, Server_Metrics::RoomsLock);
+    persistentPlayersLock.setMetrics(&metrics, Server_Metrics::PersistentPlayersLock);
+
     connect(this, SIGNAL(sigSendIslMessage(IslMessage, int)), this, SLOT(doSendIslMessage(IslMessage, int)),
             Qt::QueuedConnection);
 }
 
+Server::~Server()
+{
+    delete spectatorRelay;
+}
+
 void Server::prepareDestroy()
 {
-    roomsLock.lockForWrite();
+    roomsLock.lockForWrite(SERVER_LOCK_SITE);
     QMapIterator<int, Server_Room *> roomIterator(rooms);
     while (roomIterator.hasNext())
         delete roomIterator.next().value();
@@ -63,6 +82,12 @@ void Server::prepareDestroy()
     roomsLock.unlock();
 }
 
+void Server::startSpectatorRelay(bool groupIslSpectators)
+{
+    if (!spectatorRelay)
+        spectatorRelay = new Server_SpectatorRelay(this, groupIslSpectators);
+}
+
 void Server::setDatabaseInterface(Server_DatabaseInterface *_databaseInterface)
 {
     connect(this, SIGNAL(endSession(qint64)), _databaseInterface, SLOT(endSession(qint64)));
@@ -74,6 +99,63 @@ Server_DatabaseInterface *Server::getDatabaseInterface() const
     return databaseInterfaces.value(QThread::currentThread());
 }
 
+// Returns the timer wheel of the calling thread, creating it on first use.
+// The wheel lives in that thread, so it must keep running an event loop; it is deleted when the thread exits.
+Server_TimerWheel *Server::getTimerWheel()
+{
+    if (!timerWheels.hasLocalData())
+        timerWheels.setLocalData(new Server_TimerWheel);
+    return timerWheels.localData();
+}
+
+// Reads the flood protection settings; all limits are disabled until this is called.
+void Server::updateRateLimits()
+{
+    messageCountLimiter.setLimit(getMaxMessageCountPerInterval(), getMessageCountingInterval());
+    messageSizeLimiter.setLimit(getMaxMessageSizePerInterval(), getMessageCountingInterval());
+    addressMessageCountLimiter.setLimit(getMaxMessageCountPerIntervalPerAddress(), getMessageCountingInterval());
+    gameCommandLimiter.setLimit(getMaxCommandCountPerInterval(), getCommandCountingInterval());
+    addressGameCommandLimiter.setLimit(getMaxCommandCountPerIntervalPerAddress(), getCommandCountingInterval());
+
+    // format: "DRAW_CARDS=0,MOVE_CARD=0,..."; commands that are not listed cost 1
+    QHash<int, int> costs;
+    const QStringList costList = getGameCommandCosts().split(",", QString::SkipEmptyParts);
+    for (const QString &costItem : costList) {
+        const QStringList costPair = costItem.split("=");
+        GameCommand::GameCommandType commandType;
+        bool costOk = false;
+        const int cost = costPair.size() == 2 ? costPair[1].trimmed().toInt(&costOk) : 0;
+        if (!costOk || (cost < 0) ||
+            !GameCommand::GameCommandType_Parse(costPair[0].trimmed().toUpper().toStdString(), &commandType)) {
+            qDebug() << "Ignoring invalid game command cost:" << costItem;
+            continue;
+        }
+        costs.insert(commandType, cost);
+    }
+
+    QWriteLocker locker(&gameCommandCostsLock);
+    gameCommandCosts = costs;
+}
+
+int Server::getGameCommandCost(int commandType) const
+{
+    QReadLocker locker(&gameCommandCostsLock);
+    return gameCommandCosts.value(commandType, 1);
+}
+
+// Number of requests each limit has rejected since startup.
+QMap<QString, quint64> Server::getRateLimitStatistics() const
+{
+    QMap<QString, quint64> result;
+    const QList<const Server_RateLimiter *> limiters = QList<const Server_RateLimiter *>()
+                                                       << &messageCountLimiter << &messageSizeLimiter
+                                                       << &addressMessageCountLimiter << &gameCommandLimiter
+                                                       << &addressGameCommandLimiter;
+    for (const Server_RateLimiter *limiter : limiters)
+        result.insert(limiter->getName(), limiter->getRejectedCount());
+    return result;
+}
+
 AuthenticationResult Server::loginUser(Server_ProtocolHandler *session,
                                        QString &name,
                                        const QString &password,
@@ -88,17 +170,24 @@ AuthenticationResult Server::loginUser(Server_ProtocolHandler *session,
 
     Server_DatabaseInterface *databaseInterface = getDatabaseInterface();
 
+    ServerInfo_User data;
     AuthenticationResult authState =
-        databaseInterface->checkUserPassword(session, name, password, clientid, reasonStr, secondsLeft);
+        databaseInterface->authenticateUser(session, name, password, clientid, reasonStr, secondsLeft, data);
     if (authState == NotLoggedIn || authState == UserIsBanned || authState == UsernameInvalid ||
         authState == UserIsInactive)
         return authState;
 
-    ServerInfo_User data = databaseInterface->getUserData(name, true);
     data.set_address(session->getAddress().toStdString());
     name = QString::fromStdString(data.name()); // Compensate for case indifference
 
     if (authState == PasswordRight) {
+        // The session of the user stays with the old process, a second one would cost the user its seat.
+        if (isPreviousProcessPlayer(name)) {
+            qDebug() << "Login denied: still playing on the previous server process:" << name;
+            reasonStr = "Your game is still running on the server that is being restarted. You can log in again once "
+                        "it has ended.";
+            return WouldOverwriteOldSession;
+        }
         if (users.contains(name) || databaseInterface->userSessionExists(name)) {
             if (users.contains(name)) {
                 qDebug("Session already logged in, logging old session out");
@@ -137,66 +226,128 @@ AuthenticationResult Server::loginUser(Server_ProtocolHandler *session,
         data.set_name(name.toStdString());
     }
 
-    QWriteLocker locker(&clientsLock);
+    // the session row is written before taking the clients lock, all other threads would wait for it otherwise
     databaseInterface->lockSessionTables();
-    users.insert(name, session);
-    qDebug() << "Server::loginUser:" << session << "name=" << name;
-
     data.set_session_id(static_cast<google::protobuf::uint64>(
         databaseInterface->startSession(name, session->getAddress(), clientid, session->getConnectionType())));
     databaseInterface->unlockSessionTables();
 
-    usersBySessionId.insert(data.session_id(), session);
-
-    qDebug() << "session id:" << data.session_id();
-    session->setUserInfo(data);
+    Server_WriteLocker locker(&clientsLock, SERVER_LOCK_SITE);
+    qDebug() << "Server::loginUser:" << session << "name=" << name;
+    insertUser(session, data);
 
     Event_UserJoined event;
-    event.mutable_user_info()->CopyFrom(session->copyUserInfo(false));
-    SessionEvent *se = Server_ProtocolHandler::prepareSessionEvent(event);
-    for (auto &client : clients)
-        if (client->getAcceptsUserListChanges())
-            client->sendProtocolItem(*se);
-    delete se;
-
     event.mutable_user_info()->CopyFrom(session->copyUserInfo(true, true, true));
     locker.unlock();
 
-    if (clientid.isEmpty()) {
-        // client id is empty, either out dated client or client has been modified
-        if (getClientIDRequiredEnabled())
-            return ClientIdRequired;
-    } else {
-        // update users database table with client id
-        databaseInterface->updateUsersClientID(name, clientid);
-    }
+    // client id is empty, either out dated client or client has been modified
+    if (clientid.isEmpty() && getClientIDRequiredEnabled())
+        return ClientIdRequired;
 
-    databaseInterface->updateUsersLastLoginData(name, clientVersion);
-    se = Server_ProtocolHandler::prepareSessionEvent(event);
+    // the database interface lives in this thread, so this runs right after the login response has been sent
+    QMetaObject::invokeMethod(databaseInterface, "updateUsersLoginData", Qt::QueuedConnection, Q_ARG(QString, name),
+                              Q_ARG(QString, clientid), Q_ARG(QString, clientVersion));
+    SessionEvent *se = Server_ProtocolHandler::prepareSessionEvent(event);
     sendIsl_SessionEvent(*se);
     delete se;
 
     return authState;
 }
 
+bool Server::restoreUser(Server_ProtocolHandler *session, const ServerInfo_User &userInfo)
+{
+    const QString name = QString::fromStdString(userInfo.name());
+
+    // Nobody saw the user leave the old process, neither the ISL peers nor the clients that have been handed over
+    // before, so nobody is told that it has joined either.
+    Server_WriteLocker locker(&clientsLock, SERVER_LOCK_SITE);
+    if (users.contains(name))
+        return false;
+    qDebug() << "Server::restoreUser:" << session << "name=" << name;
+    insertUser(session, userInfo, false);
+    return true;
+}
+
+// Call this only with clientsLock locked for writing.
+void Server::insertUser(Server_ProtocolHandler *session, const ServerInfo_User &userInfo, bool sendEvent)
+{
+    users.insert(QString::fromStdString(userInfo.name()), session);
+    usersBySessionId.insert(userInfo.session_id(), session);
+
+    qDebug() << "session id:" << userInfo.session_id();
+    session->setUserInfo(userInfo);
+
+    Event_UserJoined event;
+    event.mutable_user_info()->CopyFrom(session->copyUserInfo(false));
+    event.set_directory_version(userDirectory.userJoined(event.user_info()));
+    if (!sendEvent)
+        return;
+    SessionEvent *se = Server_ProtocolHandler::prepareSessionEvent(event);
+    for (auto &client : clients)
+        if (client->getAcceptsUserListChanges())
+            client->sendProtocolItem(*se);
+    delete se;
+}
+
 void Server::addPersistentPlayer(const QString &userName, int roomId, int gameId, int playerId)
 {
-    QWriteLocker locker(&persistentPlayersLock);
+    Server_WriteLocker locker(&persistentPlayersLock, SERVER_LOCK_SITE);
     persistentPlayers.insert(userName, PlayerReference(roomId, gameId, playerId));
 }
 
 void Server::removePersistentPlayer(const QString &userName, int roomId, int gameId, int playerId)
 {
-    QWriteLocker locker(&persistentPlayersLock);
+    Server_WriteLocker locker(&persistentPlayersLock, SERVER_LOCK_SITE);
     persistentPlayers.remove(userName, PlayerReference(roomId, gameId, playerId));
 }
 
 QList<PlayerReference> Server::getPersistentPlayerReferences(const QString &userName) const
 {
-    QReadLocker locker(&persistentPlayersLock);
+    Server_ReadLocker locker(&persistentPlayersLock, SERVER_LOCK_SITE);
     return persistentPlayers.values(userName);
 }
 
+QSet<QString> Server::getPersistentPlayerNames() const
+{
+    Server_ReadLocker locker(&persistentPlayersLock, SERVER_LOCK_SITE);
+    return persistentPlayers.uniqueKeys().toSet();
+}
+
+void Server::setPreviousProcessPlayers(const QSet<QString> &names)
+{
+    QWriteLocker locker(&previousProcessPlayersLock);
+    previousProcessPlayers = names;
+}
+
+bool Server::isPreviousProcessPlayer(const QString &name) const
+{
+    QReadLocker locker(&previousProcessPlayersLock);
+    return previousProcessPlayers.contains(name);
+}
+
+void Server::addGameMember(const QString &userName, int roomId, int gameId, int playerId)
+{
+    QWriteLocker locker(&gameMembersLock);
+    gameMembers[userName].append(PlayerReference(roomId, gameId, playerId));
+}
+
+void Server::removeGameMember(const QString &userName, int roomId, int gameId, int playerId)
+{
+    QWriteLocker locker(&gameMembersLock);
+    QHash<QString, QList<PlayerReference>>::iterator member = gameMembers.find(userName);
+    if (member == gameMembers.end())
+        return;
+    member.value().removeOne(PlayerReference(roomId, gameId, playerId));
+    if (member.value().isEmpty())
+        gameMembers.erase(member);
+}
+
+QList<PlayerReference> Server::getGameMemberReferences(const QString &userName) const
+{
+    QReadLocker locker(&gameMembersLock);
+    return gameMembers.value(userName);
+}
+
 Server_AbstractUserInterface *Server::findUser(const QString &userName) const
 {
     // Call this only with clientsLock set.
@@ -216,8 +367,16 @@ void Server::addClient(Server_ProtocolHandler *client)
     if (client->getConnectionType() == "websocket")
         webSocketUserCount++;
 
-    QWriteLocker locker(&clientsLock);
+    // This is called from the thread the client lives in, so its timers end up on that thread's wheel.
+    client->startTimers();
+
+    // The address is remembered, a disconnected socket may not report it anymore when the client is removed.
+    const QString address = client->getAddress();
+
+    Server_WriteLocker locker(&clientsLock, SERVER_LOCK_SITE);
     clients << client;
+    clientsByAddress[address].append(client);
+    clientAddresses.insert(client, address);
 }
 
 void Server::removeClient(Server_ProtocolHandler *client)
@@ -229,12 +388,25 @@ void Server::removeClient(Server_ProtocolHandler *client)
     if (client->getConnectionType() == "websocket")
         webSocketUserCount--;
 
-    QWriteLocker locker(&clientsLock);
+    Server_WriteLocker locker(&clientsLock, SERVER_LOCK_SITE);
     clients.removeAt(clients.indexOf(client));
+    const QString address = clientAddresses.take(client);
+    QHash<QString, QList<Server_ProtocolHandler *>>::iterator addressClients = clientsByAddress.find(address);
+    if (addressClients != clientsByAddress.end()) {
+        addressClients.value().removeOne(client);
+        if (addressClients.value().isEmpty())
+            clientsByAddress.erase(addressClients);
+    }
     ServerInfo_User *data = client->getUserInfo();
-    if (data) {
+    if (data && client->isHandedOver()) {
+        // the session goes on in the process the client has been handed over to, it is still online
+        users.remove(QString::fromStdString(data->name()));
+        usersBySessionId.remove(data->session_id());
+        qDebug() << "Server::removeClient: handed over name=" << QString::fromStdString(data->name());
+    } else if (data) {
         Event_UserLeft event;
         event.set_name(data->name());
+        event.set_directory_version(userDirectory.userLeft(QString::fromStdString(data->name())));
         SessionEvent *se = Server_ProtocolHandler::prepareSessionEvent(event);
         for (auto &client : clients)
             if (client->getAcceptsUserListChanges())
@@ -256,6 +428,18 @@ void Server::removeClient(Server_ProtocolHandler *client)
              << users.size() << "users left";
 }
 
+int Server::getClientCountWithAddress(const QString &address) const
+{
+    Server_ReadLocker locker(&clientsLock, SERVER_LOCK_SITE);
+    return clientsByAddress.value(address).size();
+}
+
+QList<Server_ProtocolHandler *> Server::getClientsWithAddress(const QString &address) const
+{
+    Server_ReadLocker locker(&clientsLock, SERVER_LOCK_SITE);
+    return clientsByAddress.value(address);
+}
+
 QList<QString> Server::getOnlineModeratorList() const
 {
     // clients list should be locked by calling function prior to iteration otherwise sigfaults may occur
@@ -274,14 +458,28 @@ QList<QString> Server::getOnlineModeratorList() const
 void Server::externalUserJoined(const ServerInfo_User &userInfo)
 {
     // This function is always called from the main thread via signal/slot.
-    clientsLock.lockForWrite();
+    const QString userName = QString::fromStdString(userInfo.name());
+    clientsLock.lockForWrite(SERVER_LOCK_SITE);
+
+    Server_AbstractUserInterface *oldUser = externalUsers.value(userName);
+    if (oldUser) {
+        const bool sameSession = oldUser->getUserInfo()->session_id() == userInfo.session_id();
+        clientsLock.unlock();
+        if (sameSession)
+            return;
+
+        // the user has logged in again before the end of the old session was seen
+        externalUserLeft(userName);
+        clientsLock.lockForWrite(SERVER_LOCK_SITE);
+    }
 
     Server_RemoteUserInterface *newUser = new Server_RemoteUserInterface(this, ServerInfo_User_Container(userInfo));
-    externalUsers.insert(QString::fromStdString(userInfo.name()), newUser);
+    externalUsers.insert(userName, newUser);
     externalUsersBySessionId.insert(userInfo.session_id(), newUser);
 
     Event_UserJoined event;
     event.mutable_user_info()->CopyFrom(userInfo);
+    event.set_directory_version(userDirectory.userJoined(userInfo));
 
     SessionEvent *se = Server_ProtocolHandler::prepareSessionEvent(event);
     for (auto &client : clients)
@@ -299,26 +497,31 @@ void Server::externalUserLeft(const QString &userName)
 {
     // This function is always called from the main thread via signal/slot.
 
-    clientsLock.lockForWrite();
+    clientsLock.lockForWrite(SERVER_LOCK_SITE);
     Server_AbstractUserInterface *user = externalUsers.take(userName);
+    if (!user) {
+        clientsLock.unlock();
+        qDebug() << "externalUserLeft: user" << userName << "not found";
+        return;
+    }
     externalUsersBySessionId.remove(user->getUserInfo()->session_id());
     clientsLock.unlock();
 
     QMap<int, QPair<int, int>> userGames(user->getGames());
     QMapIterator<int, QPair<int, int>> userGamesIterator(userGames);
-    roomsLock.lockForRead();
+    roomsLock.lockForRead(SERVER_LOCK_SITE);
     while (userGamesIterator.hasNext()) {
         userGamesIterator.next();
         Server_Room *room = rooms.value(userGamesIterator.value().first);
         if (!room)
             continue;
 
-        QReadLocker roomGamesLocker(&room->gamesLock);
+        Server_ReadLocker roomGamesLocker(&room->gamesLock, SERVER_LOCK_SITE);
         Server_Game *game = room->getGames().value(userGamesIterator.key());
         if (!game)
             continue;
 
-        QMutexLocker gameLocker(&game->gameMutex);
+        Server_MutexLocker gameLocker(&game->gameMutex, SERVER_LOCK_SITE);
         Server_Player *player = game->getPlayers().value(userGamesIterator.value().second);
         if (!player)
             continue;
@@ -329,11 +532,12 @@ void Server::externalUserLeft(const QString &userName)
 
     delete user;
 
+    clientsLock.lockForWrite(SERVER_LOCK_SITE);
     Event_UserLeft event;
     event.set_name(userName.toStdString());
+    event.set_directory_version(userDirectory.userLeft(userName));
 
     SessionEvent *se = Server_ProtocolHandler::prepareSessionEvent(event);
-    clientsLock.lockForRead();
     for (auto &client : clients)
         if (client->getAcceptsUserListChanges())
             client->sendProtocolItem(*se);
@@ -344,7 +548,7 @@ void Server::externalUserLeft(const QString &userName)
 void Server::externalRoomUserJoined(int roomId, const ServerInfo_User &userInfo)
 {
     // This function is always called from the main thread via signal/slot.
-    QReadLocker locker(&roomsLock);
+    Server_ReadLocker locker(&roomsLock, SERVER_LOCK_SITE);
 
     Server_Room *room = rooms.value(roomId);
     if (!room) {
@@ -357,7 +561,7 @@ void Server::externalRoomUserJoined(int roomId, const ServerInfo_User &userInfo)
 void Server::externalRoomUserLeft(int roomId, const QString &userName)
 {
     // This function is always called from the main thread via signal/slot.
-    QReadLocker locker(&roomsLock);
+    Server_ReadLocker locker(&roomsLock, SERVER_LOCK_SITE);
 
     Server_Room *room = rooms.value(roomId);
     if (!room) {
@@ -370,7 +574,7 @@ void Server::externalRoomUserLeft(int roomId, const QString &userName)
 void Server::externalRoomSay(int roomId, const QString &userName, const QString &message)
 {
     // This function is always called from the main thread via signal/slot.
-    QReadLocker locker(&roomsLock);
+    Server_ReadLocker locker(&roomsLock, SERVER_LOCK_SITE);
 
     Server_Room *room = rooms.value(roomId);
     if (!room) {
@@ -386,7 +590,7 @@ void Server::externalRoomSay(int roomId, const QString &userName, const QString
 void Server::externalRoomGameListChanged(int roomId, const ServerInfo_Game &gameInfo)
 {
     // This function is always called from the main thread via signal/slot.
-    QReadLocker locker(&roomsLock);
+    Server_ReadLocker locker(&roomsLock, SERVER_LOCK_SITE);
 
     Server_Room *room = rooms.value(roomId);
     if (!room) {
@@ -405,8 +609,8 @@ void Server::externalJoinGameCommandReceived(const Command_JoinGame &cmd,
     // This function is always called from the main thread via signal/slot.
 
     try {
-        QReadLocker roomsLocker(&roomsLock);
-        QReadLocker clientsLocker(&clientsLock);
+        Server_ReadLocker roomsLocker(&roomsLock, SERVER_LOCK_SITE);
+        Server_ReadLocker clientsLocker(&clientsLock, SERVER_LOCK_SITE);
 
         Server_Room *room = rooms.value(roomId);
         if (!room) {
@@ -442,21 +646,21 @@ void Server::externalGameCommandContainerReceived(const CommandContainer &cont,
         ResponseContainer responseContainer(static_cast<int>(cont.cmd_id()));
         Response::ResponseCode finalResponseCode = Response::RespOk;
 
-        QReadLocker roomsLocker(&roomsLock);
+        Server_ReadLocker roomsLocker(&roomsLock, SERVER_LOCK_SITE);
         Server_Room *room = rooms.value(cont.room_id());
         if (!room) {
             qDebug() << "externalGameCommandContainerReceived: room id=" << cont.room_id() << "not found";
             throw Response::RespNotInRoom;
         }
 
-        QReadLocker roomGamesLocker(&room->gamesLock);
+        Server_ReadLocker roomGamesLocker(&room->gamesLock, SERVER_LOCK_SITE);
         Server_Game *game = room->getGames().value(cont.game_id());
         if (!game) {
             qDebug() << "externalGameCommandContainerReceived: game id=" << cont.game_id() << "not found";
             throw Response::RespNotInRoom;
         }
 
-        QMutexLocker gameLocker(&game->gameMutex);
+        Server_MutexLocker gameLocker(&game->gameMutex, SERVER_LOCK_SITE);
         Server_Player *player = game->getPlayers().value(playerId);
         if (!player) {
             qDebug() << "externalGameCommandContainerReceived: player id=" << playerId << "not found";
@@ -493,7 +697,7 @@ void Server::externalGameEventContainerReceived(const GameEventContainer &cont,
 {
     // This function is always called from the main thread via signal/slot.
 
-    QReadLocker usersLocker(&clientsLock);
+    Server_ReadLocker usersLocker(&clientsLock, SERVER_LOCK_SITE);
 
     Server_ProtocolHandler *client = usersBySessionId.value(sessionId);
     if (!client) {
@@ -507,7 +711,7 @@ void Server::externalResponseReceived(const Response &resp, qint64 sessionId)
 {
     // This function is always called from the main thread via signal/slot.
 
-    QReadLocker usersLocker(&clientsLock);
+    Server_ReadLocker usersLocker(&clientsLock, SERVER_LOCK_SITE);
 
     Server_ProtocolHandler *client = usersBySessionId.value(sessionId);
     if (!client) {
@@ -526,7 +730,7 @@ void Server::broadcastRoomUpdate(const ServerInfo_Room &roomInfo, bool sendToIsl
 
     SessionEvent *se = Server_ProtocolHandler::prepareSessionEvent(event);
 
-    clientsLock.lockForRead();
+    clientsLock.lockForRead(SERVER_LOCK_SITE);
     for (auto &client : clients)
         if (client->getAcceptsRoomListChanges())
             client->sendProtocolItem(*se);
@@ -540,7 +744,7 @@ void Server::broadcastRoomUpdate(const ServerInfo_Room &roomInfo, bool sendToIsl
 
 void Server::addRoom(Server_Room *newRoom)
 {
-    QWriteLocker locker(&roomsLock);
+    Server_WriteLocker locker(&roomsLock, SERVER_LOCK_SITE);
     qDebug() << "Adding room: ID=" << newRoom->getId() << "name=" << newRoom->getName();
     rooms.insert(newRoom->getId(), newRoom);
     connect(newRoom, SIGNAL(roomInfoChanged(ServerInfo_Room)), this, SLOT(broadcastRoomUpdate(const ServerInfo_Room &)),
@@ -549,23 +753,10 @@ void Server::addRoom(Server_Room *newRoom)
 
 int Server::getUsersCount() const
 {
-    QReadLocker locker(&clientsLock);
+    Server_ReadLocker locker(&clientsLock, SERVER_LOCK_SITE);
     return users.size();
 }
 
-int Server::getGamesCount() const
-{
-    int result = 0;
-    QReadLocker locker(&roomsLock);
-    QMapIterator<int, Server_Room *> roomIterator(rooms);
-    while (roomIterator.hasNext()) {
-        Server_Room *room = roomIterator.next().value();
-        QReadLocker roomLocker(&room->gamesLock);
-        result += room->getGames().size();
-    }
-    return result;
-}
-
 void Server::sendIsl_Response(const Response &item, int serverId, qint64 sessionId)
 {
     IslMessage msg;
@@ -599,6 +790,18 @@ void Server::sendIsl_GameEventContainer(const GameEventContainer &item, int serv
     emit sigSendIslMessage(msg, serverId);
 }
 
+void Server::sendIsl_GameEventContainer(const GameEventContainer &item, int serverId, const QList<qint64> &sessionIds)
+{
+    // a single message for all the sessions, the other server hands it out to them
+    IslMessage msg;
+    msg.set_message_type(IslMessage::GAME_EVENT_CONTAINER);
+    for (qint64 sessionId : sessionIds)
+        msg.add_session_ids(static_cast<google::protobuf::uint64>(sessionId));
+    msg.mutable_game_event_container()->CopyFrom(item);
+
+    emit sigSendIslMessage(msg, serverId);
+}
+
 void Server::sendIsl_RoomEvent(const RoomEvent &item, int serverId, qint64 sessionId)
 {
     IslMessage msg;
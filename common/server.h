@@ -6,19 +6,31 @@
 #include "pb/serverinfo_chat_message.pb.h"
 #include "pb/serverinfo_user.pb.h"
 #include "pb/serverinfo_warning.pb.h"
+#include "server_avatarcache.h"
+#include "server_lock.h"
+#include "server_metrics.h"
 #include "server_player_reference.h"
+#include "server_ratelimiter.h"
+#include "server_trafficrecorder.h"
+#include "server_userdirectory.h"
+#include <QAtomicInt>
+#include <QHash>
 #include <QMap>
 #include <QMultiMap>
 #include <QMutex>
 #include <QObject>
 #include <QReadWriteLock>
+#include <QSet>
 #include <QStringList>
+#include <QThreadStorage>
 
 class Server_DatabaseInterface;
 class Server_Game;
 class Server_Room;
 class Server_ProtocolHandler;
 class Server_AbstractUserInterface;
+class Server_TimerWheel;
+class Server_SpectatorRelay;
 class GameReplay;
 class IslMessage;
 class SessionEvent;
@@ -48,16 +60,15 @@ class Server : public QObject
 {
     Q_OBJECT
 signals:
-    void pingClockTimeout();
     void sigSendIslMessage(const IslMessage &message, int serverId);
     void endSession(qint64 sessionId);
 private slots:
     void broadcastRoomUpdate(const ServerInfo_Room &roomInfo, bool sendToIsl = false);
 
 public:
-    mutable QReadWriteLock clientsLock, roomsLock; // locking order: roomsLock before clientsLock
+    mutable Server_ReadWriteLock clientsLock, roomsLock; // locking order: roomsLock before clientsLock
     Server(QObject *parent = nullptr);
-    ~Server() = default;
+    ~Server();
     AuthenticationResult loginUser(Server_ProtocolHandler *session,
                                    QString &name,
                                    const QString &password,
@@ -66,6 +77,9 @@ public:
                                    QString &clientid,
                                    QString &clientVersion,
                                    QString &connectionType);
+    // Adds a user whose session has been started by another server process, see
+    // Server_ProtocolHandler::restoreSession().
+    bool restoreUser(Server_ProtocolHandler *session, const ServerInfo_User &userInfo);
 
     const QMap<int, Server_Room *> &getRooms()
     {
@@ -87,6 +101,8 @@ public:
     }
     void addClient(Server_ProtocolHandler *player);
     void removeClient(Server_ProtocolHandler *player);
+    int getClientCountWithAddress(const QString &address) const;
+    QList<Server_ProtocolHandler *> getClientsWithAddress(const QString &address) const;
     QList<QString> getOnlineModeratorList() const;
     virtual QString getLoginMessage() const
     {
@@ -164,6 +180,23 @@ public:
     {
         return 0;
     }
+    virtual int getMaxMessageCountPerIntervalPerAddress() const
+    {
+        return 0;
+    }
+    virtual int getMaxCommandCountPerIntervalPerAddress() const
+    {
+        return 0;
+    }
+    virtual QString getGameCommandCosts() const
+    {
+        return QString();
+    }
+    // seconds the events of a game are held back from its spectators, only with the spectator relay
+    virtual int getSpectatorDelay() const
+    {
+        return 0;
+    }
     virtual int getMaxUserTotal() const
     {
         return 9999999;
@@ -174,6 +207,53 @@ public:
     }
 
     Server_DatabaseInterface *getDatabaseInterface() const;
+    Server_TimerWheel *getTimerWheel();
+
+    void updateRateLimits();
+    int getGameCommandCost(int commandType) const;
+    QMap<QString, quint64> getRateLimitStatistics() const;
+    Server_Metrics &getMetrics()
+    {
+        return metrics;
+    }
+    Server_TrafficRecorder &getTrafficRecorder()
+    {
+        return trafficRecorder;
+    }
+    Server_AvatarCache &getAvatarCache()
+    {
+        return avatarCache;
+    }
+    // null unless the spectators of the games are served by the relay thread
+    Server_SpectatorRelay *getSpectatorRelay() const
+    {
+        return spectatorRelay;
+    }
+    // guarded by clientsLock
+    Server_UserDirectory &getUserDirectory()
+    {
+        return userDirectory;
+    }
+    Server_RateLimiter &getMessageCountLimiter()
+    {
+        return messageCountLimiter;
+    }
+    Server_RateLimiter &getMessageSizeLimiter()
+    {
+        return messageSizeLimiter;
+    }
+    Server_RateLimiter &getAddressMessageCountLimiter()
+    {
+        return addressMessageCountLimiter;
+    }
+    Server_RateLimiter &getGameCommandLimiter()
+    {
+        return gameCommandLimiter;
+    }
+    Server_RateLimiter &getAddressGameCommandLimiter()
+    {
+        return addressGameCommandLimiter;
+    }
     int getNextLocalGameId()
     {
         QMutexLocker locker(&nextLocalGameIdMutex);
@@ -183,6 +263,7 @@ public:
     void sendIsl_Response(const Response &item, int serverId = -1, qint64 sessionId = -1);
     void sendIsl_SessionEvent(const SessionEvent &item, int serverId = -1, qint64 sessionId = -1);
     void sendIsl_GameEventContainer(const GameEventContainer &item, int serverId = -1, qint64 sessionId = -1);
+    void sendIsl_GameEventContainer(const GameEventContainer &item, int serverId, const QList<qint64> &sessionIds);
     void sendIsl_RoomEvent(const RoomEvent &item, int serverId = -1, qint64 sessionId = -1);
     void sendIsl_GameCommand(const CommandContainer &item, int serverId, qint64 sessionId, int roomId, int playerId);
     void sendIsl_RoomCommand(const CommandContainer &item, int serverId, qint64 sessionId, int roomId);
@@ -195,8 +276,37 @@ public:
     void addPersistentPlayer(const QString &userName, int roomId, int gameId, int playerId);
     void removePersistentPlayer(const QString &userName, int roomId, int gameId, int playerId);
     QList<PlayerReference> getPersistentPlayerReferences(const QString &userName) const;
+    QSet<QString> getPersistentPlayerNames() const;
+    // Users with a seat in a game of the server process this one replaces. They can't log in here until their games
+    // have ended, they would lose their seats otherwise.
+    void setPreviousProcessPlayers(const QSet<QString> &names);
+    bool isPreviousProcessPlayer(const QString &name) const;
+    void addGameMember(const QString &userName, int roomId, int gameId, int playerId);
+    void removeGameMember(const QString &userName, int roomId, int gameId, int playerId);
+    QList<PlayerReference> getGameMemberReferences(const QString &userName) const;
     int getUsersCount() const;
-    int getGamesCount() const;
+    int getGamesCount() const
+    {
+        return gamesCount.load();
+    }
+    void incGamesCount()
+    {
+        gamesCount.ref();
+    }
+    void decGamesCount()
+    {
+        gamesCount.deref();
+    }
+    // While the clients are handed over to another server process, no games are created or joined here, so that
+    // the clients in games can follow as soon as possible.
+    bool getGamesClosed() const
+    {
+        return gamesClosed.load() != 0;
+    }
+    void closeGames()
+    {
+        gamesClosed.store(1);
+    }
     int getTCPUserCount() const
     {
         return tcpUserCount;
@@ -208,9 +318,26 @@ public:
 
 private:
     QMultiMap<QString, PlayerReference> persistentPlayers;
-    mutable QReadWriteLock persistentPlayersLock;
+    mutable Server_ReadWriteLock persistentPlayersLock;
+    QHash<QString, QList<PlayerReference>> gameMembers; // players and spectators of all local games
+    mutable QReadWriteLock gameMembersLock;
+    QSet<QString> previousProcessPlayers;
+    mutable QReadWriteLock previousProcessPlayersLock;
+    QAtomicInt gamesCount, gamesClosed;
     int nextLocalGameId, tcpUserCount, webSocketUserCount;
     QMutex nextLocalGameIdMutex;
+    QThreadStorage<Server_TimerWheel *> timerWheels;
+    Server_RateLimiter messageCountLimiter, messageSizeLimiter, addressMessageCountLimiter;
+    Server_RateLimiter gameCommandLimiter, addressGameCommandLimiter;
+    QHash<int, int> gameCommandCosts;
+    mutable QReadWriteLock gameCommandCostsLock;
+    Server_Metrics metrics;
+    Server_TrafficRecorder trafficRecorder;
+    Server_UserDirectory userDirectory;
+    Server_AvatarCache avatarCache;
+    Server_SpectatorRelay *spectatorRelay;
+
+    void insertUser(Server_ProtocolHandler *session, const ServerInfo_User &userInfo, bool sendEvent = true);
 
 protected slots:
     void externalUserJoined(const ServerInfo_User &userInfo);
@@ -232,8 +359,11 @@ protected slots:
 
 protected:
     void prepareDestroy();
+    void startSpectatorRelay(bool groupIslSpectators);
     void setDatabaseInterface(Server_DatabaseInterface *_databaseInterface);
     QList<Server_ProtocolHandler *> clients;
+    QHash<QString, QList<Server_ProtocolHandler *>> clientsByAddress;
+    QHash<Server_ProtocolHandler *, QString> clientAddresses;
     QMap<qint64, Server_ProtocolHandler *> usersBySessionId;
     QMap<QString, Server_ProtocolHandler *> users;
     QMap<qint64, Server_AbstractUserInterface *> externalUsersBySessionId;
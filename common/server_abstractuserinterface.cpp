@@ -87,19 +87,19 @@ void Server_AbstractUserInterface::joinPersistentGames(ResponseContainer &rc)
     QList<PlayerReference> gamesToJoin =
         server->getPersistentPlayerReferences(QString::fromStdString(userInfo->name()));
 
-    server->roomsLock.lockForRead();
+    server->roomsLock.lockForRead(SERVER_LOCK_SITE);
     for (int i = 0; i < gamesToJoin.size(); ++i) {
         const PlayerReference &pr = gamesToJoin.at(i);
 
         Server_Room *room = server->getRooms().value(pr.getRoomId());
         if (!room)
             continue;
-        QReadLocker roomGamesLocker(&room->gamesLock);
+        Server_ReadLocker roomGamesLocker(&room->gamesLock, SERVER_LOCK_SITE);
 
         Server_Game *game = room->getGames().value(pr.getGameId());
         if (!game)
             continue;
-        QMutexLocker gameLocker(&game->gameMutex);
+        Server_MutexLocker gameLocker(&game->gameMutex, SERVER_LOCK_SITE);
 
         Server_Player *player = game->getPlayers().value(pr.getPlayerId());
         if (!player)
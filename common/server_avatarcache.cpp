@@ -0,0 +1,49 @@
+#include "server_avatarcache.h"
+#include <QCryptographicHash>
+#include <QMutexLocker>
+
+Server_AvatarCache::Server_AvatarCache(int maxSizeBytes) : avatars(maxSizeBytes)
+{
+}
+
+QByteArray Server_AvatarCache::hashAvatar(const QByteArray &avatarBmp)
+{
+    if (avatarBmp.isEmpty())
+        return QByteArray();
+    return QCryptographicHash::hash(avatarBmp, QCryptographicHash::Sha1);
+}
+
+QByteArray Server_AvatarCache::hashAvatar(const std::string &avatarBmp)
+{
+    return hashAvatar(QByteArray::fromRawData(avatarBmp.data(), static_cast<int>(avatarBmp.size())));
+}
+
+void Server_AvatarCache::setMaxSize(int maxSizeBytes)
+{
+    QMutexLocker locker(&mutex);
+    avatars.setMaxCost(maxSizeBytes);
+}
+
+QByteArray Server_AvatarCache::find(const QByteArray &hash)
+{
+    QMutexLocker locker(&mutex);
+    // object() marks the avatar as recently used
+    QByteArray *avatarBmp = avatars.object(hash);
+    return avatarBmp ? *avatarBmp : QByteArray();
+}
+
+void Server_AvatarCache::insert(const QByteArray &hash, const QByteArray &avatarBmp)
+{
+    if (hash.isEmpty() || avatarBmp.isEmpty())
+        return;
+
+    QMutexLocker locker(&mutex);
+    // avatars bigger than the whole cache are not inserted (and deleted right away by QCache)
+    avatars.insert(hash, new QByteArray(avatarBmp), avatarBmp.size());
+}
+
+int Server_AvatarCache::getSize() const
+{
+    QMutexLocker locker(&mutex);
+    return avatars.totalCost();
+}
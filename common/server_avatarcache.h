@@ -0,0 +1,34 @@
+#ifndef SERVER_AVATARCACHE_H
+#define SERVER_AVATARCACHE_H
+
+#include <QByteArray>
+#include <QCache>
+#include <QMutex>
+#include <string>
+
+/*
+ * Small in-memory cache of avatar images by their hash, used to answer Command_GetAvatar without asking the database
+ * again when the avatar of a popular user is requested by many clients, e.g. by everyone who joins their game.
+ *
+ * The least recently used avatars are dropped once the images take up more than the maximum size.
+ */
+class Server_AvatarCache
+{
+private:
+    mutable QMutex mutex;
+    QCache<QByteArray, QByteArray> avatars;
+
+public:
+    explicit Server_AvatarCache(int maxSizeBytes = 16 * 1024 * 1024);
+
+    static QByteArray hashAvatar(const QByteArray &avatarBmp);
+    static QByteArray hashAvatar(const std::string &avatarBmp);
+
+    void setMaxSize(int maxSizeBytes);
+    // returns a null byte array if the avatar is not cached
+    QByteArray find(const QByteArray &hash);
+    void insert(const QByteArray &hash, const QByteArray &avatarBmp);
+    int getSize() const;
+};
+
+#endif
@@ -18,6 +18,22 @@ public:
                                                    const QString &clientId,
                                                    QString &reasonStr,
                                                    int &secondsLeft) = 0;
+    // Checks the password and fetches the data of the user to log in; userData is only set if the login may go
+    // on. Implementations that can get both with the same query should override this.
+    virtual AuthenticationResult authenticateUser(Server_ProtocolHandler *handler,
+                                                  const QString &user,
+                                                  const QString &password,
+                                                  const QString &clientId,
+                                                  QString &reasonStr,
+                                                  int &secondsLeft,
+                                                  ServerInfo_User &userData)
+    {
+        const AuthenticationResult result =
+            checkUserPassword(handler, user, password, clientId, reasonStr, secondsLeft);
+        if (result == PasswordRight || result == UnknownUser)
+            userData = getUserData(user, true);
+        return result;
+    }
     virtual bool checkUserIsBanned(const QString & /* ipAddress */,
                                    const QString & /* userName */,
                                    const QString & /* clientId */,
@@ -82,6 +98,13 @@ public slots:
     virtual void endSession(qint64 /* sessionId */)
     {
     }
+    // Queued by Server::loginUser, so that the bookkeeping doesn't hold up the login response.
+    void updateUsersLoginData(const QString &userName, const QString &clientId, const QString &clientVersion)
+    {
+        if (!clientId.isEmpty())
+            updateUsersClientID(userName, clientId);
+        updateUsersLastLoginData(userName, clientVersion);
+    }
 
 public:
     virtual int getNextGameId() = 0;
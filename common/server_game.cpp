@@ -43,8 +43,8 @@
 #include "server_player.h"
 #include "server_protocolhandler.h"
 #include "server_room.h"
+#include "server_spectatorrelay.h"
 #include <QDebug>
-#include <QTimer>
 #include <google/protobuf/descriptor.h>
 
 Server_Game::Server_Game(const ServerInfo_User &_creatorInfo,
@@ -66,8 +66,11 @@ Server_Game::Server_Game(const ServerInfo_User &_creatorInfo,
       onlyRegistered(_onlyRegistered), spectatorsAllowed(_spectatorsAllowed),
       spectatorsNeedPassword(_spectatorsNeedPassword), spectatorsCanTalk(_spectatorsCanTalk),
       spectatorsSeeEverything(_spectatorsSeeEverything), inactivityCounter(0), startTimeOfThisGame(0),
-      secondsElapsed(0), firstGameStarted(false), startTime(QDateTime::currentDateTime()), gameMutex(QMutex::Recursive)
+      secondsElapsed(0), firstGameStarted(false), startTime(QDateTime::currentDateTime()), timerWheel(nullptr),
+      spectatorRelay(_room->getServer()->getSpectatorRelay()), eventSequence(0), stateVersion(0),
+      spectatorSnapshotVersion(0), gameMutex("game", Server_LockProfiler::GameRank, QMutex::Recursive)
 {
+    gameMutex.setMetrics(&room->getServer()->getMetrics(), Server_Metrics::GameMutex);
     currentReplay = new GameReplay;
     currentReplay->set_replay_id(room->getServer()->getDatabaseInterface()->getNextReplayId());
     description = _description.simplified();
@@ -76,23 +79,35 @@ Server_Game::Server_Game(const ServerInfo_User &_creatorInfo,
 
     getInfo(*currentReplay->mutable_game_info());
 
+    if (spectatorRelay)
+        spectatorRelay->addGame(gameId, room->getServer()->getSpectatorDelay() * 1000);
+
     if (room->getServer()->getGameShouldPing()) {
-        pingClock = new QTimer(this);
-        connect(pingClock, SIGNAL(timeout()), this, SLOT(pingClockTimeout()));
-        pingClock->start(1000);
+        timerWheel = room->getServer()->getTimerWheel();
+        timerWheel->schedule(this, 0, 1);
     }
 }
 
 Server_Game::~Server_Game()
 {
-    room->gamesLock.lockForWrite();
-    gameMutex.lock();
+    // Must happen before taking gameMutex, cancelAll() may wait for a running pingClockTimeout().
+    if (timerWheel)
+        timerWheel->cancelAll(this);
+
+    room->gamesLock.lockForWrite(SERVER_LOCK_SITE);
+    gameMutex.lock(SERVER_LOCK_SITE);
 
     gameClosed = true;
     sendGameEventContainer(prepareGameEvent(Event_GameClosed(), -1));
+    if (spectatorRelay)
+        spectatorRelay->removeGame(gameId);
     QMapIterator<int, Server_Player *> playerIterator(players);
-    while (playerIterator.hasNext())
-        playerIterator.next().value()->prepareDestroy();
+    while (playerIterator.hasNext()) {
+        Server_Player *player = playerIterator.next().value();
+        room->getServer()->removeGameMember(QString::fromStdString(player->getUserInfo()->name()), room->getId(),
+                                            gameId, player->getPlayerId());
+        player->prepareDestroy();
+    }
     players.clear();
 
     room->removeGame(this);
@@ -144,7 +159,7 @@ void Server_Game::storeGameInformation()
 
     SessionEvent *sessionEvent = Server_ProtocolHandler::prepareSessionEvent(replayEvent);
     Server *server = room->getServer();
-    server->clientsLock.lockForRead();
+    server->clientsLock.lockForRead(SERVER_LOCK_SITE);
     while (allUsersIterator.hasNext()) {
         Server_AbstractUserInterface *userHandler = server->findUser(allUsersIterator.next());
         if (userHandler && server->getStoreReplaysEnabled())
@@ -158,9 +173,14 @@ void Server_Game::storeGameInformation()
                                                              allSpectatorsEver, replayList);
 }
 
+void Server_Game::timerWheelTimeout(int /* timerType */)
+{
+    pingClockTimeout();
+}
+
 void Server_Game::pingClockTimeout()
 {
-    QMutexLocker locker(&gameMutex);
+    Server_MutexLocker locker(&gameMutex, SERVER_LOCK_SITE);
     ++secondsElapsed;
 
     GameEventStorage ges;
@@ -200,15 +220,19 @@ void Server_Game::pingClockTimeout()
 
     const int maxTime = room->getServer()->getMaxGameInactivityTime();
     if (allPlayersInactive) {
-        if (((++inactivityCounter >= maxTime) && (maxTime > 0)) || (playerCount < maxPlayers))
+        if (((++inactivityCounter >= maxTime) && (maxTime > 0)) || (playerCount < maxPlayers)) {
             deleteLater();
+            return;
+        }
     } else
         inactivityCounter = 0;
+
+    timerWheel->schedule(this, 0, 1);
 }
 
 int Server_Game::getPlayerCount() const
 {
-    QMutexLocker locker(&gameMutex);
+    Server_MutexLocker locker(&gameMutex, SERVER_LOCK_SITE);
 
     QMapIterator<int, Server_Player *> playerIterator(players);
     int result = 0;
@@ -220,7 +244,7 @@ int Server_Game::getPlayerCount() const
 
 int Server_Game::getSpectatorCount() const
 {
-    QMutexLocker locker(&gameMutex);
+    Server_MutexLocker locker(&gameMutex, SERVER_LOCK_SITE);
 
     QMapIterator<int, Server_Player *> playerIterator(players);
     int result = 0;
@@ -270,9 +294,14 @@ void Server_Game::sendGameStateToPlayers()
         createGameStateChangedEvent(&spectatorEvent, 0, false, false);
 
     // send game state info to clients according to their role in the game
+    ++stateVersion;
+    const quint64 stateEventSequence = ++eventSequence;
     QMapIterator<int, Server_Player *> playerIterator(players);
     while (playerIterator.hasNext()) {
         Server_Player *player = playerIterator.next().value();
+        if (player->getSpectator() && spectatorRelay)
+            continue;
+
         GameEventContainer *gec;
         if (player->getSpectator())
             gec = prepareGameEvent(spectatorEvent, -1);
@@ -282,15 +311,22 @@ void Server_Game::sendGameStateToPlayers()
 
             gec = prepareGameEvent(event, -1);
         }
+        gec->set_event_sequence(stateEventSequence);
         player->sendGameEvent(*gec);
         delete gec;
     }
+    if (spectatorRelay) {
+        GameEventContainer *gec = prepareGameEvent(spectatorEvent, -1);
+        gec->set_event_sequence(stateEventSequence);
+        spectatorRelay->sendGameEvent(gameId, *gec, -1);
+        delete gec;
+    }
 }
 
 void Server_Game::doStartGameIfReady()
 {
     Server_DatabaseInterface *databaseInterface = room->getServer()->getDatabaseInterface();
-    QMutexLocker locker(&gameMutex);
+    Server_MutexLocker locker(&gameMutex, SERVER_LOCK_SITE);
 
     if (getPlayerCount() < maxPlayers)
         return;
@@ -358,7 +394,7 @@ void Server_Game::startGameIfReady()
 
 void Server_Game::stopGameIfFinished()
 {
-    QMutexLocker locker(&gameMutex);
+    Server_MutexLocker locker(&gameMutex, SERVER_LOCK_SITE);
 
     QMapIterator<int, Server_Player *> playerIterator(players);
     int playing = 0;
@@ -425,7 +461,7 @@ Server_Game::checkJoin(ServerInfo_User *user, const QString &_password, bool spe
 
 bool Server_Game::containsUser(const QString &userName) const
 {
-    QMutexLocker locker(&gameMutex);
+    Server_MutexLocker locker(&gameMutex, SERVER_LOCK_SITE);
 
     QMapIterator<int, Server_Player *> playerIterator(players);
     while (playerIterator.hasNext())
@@ -439,7 +475,7 @@ void Server_Game::addPlayer(Server_AbstractUserInterface *userInterface,
                             bool spectator,
                             bool broadcastUpdate)
 {
-    QMutexLocker locker(&gameMutex);
+    Server_MutexLocker locker(&gameMutex, SERVER_LOCK_SITE);
 
     Server_Player *newPlayer = new Server_Player(this, nextPlayerId++, userInterface->copyUserInfo(true, true, true),
                                                  spectator, userInterface);
@@ -447,7 +483,11 @@ void Server_Game::addPlayer(Server_AbstractUserInterface *userInterface,
 
     Event_Join joinEvent;
     newPlayer->getProperties(*joinEvent.mutable_player_properties(), true);
+    // A spectator joining does not change how the other players look, so the snapshots stay valid.
+    const quint64 previousStateVersion = stateVersion;
     sendGameEventContainer(prepareGameEvent(joinEvent, -1));
+    if (spectator)
+        stateVersion = previousStateVersion;
 
     const QString playerName = QString::fromStdString(newPlayer->getUserInfo()->name());
     if (spectator)
@@ -469,6 +509,7 @@ void Server_Game::addPlayer(Server_AbstractUserInterface *userInterface,
         emit gameInfoChanged(gameInfo);
     }
 
+    room->getServer()->addGameMember(playerName, room->getId(), gameId, newPlayer->getPlayerId());
     if ((newPlayer->getUserInfo()->user_level() & ServerInfo_User::IsRegistered) && !spectator)
         room->getServer()->addPersistentPlayer(playerName, room->getId(), gameId, newPlayer->getPlayerId());
 
@@ -479,9 +520,12 @@ void Server_Game::addPlayer(Server_AbstractUserInterface *userInterface,
 
 void Server_Game::removePlayer(Server_Player *player, Event_Leave::LeaveReason reason)
 {
-    room->getServer()->removePersistentPlayer(QString::fromStdString(player->getUserInfo()->name()), room->getId(),
-                                              gameId, player->getPlayerId());
+    const QString playerName = QString::fromStdString(player->getUserInfo()->name());
+    room->getServer()->removeGameMember(playerName, room->getId(), gameId, player->getPlayerId());
+    room->getServer()->removePersistentPlayer(playerName, room->getId(), gameId, player->getPlayerId());
     players.remove(player->getPlayerId());
+    if (spectatorRelay && player->getSpectator())
+        spectatorRelay->removeSpectator(gameId, player->getPlayerId());
 
     GameEventStorage ges;
     removeArrowsRelatedToPlayer(ges, player);
@@ -532,7 +576,7 @@ void Server_Game::removePlayer(Server_Player *player, Event_Leave::LeaveReason r
 
 void Server_Game::removeArrowsRelatedToPlayer(GameEventStorage &ges, Server_Player *player)
 {
-    QMutexLocker locker(&gameMutex);
+    Server_MutexLocker locker(&gameMutex, SERVER_LOCK_SITE);
 
     // Remove all arrows of other players pointing to the player being removed or to one of his cards.
     // Also remove all arrows starting at one of his cards. This is necessary since players can create
@@ -567,7 +611,7 @@ void Server_Game::removeArrowsRelatedToPlayer(GameEventStorage &ges, Server_Play
 
 void Server_Game::unattachCards(GameEventStorage &ges, Server_Player *player)
 {
-    QMutexLocker locker(&gameMutex);
+    Server_MutexLocker locker(&gameMutex, SERVER_LOCK_SITE);
 
     QMapIterator<QString, Server_CardZone *> zoneIterator(player->getZones());
     while (zoneIterator.hasNext()) {
@@ -585,7 +629,7 @@ void Server_Game::unattachCards(GameEventStorage &ges, Server_Player *player)
 
 bool Server_Game::kickPlayer(int playerId)
 {
-    QMutexLocker locker(&gameMutex);
+    Server_MutexLocker locker(&gameMutex, SERVER_LOCK_SITE);
 
     Server_Player *playerToKick = players.value(playerId);
     if (!playerToKick)
@@ -602,7 +646,7 @@ bool Server_Game::kickPlayer(int playerId)
 
 void Server_Game::setActivePlayer(int _activePlayer)
 {
-    QMutexLocker locker(&gameMutex);
+    Server_MutexLocker locker(&gameMutex, SERVER_LOCK_SITE);
 
     activePlayer = _activePlayer;
 
@@ -615,7 +659,7 @@ void Server_Game::setActivePlayer(int _activePlayer)
 
 void Server_Game::setActivePhase(int _activePhase)
 {
-    QMutexLocker locker(&gameMutex);
+    Server_MutexLocker locker(&gameMutex, SERVER_LOCK_SITE);
 
     QMapIterator<int, Server_Player *> playerIterator(players);
     while (playerIterator.hasNext()) {
@@ -641,7 +685,7 @@ void Server_Game::setActivePhase(int _activePhase)
 
 void Server_Game::nextTurn()
 {
-    QMutexLocker locker(&gameMutex);
+    Server_MutexLocker locker(&gameMutex, SERVER_LOCK_SITE);
 
     const QList<int> keys = players.keys();
     int listPos = -1;
@@ -672,7 +716,13 @@ void Server_Game::createGameJoinedEvent(Server_Player *player, ResponseContainer
             newGameType->set_description(allGameTypes[i].toStdString());
         }
     }
-    rc.enqueuePostResponseItem(ServerMessage::SESSION_EVENT, Server_AbstractUserInterface::prepareSessionEvent(event1));
+
+    // Spectators served by the relay get the game state through it as well, so that it is held back as long as the
+    // events and stays in order with them.
+    const bool relayed = spectatorRelay && player->getSpectator();
+    if (!relayed)
+        rc.enqueuePostResponseItem(ServerMessage::SESSION_EVENT,
+                                   Server_AbstractUserInterface::prepareSessionEvent(event1));
 
     Event_GameStateChanged event2;
     event2.set_seconds_elapsed(secondsElapsed);
@@ -680,33 +730,76 @@ void Server_Game::createGameJoinedEvent(Server_Player *player, ResponseContainer
     event2.set_active_player_id(activePlayer);
     event2.set_active_phase(activePhase);
 
+    // All spectators see the same thing, so their view of each player is built once and reused until the game
+    // state changes.
+    const bool omniscient = player->getSpectator() && spectatorsSeeEverything;
+    if (player->getSpectator() && (spectatorSnapshotVersion != stateVersion)) {
+        spectatorSnapshots[0].clear();
+        spectatorSnapshots[1].clear();
+        spectatorSnapshotVersion = stateVersion;
+    }
+
     QMapIterator<int, Server_Player *> playerIterator(players);
-    while (playerIterator.hasNext())
-        playerIterator.next().value()->getInfo(event2.add_player_list(), player,
-                                               player->getSpectator() && spectatorsSeeEverything, true);
+    while (playerIterator.hasNext()) {
+        Server_Player *p = playerIterator.next().value();
+        if (!player->getSpectator()) {
+            p->getInfo(event2.add_player_list(), player, false, true);
+            continue;
+        }
 
-    rc.enqueuePostResponseItem(ServerMessage::GAME_EVENT_CONTAINER, prepareGameEvent(event2, -1));
+        QMap<int, ServerInfo_Player> &snapshot = spectatorSnapshots[omniscient ? 1 : 0];
+        QMap<int, ServerInfo_Player>::const_iterator cachedInfo = snapshot.constFind(p->getPlayerId());
+        if (cachedInfo == snapshot.constEnd()) {
+            ServerInfo_Player info;
+            p->getInfo(&info, player, omniscient, true);
+            cachedInfo = snapshot.insert(p->getPlayerId(), info);
+        }
+        event2.add_player_list()->CopyFrom(cachedInfo.value());
+    }
+
+    GameEventContainer *cont = prepareGameEvent(event2, -1);
+    cont->set_event_sequence(eventSequence);
+    if (relayed) {
+        spectatorRelay->addSpectator(gameId, player);
+        spectatorRelay->sendToSpectator(gameId, player->getPlayerId(), ServerMessage::SESSION_EVENT,
+                                        Server_AbstractUserInterface::prepareSessionEvent(event1));
+        spectatorRelay->sendToSpectator(gameId, player->getPlayerId(), ServerMessage::GAME_EVENT_CONTAINER, cont);
+    } else
+        rc.enqueuePostResponseItem(ServerMessage::GAME_EVENT_CONTAINER, cont);
 }
 
 void Server_Game::sendGameEventContainer(GameEventContainer *cont,
                                          GameEventStorageItem::EventRecipients recipients,
                                          int privatePlayerId)
 {
-    QMutexLocker locker(&gameMutex);
+    Server_MutexLocker locker(&gameMutex, SERVER_LOCK_SITE);
 
+    ++stateVersion;
     cont->set_game_id(gameId);
+    cont->set_event_sequence(++eventSequence);
     QMapIterator<int, Server_Player *> playerIterator(players);
     while (playerIterator.hasNext()) {
         Server_Player *p = playerIterator.next().value();
         const bool playerPrivate =
             (p->getPlayerId() == privatePlayerId) || (p->getSpectator() && spectatorsSeeEverything);
-        if ((recipients.testFlag(GameEventStorageItem::SendToPrivate) && playerPrivate) ||
-            (recipients.testFlag(GameEventStorageItem::SendToOthers) && !playerPrivate))
+        const bool sendToPlayer = (recipients.testFlag(GameEventStorageItem::SendToPrivate) && playerPrivate) ||
+                                  (recipients.testFlag(GameEventStorageItem::SendToOthers) && !playerPrivate);
+        if (spectatorRelay && p->getSpectator()) {
+            // all other spectators get the event from the relay below
+            if (sendToPlayer && (p->getPlayerId() == privatePlayerId))
+                spectatorRelay->sendToSpectator(gameId, privatePlayerId, ServerMessage::GAME_EVENT_CONTAINER,
+                                                new GameEventContainer(*cont));
+        } else if (sendToPlayer)
             p->sendGameEvent(*cont);
     }
+    if (spectatorRelay && (recipients.testFlag(spectatorsSeeEverything ? GameEventStorageItem::SendToPrivate
+                                                                      : GameEventStorageItem::SendToOthers)))
+        spectatorRelay->sendGameEvent(gameId, *cont, privatePlayerId);
+
     if (recipients.testFlag(GameEventStorageItem::SendToPrivate)) {
         cont->set_seconds_elapsed(secondsElapsed - startTimeOfThisGame);
         cont->clear_game_id();
+        cont->clear_event_sequence();
         currentReplay->add_event_list()->CopyFrom(*cont);
     }
 
@@ -731,7 +824,7 @@ Server_Game::prepareGameEvent(const ::google::protobuf::Message &gameEvent, int
 
 void Server_Game::getInfo(ServerInfo_Game &result) const
 {
-    QMutexLocker locker(&gameMutex);
+    Server_MutexLocker locker(&gameMutex, SERVER_LOCK_SITE);
 
     result.set_room_id(room->getId());
     result.set_game_id(gameId);
@@ -23,7 +23,10 @@
 #include "pb/event_leave.pb.h"
 #include "pb/response.pb.h"
 #include "pb/serverinfo_game.pb.h"
+#include "pb/serverinfo_player.pb.h"
+#include "server_lock.h"
 #include "server_response_containers.h"
+#include "server_timerwheel.h"
 #include <QDateTime>
 #include <QMap>
 #include <QMutex>
@@ -31,18 +34,17 @@
 #include <QSet>
 #include <QStringList>
 
-class QTimer;
 class GameEventContainer;
 class GameReplay;
 class Server_Room;
 class Server_Player;
+class Server_SpectatorRelay;
 class ServerInfo_User;
-class ServerInfo_Player;
 class ServerInfo_Game;
 class Server_AbstractUserInterface;
 class Event_GameStateChanged;
 
-class Server_Game : public QObject
+class Server_Game : public QObject, public Server_TimerWheelListener
 {
     Q_OBJECT
 private:
@@ -69,9 +71,14 @@ private:
     int startTimeOfThisGame, secondsElapsed;
     bool firstGameStarted;
     QDateTime startTime;
-    QTimer *pingClock;
+    Server_TimerWheel *timerWheel;
+    // null if the spectators are sent the events directly
+    Server_SpectatorRelay *spectatorRelay;
     QList<GameReplay *> replayList;
     GameReplay *currentReplay;
+    quint64 eventSequence, stateVersion, spectatorSnapshotVersion;
+    // player info as seen by spectators, indexed by whether the spectators are omniscient
+    QMap<int, ServerInfo_Player> spectatorSnapshots[2];
 
     void createGameStateChangedEvent(Event_GameStateChanged *event,
                                      Server_Player *playerWhosAsking,
@@ -79,15 +86,15 @@ private:
                                      bool withUserInfo);
     void sendGameStateToPlayers();
     void storeGameInformation();
+    void pingClockTimeout();
 signals:
     void sigStartGameIfReady();
     void gameInfoChanged(ServerInfo_Game gameInfo);
 private slots:
-    void pingClockTimeout();
     void doStartGameIfReady();
 
 public:
-    mutable QMutex gameMutex;
+    mutable Server_Mutex gameMutex;
     Server_Game(const ServerInfo_User &_creatorInfo,
                 int _gameId,
                 const QString &_description,
@@ -102,6 +109,7 @@ public:
                 bool _spectatorsSeeEverything,
                 Server_Room *parent);
     ~Server_Game();
+    void timerWheelTimeout(int timerType);
     Server_Room *getRoom() const
     {
         return room;
@@ -185,6 +193,14 @@ public:
     {
         return secondsElapsed;
     }
+    quint64 getEventSequence() const
+    {
+        return eventSequence;
+    }
+    void invalidateStateSnapshots()
+    {
+        ++stateVersion;
+    }
 
     void createGameJoinedEvent(Server_Player *player, ResponseContainer &rc, bool resuming);
 
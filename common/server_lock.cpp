@@ -0,0 +1,281 @@
+#include "server_lock.h"
+#include <QDebug>
+#include <QList>
+#include <QStringList>
+#include <algorithm>
+
+// Sites are only ever added, at the front, so the list can be walked without locking.
+static QAtomicPointer<Server_LockSite> firstSite;
+
+namespace
+{
+struct HeldLock
+{
+    const void *lock;
+    const char *name;
+    int rank;
+    Server_LockSite *site;
+    qint64 since; // 0 if profiling was disabled when the lock was taken
+};
+
+// Enough for the ISL code, which holds the games lock of every room at once. Deeper nesting isn't tracked.
+const int maxHeldLocks = 64;
+thread_local HeldLock heldLocks[maxHeldLocks];
+thread_local int heldLockCount = 0;
+} // namespace
+
+static void storeMax(QAtomicInteger<qint64> &max, qint64 value)
+{
+    qint64 current = max.load();
+    while (value > current && !max.testAndSetRelaxed(current, value))
+        current = max.load();
+}
+
+Server_LockSite::Server_LockSite(const char *_file, int _line)
+    : contendedCount(0), orderViolations(0), maxWait(0), maxHold(0), file(_file), line(_line), lockName(nullptr)
+{
+    do
+        next = firstSite.load();
+    while (!firstSite.testAndSetOrdered(next, this));
+}
+
+QString Server_LockSite::getName() const
+{
+    const QString path = QString::fromUtf8(file);
+    const int separator = qMax(path.lastIndexOf('/'), path.lastIndexOf('\\'));
+    return QString("%1:%2").arg(path.mid(separator + 1)).arg(line);
+}
+
+void Server_LockSite::recordAcquisition(const char *_lockName, qint64 waitUsecs, bool contended)
+{
+    lockName.testAndSetRelaxed(nullptr, _lockName);
+    waits.record(waitUsecs);
+    if (contended)
+        contendedCount.fetchAndAddRelaxed(1);
+    storeMax(maxWait, waitUsecs);
+}
+
+void Server_LockSite::recordHold(qint64 usecs)
+{
+    holds.record(usecs);
+    storeMax(maxHold, usecs);
+}
+
+bool Server_LockSite::recordOrderViolation()
+{
+    return orderViolations.fetchAndAddRelaxed(1) == 0;
+}
+
+void Server_LockSite::reset()
+{
+    waits.reset();
+    holds.reset();
+    contendedCount.store(0);
+    orderViolations.store(0);
+    maxWait.store(0);
+    maxHold.store(0);
+}
+
+QAtomicInt Server_LockProfiler::enabled(0);
+QAtomicInteger<qint64> Server_LockProfiler::resetTime(0);
+
+void Server_LockProfiler::setEnabled(bool _enabled)
+{
+    if (enabled.fetchAndStoreOrdered(_enabled ? 1 : 0) != (_enabled ? 1 : 0))
+        reset();
+}
+
+void Server_LockProfiler::reset()
+{
+    for (Server_LockSite *site = firstSite.load(); site; site = site->getNext())
+        site->reset();
+    resetTime.store(Server_Metrics::currentTime());
+}
+
+void Server_LockProfiler::checkOrder(const void *lock, const char *name, int rank, bool recursive,
+                                     Server_LockSite *site)
+{
+    for (int i = 0; i < heldLockCount && i < maxHeldLocks; ++i) {
+        const HeldLock &held = heldLocks[i];
+        QString problem;
+        if (held.lock == lock && !recursive)
+            problem = QString("%1 is not recursive but already held").arg(name);
+        else if (held.rank > rank)
+            problem = QString("%1 is taken while holding %2").arg(name).arg(held.name);
+        else
+            continue;
+
+        if (!site || site->recordOrderViolation())
+            qWarning() << "Lock order violation at" << (site ? site->getName() : QString("unknown site")) << ":"
+                       << problem << "(taken at" << (held.site ? held.site->getName() : QString("unknown site"))
+                       << ")";
+        return;
+    }
+}
+
+void Server_LockProfiler::acquired(const void *lock,
+                                   const char *name,
+                                   int rank,
+                                   Server_LockSite *site,
+                                   qint64 waitUsecs,
+                                   bool contended)
+{
+    const bool profiling = isEnabled();
+    if (!profiling && !checksOrder())
+        return;
+    if (profiling && site)
+        site->recordAcquisition(name, waitUsecs, contended);
+
+    if (heldLockCount < maxHeldLocks)
+        heldLocks[heldLockCount] = {lock, name, rank, site, profiling ? Server_Metrics::currentTime() : 0};
+    ++heldLockCount;
+}
+
+void Server_LockProfiler::released(const void *lock)
+{
+    if (!heldLockCount)
+        return;
+    // Locks are usually released in the reverse order they were taken in.
+    for (int i = qMin(heldLockCount, maxHeldLocks) - 1; i >= 0; --i) {
+        if (heldLocks[i].lock != lock)
+            continue;
+        const HeldLock &held = heldLocks[i];
+        if (held.since && held.site && isEnabled())
+            held.site->recordHold(Server_Metrics::currentTime() - held.since);
+        for (int j = i + 1; j < qMin(heldLockCount, maxHeldLocks); ++j)
+            heldLocks[j - 1] = heldLocks[j];
+        --heldLockCount;
+        return;
+    }
+    // not found: taken beyond maxHeldLocks, or before profiling was enabled
+    if (heldLockCount > maxHeldLocks)
+        --heldLockCount;
+}
+
+static QString formatUsecs(qint64 usecs)
+{
+    if (usecs >= 10000)
+        return QString("%1ms").arg(usecs / 1000);
+    return QString("%1us").arg(usecs);
+}
+
+QString Server_LockProfiler::getReport()
+{
+    QList<Server_LockSite *> sites;
+    quint64 violations = 0;
+    for (Server_LockSite *site = firstSite.load(); site; site = site->getNext()) {
+        violations += site->orderViolations.load();
+        if (site->waits.getCount() || site->orderViolations.load())
+            sites.append(site);
+    }
+    std::sort(sites.begin(), sites.end(), [](const Server_LockSite *a, const Server_LockSite *b) {
+        if (a->maxHold.load() != b->maxHold.load())
+            return a->maxHold.load() > b->maxHold.load();
+        return a->waits.getSum() > b->waits.getSum();
+    });
+
+    QStringList lines;
+    lines.append(QString("Lock profile of the last %1 s, profiling %2, lock order checks %3")
+                     .arg((Server_Metrics::currentTime() - resetTime.load()) / 1000000)
+                     .arg(isEnabled() ? "enabled" : "disabled")
+                     .arg(checksOrder() ? "enabled" : "disabled"));
+    if (checksOrder())
+        lines.append(QString("Lock order violations: %1").arg(violations));
+    lines.append(QString("%1 %2 %3 %4 %5 %6 %7 %8 %9")
+                     .arg("site", -32)
+                     .arg("lock", -10)
+                     .arg("acquired", 10)
+                     .arg("contended", 10)
+                     .arg("wait avg", 9)
+                     .arg("wait max", 9)
+                     .arg("hold avg", 9)
+                     .arg("hold max", 9)
+                     .arg("violations", 10));
+    for (const Server_LockSite *site : sites) {
+        const quint64 acquisitions = site->waits.getCount();
+        const quint64 holds = site->holds.getCount();
+        lines.append(QString("%1 %2 %3 %4 %5 %6 %7 %8 %9")
+                         .arg(site->getName(), -32)
+                         .arg(site->getLockName() ? site->getLockName() : "", -10)
+                         .arg(acquisitions, 10)
+                         .arg(site->contendedCount.load(), 10)
+                         .arg(formatUsecs(acquisitions ? site->waits.getSum() / acquisitions : 0), 9)
+                         .arg(formatUsecs(site->maxWait.load()), 9)
+                         .arg(formatUsecs(holds ? site->holds.getSum() / holds : 0), 9)
+                         .arg(formatUsecs(site->maxHold.load()), 9)
+                         .arg(site->orderViolations.load(), 10));
+    }
+    return lines.join("\n") + "\n";
+}
+
+// Takes the lock with tryLock() first so that the clock is only read if the lock is contended or profiled.
+template <typename TryLock, typename Lock>
+static void acquire(const void *lock,
+                    const char *name,
+                    int rank,
+                    bool recursive,
+                    Server_LockSite *site,
+                    Server_Metrics *metrics,
+                    Server_Metrics::LockType metricsType,
+                    TryLock tryLock,
+                    Lock doLock)
+{
+    if (Server_LockProfiler::checksOrder())
+        Server_LockProfiler::checkOrder(lock, name, rank, recursive, site);
+
+    qint64 waitUsecs = 0;
+    const bool contended = !tryLock();
+    if (contended) {
+        const qint64 startTime = Server_Metrics::currentTime();
+        doLock();
+        waitUsecs = Server_Metrics::currentTime() - startTime;
+    }
+    if (metrics)
+        metrics->recordLockWait(metricsType, waitUsecs);
+    Server_LockProfiler::acquired(lock, name, rank, site, waitUsecs, contended);
+}
+
+Server_ReadWriteLock::Server_ReadWriteLock(const char *_name, int _rank, QReadWriteLock::RecursionMode recursionMode)
+    : lock(recursionMode), name(_name), rank(_rank), recursive(recursionMode == QReadWriteLock::Recursive),
+      metrics(nullptr), metricsType(Server_Metrics::LockTypeCount)
+{
+}
+
+void Server_ReadWriteLock::lockForRead(Server_LockSite *site)
+{
+    acquire(
+        this, name, rank, recursive, site, metrics, metricsType, [this]() { return lock.tryLockForRead(); },
+        [this]() { lock.lockForRead(); });
+}
+
+void Server_ReadWriteLock::lockForWrite(Server_LockSite *site)
+{
+    acquire(
+        this, name, rank, recursive, site, metrics, metricsType, [this]() { return lock.tryLockForWrite(); },
+        [this]() { lock.lockForWrite(); });
+}
+
+void Server_ReadWriteLock::unlock()
+{
+    Server_LockProfiler::released(this);
+    lock.unlock();
+}
+
+Server_Mutex::Server_Mutex(const char *_name, int _rank, QMutex::RecursionMode recursionMode)
+    : mutex(recursionMode), name(_name), rank(_rank), recursive(recursionMode == QMutex::Recursive),
+      metrics(nullptr), metricsType(Server_Metrics::LockTypeCount)
+{
+}
+
+void Server_Mutex::lock(Server_LockSite *site)
+{
+    acquire(
+        this, name, rank, recursive, site, metrics, metricsType, [this]() { return mutex.tryLock(); },
+        [this]() { mutex.lock(); });
+}
+
+void Server_Mutex::unlock()
+{
+    Server_LockProfiler::released(this);
+    mutex.unlock();
+}
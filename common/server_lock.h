@@ -0,0 +1,266 @@
+#ifndef SERVER_LOCK_H
+#define SERVER_LOCK_H
+
+#include "server_metrics.h"
+#include <QAtomicInteger>
+#include <QAtomicPointer>
+#include <QMutex>
+#include <QReadWriteLock>
+#include <QString>
+
+/*
+ * The place in the code a server lock is taken at, with the statistics of the acquisitions made there.
+ * Sites are created on first use by SERVER_LOCK_SITE and never destroyed.
+ */
+class Server_LockSite
+{
+public:
+    Server_LockSite(const char *_file, int _line);
+
+    QString getName() const; // file name without the directory, and line
+    const char *getLockName() const
+    {
+        return lockName.load();
+    }
+    Server_LockSite *getNext() const
+    {
+        return next;
+    }
+
+    void recordAcquisition(const char *_lockName, qint64 waitUsecs, bool contended);
+    void recordHold(qint64 usecs);
+    // Returns true the first time the order is violated at this site.
+    bool recordOrderViolation();
+    void reset();
+
+    Server_MetricsHistogram waits, holds;
+    QAtomicInteger<quint64> contendedCount, orderViolations;
+    QAtomicInteger<qint64> maxWait, maxHold;
+
+private:
+    const char *file;
+    int line;
+    QAtomicPointer<const char> lockName;
+    Server_LockSite *next;
+
+    Q_DISABLE_COPY(Server_LockSite)
+};
+
+#define SERVER_LOCK_SITE                                                                                               \
+    ([]() -> Server_LockSite * {                                                                                       \
+        static Server_LockSite site(__FILE__, __LINE__);                                                               \
+        return &site;                                                                                                  \
+    }())
+
+/*
+ * Process wide switches and reports of the lock profiling.
+ *
+ * While profiling is enabled, every acquisition of a server lock records the time spent waiting and holding it per
+ * site. Builds without QT_NO_DEBUG also check that the locks are taken in the order of their ranks, whether
+ * profiling is enabled or not.
+ */
+class Server_LockProfiler
+{
+public:
+    // Locks of a lower rank have to be taken first. Locks of the same rank may be held together.
+    enum Rank
+    {
+        RoomsRank = 10,
+        GamesRank = 20,
+        GameRank = 30,
+        ClientsRank = 40,
+        LeafRank = 100 // nothing else is taken while holding these
+    };
+
+    static void setEnabled(bool enabled);
+    static bool isEnabled()
+    {
+        return enabled.load();
+    }
+    static bool checksOrder()
+    {
+#ifdef QT_NO_DEBUG
+        return false;
+#else
+        return true;
+#endif
+    }
+
+    // Sites sorted by the longest hold time, then by the total wait time.
+    static QString getReport();
+    static void reset();
+
+    // Used by the lock classes below.
+    static void checkOrder(const void *lock, const char *name, int rank, bool recursive, Server_LockSite *site);
+    static void
+    acquired(const void *lock, const char *name, int rank, Server_LockSite *site, qint64 waitUsecs, bool contended);
+    static void released(const void *lock);
+
+private:
+    static QAtomicInt enabled;
+    static QAtomicInteger<qint64> resetTime;
+};
+
+/*
+ * Drop-in replacement for QReadWriteLock that reports to the lock profiler and, if set, to the lock wait
+ * histograms of the server metrics.
+ */
+class Server_ReadWriteLock
+{
+public:
+    Server_ReadWriteLock(const char *_name,
+                         int _rank,
+                         QReadWriteLock::RecursionMode recursionMode = QReadWriteLock::NonRecursive);
+
+    void setMetrics(Server_Metrics *_metrics, Server_Metrics::LockType _metricsType)
+    {
+        metrics = _metrics;
+        metricsType = _metricsType;
+    }
+    const char *getName() const
+    {
+        return name;
+    }
+
+    void lockForRead(Server_LockSite *site = nullptr);
+    void lockForWrite(Server_LockSite *site = nullptr);
+    void unlock();
+
+private:
+    QReadWriteLock lock;
+    const char *name;
+    int rank;
+    bool recursive;
+    Server_Metrics *metrics;
+    Server_Metrics::LockType metricsType;
+
+    Q_DISABLE_COPY(Server_ReadWriteLock)
+};
+
+// Drop-in replacement for QMutex, see Server_ReadWriteLock.
+class Server_Mutex
+{
+public:
+    Server_Mutex(const char *_name, int _rank, QMutex::RecursionMode recursionMode = QMutex::NonRecursive);
+
+    void setMetrics(Server_Metrics *_metrics, Server_Metrics::LockType _metricsType)
+    {
+        metrics = _metrics;
+        metricsType = _metricsType;
+    }
+    const char *getName() const
+    {
+        return name;
+    }
+
+    void lock(Server_LockSite *site = nullptr);
+    void unlock();
+
+private:
+    QMutex mutex;
+    const char *name;
+    int rank;
+    bool recursive;
+    Server_Metrics *metrics;
+    Server_Metrics::LockType metricsType;
+
+    Q_DISABLE_COPY(Server_Mutex)
+};
+
+class Server_ReadLocker
+{
+public:
+    Server_ReadLocker(Server_ReadWriteLock *_lock, Server_LockSite *_site = nullptr)
+        : lock(_lock), site(_site), locked(false)
+    {
+        relock();
+    }
+    ~Server_ReadLocker()
+    {
+        unlock();
+    }
+    void unlock()
+    {
+        if (locked)
+            lock->unlock();
+        locked = false;
+    }
+    void relock()
+    {
+        if (!locked)
+            lock->lockForRead(site);
+        locked = true;
+    }
+
+private:
+    Server_ReadWriteLock *lock;
+    Server_LockSite *site;
+    bool locked;
+    Q_DISABLE_COPY(Server_ReadLocker)
+};
+
+class Server_WriteLocker
+{
+public:
+    Server_WriteLocker(Server_ReadWriteLock *_lock, Server_LockSite *_site = nullptr)
+        : lock(_lock), site(_site), locked(false)
+    {
+        relock();
+    }
+    ~Server_WriteLocker()
+    {
+        unlock();
+    }
+    void unlock()
+    {
+        if (locked)
+            lock->unlock();
+        locked = false;
+    }
+    void relock()
+    {
+        if (!locked)
+            lock->lockForWrite(site);
+        locked = true;
+    }
+
+private:
+    Server_ReadWriteLock *lock;
+    Server_LockSite *site;
+    bool locked;
+    Q_DISABLE_COPY(Server_WriteLocker)
+};
+
+class Server_MutexLocker
+{
+public:
+    Server_MutexLocker(Server_Mutex *_mutex, Server_LockSite *_site = nullptr)
+        : mutex(_mutex), site(_site), locked(false)
+    {
+        relock();
+    }
+    ~Server_MutexLocker()
+    {
+        unlock();
+    }
+    void unlock()
+    {
+        if (locked)
+            mutex->unlock();
+        locked = false;
+    }
+    void relock()
+    {
+        if (!locked)
+            mutex->lock(site);
+        locked = true;
+    }
+
+private:
+    Server_Mutex *mutex;
+    Server_LockSite *site;
+    bool locked;
+    Q_DISABLE_COPY(Server_MutexLocker)
+};
+
+#endif
@@ -21,6 +21,7 @@ Q_DECLARE_METATYPE(CommandContainer)
 Q_DECLARE_METATYPE(Response)
 Q_DECLARE_METATYPE(GameEventContainer)
 Q_DECLARE_METATYPE(IslMessage)
+Q_DECLARE_METATYPE(IslResync)
 Q_DECLARE_METATYPE(Command_JoinGame)
 
 #endif
@@ -0,0 +1,247 @@
+#include "server_metrics.h"
+#include "pb/admin_commands.pb.h"
+#include "pb/game_commands.pb.h"
+#include "pb/moderator_commands.pb.h"
+#include "pb/room_commands.pb.h"
+#include "pb/session_commands.pb.h"
+#include <QElapsedTimer>
+#include <QStringList>
+#include <google/protobuf/descriptor.h>
+
+const qint64 Server_MetricsHistogram::bucketBounds[bucketCount] = {
+    50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 100000, 250000, 1000000};
+
+Server_MetricsHistogram::Server_MetricsHistogram() : sum(0), count(0)
+{
+    for (int i = 0; i <= bucketCount; ++i)
+        buckets[i].store(0);
+}
+
+void Server_MetricsHistogram::record(qint64 usecs)
+{
+    int bucket = 0;
+    while ((bucket < bucketCount) && (usecs > bucketBounds[bucket]))
+        ++bucket;
+    buckets[bucket].fetchAndAddRelaxed(1);
+    sum.fetchAndAddRelaxed(usecs);
+    count.fetchAndAddRelaxed(1);
+}
+
+void Server_MetricsHistogram::reset()
+{
+    for (int i = 0; i <= bucketCount; ++i)
+        buckets[i].store(0);
+    sum.store(0);
+    count.store(0);
+}
+
+quint64 Server_MetricsHistogram::getCumulativeCount(int bucket) const
+{
+    quint64 result = 0;
+    for (int i = 0; i <= bucket; ++i)
+        result += buckets[i].load();
+    return result;
+}
+
+static const google::protobuf::EnumDescriptor *commandTypeDescriptor(int category)
+{
+    switch (category) {
+        case Server_Metrics::SessionCommands:
+            return SessionCommand::SessionCommandType_descriptor();
+        case Server_Metrics::RoomCommands:
+            return RoomCommand::RoomCommandType_descriptor();
+        case Server_Metrics::GameCommands:
+            return GameCommand::GameCommandType_descriptor();
+        case Server_Metrics::ModeratorCommands:
+            return ModeratorCommand::ModeratorCommandType_descriptor();
+        case Server_Metrics::AdminCommands:
+            return AdminCommand::AdminCommandType_descriptor();
+        default:
+            return nullptr;
+    }
+}
+
+static const char *commandCategoryNames[Server_Metrics::CommandCategoryCount] = {"session", "room", "game",
+                                                                                 "moderator", "admin"};
+static const char *lockNames[Server_Metrics::LockTypeCount] = {"clients", "rooms",   "games",
+                                                               "game",    "history", "persistent_players"};
+
+// Commands with a type that isn't part of the protocol are counted under this type.
+static const int unknownCommandType = 0xffff;
+
+Server_Metrics::Server_Metrics() : txBytes(0), rxBytes(0)
+{
+    for (int category = 0; category < CommandCategoryCount; ++category) {
+        const google::protobuf::EnumDescriptor *descriptor = commandTypeDescriptor(category);
+        for (int i = 0; i < descriptor->value_count(); ++i)
+            commands.insert(category << 16 | descriptor->value(i)->number(), new Server_MetricsHistogram);
+        commands.insert(category << 16 | unknownCommandType, new Server_MetricsHistogram);
+    }
+}
+
+Server_Metrics::~Server_Metrics()
+{
+    qDeleteAll(commands);
+    qDeleteAll(pools);
+}
+
+qint64 Server_Metrics::currentTime()
+{
+    static const QElapsedTimer clock = []() {
+        QElapsedTimer timer;
+        timer.start();
+        return timer;
+    }();
+    return clock.nsecsElapsed() / 1000;
+}
+
+void Server_Metrics::recordCommand(CommandCategory category, int commandType, qint64 usecs)
+{
+    Server_MetricsHistogram *histogram = nullptr;
+    if ((commandType >= 0) && (commandType < unknownCommandType))
+        histogram = commands.value(category << 16 | commandType);
+    if (!histogram)
+        histogram = commands.value(category << 16 | unknownCommandType);
+    histogram->record(usecs);
+}
+
+Server_PoolMetrics *Server_Metrics::getPoolMetrics(int pool)
+{
+    {
+        QReadLocker locker(&poolsLock);
+        Server_PoolMetrics *result = pools.value(pool);
+        if (result)
+            return result;
+    }
+
+    QWriteLocker locker(&poolsLock);
+    Server_PoolMetrics *&result = pools[pool];
+    if (!result)
+        result = new Server_PoolMetrics;
+    return result;
+}
+
+static void appendHistogram(QStringList &lines,
+                            const QString &name,
+                            const QString &labels,
+                            const Server_MetricsHistogram &histogram)
+{
+    const QString separator = labels.isEmpty() ? QString() : QString(",");
+    for (int i = 0; i < Server_MetricsHistogram::bucketCount; ++i)
+        lines.append(QString("%1_bucket{%2%3le=\"%4\"} %5")
+                         .arg(name)
+                         .arg(labels)
+                         .arg(separator)
+                         .arg(Server_MetricsHistogram::bucketBounds[i] / 1000000.0)
+                         .arg(histogram.getCumulativeCount(i)));
+    lines.append(QString("%1_bucket{%2%3le=\"+Inf\"} %4")
+                     .arg(name)
+                     .arg(labels)
+                     .arg(separator)
+                     .arg(histogram.getCount()));
+    const QString braces = labels.isEmpty() ? QString() : QString("{%1}").arg(labels);
+    lines.append(QString("%1_sum%2 %3").arg(name).arg(braces).arg(histogram.getSum() / 1000000.0, 0, 'f', 6));
+    lines.append(QString("%1_count%2 %3").arg(name).arg(braces).arg(histogram.getCount()));
+}
+
+static QString poolLabel(int pool)
+{
+    return pool == -1 ? QString("main") : QString::number(pool);
+}
+
+QString Server_Metrics::toPrometheusText() const
+{
+    QStringList lines;
+
+    lines.append("# HELP servatrice_command_duration_seconds Time spent processing client commands.");
+    lines.append("# TYPE servatrice_command_duration_seconds histogram");
+    for (int category = 0; category < CommandCategoryCount; ++category) {
+        const google::protobuf::EnumDescriptor *descriptor = commandTypeDescriptor(category);
+        QList<int> types;
+        for (int i = 0; i < descriptor->value_count(); ++i)
+            types.append(descriptor->value(i)->number());
+        types.append(unknownCommandType);
+
+        for (int type : types) {
+            const Server_MetricsHistogram *histogram = commands.value(category << 16 | type);
+            if (!histogram->getCount())
+                continue;
+            const google::protobuf::EnumValueDescriptor *value = descriptor->FindValueByNumber(type);
+            const QString typeName = value ? QString::fromStdString(value->name()) : QString("UNKNOWN");
+            appendHistogram(lines, "servatrice_command_duration_seconds",
+                            QString("category=\"%1\",command=\"%2\"").arg(commandCategoryNames[category]).arg(typeName),
+                            *histogram);
+        }
+    }
+
+    lines.append("# HELP servatrice_lock_wait_seconds Time spent waiting for server locks.");
+    lines.append("# TYPE servatrice_lock_wait_seconds histogram");
+    for (int type = 0; type < LockTypeCount; ++type)
+        appendHistogram(lines, "servatrice_lock_wait_seconds", QString("lock=\"%1\"").arg(lockNames[type]),
+                        lockWaits[type]);
+
+    QReadLocker locker(&poolsLock);
+    lines.append("# HELP servatrice_database_query_duration_seconds Time spent executing database queries.");
+    lines.append("# TYPE servatrice_database_query_duration_seconds histogram");
+    for (auto i = pools.constBegin(); i != pools.constEnd(); ++i)
+        appendHistogram(lines, "servatrice_database_query_duration_seconds",
+                        QString("pool=\"%1\"").arg(poolLabel(i.key())), i.value()->databaseQueries);
+
+    lines.append("# HELP servatrice_output_queue_messages Messages waiting to be written to client sockets.");
+    lines.append("# TYPE servatrice_output_queue_messages gauge");
+    for (auto i = pools.constBegin(); i != pools.constEnd(); ++i)
+        lines.append(QString("servatrice_output_queue_messages{pool=\"%1\"} %2")
+                         .arg(poolLabel(i.key()))
+                         .arg(i.value()->queuedMessages.load()));
+
+    lines.append("# HELP servatrice_output_queue_bytes Serialized size of the messages waiting to be written.");
+    lines.append("# TYPE servatrice_output_queue_bytes gauge");
+    for (auto i = pools.constBegin(); i != pools.constEnd(); ++i)
+        lines.append(QString("servatrice_output_queue_bytes{pool=\"%1\"} %2")
+                         .arg(poolLabel(i.key()))
+                         .arg(i.value()->queuedBytes.load()));
+
+    lines.append("# HELP servatrice_pool_received_messages_total Messages received from the clients of a pool.");
+    lines.append("# TYPE servatrice_pool_received_messages_total counter");
+    for (auto i = pools.constBegin(); i != pools.constEnd(); ++i)
+        lines.append(QString("servatrice_pool_received_messages_total{pool=\"%1\"} %2")
+                         .arg(poolLabel(i.key()))
+                         .arg(i.value()->receivedMessages.load()));
+
+    lines.append("# HELP servatrice_pool_command_seconds_total Time a pool spent processing client messages.");
+    lines.append("# TYPE servatrice_pool_command_seconds_total counter");
+    for (auto i = pools.constBegin(); i != pools.constEnd(); ++i)
+        lines.append(QString("servatrice_pool_command_seconds_total{pool=\"%1\"} %2")
+                         .arg(poolLabel(i.key()))
+                         .arg(i.value()->commandTime.load() / 1000000.0, 0, 'f', 6));
+
+    lines.append("# HELP servatrice_pool_clients Connections handled by a pool.");
+    lines.append("# TYPE servatrice_pool_clients gauge");
+    for (auto i = pools.constBegin(); i != pools.constEnd(); ++i)
+        lines.append(
+            QString("servatrice_pool_clients{pool=\"%1\"} %2").arg(poolLabel(i.key())).arg(i.value()->clients.load()));
+
+    lines.append("# HELP servatrice_pool_event_loop_lag_seconds How late the last timer of a pool fired.");
+    lines.append("# TYPE servatrice_pool_event_loop_lag_seconds gauge");
+    for (auto i = pools.constBegin(); i != pools.constEnd(); ++i)
+        lines.append(QString("servatrice_pool_event_loop_lag_seconds{pool=\"%1\"} %2")
+                         .arg(poolLabel(i.key()))
+                         .arg(i.value()->eventLoopLag.load() / 1000000.0, 0, 'f', 6));
+
+    lines.append("# HELP servatrice_pool_load Load of a pool that new connections are placed by; 1 is a busy thread.");
+    lines.append("# TYPE servatrice_pool_load gauge");
+    for (auto i = pools.constBegin(); i != pools.constEnd(); ++i)
+        lines.append(QString("servatrice_pool_load{pool=\"%1\"} %2")
+                         .arg(poolLabel(i.key()))
+                         .arg(i.value()->load.load() / 1000.0, 0, 'f', 3));
+    locker.unlock();
+
+    lines.append("# HELP servatrice_transmitted_bytes_total Bytes sent to clients and other servers.");
+    lines.append("# TYPE servatrice_transmitted_bytes_total counter");
+    lines.append(QString("servatrice_transmitted_bytes_total %1").arg(txBytes.load()));
+    lines.append("# HELP servatrice_received_bytes_total Bytes received from clients and other servers.");
+    lines.append("# TYPE servatrice_received_bytes_total counter");
+    lines.append(QString("servatrice_received_bytes_total %1").arg(rxBytes.load()));
+
+    return lines.join("\n") + "\n";
+}
@@ -0,0 +1,119 @@
+#ifndef SERVER_METRICS_H
+#define SERVER_METRICS_H
+
+#include <QAtomicInteger>
+#include <QHash>
+#include <QMap>
+#include <QReadWriteLock>
+#include <QString>
+
+/*
+ * Latency histogram with fixed buckets that can be updated from any thread without locking.
+ * Values are recorded in microseconds and exported in seconds.
+ */
+class Server_MetricsHistogram
+{
+public:
+    static const int bucketCount = 12;
+    static const qint64 bucketBounds[bucketCount];
+
+    Server_MetricsHistogram();
+    void record(qint64 usecs);
+    void reset();
+
+    // Number of values up to and including bucketBounds[bucket]; bucketCount yields the total.
+    quint64 getCumulativeCount(int bucket) const;
+    quint64 getCount() const
+    {
+        return count.load();
+    }
+    quint64 getSum() const
+    {
+        return sum.load();
+    }
+
+private:
+    QAtomicInteger<quint64> buckets[bucketCount + 1];
+    QAtomicInteger<quint64> sum, count;
+
+    Q_DISABLE_COPY(Server_MetricsHistogram)
+};
+
+// Statistics of one connection pool (one thread and its database connection).
+struct Server_PoolMetrics
+{
+    Server_MetricsHistogram databaseQueries;
+    QAtomicInt queuedMessages;
+    QAtomicInteger<qint64> queuedBytes;
+    QAtomicInteger<quint64> receivedMessages;
+    QAtomicInteger<quint64> commandTime; // microseconds spent processing the received messages
+    // these are sampled by the pool itself
+    QAtomicInt clients;
+    QAtomicInteger<qint64> eventLoopLag; // microseconds
+    QAtomicInt load;                     // thousandths, see Servatrice_ConnectionPool::updateLoad()
+};
+
+/*
+ * Counters and latency histograms of the server, exported in the Prometheus text format.
+ *
+ * Everything that is updated per command or per message is allocated up front or handed out as a stable
+ * pointer, so recording never takes a lock.
+ */
+class Server_Metrics
+{
+public:
+    enum CommandCategory
+    {
+        SessionCommands,
+        RoomCommands,
+        GameCommands,
+        ModeratorCommands,
+        AdminCommands,
+        CommandCategoryCount
+    };
+    enum LockType
+    {
+        ClientsLock,
+        RoomsLock,
+        GamesLock,
+        GameMutex,
+        HistoryLock,
+        PersistentPlayersLock,
+        LockTypeCount
+    };
+
+    Server_Metrics();
+    ~Server_Metrics();
+
+    void recordCommand(CommandCategory category, int commandType, qint64 usecs);
+    void recordLockWait(LockType type, qint64 usecs)
+    {
+        lockWaits[type].record(usecs);
+    }
+    // The returned object lives as long as this one; callers are expected to keep the pointer.
+    Server_PoolMetrics *getPoolMetrics(int pool);
+    void addTxBytes(quint64 num)
+    {
+        txBytes.fetchAndAddRelaxed(num);
+    }
+    void addRxBytes(quint64 num)
+    {
+        rxBytes.fetchAndAddRelaxed(num);
+    }
+
+    QString toPrometheusText() const;
+
+    // Microseconds on a monotonic clock.
+    static qint64 currentTime();
+
+private:
+    QHash<int, Server_MetricsHistogram *> commands; // key: category << 16 | command type; filled in the constructor
+    Server_MetricsHistogram lockWaits[LockTypeCount];
+    QMap<int, Server_PoolMetrics *> pools;
+    mutable QReadWriteLock poolsLock;
+    QAtomicInteger<quint64> txBytes, rxBytes;
+
+    Q_DISABLE_COPY(Server_Metrics)
+};
+
+#endif
@@ -71,6 +71,7 @@
 #include "pb/response_dump_zone.pb.h"
 #include "pb/serverinfo_player.pb.h"
 #include "pb/serverinfo_user.pb.h"
+#include "pb/session_event.pb.h"
 
 #include "pb/context_concede.pb.h"
 #include "pb/context_connection_state_changed.pb.h"
@@ -246,8 +247,11 @@ void Server_Player::clearZones()
 void Server_Player::getProperties(ServerInfo_PlayerProperties &result, bool withUserInfo)
 {
     result.set_player_id(playerId);
-    if (withUserInfo)
+    if (withUserInfo) {
+        // the properties are sent to every participant of the game, they fetch the avatar by its hash instead
         copyUserInfo(*(result.mutable_user_info()), true);
+        result.mutable_user_info()->clear_avatar_bmp();
+    }
     result.set_spectator(spectator);
     if (!spectator) {
         result.set_conceded(conceded);
@@ -1729,6 +1733,8 @@ Response::ResponseCode Server_Player::cmdChangeZoneProperties(const Command_Chan
 Response::ResponseCode
 Server_Player::processGameCommand(const GameCommand &command, ResponseContainer &rc, GameEventStorage &ges)
 {
+    game->invalidateStateSnapshots();
+
     switch ((GameCommand::GameCommandType)getPbExtension(command)) {
         case GameCommand::KICK_FROM_GAME:
             return cmdKickFromGame(command.GetExtension(Command_KickFromGame::ext), rc, ges);
@@ -1839,6 +1845,14 @@ void Server_Player::sendGameEvent(const GameEventContainer &cont)
         userInterface->sendProtocolItem(cont);
 }
 
+void Server_Player::sendSessionEvent(const SessionEvent &event)
+{
+    QMutexLocker locker(&playerMutex);
+
+    if (userInterface)
+        userInterface->sendProtocolItem(event);
+}
+
 void Server_Player::setUserInterface(Server_AbstractUserInterface *_userInterface)
 {
     playerMutex.lock();
@@ -9,6 +9,7 @@
 #include <QString>
 
 #include "pb/card_attributes.pb.h"
+#include "pb/game_event_container.pb.h"
 #include "pb/response.pb.h"
 
 class DeckList;
@@ -23,10 +24,10 @@ class ServerInfo_Player;
 class ServerInfo_PlayerProperties;
 class CommandContainer;
 class CardToMove;
-class GameEventContainer;
 class GameEventStorage;
 class ResponseContainer;
 class GameCommand;
+class SessionEvent;
 
 class Command_KickFromGame;
 class Command_LeaveGame;
@@ -230,6 +231,7 @@ public:
 
     Response::ResponseCode processGameCommand(const GameCommand &command, ResponseContainer &rc, GameEventStorage &ges);
     void sendGameEvent(const GameEventContainer &event);
+    void sendSessionEvent(const SessionEvent &event);
 
     void getInfo(ServerInfo_Player *info, Server_Player *playerWhosAsking, bool omniscient, bool withUserInfo);
 };
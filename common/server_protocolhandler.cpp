@@ -4,39 +4,139 @@
 #include "pb/commands.pb.h"
 #include "pb/event_game_joined.pb.h"
 #include "pb/event_list_rooms.pb.h"
+#include "pb/event_room_chat_history.pb.h"
 #include "pb/event_notify_user.pb.h"
 #include "pb/event_room_say.pb.h"
 #include "pb/event_server_message.pb.h"
 #include "pb/event_user_message.pb.h"
 #include "pb/response.pb.h"
+#include "pb/response_get_avatar.pb.h"
 #include "pb/response_get_games_of_user.pb.h"
 #include "pb/response_get_user_info.pb.h"
 #include "pb/response_join_room.pb.h"
+#include "pb/response_list_room_contents.pb.h"
 #include "pb/response_list_users.pb.h"
 #include "pb/response_login.pb.h"
 #include "pb/serverinfo_user.pb.h"
+#include "pb/session_handoff.pb.h"
 #include "server_database_interface.h"
 #include "server_game.h"
 #include "server_player.h"
 #include "server_room.h"
+#include "server_trafficrecorder.h"
 #include <QDateTime>
 #include <QDebug>
 #include <google/protobuf/descriptor.h>
 #include <math.h>
 
+// Users and games sent per page to clients that page the contents of the rooms they join
+static const int defaultRoomListPageSize = 200;
+static const int maxRoomListPageSize = 1000;
+
+static int roomListPageSize(unsigned int requested)
+{
+    if (requested == 0)
+        return defaultRoomListPageSize;
+    return static_cast<int>(qMin(requested, static_cast<unsigned int>(maxRoomListPageSize)));
+}
+
 Server_ProtocolHandler::Server_ProtocolHandler(Server *_server,
                                                Server_DatabaseInterface *_databaseInterface,
                                                QObject *parent)
-    : QObject(parent), Server_AbstractUserInterface(_server), deleted(false), databaseInterface(_databaseInterface),
-      authState(NotLoggedIn), acceptsUserListChanges(false), acceptsRoomListChanges(false),
-      idleClientWarningSent(false), timeRunning(0), lastDataReceived(0), lastActionReceived(0)
-
+    : QObject(parent), Server_AbstractUserInterface(_server), deleted(false), handedOver(false),
+      databaseInterface(_databaseInterface), authState(NotLoggedIn), acceptsUserListChanges(false),
+      acceptsRoomListChanges(false), supportsAvatarHashes(false), idleClientWarningSent(false),
+      messageCountArrivalTime(0), messageSizeArrivalTime(0), commandCountArrivalTime(0), lastDataReceived(0),
+      lastActionReceived(0), timerWheel(nullptr), recording(nullptr)
 {
-    connect(server, SIGNAL(pingClockTimeout()), this, SLOT(pingClockTimeout()));
+    if (server->getTrafficRecorder().isEnabled())
+        recording = new Server_SessionRecording(&server->getTrafficRecorder());
 }
 
 Server_ProtocolHandler::~Server_ProtocolHandler()
 {
+    if (timerWheel)
+        timerWheel->cancelAll(this);
+    delete recording;
+}
+
+// This function must be called from the thread this object lives in.
+void Server_ProtocolHandler::startTimers()
+{
+    // Servers without a keepalive interval (like the local server) never time out their clients.
+    if (timerWheel || (server->getClientKeepAlive() <= 0))
+        return;
+
+    timerWheel = server->getTimerWheel();
+    // relative to tick 0 until now, see stopTimers()
+    lastDataReceived += timerWheel->getCurrentTick();
+    lastActionReceived += timerWheel->getCurrentTick();
+    timerWheel->schedule(this, InactivityTimer, server->getMaxPlayerInactivityTime() + 1);
+    scheduleIdleTimer();
+}
+
+// This function must be called from the thread this object lives in, before moving the object to another thread.
+// startTimers() continues the timers in the new thread.
+void Server_ProtocolHandler::stopTimers()
+{
+    if (!timerWheel)
+        return;
+
+    timerWheel->cancelAll(this);
+    // the ticks of the wheels of different threads are unrelated, only how long ago things happened is kept
+    lastDataReceived -= timerWheel->getCurrentTick();
+    lastActionReceived -= timerWheel->getCurrentTick();
+    timerWheel = nullptr;
+}
+
+void Server_ProtocolHandler::getSessionState(SessionHandoff &state) const
+{
+    if (authState != NotLoggedIn) {
+        state.mutable_user_info()->CopyFrom(copyUserInfo(true, true, true));
+        state.set_registered(authState == PasswordRight);
+        for (int roomId : rooms.keys())
+            state.add_room_ids(roomId);
+    }
+    state.set_accepts_user_list_changes(acceptsUserListChanges);
+    state.set_accepts_room_list_changes(acceptsRoomListChanges);
+    state.set_supports_avatar_hashes(supportsAvatarHashes);
+    state.set_idle_client_warning_sent(idleClientWarningSent);
+    state.set_last_data_received(static_cast<google::protobuf::uint32>(qMax(getLastCommandTime(), 0)));
+    state.set_last_action_received(static_cast<google::protobuf::uint32>(qMax(getLastActionTime(), 0)));
+}
+
+bool Server_ProtocolHandler::restoreSession(const SessionHandoff &state)
+{
+    acceptsUserListChanges = state.accepts_user_list_changes();
+    acceptsRoomListChanges = state.accepts_room_list_changes();
+    supportsAvatarHashes = state.supports_avatar_hashes();
+    idleClientWarningSent = state.idle_client_warning_sent();
+
+    // the timers are continued relative to the current tick, see stopTimers()
+    stopTimers();
+    lastDataReceived = -static_cast<int>(state.last_data_received());
+    lastActionReceived = -static_cast<int>(state.last_action_received());
+    startTimers();
+
+    if (!state.has_user_info())
+        return true;
+    if (!server->restoreUser(this, state.user_info())) {
+        // the user has logged in again in the meantime
+        databaseInterface->endSession(static_cast<qint64>(state.user_info().session_id()));
+        return false;
+    }
+    authState = state.registered() ? PasswordRight : UnknownUser;
+
+    Server_ReadLocker serverLocker(&server->roomsLock, SERVER_LOCK_SITE);
+    for (int roomId : state.room_ids()) {
+        Server_Room *r = server->getRooms().value(roomId, 0);
+        if (!r)
+            continue;
+        // the other users of the room haven't seen the user leave the old process
+        r->addClient(this, false);
+        rooms.insert(r->getId(), r);
+    }
+    return true;
 }
 
 // This function must only be called from the thread this object lives in.
@@ -47,13 +147,16 @@ void Server_ProtocolHandler::prepareDestroy()
         return;
     deleted = true;
 
+    if (timerWheel)
+        timerWheel->cancelAll(this);
+
     QMapIterator<int, Server_Room *> roomIterator(rooms);
     while (roomIterator.hasNext())
-        roomIterator.next().value()->removeClient(this);
+        roomIterator.next().value()->removeClient(this, !handedOver);
 
     QMap<int, QPair<int, int>> tempGames(getGames());
 
-    server->roomsLock.lockForRead();
+    server->roomsLock.lockForRead(SERVER_LOCK_SITE);
     QMapIterator<int, QPair<int, int>> gameIterator(tempGames);
     while (gameIterator.hasNext()) {
         gameIterator.next();
@@ -61,13 +164,13 @@ void Server_ProtocolHandler::prepareDestroy()
         Server_Room *r = server->getRooms().value(gameIterator.value().first);
         if (!r)
             continue;
-        r->gamesLock.lockForRead();
+        r->gamesLock.lockForRead(SERVER_LOCK_SITE);
         Server_Game *g = r->getGames().value(gameIterator.key());
         if (!g) {
             r->gamesLock.unlock();
             continue;
         }
-        g->gameMutex.lock();
+        g->gameMutex.lock(SERVER_LOCK_SITE);
         Server_Player *p = g->getPlayers().value(gameIterator.value().second);
         if (!p) {
             g->gameMutex.unlock();
@@ -98,6 +201,9 @@ void Server_ProtocolHandler::sendProtocolItem(const Response &item)
 
 void Server_ProtocolHandler::sendProtocolItem(const SessionEvent &item)
 {
+    if (recording)
+        recording->recordSessionEvent(item);
+
     ServerMessage msg;
     msg.mutable_session_event()->CopyFrom(item);
     msg.set_message_type(ServerMessage::SESSION_EVENT);
@@ -107,6 +213,12 @@ void Server_ProtocolHandler::sendProtocolItem(const SessionEvent &item)
 
 void Server_ProtocolHandler::sendProtocolItem(const GameEventContainer &item)
 {
+    if (recording) {
+        const QMap<int, QPair<int, int>> games = getGames();
+        if (games.contains(static_cast<int>(item.game_id())))
+            recording->recordGameEventContainer(item, games.value(static_cast<int>(item.game_id())).second);
+    }
+
     ServerMessage msg;
     msg.mutable_game_event_container()->CopyFrom(item);
     msg.set_message_type(ServerMessage::GAME_EVENT_CONTAINER);
@@ -143,6 +255,7 @@ Response::ResponseCode Server_ProtocolHandler::processSessionCommandContainer(co
             } else
                 logDebugMessage(QString::fromStdString(sc.ShortDebugString()));
         }
+        const qint64 startTime = Server_Metrics::currentTime();
         switch ((SessionCommand::SessionCommandType)num) {
             case SessionCommand::PING:
                 resp = cmdPing(sc.GetExtension(Command_Ping::ext), rc);
@@ -159,6 +272,9 @@ Response::ResponseCode Server_ProtocolHandler::processSessionCommandContainer(co
             case SessionCommand::GET_USER_INFO:
                 resp = cmdGetUserInfo(sc.GetExtension(Command_GetUserInfo::ext), rc);
                 break;
+            case SessionCommand::GET_AVATAR:
+                resp = cmdGetAvatar(sc.GetExtension(Command_GetAvatar::ext), rc);
+                break;
             case SessionCommand::LIST_ROOMS:
                 resp = cmdListRooms(sc.GetExtension(Command_ListRooms::ext), rc);
                 break;
@@ -171,6 +287,8 @@ Response::ResponseCode Server_ProtocolHandler::processSessionCommandContainer(co
             default:
                 resp = processExtendedSessionCommand(num, sc, rc);
         }
+        server->getMetrics().recordCommand(Server_Metrics::SessionCommands, num,
+                                           Server_Metrics::currentTime() - startTime);
         if (resp != Response::RespOk)
             finalResponseCode = resp;
     }
@@ -183,7 +301,7 @@ Response::ResponseCode Server_ProtocolHandler::processRoomCommandContainer(const
     if (authState == NotLoggedIn)
         return Response::RespLoginNeeded;
 
-    QReadLocker locker(&server->roomsLock);
+    Server_ReadLocker locker(&server->roomsLock, SERVER_LOCK_SITE);
     Server_Room *room = rooms.value(cont.room_id(), 0);
     if (!room)
         return Response::RespNotInRoom;
@@ -196,6 +314,7 @@ Response::ResponseCode Server_ProtocolHandler::processRoomCommandContainer(const
         const RoomCommand &sc = cont.room_command(i);
         const int num = getPbExtension(sc);
         logDebugMessage(QString::fromStdString(sc.ShortDebugString()));
+        const qint64 startTime = Server_Metrics::currentTime();
         switch ((RoomCommand::RoomCommandType)num) {
             case RoomCommand::LEAVE_ROOM:
                 resp = cmdLeaveRoom(sc.GetExtension(Command_LeaveRoom::ext), room, rc);
@@ -209,7 +328,12 @@ Response::ResponseCode Server_ProtocolHandler::processRoomCommandContainer(const
             case RoomCommand::JOIN_GAME:
                 resp = cmdJoinGame(sc.GetExtension(Command_JoinGame::ext), room, rc);
                 break;
+            case RoomCommand::LIST_ROOM_CONTENTS:
+                resp = cmdListRoomContents(sc.GetExtension(Command_ListRoomContents::ext), room, rc);
+                break;
         }
+        server->getMetrics().recordCommand(Server_Metrics::RoomCommands, num,
+                                           Server_Metrics::currentTime() - startTime);
         if (resp != Response::RespOk)
             finalResponseCode = resp;
     }
@@ -219,23 +343,6 @@ Response::ResponseCode Server_ProtocolHandler::processRoomCommandContainer(const
 Response::ResponseCode Server_ProtocolHandler::processGameCommandContainer(const CommandContainer &cont,
                                                                            ResponseContainer &rc)
 {
-    static QList<GameCommand::GameCommandType> antifloodCommandsWhiteList =
-        QList<GameCommand::GameCommandType>()
-        // draw/undo card draw (example: drawing 10 cards one by one from the deck)
-        << GameCommand::DRAW_CARDS
-        << GameCommand::UNDO_DRAW
-        // create, delete arrows (example: targeting with 10 cards during an attack)
-        << GameCommand::CREATE_ARROW
-        << GameCommand::DELETE_ARROW
-        // set card attributes (example: tapping 10 cards at once)
-        << GameCommand::SET_CARD_ATTR
-        // increment / decrement counter (example: -10 life points one by one)
-        << GameCommand::INC_COUNTER
-        // mulling lots of hands in a row
-        << GameCommand::MULLIGAN
-        // allows a user to sideboard without receiving flooding message
-        << GameCommand::MOVE_CARD;
-
     if (authState == NotLoggedIn)
         return Response::RespLoginNeeded;
 
@@ -244,12 +351,13 @@ Response::ResponseCode Server_ProtocolHandler::processGameCommandContainer(const
         return Response::RespNotInRoom;
     const QPair<int, int> roomIdAndPlayerId = gameMap.value(cont.game_id());
 
-    QReadLocker roomsLocker(&server->roomsLock);
+    Server_Metrics &metrics = server->getMetrics();
+    Server_ReadLocker roomsLocker(&server->roomsLock, SERVER_LOCK_SITE);
     Server_Room *room = server->getRooms().value(roomIdAndPlayerId.first);
     if (!room)
         return Response::RespNotInRoom;
 
-    QReadLocker roomGamesLocker(&room->gamesLock);
+    Server_ReadLocker roomGamesLocker(&room->gamesLock, SERVER_LOCK_SITE);
     Server_Game *game = room->getGames().value(cont.game_id());
     if (!game) {
         if (room->getExternalGames().contains(cont.game_id())) {
@@ -260,15 +368,16 @@ Response::ResponseCode Server_ProtocolHandler::processGameCommandContainer(const
         return Response::RespNotInRoom;
     }
 
-    QMutexLocker gameLocker(&game->gameMutex);
+    Server_MutexLocker gameLocker(&game->gameMutex, SERVER_LOCK_SITE);
     Server_Player *player = game->getPlayers().value(roomIdAndPlayerId.second);
     if (!player)
         return Response::RespNotInRoom;
 
     resetIdleTimer();
 
-    int commandCountingInterval = server->getCommandCountingInterval();
-    int maxCommandCountPerInterval = server->getMaxCommandCountPerInterval();
+    if (!checkGameCommandFlood(cont))
+        return Response::RespChatFlood;
+
     GameEventStorage ges;
     Response::ResponseCode finalResponseCode = Response::RespOk;
     for (int i = cont.game_command_size() - 1; i >= 0; --i) {
@@ -276,22 +385,10 @@ Response::ResponseCode Server_ProtocolHandler::processGameCommandContainer(const
         logDebugMessage(QString("game %1 player %2: ").arg(cont.game_id()).arg(roomIdAndPlayerId.second) +
                         QString::fromStdString(sc.ShortDebugString()));
 
-        if (commandCountingInterval > 0) {
-            int totalCount = 0;
-            if (commandCountOverTime.isEmpty())
-                commandCountOverTime.prepend(0);
-
-            if (!antifloodCommandsWhiteList.contains((GameCommand::GameCommandType)getPbExtension(sc)))
-                ++commandCountOverTime[0];
-
-            for (int i = 0; i < commandCountOverTime.size(); ++i)
-                totalCount += commandCountOverTime[i];
-
-            if (totalCount > maxCommandCountPerInterval)
-                return Response::RespChatFlood;
-        }
-
+        const qint64 startTime = Server_Metrics::currentTime();
         Response::ResponseCode resp = player->processGameCommand(sc, rc, ges);
+        metrics.recordCommand(Server_Metrics::GameCommands, getPbExtension(sc),
+                              Server_Metrics::currentTime() - startTime);
 
         if (resp != Response::RespOk)
             finalResponseCode = resp;
@@ -318,7 +415,10 @@ Response::ResponseCode Server_ProtocolHandler::processModeratorCommandContainer(
         const int num = getPbExtension(sc);
         logDebugMessage(QString::fromStdString(sc.ShortDebugString()));
 
+        const qint64 startTime = Server_Metrics::currentTime();
         resp = processExtendedModeratorCommand(num, sc, rc);
+        server->getMetrics().recordCommand(Server_Metrics::ModeratorCommands, num,
+                                           Server_Metrics::currentTime() - startTime);
         if (resp != Response::RespOk)
             finalResponseCode = resp;
     }
@@ -342,7 +442,10 @@ Response::ResponseCode Server_ProtocolHandler::processAdminCommandContainer(cons
         const int num = getPbExtension(sc);
         logDebugMessage(QString::fromStdString(sc.ShortDebugString()));
 
+        const qint64 startTime = Server_Metrics::currentTime();
         resp = processExtendedAdminCommand(num, sc, rc);
+        server->getMetrics().recordCommand(Server_Metrics::AdminCommands, num,
+                                           Server_Metrics::currentTime() - startTime);
         if (resp != Response::RespOk)
             finalResponseCode = resp;
     }
@@ -355,7 +458,9 @@ void Server_ProtocolHandler::processCommandContainer(const CommandContainer &con
     if (deleted)
         return;
 
-    lastDataReceived = timeRunning;
+    lastDataReceived = getCurrentTime();
+    if (recording)
+        recording->recordCommandContainer(cont);
 
     ResponseContainer responseContainer(cont.has_cmd_id() ? cont.cmd_id() : -1);
     Response::ResponseCode finalResponseCode;
@@ -377,56 +482,115 @@ void Server_ProtocolHandler::processCommandContainer(const CommandContainer &con
         sendResponseContainer(responseContainer, finalResponseCode);
 }
 
-void Server_ProtocolHandler::pingClockTimeout()
+void Server_ProtocolHandler::timerWheelTimeout(int timerType)
 {
+    switch (timerType) {
+        case InactivityTimer:
+            checkInactivity();
+            break;
+        case IdleTimer:
+            checkIdleTimeout();
+            break;
+        default:
+            break;
+    }
+}
 
-    int cmdcountinterval = server->getCommandCountingInterval();
-    int msgcountinterval = server->getMessageCountingInterval();
-    int pingclockinterval = server->getClientKeepAlive();
-
-    int interval = server->getMessageCountingInterval();
-    if (interval > 0) {
-        if (pingclockinterval > 0) {
-            messageSizeOverTime.prepend(0);
-            if (messageSizeOverTime.size() > (msgcountinterval / pingclockinterval))
-                messageSizeOverTime.removeLast();
-            messageCountOverTime.prepend(0);
-            if (messageCountOverTime.size() > (msgcountinterval / pingclockinterval))
-                messageCountOverTime.removeLast();
-        }
+// All commands of a container are charged at once, so a container is either processed completely or not at all.
+bool Server_ProtocolHandler::checkGameCommandFlood(const CommandContainer &cont)
+{
+    Server_RateLimiter &sessionLimiter = server->getGameCommandLimiter();
+    Server_RateLimiter &addressLimiter = server->getAddressGameCommandLimiter();
+    if (!sessionLimiter.isEnabled() && !addressLimiter.isEnabled())
+        return true;
+
+    int totalCost = 0;
+    for (int i = 0; i < cont.game_command_size(); ++i)
+        totalCost += server->getGameCommandCost(getPbExtension(cont.game_command(i)));
+
+    if (!sessionLimiter.consume(commandCountArrivalTime, totalCost))
+        return false;
+    if (!addressLimiter.consume(getAddress(), totalCost)) {
+        sessionLimiter.refund(commandCountArrivalTime, totalCost);
+        return false;
     }
+    return true;
+}
 
-    interval = server->getCommandCountingInterval();
-    if (interval > 0) {
-        if (pingclockinterval > 0) {
-            commandCountOverTime.prepend(0);
-            if (commandCountOverTime.size() > (cmdcountinterval / pingclockinterval))
-                commandCountOverTime.removeLast();
-        }
+// A message that one of the limiters rejects is not charged to the others either.
+bool Server_ProtocolHandler::checkMessageFlood(int messageSize)
+{
+    Server_RateLimiter &countLimiter = server->getMessageCountLimiter();
+    Server_RateLimiter &sizeLimiter = server->getMessageSizeLimiter();
+    Server_RateLimiter &addressLimiter = server->getAddressMessageCountLimiter();
+
+    if (!countLimiter.consume(messageCountArrivalTime, 1))
+        return false;
+    if (!sizeLimiter.consume(messageSizeArrivalTime, messageSize)) {
+        countLimiter.refund(messageCountArrivalTime, 1);
+        return false;
     }
+    if (!addressLimiter.consume(getAddress(), 1)) {
+        countLimiter.refund(messageCountArrivalTime, 1);
+        sizeLimiter.refund(messageSizeArrivalTime, messageSize);
+        return false;
+    }
+    return true;
+}
 
-    if (timeRunning - lastDataReceived > server->getMaxPlayerInactivityTime())
+// lastDataReceived is updated on every command without touching the wheel; the deadline is simply
+// pushed back here if data has been received since it was scheduled.
+void Server_ProtocolHandler::checkInactivity()
+{
+    const int maxInactivityTime = server->getMaxPlayerInactivityTime();
+    const int inactiveTime = getCurrentTime() - lastDataReceived;
+    if (inactiveTime > maxInactivityTime)
         prepareDestroy();
+    else
+        timerWheel->schedule(this, InactivityTimer, maxInactivityTime + 1 - inactiveTime);
+}
 
-    if (!userInfo || QString::fromStdString(userInfo->privlevel()).toLower() == "none") {
-        if ((server->getIdleClientTimeout() > 0) && (idleClientWarningSent)) {
-            if (timeRunning - lastActionReceived > server->getIdleClientTimeout()) {
-                prepareDestroy();
-            }
-        }
+void Server_ProtocolHandler::scheduleIdleTimer()
+{
+    const int idleClientTimeout = server->getIdleClientTimeout();
+    if (idleClientTimeout <= 0)
+        return;
 
-        if (((timeRunning - lastActionReceived) >= ceil(server->getIdleClientTimeout() * .9)) &&
-            (!idleClientWarningSent) && (server->getIdleClientTimeout() > 0)) {
-            Event_NotifyUser event;
-            event.set_type(Event_NotifyUser::IDLEWARNING);
-            SessionEvent *se = prepareSessionEvent(event);
-            sendProtocolItem(*se);
-            delete se;
-            idleClientWarningSent = true;
-        }
+    const int idleTime = getCurrentTime() - lastActionReceived;
+    if (idleClientWarningSent)
+        timerWheel->schedule(this, IdleTimer, idleClientTimeout + 1 - idleTime);
+    else
+        timerWheel->schedule(this, IdleTimer, (int)ceil(idleClientTimeout * .9) - idleTime);
+}
+
+void Server_ProtocolHandler::checkIdleTimeout()
+{
+    const int idleClientTimeout = server->getIdleClientTimeout();
+    if (idleClientTimeout <= 0)
+        return;
+
+    // Privileged users are never kicked, but their privileges can change; check again later.
+    if (userInfo && QString::fromStdString(userInfo->privlevel()).toLower() != "none") {
+        timerWheel->schedule(this, IdleTimer, idleClientTimeout);
+        return;
+    }
+
+    const int idleTime = getCurrentTime() - lastActionReceived;
+    if (idleClientWarningSent && (idleTime > idleClientTimeout)) {
+        prepareDestroy();
+        return;
+    }
+
+    if (!idleClientWarningSent && (idleTime >= ceil(idleClientTimeout * .9))) {
+        Event_NotifyUser event;
+        event.set_type(Event_NotifyUser::IDLEWARNING);
+        SessionEvent *se = prepareSessionEvent(event);
+        sendProtocolItem(*se);
+        delete se;
+        idleClientWarningSent = true;
     }
 
-    ++timeRunning;
+    scheduleIdleTimer();
 }
 
 Response::ResponseCode Server_ProtocolHandler::cmdPing(const Command_Ping & /*cmd*/, ResponseContainer & /*rc*/)
@@ -454,6 +618,7 @@ Response::ResponseCode Server_ProtocolHandler::cmdLogin(const Command_Login &cmd
 
     missingClientFeatures =
         features.identifyMissingFeatures(receivedClientFeatures, server->getServerRequiredFeatureList());
+    supportsAvatarHashes = receivedClientFeatures.contains("avatar_hash");
 
     if (!missingClientFeatures.isEmpty()) {
         if (features.isRequiredFeaturesMissing(missingClientFeatures, server->getServerRequiredFeatureList())) {
@@ -483,8 +648,12 @@ Response::ResponseCode Server_ProtocolHandler::cmdLogin(const Command_Login &cmd
         }
         case NotLoggedIn:
             return Response::RespWrongPassword;
-        case WouldOverwriteOldSession:
+        case WouldOverwriteOldSession: {
+            Response_Login *re = new Response_Login;
+            re->set_denied_reason_str(reasonStr.toStdString());
+            rc.setResponseExtension(re);
             return Response::RespWouldOverwriteOldSession;
+        }
         case UsernameInvalid: {
             Response_Login *re = new Response_Login;
             re->set_denied_reason_str(reasonStr.toStdString());
@@ -518,6 +687,8 @@ Response::ResponseCode Server_ProtocolHandler::cmdLogin(const Command_Login &cmd
 
     Response_Login *re = new Response_Login;
     re->mutable_user_info()->CopyFrom(copyUserInfo(true));
+    if (supportsAvatarHashes)
+        re->mutable_user_info()->clear_avatar_bmp();
 
     if (authState == PasswordRight) {
         QMapIterator<QString, ServerInfo_User> buddyIterator(databaseInterface->getBuddyList(userName));
@@ -547,7 +718,7 @@ Response::ResponseCode Server_ProtocolHandler::cmdMessage(const Command_Message
     if (authState == NotLoggedIn)
         return Response::RespLoginNeeded;
 
-    QReadLocker locker(&server->clientsLock);
+    Server_ReadLocker locker(&server->clientsLock, SERVER_LOCK_SITE);
 
     QString receiver = QString::fromStdString(cmd.user_name());
     Server_AbstractUserInterface *userInterface = server->findUser(receiver);
@@ -555,6 +726,8 @@ Response::ResponseCode Server_ProtocolHandler::cmdMessage(const Command_Message
         return Response::RespNameNotFound;
     if (databaseInterface->isInIgnoreList(receiver, QString::fromStdString(userInfo->name())))
         return Response::RespInIgnoreList;
+    if (!checkMessageFlood(QString::fromStdString(cmd.message()).size()))
+        return Response::RespChatFlood;
 
     Event_UserMessage event;
     event.set_sender_name(userInfo->name());
@@ -582,17 +755,31 @@ Response::ResponseCode Server_ProtocolHandler::cmdGetGamesOfUser(const Command_G
     // We don't need to check whether the user is logged in; persistent games should also work.
     // The client needs to deal with an empty result list.
 
+    // Only the rooms containing games of the user are sent along.
+    const QList<PlayerReference> gameReferences =
+        server->getGameMemberReferences(QString::fromStdString(cmd.user_name()));
+
     Response_GetGamesOfUser *re = new Response_GetGamesOfUser;
-    server->roomsLock.lockForRead();
-    QMapIterator<int, Server_Room *> roomIterator(server->getRooms());
-    while (roomIterator.hasNext()) {
-        Server_Room *room = roomIterator.next().value();
-        room->gamesLock.lockForRead();
-        room->getInfo(*re->add_room_list(), false, true);
-        QListIterator<ServerInfo_Game> gameIterator(room->getGamesOfUser(QString::fromStdString(cmd.user_name())));
-        while (gameIterator.hasNext())
-            re->add_game_list()->CopyFrom(gameIterator.next());
-        room->gamesLock.unlock();
+    QSet<int> gamesAdded, roomsAdded;
+    server->roomsLock.lockForRead(SERVER_LOCK_SITE);
+    for (const PlayerReference &gameReference : gameReferences) {
+        if (gamesAdded.contains(gameReference.getGameId()))
+            continue;
+        Server_Room *room = server->getRooms().value(gameReference.getRoomId());
+        if (!room)
+            continue;
+
+        Server_ReadLocker gamesLocker(&room->gamesLock, SERVER_LOCK_SITE);
+        Server_Game *game = room->getGames().value(gameReference.getGameId());
+        if (!game)
+            continue;
+        game->getInfo(*re->add_game_list());
+        gamesAdded.insert(gameReference.getGameId());
+
+        if (!roomsAdded.contains(room->getId())) {
+            room->getInfo(*re->add_room_list(), false, true);
+            roomsAdded.insert(room->getId());
+        }
     }
     server->roomsLock.unlock();
 
@@ -611,7 +798,7 @@ Response::ResponseCode Server_ProtocolHandler::cmdGetUserInfo(const Command_GetU
         re->mutable_user_info()->CopyFrom(*userInfo);
     else {
 
-        QReadLocker locker(&server->clientsLock);
+        Server_ReadLocker locker(&server->clientsLock, SERVER_LOCK_SITE);
 
         ServerInfo_User_Container *infoSource = server->findUser(userName);
         if (!infoSource) {
@@ -621,11 +808,48 @@ Response::ResponseCode Server_ProtocolHandler::cmdGetUserInfo(const Command_GetU
                 infoSource->copyUserInfo(true, false, userInfo->user_level() & ServerInfo_User::IsModerator));
         }
     }
+    if (supportsAvatarHashes)
+        re->mutable_user_info()->clear_avatar_bmp();
 
     rc.setResponseExtension(re);
     return Response::RespOk;
 }
 
+Response::ResponseCode Server_ProtocolHandler::cmdGetAvatar(const Command_GetAvatar &cmd, ResponseContainer &rc)
+{
+    if (authState == NotLoggedIn)
+        return Response::RespLoginNeeded;
+
+    const QByteArray hash = QByteArray::fromStdString(cmd.avatar_hash());
+    if (hash.isEmpty())
+        return Response::RespContextError;
+
+    QByteArray avatarBmp = server->getAvatarCache().find(hash);
+    if (avatarBmp.isNull()) {
+        // the current avatar of the user is the only one that can be looked up, an outdated hash is not found
+        QString userName = QString::fromStdString(cmd.user_name());
+        ServerInfo_User avatarSource;
+        {
+            Server_ReadLocker locker(&server->clientsLock, SERVER_LOCK_SITE);
+            ServerInfo_User_Container *infoSource = server->findUser(userName);
+            if (infoSource)
+                avatarSource = infoSource->copyUserInfo(true);
+        }
+        if (!avatarSource.has_avatar_hash())
+            avatarSource = databaseInterface->getUserData(userName);
+        if (QByteArray::fromStdString(avatarSource.avatar_hash()) != hash)
+            return Response::RespNameNotFound;
+
+        avatarBmp = QByteArray::fromStdString(avatarSource.avatar_bmp());
+        server->getAvatarCache().insert(hash, avatarBmp);
+    }
+
+    Response_GetAvatar *re = new Response_GetAvatar;
+    re->set_avatar_bmp(avatarBmp.constData(), static_cast<size_t>(avatarBmp.size()));
+    rc.setResponseExtension(re);
+    return Response::RespOk;
+}
+
 Response::ResponseCode Server_ProtocolHandler::cmdListRooms(const Command_ListRooms & /*cmd*/, ResponseContainer &rc)
 {
     if (authState == NotLoggedIn)
@@ -649,7 +873,7 @@ Response::ResponseCode Server_ProtocolHandler::cmdJoinRoom(const Command_JoinRoo
     if (rooms.contains(cmd.room_id()))
         return Response::RespContextError;
 
-    QReadLocker serverLocker(&server->roomsLock);
+    Server_ReadLocker serverLocker(&server->roomsLock, SERVER_LOCK_SITE);
     Server_Room *r = server->getRooms().value(cmd.room_id(), 0);
     if (!r)
         return Response::RespNameNotFound;
@@ -666,39 +890,53 @@ Response::ResponseCode Server_ProtocolHandler::cmdJoinRoom(const Command_JoinRoo
     joinMessageEvent.set_message_type(Event_RoomSay::Welcome);
     rc.enqueuePostResponseItem(ServerMessage::ROOM_EVENT, r->prepareRoomEvent(joinMessageEvent));
 
-    QReadLocker chatHistoryLocker(&r->historyLock);
-    QList<ServerInfo_ChatMessage> chatHistory = r->getChatHistory();
-    ServerInfo_ChatMessage chatMessage;
-    for (int i = 0; i < chatHistory.size(); ++i) {
-        chatMessage = chatHistory.at(i);
-        Event_RoomSay roomChatHistory;
-        roomChatHistory.set_message(chatMessage.sender_name() + ": " + chatMessage.message());
-        roomChatHistory.set_message_type(Event_RoomSay::ChatHistory);
-        roomChatHistory.set_time_of(
-            QDateTime::fromString(QString::fromStdString(chatMessage.time())).toMSecsSinceEpoch());
-        rc.enqueuePostResponseItem(ServerMessage::ROOM_EVENT, r->prepareRoomEvent(roomChatHistory));
+    if (cmd.batched_chat_history()) {
+        rc.enqueuePostResponseItem(ServerMessage::ROOM_EVENT, r->prepareChatHistoryEvent());
+    } else {
+        Event_RoomChatHistory chatHistory;
+        r->getChatHistory(chatHistory);
+        for (int i = 0; i < chatHistory.messages_size(); ++i)
+            rc.enqueuePostResponseItem(ServerMessage::ROOM_EVENT, r->prepareRoomEvent(chatHistory.messages(i)));
     }
 
     Response_JoinRoom *re = new Response_JoinRoom;
-    r->getInfo(*re->mutable_room_info(), true);
+    if (cmd.list_page_size() > 0) {
+        const int pageSize = roomListPageSize(cmd.list_page_size());
+        ServerInfo_Room *roomInfo = re->mutable_room_info();
+        r->getInfo(*roomInfo, false, true);
+        re->set_more_users(r->getUserPage(*roomInfo->mutable_user_list(), QString(), pageSize));
+        re->set_more_games(r->getGamePage(*roomInfo->mutable_game_list(), -1, pageSize));
+    } else {
+        r->getInfo(*re->mutable_room_info(), true);
+    }
 
     rc.setResponseExtension(re);
     return Response::RespOk;
 }
 
-Response::ResponseCode Server_ProtocolHandler::cmdListUsers(const Command_ListUsers & /*cmd*/, ResponseContainer &rc)
+Response::ResponseCode Server_ProtocolHandler::cmdListUsers(const Command_ListUsers &cmd, ResponseContainer &rc)
 {
     if (authState == NotLoggedIn)
         return Response::RespLoginNeeded;
 
     Response_ListUsers *re = new Response_ListUsers;
-    server->clientsLock.lockForRead();
-    QMapIterator<QString, Server_ProtocolHandler *> userIterator = server->getUsers();
-    while (userIterator.hasNext())
-        re->add_user_list()->CopyFrom(userIterator.next().value()->copyUserInfo(false));
-    QMapIterator<QString, Server_AbstractUserInterface *> extIterator = server->getExternalUsers();
-    while (extIterator.hasNext())
-        re->add_user_list()->CopyFrom(extIterator.next().value()->copyUserInfo(false));
+    server->clientsLock.lockForRead(SERVER_LOCK_SITE);
+    const Server_UserDirectory &directory = server->getUserDirectory();
+    re->set_directory_id(directory.getId());
+    re->set_version(directory.getVersion());
+
+    // a client that still has the list of an earlier connection only needs the changes since then
+    if (cmd.directory_id() == directory.getId() &&
+        directory.getChanges(cmd.since_version(), *re->mutable_user_list(), *re->mutable_removed_users())) {
+        re->set_delta(true);
+    } else {
+        QMapIterator<QString, Server_ProtocolHandler *> userIterator = server->getUsers();
+        while (userIterator.hasNext())
+            re->add_user_list()->CopyFrom(userIterator.next().value()->copyUserInfo(false));
+        QMapIterator<QString, Server_AbstractUserInterface *> extIterator = server->getExternalUsers();
+        while (extIterator.hasNext())
+            re->add_user_list()->CopyFrom(extIterator.next().value()->copyUserInfo(false));
+    }
 
     acceptsUserListChanges = true;
     server->clientsLock.unlock();
@@ -720,24 +958,8 @@ Server_ProtocolHandler::cmdRoomSay(const Command_RoomSay &cmd, Server_Room *room
 {
     QString msg = QString::fromStdString(cmd.message());
 
-    if (server->getMessageCountingInterval() > 0) {
-        int totalSize = 0, totalCount = 0;
-        if (messageSizeOverTime.isEmpty())
-            messageSizeOverTime.prepend(0);
-        messageSizeOverTime[0] += msg.size();
-        for (int i = 0; i < messageSizeOverTime.size(); ++i)
-            totalSize += messageSizeOverTime[i];
-
-        if (messageCountOverTime.isEmpty())
-            messageCountOverTime.prepend(0);
-        ++messageCountOverTime[0];
-        for (int i = 0; i < messageCountOverTime.size(); ++i)
-            totalCount += messageCountOverTime[i];
-
-        if ((totalSize > server->getMaxMessageSizePerInterval()) ||
-            (totalCount > server->getMaxMessageCountPerInterval()))
-            return Response::RespChatFlood;
-    }
+    if (!checkMessageFlood(msg.size()))
+        return Response::RespChatFlood;
     msg.replace(QChar('\n'), QChar(' '));
 
     room->say(QString::fromStdString(userInfo->name()), msg);
@@ -754,6 +976,8 @@ Server_ProtocolHandler::cmdCreateGame(const Command_CreateGame &cmd, Server_Room
 {
     if (authState == NotLoggedIn)
         return Response::RespLoginNeeded;
+    if (server->getGamesClosed())
+        return Response::RespFunctionNotAllowed;
     const int gameId = databaseInterface->getNextGameId();
     if (gameId == -1)
         return Response::RespInternalError;
@@ -791,8 +1015,28 @@ Server_ProtocolHandler::cmdJoinGame(const Command_JoinGame &cmd, Server_Room *ro
     return room->processJoinGameCommand(cmd, rc, this);
 }
 
+Response::ResponseCode Server_ProtocolHandler::cmdListRoomContents(const Command_ListRoomContents &cmd,
+                                                                   Server_Room *room,
+                                                                   ResponseContainer &rc)
+{
+    if (authState == NotLoggedIn)
+        return Response::RespLoginNeeded;
+
+    const int pageSize = roomListPageSize(cmd.page_size());
+    Response_ListRoomContents *re = new Response_ListRoomContents;
+    if (cmd.list_users())
+        re->set_more_users(
+            room->getUserPage(*re->mutable_user_list(), QString::fromStdString(cmd.users_after()), pageSize));
+    if (cmd.list_games())
+        re->set_more_games(room->getGamePage(*re->mutable_game_list(), cmd.games_after(), pageSize));
+
+    rc.setResponseExtension(re);
+    return Response::RespOk;
+}
+
+// The pending idle deadline is left as it is and rescheduled lazily when it fires.
 void Server_ProtocolHandler::resetIdleTimer()
 {
-    lastActionReceived = timeRunning;
+    lastActionReceived = getCurrentTime();
     idleClientWarningSent = false;
 }
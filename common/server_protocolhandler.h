@@ -5,6 +5,7 @@
 #include "pb/server_message.pb.h"
 #include "server.h"
 #include "server_abstractuserinterface.h"
+#include "server_timerwheel.h"
 #include <QObject>
 #include <QPair>
 
@@ -13,8 +14,9 @@ class Server_DatabaseInterface;
 class Server_Player;
 class ServerInfo_User;
 class Server_Room;
-class QTimer;
 class FeatureSet;
+class Server_SessionRecording;
+class SessionHandoff;
 
 class ServerMessage;
 class Response;
@@ -35,33 +37,46 @@ class Command_Message;
 class Command_ListUsers;
 class Command_GetGamesOfUser;
 class Command_GetUserInfo;
+class Command_GetAvatar;
 class Command_ListRooms;
 class Command_JoinRoom;
 class Command_LeaveRoom;
 class Command_RoomSay;
 class Command_CreateGame;
 class Command_JoinGame;
+class Command_ListRoomContents;
 
-class Server_ProtocolHandler : public QObject, public Server_AbstractUserInterface
+class Server_ProtocolHandler : public QObject, public Server_AbstractUserInterface, public Server_TimerWheelListener
 {
     Q_OBJECT
 protected:
     QMap<int, Server_Room *> rooms;
 
     bool deleted;
+    // the connection goes on in another server process, see Servatrice_Handoff
+    bool handedOver;
     Server_DatabaseInterface *databaseInterface;
     AuthenticationResult authState;
     bool acceptsUserListChanges;
     bool acceptsRoomListChanges;
+    // the client fetches avatars by their hash, so user infos are sent to it without the image
+    bool supportsAvatarHashes;
     bool idleClientWarningSent;
     virtual void logDebugMessage(const QString & /* message */)
     {
     }
 
 private:
-    QList<int> messageSizeOverTime, messageCountOverTime, commandCountOverTime;
-    int timeRunning, lastDataReceived, lastActionReceived;
-    QTimer *pingClock;
+    enum TimerType
+    {
+        InactivityTimer,
+        IdleTimer
+    };
+
+    qint64 messageCountArrivalTime, messageSizeArrivalTime, commandCountArrivalTime;
+    int lastDataReceived, lastActionReceived;
+    Server_TimerWheel *timerWheel;
+    Server_SessionRecording *recording; // only set if traffic recording is enabled
 
     virtual void transmitProtocolItem(const ServerMessage &item) = 0;
 
@@ -70,6 +85,7 @@ private:
     Response::ResponseCode cmdMessage(const Command_Message &cmd, ResponseContainer &rc);
     Response::ResponseCode cmdGetGamesOfUser(const Command_GetGamesOfUser &cmd, ResponseContainer &rc);
     Response::ResponseCode cmdGetUserInfo(const Command_GetUserInfo &cmd, ResponseContainer &rc);
+    Response::ResponseCode cmdGetAvatar(const Command_GetAvatar &cmd, ResponseContainer &rc);
     Response::ResponseCode cmdListRooms(const Command_ListRooms &cmd, ResponseContainer &rc);
     Response::ResponseCode cmdJoinRoom(const Command_JoinRoom &cmd, ResponseContainer &rc);
     Response::ResponseCode cmdListUsers(const Command_ListUsers &cmd, ResponseContainer &rc);
@@ -77,6 +93,8 @@ private:
     Response::ResponseCode cmdRoomSay(const Command_RoomSay &cmd, Server_Room *room, ResponseContainer &rc);
     Response::ResponseCode cmdCreateGame(const Command_CreateGame &cmd, Server_Room *room, ResponseContainer &rc);
     Response::ResponseCode cmdJoinGame(const Command_JoinGame &cmd, Server_Room *room, ResponseContainer &rc);
+    Response::ResponseCode
+    cmdListRoomContents(const Command_ListRoomContents &cmd, Server_Room *room, ResponseContainer &rc);
 
     Response::ResponseCode processSessionCommandContainer(const CommandContainer &cont, ResponseContainer &rc);
     virtual Response::ResponseCode
@@ -100,8 +118,15 @@ private:
     }
 
     void resetIdleTimer();
-private slots:
-    void pingClockTimeout();
+    int getCurrentTime() const
+    {
+        return timerWheel ? timerWheel->getCurrentTick() : 0;
+    }
+    bool checkGameCommandFlood(const CommandContainer &cont);
+    bool checkMessageFlood(int messageSize);
+    void checkInactivity();
+    void checkIdleTimeout();
+    void scheduleIdleTimer();
 public slots:
     void prepareDestroy();
 
@@ -109,6 +134,10 @@ public:
     Server_ProtocolHandler(Server *_server, Server_DatabaseInterface *_databaseInterface, QObject *parent = 0);
     ~Server_ProtocolHandler();
 
+    bool isHandedOver() const
+    {
+        return handedOver;
+    }
     bool getAcceptsUserListChanges() const
     {
         return acceptsUserListChanges;
@@ -126,8 +155,20 @@ public:
 
     int getLastCommandTime() const
     {
-        return timeRunning - lastDataReceived;
+        return getCurrentTime() - lastDataReceived;
+    }
+    // unlike getLastCommandTime(), pings and other automatic commands don't count as actions
+    int getLastActionTime() const
+    {
+        return getCurrentTime() - lastActionReceived;
     }
+    Q_INVOKABLE void startTimers();
+    void stopTimers();
+    // What another server process needs to continue the session, see restoreSession().
+    void getSessionState(SessionHandoff &state) const;
+    // This must be called from the thread this object lives in, after it has been added to the server.
+    bool restoreSession(const SessionHandoff &state);
+    void timerWheelTimeout(int timerType);
     void processCommandContainer(const CommandContainer &cont);
 
     void sendProtocolItem(const Response &item);
@@ -0,0 +1,98 @@
+#include "server_ratelimiter.h"
+#include <QElapsedTimer>
+
+Server_RateLimiter::Server_RateLimiter(const QString &_name)
+    : name(_name), emissionInterval(0), tolerance(0), rejectedCount(0), pruneThreshold(1024)
+{
+}
+
+// Microseconds on a monotonic clock.
+qint64 Server_RateLimiter::currentTime()
+{
+    static const QElapsedTimer clock = []() {
+        QElapsedTimer timer;
+        timer.start();
+        return timer;
+    }();
+    return clock.nsecsElapsed() / 1000;
+}
+
+// A maxCostPerInterval or intervalSeconds of 0 disables the limit.
+void Server_RateLimiter::setLimit(int maxCostPerInterval, int intervalSeconds)
+{
+    if ((maxCostPerInterval <= 0) || (intervalSeconds <= 0)) {
+        emissionInterval.store(0);
+        tolerance.store(0);
+    } else {
+        const qint64 interval = (qint64)intervalSeconds * 1000000;
+        emissionInterval.store(qMax(interval / maxCostPerInterval, (qint64)1));
+        tolerance.store(interval);
+    }
+
+    QMutexLocker locker(&keysMutex);
+    keyArrivalTimes.clear();
+}
+
+bool Server_RateLimiter::consume(qint64 &theoreticalArrivalTime, int cost, qint64 now)
+{
+    const qint64 emission = emissionInterval.load();
+    if ((emission <= 0) || (cost <= 0))
+        return true;
+
+    const qint64 newArrivalTime = qMax(theoreticalArrivalTime, now) + cost * emission;
+    if (newArrivalTime - now > tolerance.load()) {
+        rejectedCount.fetchAndAddRelaxed(1);
+        return false;
+    }
+    theoreticalArrivalTime = newArrivalTime;
+    return true;
+}
+
+bool Server_RateLimiter::consume(qint64 &theoreticalArrivalTime, int cost)
+{
+    if (!isEnabled())
+        return true;
+    return consume(theoreticalArrivalTime, cost, currentTime());
+}
+
+bool Server_RateLimiter::consume(const QString &key, int cost)
+{
+    if (!isEnabled())
+        return true;
+
+    const qint64 now = currentTime();
+    QMutexLocker locker(&keysMutex);
+
+    // Keys whose arrival time lies in the past carry no state anymore and can be dropped.
+    if (keyArrivalTimes.size() >= pruneThreshold) {
+        QMutableHashIterator<QString, qint64> keyIterator(keyArrivalTimes);
+        while (keyIterator.hasNext())
+            if (keyIterator.next().value() <= now)
+                keyIterator.remove();
+        pruneThreshold = qMax(keyArrivalTimes.size() * 2, 1024);
+    }
+
+    qint64 &theoreticalArrivalTime = keyArrivalTimes[key];
+    return consume(theoreticalArrivalTime, cost, now);
+}
+
+// Consuming moved the arrival time forward by exactly cost * emissionInterval (from at least the time of the
+// request), so moving it back restores the state the request found.
+void Server_RateLimiter::refund(qint64 &theoreticalArrivalTime, int cost)
+{
+    const qint64 emission = emissionInterval.load();
+    if ((emission <= 0) || (cost <= 0))
+        return;
+    theoreticalArrivalTime -= cost * emission;
+}
+
+void Server_RateLimiter::refund(const QString &key, int cost)
+{
+    if (!isEnabled())
+        return;
+
+    QMutexLocker locker(&keysMutex);
+    auto keyIterator = keyArrivalTimes.find(key);
+    if (keyIterator != keyArrivalTimes.end())
+        refund(keyIterator.value(), cost);
+}
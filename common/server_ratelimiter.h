@@ -0,0 +1,59 @@
+#ifndef SERVER_RATELIMITER_H
+#define SERVER_RATELIMITER_H
+
+#include <QAtomicInteger>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+
+/*
+ * Rate limiter based on the generic cell rate algorithm (a token bucket that only needs
+ * to remember one timestamp per key).
+ *
+ * A limit allows a total cost of maxCostPerInterval within intervalSeconds, where every
+ * request may carry an arbitrary cost (e.g. the number of commands in a container or the
+ * length of a message). Checking a request is O(1).
+ *
+ * The state can either be owned by the caller (e.g. one timestamp per session, which needs
+ * no locking) or be kept inside the limiter, keyed by a string such as the client's address.
+ */
+class Server_RateLimiter
+{
+private:
+    QString name;
+    QAtomicInteger<qint64> emissionInterval, tolerance;
+    QAtomicInteger<quint64> rejectedCount;
+    QMutex keysMutex;
+    QHash<QString, qint64> keyArrivalTimes;
+    int pruneThreshold;
+
+    bool consume(qint64 &theoreticalArrivalTime, int cost, qint64 now);
+
+public:
+    explicit Server_RateLimiter(const QString &_name);
+
+    const QString &getName() const
+    {
+        return name;
+    }
+    bool isEnabled() const
+    {
+        return emissionInterval.load() > 0;
+    }
+    quint64 getRejectedCount() const
+    {
+        return rejectedCount.load();
+    }
+    void setLimit(int maxCostPerInterval, int intervalSeconds);
+
+    // Both return false and leave the state untouched if the cost exceeds the limit.
+    bool consume(qint64 &theoreticalArrivalTime, int cost);
+    bool consume(const QString &key, int cost);
+    // Gives back a cost that was consumed before, for requests that another limiter rejected afterwards.
+    void refund(qint64 &theoreticalArrivalTime, int cost);
+    void refund(const QString &key, int cost);
+
+    static qint64 currentTime();
+};
+
+#endif
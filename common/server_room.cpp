@@ -8,11 +8,14 @@
 #include "pb/event_join_room.pb.h"
 #include "pb/event_leave_room.pb.h"
 #include "pb/event_list_games.pb.h"
+#include "pb/event_room_chat_history.pb.h"
 #include "pb/event_room_say.pb.h"
 #include "pb/room_commands.pb.h"
-#include "pb/serverinfo_chat_message.pb.h"
 #include "pb/serverinfo_room.pb.h"
 #include <google/protobuf/descriptor.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#include <google/protobuf/unknown_field_set.h>
+#include <google/protobuf/wire_format_lite.h>
 
 Server_Room::Server_Room(int _id,
                          int _chatHistorySize,
@@ -26,8 +29,12 @@ Server_Room::Server_Room(int _id,
                          Server *parent)
     : QObject(parent), id(_id), chatHistorySize(_chatHistorySize), name(_name), description(_description),
       permissionLevel(_permissionLevel), privilegeLevel(_privilegeLevel), autoJoin(_autoJoin),
-      joinMessage(_joinMessage), gameTypes(_gameTypes), gamesLock(QReadWriteLock::Recursive)
+      joinMessage(_joinMessage), gameTypes(_gameTypes),
+      gamesLock("games", Server_LockProfiler::GamesRank, QReadWriteLock::Recursive),
+      historyLock("history", Server_LockProfiler::LeafRank), chatHistoryStart(0)
 {
+    gamesLock.setMetrics(&parent->getMetrics(), Server_Metrics::GamesLock);
+    historyLock.setMetrics(&parent->getMetrics(), Server_Metrics::HistoryLock);
     connect(this, SIGNAL(gameListChanged(ServerInfo_Game)), this, SLOT(broadcastGameListUpdate(ServerInfo_Game)),
             Qt::QueuedConnection);
 }
@@ -36,7 +43,7 @@ Server_Room::~Server_Room()
 {
     qDebug("Server_Room destructor");
 
-    gamesLock.lockForWrite();
+    gamesLock.lockForWrite(SERVER_LOCK_SITE);
     const QList<Server_Game *> gameList = games.values();
     for (int i = 0; i < gameList.size(); ++i)
         delete gameList[i];
@@ -84,7 +91,7 @@ Server_Room::getInfo(ServerInfo_Room &result, bool complete, bool showGameTypes,
     result.set_permissionlevel(permissionLevel.toStdString());
     result.set_privilegelevel(privilegeLevel.toStdString());
 
-    gamesLock.lockForRead();
+    gamesLock.lockForRead(SERVER_LOCK_SITE);
     result.set_game_count(games.size() + externalGames.size());
     if (complete) {
         QMapIterator<int, Server_Game *> gameIterator(games);
@@ -122,6 +129,49 @@ Server_Room::getInfo(ServerInfo_Room &result, bool complete, bool showGameTypes,
     return result;
 }
 
+bool Server_Room::getUserPage(::google::protobuf::RepeatedPtrField<ServerInfo_User> &result,
+                              const QString &after,
+                              int maxCount,
+                              bool includeExternalData) const
+{
+    usersLock.lockForRead();
+    auto user = users.upperBound(after);
+    auto externalUser = includeExternalData ? externalUsers.upperBound(after) : externalUsers.constEnd();
+    for (int i = 0; i < maxCount; ++i) {
+        // merge both maps so that the page is ordered by name
+        if (user != users.constEnd() && (externalUser == externalUsers.constEnd() || user.key() < externalUser.key()))
+            result.Add()->CopyFrom((user++).value()->copyUserInfo(false));
+        else if (externalUser != externalUsers.constEnd())
+            result.Add()->CopyFrom((externalUser++).value().copyUserInfo(false));
+        else
+            break;
+    }
+    const bool more = user != users.constEnd() || externalUser != externalUsers.constEnd();
+    usersLock.unlock();
+    return more;
+}
+
+bool Server_Room::getGamePage(::google::protobuf::RepeatedPtrField<ServerInfo_Game> &result,
+                              int after,
+                              int maxCount,
+                              bool includeExternalData) const
+{
+    gamesLock.lockForRead(SERVER_LOCK_SITE);
+    auto game = games.upperBound(after);
+    auto externalGame = includeExternalData ? externalGames.upperBound(after) : externalGames.constEnd();
+    for (int i = 0; i < maxCount; ++i) {
+        if (game != games.constEnd() && (externalGame == externalGames.constEnd() || game.key() < externalGame.key()))
+            (game++).value()->getInfo(*result.Add());
+        else if (externalGame != externalGames.constEnd())
+            result.Add()->CopyFrom((externalGame++).value());
+        else
+            break;
+    }
+    const bool more = game != games.constEnd() || externalGame != externalGames.constEnd();
+    gamesLock.unlock();
+    return more;
+}
+
 RoomEvent *Server_Room::prepareRoomEvent(const ::google::protobuf::Message &roomEvent)
 {
     RoomEvent *event = new RoomEvent;
@@ -132,11 +182,13 @@ RoomEvent *Server_Room::prepareRoomEvent(const ::google::protobuf::Message &room
     return event;
 }
 
-void Server_Room::addClient(Server_ProtocolHandler *client)
+void Server_Room::addClient(Server_ProtocolHandler *client, bool sendEvent)
 {
-    Event_JoinRoom event;
-    event.mutable_user_info()->CopyFrom(client->copyUserInfo(false));
-    sendRoomEvent(prepareRoomEvent(event));
+    if (sendEvent) {
+        Event_JoinRoom event;
+        event.mutable_user_info()->CopyFrom(client->copyUserInfo(false));
+        sendRoomEvent(prepareRoomEvent(event));
+    }
 
     ServerInfo_Room roomInfo;
     roomInfo.set_room_id(id);
@@ -147,7 +199,7 @@ void Server_Room::addClient(Server_ProtocolHandler *client)
     usersLock.unlock();
 
     // XXX This can be removed during the next client update.
-    gamesLock.lockForRead();
+    gamesLock.lockForRead(SERVER_LOCK_SITE);
     roomInfo.set_game_count(games.size() + externalGames.size());
     gamesLock.unlock();
     // -----------
@@ -155,7 +207,7 @@ void Server_Room::addClient(Server_ProtocolHandler *client)
     emit roomInfoChanged(roomInfo);
 }
 
-void Server_Room::removeClient(Server_ProtocolHandler *client)
+void Server_Room::removeClient(Server_ProtocolHandler *client, bool sendEvent)
 {
     usersLock.lockForWrite();
     users.remove(QString::fromStdString(client->getUserInfo()->name()));
@@ -165,12 +217,14 @@ void Server_Room::removeClient(Server_ProtocolHandler *client)
     roomInfo.set_player_count(users.size() + externalUsers.size());
     usersLock.unlock();
 
-    Event_LeaveRoom event;
-    event.set_name(client->getUserInfo()->name());
-    sendRoomEvent(prepareRoomEvent(event));
+    if (sendEvent) {
+        Event_LeaveRoom event;
+        event.set_name(client->getUserInfo()->name());
+        sendRoomEvent(prepareRoomEvent(event));
+    }
 
     // XXX This can be removed during the next client update.
-    gamesLock.lockForRead();
+    gamesLock.lockForRead(SERVER_LOCK_SITE);
     roomInfo.set_game_count(games.size() + externalGames.size());
     gamesLock.unlock();
     // -----------
@@ -222,7 +276,7 @@ void Server_Room::updateExternalGameList(const ServerInfo_Game &gameInfo)
     ServerInfo_Room roomInfo;
     roomInfo.set_room_id(id);
 
-    gamesLock.lockForWrite();
+    gamesLock.lockForWrite(SERVER_LOCK_SITE);
     if (!gameInfo.has_player_count() && externalGames.contains(gameInfo.game_id()))
         externalGames.remove(gameInfo.game_id());
     else
@@ -241,7 +295,10 @@ Response::ResponseCode Server_Room::processJoinGameCommand(const Command_JoinGam
     // This function is called from the Server thread and from the S_PH thread.
     // server->roomsMutex is always locked.
 
-    QReadLocker roomGamesLocker(&gamesLock);
+    if (getServer()->getGamesClosed())
+        return Response::RespFunctionNotAllowed;
+
+    Server_ReadLocker roomGamesLocker(&gamesLock, SERVER_LOCK_SITE);
     Server_Game *g = games.value(cmd.game_id());
     if (!g) {
         if (externalGames.contains(cmd.game_id())) {
@@ -259,7 +316,7 @@ Response::ResponseCode Server_Room::processJoinGameCommand(const Command_JoinGam
             return Response::RespNameNotFound;
     }
 
-    QMutexLocker gameLocker(&g->gameMutex);
+    Server_MutexLocker gameLocker(&g->gameMutex, SERVER_LOCK_SITE);
 
     Response::ResponseCode result = g->checkJoin(userInterface->getUserInfo(), QString::fromStdString(cmd.password()),
                                                  cmd.spectator(), cmd.override_restrictions());
@@ -276,21 +333,53 @@ void Server_Room::say(const QString &userName, const QString &s, bool sendToIsl)
     event.set_message(s.toStdString());
     sendRoomEvent(prepareRoomEvent(event), sendToIsl);
 
-    if (chatHistorySize != 0) {
-        ServerInfo_ChatMessage chatMessage;
-        QDateTime dateTime = dateTime.currentDateTimeUtc();
-        QString dateTimeString = dateTime.toString();
-        chatMessage.set_time(dateTimeString.toStdString());
-        chatMessage.set_sender_name(userName.toStdString());
-        chatMessage.set_message(s.simplified().toStdString());
+    if (chatHistorySize > 0) {
+        Event_RoomSay historyEvent;
+        historyEvent.set_message((userName + ": " + s.simplified()).toStdString());
+        historyEvent.set_message_type(Event_RoomSay::ChatHistory);
+        historyEvent.set_time_of(QDateTime::currentMSecsSinceEpoch());
+        std::string serializedEvent = historyEvent.SerializeAsString();
+
+        historyLock.lockForWrite(SERVER_LOCK_SITE);
+        if (chatHistory.size() < chatHistorySize) {
+            chatHistory.append(serializedEvent);
+        } else {
+            chatHistory[chatHistoryStart].swap(serializedEvent);
+            chatHistoryStart = (chatHistoryStart + 1) % chatHistory.size();
+        }
+        historyLock.unlock();
+    }
+}
 
-        historyLock.lockForWrite();
-        if (chatHistory.size() >= chatHistorySize)
-            chatHistory.removeAt(0);
+void Server_Room::getChatHistory(Event_RoomChatHistory &result) const
+{
+    historyLock.lockForRead(SERVER_LOCK_SITE);
+    result.mutable_messages()->Reserve(chatHistory.size());
+    for (int i = 0; i < chatHistory.size(); ++i)
+        result.add_messages()->ParseFromString(chatHistory[(chatHistoryStart + i) % chatHistory.size()]);
+    historyLock.unlock();
+}
 
-        chatHistory << chatMessage;
+// The extension is added as an unknown field, which is serialized as it is, so that joining a room only copies the
+// history instead of serializing it again.
+RoomEvent *Server_Room::prepareChatHistoryEvent() const
+{
+    std::string history;
+    {
+        google::protobuf::io::StringOutputStream stream(&history);
+        google::protobuf::io::CodedOutputStream output(&stream);
+        historyLock.lockForRead(SERVER_LOCK_SITE);
+        for (int i = 0; i < chatHistory.size(); ++i)
+            google::protobuf::internal::WireFormatLite::WriteBytes(
+                Event_RoomChatHistory::kMessagesFieldNumber, chatHistory[(chatHistoryStart + i) % chatHistory.size()],
+                &output);
         historyLock.unlock();
     }
+
+    RoomEvent *event = new RoomEvent;
+    event->set_room_id(id);
+    event->mutable_unknown_fields()->AddLengthDelimited(Event_RoomChatHistory::kExtFieldNumber, history);
+    return event;
 }
 
 void Server_Room::sendRoomEvent(RoomEvent *event, bool sendToIsl)
@@ -321,11 +410,12 @@ void Server_Room::addGame(Server_Game *game)
     ServerInfo_Room roomInfo;
     roomInfo.set_room_id(id);
 
-    gamesLock.lockForWrite();
+    gamesLock.lockForWrite(SERVER_LOCK_SITE);
     connect(game, SIGNAL(gameInfoChanged(ServerInfo_Game)), this, SLOT(broadcastGameListUpdate(ServerInfo_Game)));
 
-    game->gameMutex.lock();
+    game->gameMutex.lock(SERVER_LOCK_SITE);
     games.insert(game->getGameId(), game);
+    getServer()->incGamesCount();
     ServerInfo_Game gameInfo;
     game->getInfo(gameInfo);
     roomInfo.set_game_count(games.size() + externalGames.size());
@@ -353,7 +443,8 @@ void Server_Room::removeGame(Server_Game *game)
     game->getInfo(gameInfo);
     emit gameListChanged(gameInfo);
 
-    games.remove(game->getGameId());
+    if (games.remove(game->getGameId()))
+        getServer()->decGamesCount();
 
     ServerInfo_Room roomInfo;
     roomInfo.set_room_id(id);
@@ -370,7 +461,7 @@ void Server_Room::removeGame(Server_Game *game)
 
 int Server_Room::getGamesCreatedByUser(const QString &userName) const
 {
-    QReadLocker locker(&gamesLock);
+    Server_ReadLocker locker(&gamesLock, SERVER_LOCK_SITE);
 
     QMapIterator<int, Server_Game *> gamesIterator(games);
     int result = 0;
@@ -379,20 +470,3 @@ int Server_Room::getGamesCreatedByUser(const QString &userName) const
             ++result;
     return result;
 }
-
-QList<ServerInfo_Game> Server_Room::getGamesOfUser(const QString &userName) const
-{
-    QReadLocker locker(&gamesLock);
-
-    QList<ServerInfo_Game> result;
-    QMapIterator<int, Server_Game *> gamesIterator(games);
-    while (gamesIterator.hasNext()) {
-        Server_Game *game = gamesIterator.next().value();
-        if (game->containsUser(userName)) {
-            ServerInfo_Game gameInfo;
-            game->getInfo(gameInfo);
-            result.append(gameInfo);
-        }
-    }
-    return result;
-}
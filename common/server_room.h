@@ -2,7 +2,8 @@
 #define SERVER_ROOM_H
 
 #include "pb/response.pb.h"
-#include "pb/serverinfo_chat_message.pb.h"
+#include "pb/event_room_say.pb.h"
+#include "server_lock.h"
 #include "serverinfo_user_container.h"
 #include <QList>
 #include <QMap>
@@ -10,10 +11,12 @@
 #include <QObject>
 #include <QReadWriteLock>
 #include <QStringList>
+#include <QVector>
 
 class Server_DatabaseInterface;
 class Server_ProtocolHandler;
 class RoomEvent;
+class Event_RoomChatHistory;
 class ServerInfo_User;
 class ServerInfo_Room;
 class ServerInfo_Game;
@@ -45,14 +48,16 @@ private:
     QMap<int, ServerInfo_Game> externalGames;
     QMap<QString, Server_ProtocolHandler *> users;
     QMap<QString, ServerInfo_User_Container> externalUsers;
-    QList<ServerInfo_ChatMessage> chatHistory;
+    // the last chatHistorySize messages as serialized history events, a ring buffer starting at chatHistoryStart
+    QVector<std::string> chatHistory;
+    int chatHistoryStart;
 private slots:
     void broadcastGameListUpdate(const ServerInfo_Game &gameInfo, bool sendToIsl = true);
 
 public:
     mutable QReadWriteLock usersLock;
-    mutable QReadWriteLock gamesLock;
-    mutable QReadWriteLock historyLock;
+    mutable Server_ReadWriteLock gamesLock;
+    mutable Server_ReadWriteLock historyLock;
     Server_Room(int _id,
                 int _chatHistorySize,
                 const QString &_name,
@@ -109,14 +114,23 @@ public:
     const ServerInfo_Room &
     getInfo(ServerInfo_Room &result, bool complete, bool showGameTypes = false, bool includeExternalData = true) const;
     int getGamesCreatedByUser(const QString &name) const;
-    QList<ServerInfo_Game> getGamesOfUser(const QString &name) const;
-    QList<ServerInfo_ChatMessage> &getChatHistory()
-    {
-        return chatHistory;
-    }
+    void getChatHistory(Event_RoomChatHistory &result) const;
+    // An Event_RoomChatHistory made of the history events as they have been serialized when the messages were said.
+    RoomEvent *prepareChatHistoryEvent() const;
+    // These append up to maxCount users (games) that sort after the given name (id) and return whether there are
+    // more of them.
+    bool getUserPage(::google::protobuf::RepeatedPtrField<ServerInfo_User> &result,
+                     const QString &after,
+                     int maxCount,
+                     bool includeExternalData = true) const;
+    bool getGamePage(::google::protobuf::RepeatedPtrField<ServerInfo_Game> &result,
+                     int after,
+                     int maxCount,
+                     bool includeExternalData = true) const;
 
-    void addClient(Server_ProtocolHandler *client);
-    void removeClient(Server_ProtocolHandler *client);
+    // The other users of the room aren't told about clients that are handed over between server processes.
+    void addClient(Server_ProtocolHandler *client, bool sendEvent = true);
+    void removeClient(Server_ProtocolHandler *client, bool sendEvent = true);
 
     void addExternalUser(const ServerInfo_User &userInfo);
     void removeExternalUser(const QString &name);
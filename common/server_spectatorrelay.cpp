@@ -0,0 +1,188 @@
+#include "server_spectatorrelay.h"
+#include "pb/game_event_container.pb.h"
+#include "pb/session_event.pb.h"
+#include "server.h"
+#include "server_player.h"
+#include "server_remoteuserinterface.h"
+#include <QMutexLocker>
+#include <QThread>
+#include <QTimer>
+
+Server_SpectatorRelay::Server_SpectatorRelay(Server *_server, bool _groupIslSpectators)
+    : QObject(), server(_server), groupIslSpectators(_groupIslSpectators), flushScheduled(false)
+{
+    clock.start();
+
+    flushTimer = new QTimer(this);
+    flushTimer->setSingleShot(true);
+    connect(flushTimer, SIGNAL(timeout()), this, SLOT(flush()));
+
+    thread = new QThread;
+    moveToThread(thread);
+    connect(thread, SIGNAL(finished()), flushTimer, SLOT(stop()), Qt::DirectConnection);
+    thread->start();
+}
+
+Server_SpectatorRelay::~Server_SpectatorRelay()
+{
+    thread->quit();
+    thread->wait();
+    delete thread;
+}
+
+void Server_SpectatorRelay::addGame(int gameId, int delay)
+{
+    QMutexLocker locker(&queueMutex);
+    queues.insert(gameId, GameQueue{qMax(delay, 0), 0, 0, QList<Item>()});
+}
+
+void Server_SpectatorRelay::removeGame(int gameId)
+{
+    QMutexLocker spectatorsLocker(&spectatorsMutex);
+
+    queueMutex.lock();
+    const QList<Item> items = queues.take(gameId).items;
+    queueMutex.unlock();
+
+    const QMap<int, Spectator> gameSpectators = spectators.take(gameId);
+    for (const Item &item : items)
+        deliver(gameSpectators, item);
+}
+
+void Server_SpectatorRelay::addSpectator(int gameId, Server_Player *spectator)
+{
+    Spectator entry;
+    entry.player = spectator;
+    spectator->playerMutex.lock();
+    entry.remote = dynamic_cast<Server_RemoteUserInterface *>(spectator->getUserInterface()) != nullptr;
+    spectator->playerMutex.unlock();
+    entry.serverId = spectator->getUserInfo()->server_id();
+    entry.sessionId = static_cast<qint64>(spectator->getUserInfo()->session_id());
+
+    QMutexLocker spectatorsLocker(&spectatorsMutex);
+    {
+        QMutexLocker queueLocker(&queueMutex);
+        auto queue = queues.find(gameId);
+        if (queue == queues.end())
+            return;
+        entry.firstItemNumber = queue->nextItemNumber;
+        ++queue->spectatorCount;
+    }
+    spectators[gameId].insert(spectator->getPlayerId(), entry);
+}
+
+void Server_SpectatorRelay::removeSpectator(int gameId, int playerId)
+{
+    QMutexLocker spectatorsLocker(&spectatorsMutex);
+    auto gameSpectators = spectators.find(gameId);
+    if (gameSpectators == spectators.end() || !gameSpectators->remove(playerId))
+        return;
+
+    QMutexLocker queueLocker(&queueMutex);
+    auto queue = queues.find(gameId);
+    if (queue != queues.end())
+        --queue->spectatorCount;
+}
+
+void Server_SpectatorRelay::sendGameEvent(int gameId, const GameEventContainer &cont, int excludedPlayerId)
+{
+    Item item;
+    item.playerId = -1;
+    item.excludedPlayerId = excludedPlayerId;
+    item.type = ServerMessage::GAME_EVENT_CONTAINER;
+    item.message = QSharedPointer<::google::protobuf::Message>(new GameEventContainer(cont));
+    enqueue(gameId, item);
+}
+
+void Server_SpectatorRelay::sendToSpectator(int gameId,
+                                            int playerId,
+                                            ServerMessage::MessageType type,
+                                            ::google::protobuf::Message *message)
+{
+    Item item;
+    item.playerId = playerId;
+    item.excludedPlayerId = -1;
+    item.type = type;
+    item.message = QSharedPointer<::google::protobuf::Message>(message);
+    enqueue(gameId, item);
+}
+
+void Server_SpectatorRelay::enqueue(int gameId, Item &item)
+{
+    QMutexLocker locker(&queueMutex);
+    auto queue = queues.find(gameId);
+    // an event nobody would receive isn't worth a copy; items for a single spectator are queued after it was added
+    if (queue == queues.end() || queue->spectatorCount == 0)
+        return;
+
+    item.dueTime = clock.elapsed() + queue->delay;
+    item.number = queue->nextItemNumber++;
+    queue->items.append(item);
+
+    if (!flushScheduled) {
+        flushScheduled = true;
+        QMetaObject::invokeMethod(this, "flush", Qt::QueuedConnection);
+    }
+}
+
+void Server_SpectatorRelay::flush()
+{
+    QMutexLocker spectatorsLocker(&spectatorsMutex);
+
+    // the due items are taken out of the queues first, so that the games can keep queueing while they are sent
+    QList<QPair<int, QList<Item>>> dueItems;
+    qint64 nextDueTime = -1;
+    queueMutex.lock();
+    flushScheduled = false;
+    const qint64 now = clock.elapsed();
+    for (auto queue = queues.begin(); queue != queues.end(); ++queue) {
+        QList<Item> &items = queue->items;
+        int dueCount = 0;
+        while (dueCount < items.size() && items[dueCount].dueTime <= now)
+            ++dueCount;
+        if (dueCount > 0) {
+            dueItems.append(qMakePair(queue.key(), items.mid(0, dueCount)));
+            items.erase(items.begin(), items.begin() + dueCount);
+        }
+        if (!items.isEmpty() && (nextDueTime == -1 || items.first().dueTime < nextDueTime))
+            nextDueTime = items.first().dueTime;
+    }
+    queueMutex.unlock();
+
+    for (const auto &gameItems : dueItems) {
+        const QMap<int, Spectator> gameSpectators = spectators.value(gameItems.first);
+        for (const Item &item : gameItems.second)
+            deliver(gameSpectators, item);
+    }
+
+    if (nextDueTime != -1)
+        flushTimer->start(static_cast<int>(qMax(nextDueTime - clock.elapsed(), qint64(0))));
+}
+
+void Server_SpectatorRelay::deliver(const QMap<int, Spectator> &gameSpectators, const Item &item)
+{
+    if (item.playerId != -1) {
+        auto spectator = gameSpectators.find(item.playerId);
+        if (spectator == gameSpectators.end() || item.number < spectator->firstItemNumber)
+            return;
+        if (item.type == ServerMessage::SESSION_EVENT)
+            spectator->player->sendSessionEvent(static_cast<const SessionEvent &>(*item.message));
+        else
+            spectator->player->sendGameEvent(static_cast<const GameEventContainer &>(*item.message));
+        return;
+    }
+
+    const GameEventContainer &cont = static_cast<const GameEventContainer &>(*item.message);
+    QMap<int, QList<qint64>> islSessions;
+    for (const Spectator &spectator : gameSpectators) {
+        if (spectator.player->getPlayerId() == item.excludedPlayerId || item.number < spectator.firstItemNumber)
+            continue;
+        if (groupIslSpectators && spectator.remote)
+            islSessions[spectator.serverId].append(spectator.sessionId);
+        else
+            spectator.player->sendGameEvent(cont);
+    }
+
+    for (auto sessions = islSessions.constBegin(); sessions != islSessions.constEnd(); ++sessions)
+        server->sendIsl_GameEventContainer(cont, sessions.key(), sessions.value());
+}
@@ -0,0 +1,97 @@
+#ifndef SERVER_SPECTATORRELAY_H
+#define SERVER_SPECTATORRELAY_H
+
+#include "pb/server_message.pb.h"
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QMap>
+#include <QMutex>
+#include <QObject>
+#include <QSharedPointer>
+
+class GameEventContainer;
+class Server;
+class Server_Player;
+class QThread;
+class QTimer;
+
+/*
+ * Sends the game events to the spectators of all games on a thread of its own, so that the players of a game with
+ * many spectators don't have to wait for every event to be sent to all of them while the game mutex is held.
+ *
+ * The game queues one copy of every event the spectators see; the relay thread sends it to each of them. Events
+ * can be held back for a fixed delay per game, to keep spectators from passing information to a player. Spectators
+ * on another server can be served with a single message per event and server over the ISL link, which the other
+ * server then hands out to its sessions.
+ *
+ * Locking: the queues are guarded by queueMutex, which is only held briefly, so queueing an event never waits for
+ * events being sent. The spectators are guarded by spectatorsMutex, which is held while sending; a spectator that
+ * has been removed therefore doesn't receive anything anymore once removeSpectator() returned.
+ */
+class Server_SpectatorRelay : public QObject
+{
+    Q_OBJECT
+private:
+    struct Item
+    {
+        qint64 dueTime;
+        quint64 number;
+        // -1 for items sent to all spectators
+        int playerId;
+        int excludedPlayerId;
+        ServerMessage::MessageType type;
+        QSharedPointer<::google::protobuf::Message> message;
+    };
+    struct GameQueue
+    {
+        int delay;
+        int spectatorCount;
+        quint64 nextItemNumber;
+        QList<Item> items;
+    };
+    struct Spectator
+    {
+        Server_Player *player;
+        // items queued before the spectator joined are part of the game state it got
+        quint64 firstItemNumber;
+        bool remote;
+        int serverId;
+        qint64 sessionId;
+    };
+
+    Server *server;
+    bool groupIslSpectators;
+    QThread *thread;
+    QTimer *flushTimer;
+    QElapsedTimer clock;
+
+    QMutex queueMutex;
+    QHash<int, GameQueue> queues;
+    bool flushScheduled;
+
+    QMutex spectatorsMutex;
+    QHash<int, QMap<int, Spectator>> spectators;
+
+    void enqueue(int gameId, Item &item);
+    void deliver(const QMap<int, Spectator> &gameSpectators, const Item &item);
+private slots:
+    void flush();
+
+public:
+    Server_SpectatorRelay(Server *_server, bool _groupIslSpectators);
+    ~Server_SpectatorRelay();
+
+    // delay in milliseconds
+    void addGame(int gameId, int delay);
+    // sends what is still queued for the game right away and forgets the game
+    void removeGame(int gameId);
+    void addSpectator(int gameId, Server_Player *spectator);
+    void removeSpectator(int gameId, int playerId);
+
+    void sendGameEvent(int gameId, const GameEventContainer &cont, int excludedPlayerId);
+    // sends an item to a single spectator, in order with the game events; takes the ownership of the item
+    void sendToSpectator(int gameId, int playerId, ServerMessage::MessageType type, ::google::protobuf::Message *item);
+};
+
+#endif
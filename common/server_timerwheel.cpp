@@ -0,0 +1,171 @@
+#include "server_timerwheel.h"
+#include <QThread>
+#include <QTimer>
+
+Server_TimerWheel::Server_TimerWheel(int tickInterval, QObject *parent)
+    : QObject(parent), currentTick(0), dispatchingListener(nullptr)
+{
+    for (int i = 0; i < levelCount; ++i)
+        wheelSlots[i].resize(slotCount);
+
+    tickTimer = new QTimer(this);
+    connect(tickTimer, SIGNAL(timeout()), this, SLOT(tick()));
+    tickTimer->start(tickInterval);
+}
+
+Server_TimerWheel::~Server_TimerWheel()
+{
+    QHashIterator<Server_TimerWheelListener *, QHash<int, Entry *>> listenerIterator(entries);
+    while (listenerIterator.hasNext())
+        qDeleteAll(listenerIterator.next().value());
+}
+
+int Server_TimerWheel::getPendingCount() const
+{
+    QMutexLocker locker(&wheelMutex);
+
+    int result = 0;
+    QHashIterator<Server_TimerWheelListener *, QHash<int, Entry *>> listenerIterator(entries);
+    while (listenerIterator.hasNext())
+        result += listenerIterator.next().value().size();
+    return result;
+}
+
+void Server_TimerWheel::insertEntry(Entry *entry)
+{
+    const int ticksLeft = entry->expiry - currentTick.load();
+
+    int level = 0;
+    while ((level < levelCount - 1) && (ticksLeft >= (1 << (slotBits * (level + 1)))))
+        ++level;
+
+    entry->level = level;
+    entry->slot = (entry->expiry >> (slotBits * level)) & slotMask;
+    wheelSlots[level][entry->slot].insert(entry);
+}
+
+void Server_TimerWheel::removeEntry(Entry *entry)
+{
+    // Entries that are about to be dispatched have already been taken out of their slot.
+    if (entry->level != -1)
+        wheelSlots[entry->level][entry->slot].remove(entry);
+    entry->level = -1;
+}
+
+void Server_TimerWheel::cascade(int level)
+{
+    QSet<Entry *> &slotEntries = wheelSlots[level][(currentTick.load() >> (slotBits * level)) & slotMask];
+    const QSet<Entry *> movedEntries = slotEntries;
+    slotEntries.clear();
+
+    QSetIterator<Entry *> entryIterator(movedEntries);
+    while (entryIterator.hasNext())
+        insertEntry(entryIterator.next());
+}
+
+void Server_TimerWheel::schedule(Server_TimerWheelListener *listener, int timerType, int ticks)
+{
+    const int maxTicks = (1 << (slotBits * levelCount)) - 1;
+    if (ticks < 1)
+        ticks = 1;
+    else if (ticks > maxTicks)
+        ticks = maxTicks;
+
+    QMutexLocker locker(&wheelMutex);
+
+    Entry *entry = entries[listener].value(timerType);
+    if (entry)
+        removeEntry(entry);
+    else {
+        entry = new Entry;
+        entry->listener = listener;
+        entry->timerType = timerType;
+        entries[listener].insert(timerType, entry);
+    }
+    entry->expiry = currentTick.load() + ticks;
+    insertEntry(entry);
+}
+
+void Server_TimerWheel::cancel(Server_TimerWheelListener *listener, int timerType)
+{
+    QMutexLocker locker(&wheelMutex);
+
+    QHash<Server_TimerWheelListener *, QHash<int, Entry *>>::iterator listenerIterator = entries.find(listener);
+    if (listenerIterator == entries.end())
+        return;
+
+    Entry *entry = listenerIterator.value().take(timerType);
+    if (!entry)
+        return;
+    removeEntry(entry);
+    delete entry;
+
+    if (listenerIterator.value().isEmpty())
+        entries.erase(listenerIterator);
+}
+
+void Server_TimerWheel::cancelAll(Server_TimerWheelListener *listener)
+{
+    QMutexLocker locker(&wheelMutex);
+
+    const QHash<int, Entry *> listenerEntries = entries.take(listener);
+    QHashIterator<int, Entry *> entryIterator(listenerEntries);
+    while (entryIterator.hasNext()) {
+        Entry *entry = entryIterator.next().value();
+        removeEntry(entry);
+        delete entry;
+    }
+
+    // A listener that is destroyed from another thread must not go away while it is being dispatched.
+    if (QThread::currentThread() != thread())
+        while (dispatchingListener == listener)
+            dispatchFinished.wait(&wheelMutex);
+}
+
+void Server_TimerWheel::tick()
+{
+    QMutexLocker locker(&wheelMutex);
+
+    const int tick = currentTick.fetchAndAddOrdered(1) + 1;
+
+    // When a level wraps around, the next slot of each coarser level is spread out over the finer levels.
+    int wrappedLevels = 0;
+    while ((wrappedLevels < levelCount - 1) && !(tick & ((1 << (slotBits * (wrappedLevels + 1))) - 1)))
+        ++wrappedLevels;
+    for (int level = wrappedLevels; level > 0; --level)
+        cascade(level);
+
+    QSet<Entry *> &dueSlot = wheelSlots[0][tick & slotMask];
+    QList<Entry> dueEntries;
+    QSetIterator<Entry *> dueIterator(dueSlot);
+    while (dueIterator.hasNext()) {
+        Entry *entry = dueIterator.next();
+        entry->level = -1;
+        dueEntries.append(*entry);
+    }
+    dueSlot.clear();
+
+    for (int i = 0; i < dueEntries.size(); ++i) {
+        const Entry &due = dueEntries[i];
+
+        // The entry may have been cancelled or rescheduled by a listener dispatched earlier in this tick.
+        QHash<Server_TimerWheelListener *, QHash<int, Entry *>>::iterator listenerIterator =
+            entries.find(due.listener);
+        if (listenerIterator == entries.end())
+            continue;
+        Entry *entry = listenerIterator.value().value(due.timerType);
+        if (!entry || (entry->expiry != due.expiry) || (entry->level != -1))
+            continue;
+        listenerIterator.value().remove(due.timerType);
+        if (listenerIterator.value().isEmpty())
+            entries.erase(listenerIterator);
+        delete entry;
+
+        dispatchingListener = due.listener;
+        locker.unlock();
+        due.listener->timerWheelTimeout(due.timerType);
+        locker.relock();
+        dispatchingListener = nullptr;
+        dispatchFinished.wakeAll();
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef SERVER_TIMERWHEEL_H
+#define SERVER_TIMERWHEEL_H
+
+#include <QAtomicInt>
+#include <QHash>
+#include <QMutex>
+#include <QObject>
+#include <QSet>
+#include <QVector>
+#include <QWaitCondition>
+
+class QTimer;
+
+class Server_TimerWheelListener
+{
+public:
+    virtual ~Server_TimerWheelListener()
+    {
+    }
+    virtual void timerWheelTimeout(int timerType) = 0;
+};
+
+/*
+ * Hierarchical timer wheel, one instance per thread (see Server::getTimerWheel()).
+ *
+ * A single QTimer drives the wheel; every tick only the entries that are due are
+ * dispatched. Each listener can have at most one pending deadline per timer type,
+ * rescheduling an existing type replaces the old deadline.
+ *
+ * Listeners are called in the thread the wheel lives in and without any wheel lock
+ * held, so they may schedule or cancel timers from inside timerWheelTimeout().
+ */
+class Server_TimerWheel : public QObject
+{
+    Q_OBJECT
+private:
+    static const int slotBits = 6;
+    static const int slotCount = 1 << slotBits;
+    static const int slotMask = slotCount - 1;
+    static const int levelCount = 4;
+
+    struct Entry
+    {
+        Server_TimerWheelListener *listener;
+        int timerType;
+        int expiry;
+        int level, slot;
+    };
+
+    QTimer *tickTimer;
+    QAtomicInt currentTick;
+    mutable QMutex wheelMutex;
+    QWaitCondition dispatchFinished;
+    Server_TimerWheelListener *dispatchingListener;
+    QHash<Server_TimerWheelListener *, QHash<int, Entry *>> entries;
+    QVector<QSet<Entry *>> wheelSlots[levelCount];
+
+    void insertEntry(Entry *entry);
+    void removeEntry(Entry *entry);
+    void cascade(int level);
+private slots:
+    void tick();
+
+public:
+    Server_TimerWheel(int tickInterval = 1000, QObject *parent = nullptr);
+    ~Server_TimerWheel();
+
+    int getCurrentTick() const
+    {
+        return currentTick.load();
+    }
+    int getPendingCount() const;
+    void schedule(Server_TimerWheelListener *listener, int timerType, int ticks);
+    void cancel(Server_TimerWheelListener *listener, int timerType);
+    void cancelAll(Server_TimerWheelListener *listener);
+};
+
+#endif
@@ -0,0 +1,306 @@
+#include "server_trafficrecorder.h"
+#include "get_pb_extension.h"
+#include "pb/commands.pb.h"
+#include "pb/event_draw_cards.pb.h"
+#include "pb/event_game_joined.pb.h"
+#include "pb/event_move_card.pb.h"
+#include "pb/game_event.pb.h"
+#include "pb/game_event_container.pb.h"
+#include "pb/server_message.pb.h"
+#include "pb/serverinfo_game.pb.h"
+#include "pb/session_event.pb.h"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QMutexLocker>
+#include <QUuid>
+#include <QtEndian>
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/message.h>
+
+const char Server_TrafficRecorder::fileMagic[4] = {'C', 'T', 'R', 'F'};
+
+static const int headerSize = 4 + 1 + 8;
+
+Server_TrafficRecorder::Server_TrafficRecorder() : anonymize(true), nextSessionNumber(0)
+{
+}
+
+void Server_TrafficRecorder::setup(const QString &_directory, bool _anonymize)
+{
+    directory = _directory;
+    anonymize = _anonymize;
+    // a new salt for every run, so the pseudonyms can't be matched across recordings
+    salt = QUuid::createUuid().toRfc4122();
+
+    if (!directory.isEmpty() && !QDir().mkpath(directory)) {
+        qDebug() << "Traffic recorder: could not create" << directory << "- recording disabled";
+        directory.clear();
+    }
+}
+
+QString Server_TrafficRecorder::getNextFileName()
+{
+    return QString("%1/%2-%3.ctrf")
+        .arg(directory)
+        .arg(QDateTime::currentDateTimeUtc().toString("yyyyMMdd-hhmmss"))
+        .arg(nextSessionNumber.fetchAndAddRelaxed(1));
+}
+
+std::string Server_TrafficRecorder::pseudonym(const std::string &name) const
+{
+    if (name.empty())
+        return name;
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(salt);
+    hash.addData(name.data(), static_cast<int>(name.size()));
+    return "u" + hash.result().toHex().left(12).toStdString();
+}
+
+enum AnonymizeAction
+{
+    KeepField,
+    PseudonymizeField,
+    ClearField,
+    MaskField
+};
+
+static AnonymizeAction anonymizeAction(const std::string &fieldName)
+{
+    if (fieldName == "user_name" || fieldName == "mod_name" || fieldName == "clientid" ||
+        fieldName == "user_clientid")
+        return PseudonymizeField;
+    if (fieldName.find("password") != std::string::npos || fieldName == "token" || fieldName == "email" ||
+        fieldName == "real_name" || fieldName == "country" || fieldName == "address" || fieldName == "ip_address")
+        return ClearField;
+    if (fieldName == "message" || fieldName == "description" || fieldName == "reason" ||
+        fieldName == "visible_reason" || fieldName == "annotation" || fieldName == "image")
+        return MaskField;
+    return KeepField;
+}
+
+// Walks all set fields, including extensions, so new commands are covered without changes here.
+void Server_TrafficRecorder::anonymizeMessage(::google::protobuf::Message &message) const
+{
+    const ::google::protobuf::Reflection *reflection = message.GetReflection();
+    std::vector<const ::google::protobuf::FieldDescriptor *> fields;
+    reflection->ListFields(message, &fields);
+
+    for (const ::google::protobuf::FieldDescriptor *field : fields) {
+        if (field->cpp_type() == ::google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE) {
+            if (field->is_repeated()) {
+                for (int i = 0; i < reflection->FieldSize(message, field); ++i)
+                    anonymizeMessage(*reflection->MutableRepeatedMessage(&message, field, i));
+            } else
+                anonymizeMessage(*reflection->MutableMessage(&message, field));
+            continue;
+        }
+        if (field->cpp_type() != ::google::protobuf::FieldDescriptor::CPPTYPE_STRING)
+            continue;
+
+        const AnonymizeAction action = anonymizeAction(field->name());
+        if (action == KeepField)
+            continue;
+        if (action == ClearField) {
+            reflection->ClearField(&message, field);
+            continue;
+        }
+
+        const int count = field->is_repeated() ? reflection->FieldSize(message, field) : 1;
+        for (int i = 0; i < count; ++i) {
+            std::string value = field->is_repeated() ? reflection->GetRepeatedString(message, field, i)
+                                                     : reflection->GetString(message, field);
+            if (action == PseudonymizeField)
+                value = pseudonym(value);
+            else
+                value.assign(value.size(), 'x');
+
+            if (field->is_repeated())
+                reflection->SetRepeatedString(&message, field, i, value);
+            else
+                reflection->SetString(&message, field, value);
+        }
+    }
+}
+
+Server_SessionRecording::Server_SessionRecording(Server_TrafficRecorder *_recorder)
+    : recorder(_recorder), failed(false), startTime(QDateTime::currentMSecsSinceEpoch()), lastRecordTime(0)
+{
+    clock.start();
+}
+
+Server_SessionRecording::~Server_SessionRecording()
+{
+    if (file.isOpen())
+        file.close();
+}
+
+static void appendVarint(std::string &buffer, quint64 value)
+{
+    while (value >= 0x80) {
+        buffer += static_cast<char>((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    buffer += static_cast<char>(value);
+}
+
+// Must be called with the mutex locked.
+void Server_SessionRecording::writeRecord(Server_TrafficRecorder::RecordType type, const std::string &payload)
+{
+    if (failed)
+        return;
+
+    if (!file.isOpen()) {
+        file.setFileName(recorder->getNextFileName());
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+            qDebug() << "Traffic recorder: could not open" << file.fileName();
+            failed = true;
+            return;
+        }
+        char header[headerSize];
+        memcpy(header, Server_TrafficRecorder::fileMagic, 4);
+        header[4] = Server_TrafficRecorder::fileVersion;
+        qToBigEndian<qint64>(startTime, reinterpret_cast<uchar *>(header + 5));
+        file.write(header, headerSize);
+    }
+
+    const qint64 now = clock.nsecsElapsed() / 1000;
+    std::string record;
+    record.reserve(payload.size() + 11);
+    record += static_cast<char>(type);
+    appendVarint(record, static_cast<quint64>(qMax(now - lastRecordTime, Q_INT64_C(0))));
+    appendVarint(record, payload.size());
+    record += payload;
+    lastRecordTime = now;
+
+    if (file.write(record.data(), static_cast<qint64>(record.size())) != static_cast<qint64>(record.size())) {
+        qDebug() << "Traffic recorder: could not write" << file.fileName();
+        failed = true;
+    }
+}
+
+void Server_SessionRecording::recordCommandContainer(const CommandContainer &cont)
+{
+    std::string payload;
+    if (recorder->getAnonymize()) {
+        CommandContainer anonymized(cont);
+        recorder->anonymizeMessage(anonymized);
+        anonymized.SerializeToString(&payload);
+    } else
+        cont.SerializeToString(&payload);
+
+    QMutexLocker locker(&mutex);
+    writeRecord(Server_TrafficRecorder::CommandRecord, payload);
+}
+
+// Only the ids are kept; the game info would contain names and descriptions.
+void Server_SessionRecording::recordSessionEvent(const SessionEvent &event)
+{
+    if (!event.HasExtension(Event_GameJoined::ext))
+        return;
+    const Event_GameJoined &gameJoined = event.GetExtension(Event_GameJoined::ext);
+
+    ServerMessage message;
+    message.set_message_type(ServerMessage::SESSION_EVENT);
+    Event_GameJoined *reduced = message.mutable_session_event()->MutableExtension(Event_GameJoined::ext);
+    reduced->mutable_game_info()->set_game_id(gameJoined.game_info().game_id());
+    reduced->set_player_id(gameJoined.player_id());
+    reduced->set_spectator(gameJoined.spectator());
+
+    std::string payload;
+    message.SerializeToString(&payload);
+    QMutexLocker locker(&mutex);
+    writeRecord(Server_TrafficRecorder::ServerMessageRecord, payload);
+}
+
+// Keeps the events that tell the player the ids of its own cards, e.g. the ones it drew.
+void Server_SessionRecording::recordGameEventContainer(const GameEventContainer &cont, int playerId)
+{
+    ServerMessage message;
+    GameEventContainer *reduced = nullptr;
+    for (int i = 0; i < cont.event_list_size(); ++i) {
+        const GameEvent &event = cont.event_list(i);
+        if (event.player_id() != playerId)
+            continue;
+
+        const int eventType = getPbExtension(event);
+        if (eventType == GameEvent::DRAW_CARDS) {
+            if (!event.GetExtension(Event_DrawCards::ext).cards_size())
+                continue;
+        } else if (eventType == GameEvent::MOVE_CARD) {
+            if (event.GetExtension(Event_MoveCard::ext).new_card_id() < 0)
+                continue;
+        } else
+            continue;
+
+        if (!reduced) {
+            message.set_message_type(ServerMessage::GAME_EVENT_CONTAINER);
+            reduced = message.mutable_game_event_container();
+            reduced->set_game_id(cont.game_id());
+        }
+        reduced->add_event_list()->CopyFrom(event);
+    }
+    if (!reduced)
+        return;
+
+    std::string payload;
+    message.SerializeToString(&payload);
+    QMutexLocker locker(&mutex);
+    writeRecord(Server_TrafficRecorder::ServerMessageRecord, payload);
+}
+
+Server_TrafficRecordReader::Server_TrafficRecordReader() : position(0), sessionStart(0), recordTime(0)
+{
+}
+
+bool Server_TrafficRecordReader::open(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    data = file.readAll();
+    if ((data.size() < headerSize) || memcmp(data.constData(), Server_TrafficRecorder::fileMagic, 4) ||
+        (data[4] != Server_TrafficRecorder::fileVersion))
+        return false;
+
+    sessionStart = qFromBigEndian<qint64>(reinterpret_cast<const uchar *>(data.constData() + 5));
+    position = headerSize;
+    recordTime = 0;
+    return true;
+}
+
+bool Server_TrafficRecordReader::readVarint(quint64 &value)
+{
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (position >= data.size())
+            return false;
+        const quint8 byte = static_cast<quint8>(data[position++]);
+        value |= static_cast<quint64>(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+bool Server_TrafficRecordReader::readRecord(Server_TrafficRecorder::RecordType &type,
+                                           qint64 &usecs,
+                                           QByteArray &payload)
+{
+    if (atEnd())
+        return false;
+    type = static_cast<Server_TrafficRecorder::RecordType>(data[position++]);
+
+    quint64 delta, size;
+    // a record cut short by a crash ends the recording
+    if (!readVarint(delta) || !readVarint(size) || (size > static_cast<quint64>(data.size() - position))) {
+        position = data.size();
+        return false;
+    }
+    recordTime += static_cast<qint64>(delta);
+    usecs = recordTime;
+    payload = data.mid(position, static_cast<int>(size));
+    position += static_cast<int>(size);
+    return true;
+}
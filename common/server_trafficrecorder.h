@@ -0,0 +1,123 @@
+#ifndef SERVER_TRAFFICRECORDER_H
+#define SERVER_TRAFFICRECORDER_H
+
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMutex>
+#include <QString>
+#include <string>
+
+class CommandContainer;
+class GameEventContainer;
+class SessionEvent;
+namespace google
+{
+namespace protobuf
+{
+class Message;
+}
+} // namespace google
+
+/*
+ * Opt-in recording of the commands every session sends, so that real traffic can be replayed against a test server.
+ *
+ * Every session is written to its own append-only file:
+ *   header:  "CTRF", format version (1 byte), session start in milliseconds since the epoch (8 bytes, big endian)
+ *   records: record type (1 byte), microseconds since the previous record (varint), payload size (varint), payload
+ *
+ * The payload of a command record is the serialized CommandContainer. Game and card ids differ when the traffic is
+ * replayed, so the game joins of the session and the card ids its own commands revealed from hidden zones are
+ * recorded as well, as reduced ServerMessages; the replayer matches them against what the live server sends.
+ *
+ * With anonymization, user names and client ids are replaced by salted hashes (consistent within one server run),
+ * passwords and personal data are dropped and free text is replaced by placeholders of the same length.
+ */
+class Server_TrafficRecorder
+{
+public:
+    enum RecordType
+    {
+        CommandRecord = 1,
+        ServerMessageRecord = 2
+    };
+    static const char fileMagic[4];
+    static const int fileVersion = 1;
+
+    Server_TrafficRecorder();
+
+    void setup(const QString &_directory, bool _anonymize);
+    bool isEnabled() const
+    {
+        return !directory.isEmpty();
+    }
+    bool getAnonymize() const
+    {
+        return anonymize;
+    }
+    QString getNextFileName();
+
+    void anonymizeMessage(::google::protobuf::Message &message) const;
+    std::string pseudonym(const std::string &name) const;
+
+private:
+    QString directory;
+    bool anonymize;
+    QByteArray salt;
+    QAtomicInt nextSessionNumber;
+};
+
+/*
+ * The recording of one session. Commands are recorded from the session's thread, the server messages from whichever
+ * thread sends them, hence the mutex. The file is only created when the first record is written.
+ */
+class Server_SessionRecording
+{
+public:
+    explicit Server_SessionRecording(Server_TrafficRecorder *_recorder);
+    ~Server_SessionRecording();
+
+    void recordCommandContainer(const CommandContainer &cont);
+    void recordSessionEvent(const SessionEvent &event);
+    void recordGameEventContainer(const GameEventContainer &cont, int playerId);
+
+private:
+    Server_TrafficRecorder *recorder;
+    QMutex mutex;
+    QFile file;
+    bool failed;
+    qint64 startTime;
+    QElapsedTimer clock;
+    qint64 lastRecordTime;
+
+    void writeRecord(Server_TrafficRecorder::RecordType type, const std::string &payload);
+};
+
+class Server_TrafficRecordReader
+{
+public:
+    Server_TrafficRecordReader();
+
+    bool open(const QString &fileName);
+    qint64 getSessionStart() const
+    {
+        return sessionStart;
+    }
+    bool atEnd() const
+    {
+        return position >= data.size();
+    }
+    // Reads the next record; usecs is the time since the session started. Returns false at the end or on errors.
+    bool readRecord(Server_TrafficRecorder::RecordType &type, qint64 &usecs, QByteArray &payload);
+
+private:
+    QByteArray data;
+    int position;
+    qint64 sessionStart;
+    qint64 recordTime;
+
+    bool readVarint(quint64 &value);
+};
+
+#endif
@@ -0,0 +1,68 @@
+#include "server_userdirectory.h"
+#include <QMap>
+#include <random>
+
+Server_UserDirectory::Server_UserDirectory(int _historySize) : id(0), version(0), historySize(qMax(_historySize, 0))
+{
+    // 0 is the "no directory known" value of the protocol
+    std::random_device seed;
+    std::mt19937_64 generator((static_cast<quint64>(seed()) << 32) | seed());
+    while (id == 0)
+        id = generator();
+}
+
+void Server_UserDirectory::setHistorySize(int _historySize)
+{
+    historySize = qMax(_historySize, 0);
+    while (changes.size() > historySize)
+        changes.removeFirst();
+}
+
+quint64 Server_UserDirectory::addChange(const QString &name, bool joined, const ServerInfo_User &userInfo)
+{
+    ++version;
+    if (historySize == 0)
+        return version;
+
+    if (changes.size() >= historySize)
+        changes.removeFirst();
+    changes.append(Change{version, name, joined, userInfo});
+    return version;
+}
+
+quint64 Server_UserDirectory::userJoined(const ServerInfo_User &userInfo)
+{
+    return addChange(QString::fromStdString(userInfo.name()), true, userInfo);
+}
+
+quint64 Server_UserDirectory::userLeft(const QString &userName)
+{
+    return addChange(userName, false, ServerInfo_User());
+}
+
+bool Server_UserDirectory::getChanges(quint64 sinceVersion,
+                                      google::protobuf::RepeatedPtrField<ServerInfo_User> &joinedUsers,
+                                      google::protobuf::RepeatedPtrField<std::string> &leftUsers) const
+{
+    if (sinceVersion > version)
+        return false;
+    if (sinceVersion == version)
+        return true;
+
+    // versions are consecutive, so the first change to send can be found by its offset
+    const quint64 firstVersion = version - static_cast<quint64>(changes.size()) + 1;
+    if (changes.isEmpty() || sinceVersion + 1 < firstVersion)
+        return false;
+
+    QMap<QString, const Change *> lastChanges;
+    for (int i = static_cast<int>(sinceVersion + 1 - firstVersion); i < changes.size(); ++i)
+        lastChanges.insert(changes[i].name, &changes[i]);
+
+    for (const Change *change : lastChanges) {
+        if (change->joined)
+            joinedUsers.Add()->CopyFrom(change->userInfo);
+        else
+            leftUsers.Add()->assign(change->name.toStdString());
+    }
+    return true;
+}
@@ -0,0 +1,60 @@
+#ifndef SERVER_USERDIRECTORY_H
+#define SERVER_USERDIRECTORY_H
+
+#include "pb/serverinfo_user.pb.h"
+#include <QList>
+#include <QString>
+#include <google/protobuf/repeated_field.h>
+#include <string>
+
+/*
+ * Versioned log of the users joining and leaving the server, so that a client which reconnects can ask for the
+ * changes since the user list it already has instead of downloading the whole list again.
+ *
+ * Every change increments the version by one. The directory id is chosen randomly at startup; a client that knows
+ * a version of a different id (e.g. from before a server restart) always gets a full list. Only the last
+ * historySize changes are kept, older versions fall back to a full list as well.
+ *
+ * The directory is not locked itself, it is guarded by Server::clientsLock: changes are recorded with the write
+ * lock held, together with the broadcast of the matching Event_UserJoined / Event_UserLeft.
+ */
+class Server_UserDirectory
+{
+private:
+    struct Change
+    {
+        quint64 version;
+        QString name;
+        bool joined;
+        ServerInfo_User userInfo;
+    };
+    quint64 id, version;
+    int historySize;
+    QList<Change> changes;
+
+    quint64 addChange(const QString &name, bool joined, const ServerInfo_User &userInfo);
+
+public:
+    explicit Server_UserDirectory(int _historySize = 10000);
+
+    quint64 getId() const
+    {
+        return id;
+    }
+    quint64 getVersion() const
+    {
+        return version;
+    }
+    void setHistorySize(int _historySize);
+
+    quint64 userJoined(const ServerInfo_User &userInfo);
+    quint64 userLeft(const QString &userName);
+
+    // Collapses the changes after sinceVersion to the last state of every affected user. Returns false if
+    // sinceVersion is no longer (or not yet) covered by the history, in which case a full list is needed.
+    bool getChanges(quint64 sinceVersion,
+                    google::protobuf::RepeatedPtrField<ServerInfo_User> &joinedUsers,
+                    google::protobuf::RepeatedPtrField<std::string> &leftUsers) const;
+};
+
+#endif
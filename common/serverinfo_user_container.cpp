@@ -44,8 +44,10 @@ ServerInfo_User &ServerInfo_User_Container::copyUserInfo(ServerInfo_User &result
             result.clear_id();
             result.clear_email();
         }
-        if (!complete)
+        if (!complete) {
             result.clear_avatar_bmp();
+            result.clear_avatar_hash();
+        }
     }
     return result;
 }
@@ -22,6 +22,14 @@ if ((schema_ver != new_ver)); then
     exit 1
 fi
 
+sqlite_version_line="$(grep 'INSERT INTO cockatrice_schema_version' servatrice/servatrice_sqlite.sql)"
+sqlite_version_line="${sqlite_version_line#*VALUES(}"
+declare -i sqlite_schema_ver="${sqlite_version_line%%)*}"
+if ((sqlite_schema_ver != new_ver)); then
+    echo "SQLite schema version $sqlite_schema_ver does not equal new version $new_ver"
+    exit 1
+fi
+
 expected_sql="^UPDATE cockatrice_schema_version SET version=${new_ver} WHERE version=${old_ver};$"
 if ! grep -q "$expected_sql" servatrice/migrations/$latest_migration; then
     echo "$latest_migration does not contain expected sql: $expected_sql"
@@ -0,0 +1,531 @@
+#include "loadgen_client.h"
+#include "featureset.h"
+#include "get_pb_extension.h"
+#include "loadgen_statistics.h"
+#include "pb/command_deck_select.pb.h"
+#include "pb/command_draw_cards.pb.h"
+#include "pb/command_game_say.pb.h"
+#include "pb/command_leave_game.pb.h"
+#include "pb/command_move_card.pb.h"
+#include "pb/command_ready_start.pb.h"
+#include "pb/command_roll_die.pb.h"
+#include "pb/command_shuffle.pb.h"
+#include "pb/event_connection_closed.pb.h"
+#include "pb/event_game_joined.pb.h"
+#include "pb/event_game_state_changed.pb.h"
+#include "pb/event_list_rooms.pb.h"
+#include "pb/event_server_identification.pb.h"
+#include "pb/game_event.pb.h"
+#include "pb/game_event_container.pb.h"
+#include "pb/room_commands.pb.h"
+#include "pb/server_message.pb.h"
+#include "pb/serverinfo_game.pb.h"
+#include "pb/serverinfo_room.pb.h"
+#include "pb/session_commands.pb.h"
+#include "pb/session_event.pb.h"
+#include "version_string.h"
+#include <QTcpSocket>
+#include <QTimer>
+#include <QUrl>
+#include <math.h>
+#ifdef QT_WEBSOCKETS_LIB
+#include <QWebSocket>
+#endif
+
+static const int pingInterval = 5000;
+static const int protocolVersion = 14;
+
+LoadGenClient::LoadGenClient(int _index,
+                             const LoadGenSettings &_settings,
+                             LoadGenStatistics *_statistics,
+                             QObject *parent)
+    : QObject(parent), index(_index), settings(_settings), statistics(_statistics), partner(nullptr), isHost(false),
+      tcpSocket(nullptr), webSocket(nullptr), handshakeDone(false), messageLength(-1), nextCmdId(0), connected(false),
+      loggedIn(false), roomId(-1), gameId(-1), playerId(-1), gameStarted(false), gameActionsLeft(0),
+      nextGameAction(0), partnerInGame(false)
+{
+    pingTimer = new QTimer(this);
+    pingTimer->setInterval(pingInterval);
+    connect(pingTimer, SIGNAL(timeout()), this, SLOT(sendPing()));
+
+    chatTimer = new QTimer(this);
+    chatTimer->setSingleShot(true);
+    connect(chatTimer, SIGNAL(timeout()), this, SLOT(sendRoomSay()));
+
+    gameActionTimer = new QTimer(this);
+    gameActionTimer->setInterval(qMax(static_cast<int>(1000 / qMax(settings.gameActionRate, 0.001)), 1));
+    connect(gameActionTimer, SIGNAL(timeout()), this, SLOT(sendGameAction()));
+
+    clock.start();
+}
+
+LoadGenClient::~LoadGenClient()
+{
+    disconnectFromServer();
+}
+
+void LoadGenClient::setPartner(LoadGenClient *_partner, bool _isHost)
+{
+    partner = _partner;
+    isHost = _isHost;
+}
+
+void LoadGenClient::connectToServer()
+{
+    if (settings.websocket) {
+#ifdef QT_WEBSOCKETS_LIB
+        webSocket = new QWebSocket(QString(), QWebSocketProtocol::VersionLatest, this);
+        connect(webSocket, SIGNAL(connected()), this, SLOT(socketConnected()));
+        connect(webSocket, SIGNAL(disconnected()), this, SLOT(socketDisconnected()));
+        connect(webSocket, SIGNAL(error(QAbstractSocket::SocketError)), this,
+                SLOT(socketError(QAbstractSocket::SocketError)));
+        connect(webSocket, SIGNAL(binaryMessageReceived(const QByteArray &)), this,
+                SLOT(binaryMessageReceived(const QByteArray &)));
+        webSocket->open(QUrl(QString("ws://%1:%2").arg(settings.host).arg(settings.port)));
+#endif
+    } else {
+        tcpSocket = new QTcpSocket(this);
+        tcpSocket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+        connect(tcpSocket, SIGNAL(connected()), this, SLOT(socketConnected()));
+        connect(tcpSocket, SIGNAL(disconnected()), this, SLOT(socketDisconnected()));
+        connect(tcpSocket, SIGNAL(error(QAbstractSocket::SocketError)), this,
+                SLOT(socketError(QAbstractSocket::SocketError)));
+        connect(tcpSocket, SIGNAL(readyRead()), this, SLOT(readTcpData()));
+        tcpSocket->connectToHost(settings.host, static_cast<quint16>(settings.port));
+    }
+}
+
+void LoadGenClient::disconnectFromServer()
+{
+    pingTimer->stop();
+    chatTimer->stop();
+    gameActionTimer->stop();
+
+    if (tcpSocket) {
+        tcpSocket->disconnect(this);
+        tcpSocket->abort();
+        tcpSocket->deleteLater();
+        tcpSocket = nullptr;
+    }
+#ifdef QT_WEBSOCKETS_LIB
+    if (webSocket) {
+        webSocket->disconnect(this);
+        webSocket->abort();
+        webSocket->deleteLater();
+        webSocket = nullptr;
+    }
+#endif
+
+    if (gameId != -1) {
+        statistics->clientsInGame.deref();
+        gameId = -1;
+        if (partner)
+            partner->partnerLeftGame();
+    }
+    if (loggedIn)
+        statistics->clientsLoggedIn.deref();
+    if (connected)
+        statistics->clientsConnected.deref();
+    loggedIn = connected = false;
+    pendingCommands.clear();
+}
+
+void LoadGenClient::socketConnected()
+{
+    connected = true;
+    statistics->clientsConnected.ref();
+
+    // the server expects an empty command container first, like the original client sends it
+    if (tcpSocket) {
+        CommandContainer cont;
+        sendCommandContainer(cont, QString(), OtherCommand);
+    }
+}
+
+void LoadGenClient::socketError(QAbstractSocket::SocketError /* error */)
+{
+    if (!connected)
+        statistics->connectionErrors.fetchAndAddRelaxed(1);
+    disconnectFromServer();
+}
+
+void LoadGenClient::socketDisconnected()
+{
+    statistics->disconnects.fetchAndAddRelaxed(1);
+    disconnectFromServer();
+}
+
+void LoadGenClient::readTcpData()
+{
+    inputBuffer.append(tcpSocket->readAll());
+
+    // the server greets tcp clients with an xml header for compatibility with very old clients
+    if (!handshakeDone) {
+        if (inputBuffer.size() < 60)
+            return;
+        if (inputBuffer.startsWith("<?xm"))
+            inputBuffer.remove(0, 60);
+        handshakeDone = true;
+    }
+
+    while (tcpSocket) {
+        if (messageLength == -1) {
+            if (inputBuffer.size() < 4)
+                return;
+            messageLength = (((quint32)(unsigned char)inputBuffer[0]) << 24) +
+                            (((quint32)(unsigned char)inputBuffer[1]) << 16) +
+                            (((quint32)(unsigned char)inputBuffer[2]) << 8) + ((quint32)(unsigned char)inputBuffer[3]);
+            inputBuffer.remove(0, 4);
+        }
+        if (inputBuffer.size() < messageLength)
+            return;
+
+        const QByteArray message = inputBuffer.left(messageLength);
+        inputBuffer.remove(0, messageLength);
+        messageLength = -1;
+        processServerMessage(message);
+    }
+}
+
+void LoadGenClient::binaryMessageReceived(const QByteArray &message)
+{
+    processServerMessage(message);
+}
+
+void LoadGenClient::sendCommandContainer(CommandContainer &cont, const QString &name, PendingCommandKind kind)
+{
+    if (!name.isEmpty()) {
+        cont.set_cmd_id(static_cast<google::protobuf::uint64>(++nextCmdId));
+        PendingCommand pending;
+        pending.name = name;
+        pending.kind = kind;
+        pending.sentAt = clock.nsecsElapsed() / 1000;
+        pendingCommands.insert(nextCmdId, pending);
+    }
+
+    QByteArray buf;
+    const int size = cont.ByteSize();
+    if (tcpSocket) {
+        buf.resize(size + 4);
+        cont.SerializeToArray(buf.data() + 4, size);
+        buf.data()[3] = (unsigned char)size;
+        buf.data()[2] = (unsigned char)(size >> 8);
+        buf.data()[1] = (unsigned char)(size >> 16);
+        buf.data()[0] = (unsigned char)(size >> 24);
+        tcpSocket->write(buf);
+    }
+#ifdef QT_WEBSOCKETS_LIB
+    else if (webSocket) {
+        buf.resize(size);
+        cont.SerializeToArray(buf.data(), size);
+        webSocket->sendBinaryMessage(buf);
+    }
+#endif
+    statistics->commandSent(buf.size());
+}
+
+void LoadGenClient::sendSessionCommand(const ::google::protobuf::Message &cmd, PendingCommandKind kind)
+{
+    CommandContainer cont;
+    SessionCommand *c = cont.add_session_command();
+    c->GetReflection()->MutableMessage(c, cmd.GetDescriptor()->FindExtensionByName("ext"))->CopyFrom(cmd);
+    sendCommandContainer(cont, QString::fromStdString(cmd.GetDescriptor()->name()), kind);
+}
+
+void LoadGenClient::sendRoomCommand(const ::google::protobuf::Message &cmd, PendingCommandKind kind)
+{
+    CommandContainer cont;
+    cont.set_room_id(static_cast<google::protobuf::uint32>(roomId));
+    RoomCommand *c = cont.add_room_command();
+    c->GetReflection()->MutableMessage(c, cmd.GetDescriptor()->FindExtensionByName("ext"))->CopyFrom(cmd);
+    sendCommandContainer(cont, QString::fromStdString(cmd.GetDescriptor()->name()), kind);
+}
+
+void LoadGenClient::sendGameCommand(const ::google::protobuf::Message &cmd)
+{
+    CommandContainer cont;
+    cont.set_game_id(static_cast<google::protobuf::uint32>(gameId));
+    GameCommand *c = cont.add_game_command();
+    c->GetReflection()->MutableMessage(c, cmd.GetDescriptor()->FindExtensionByName("ext"))->CopyFrom(cmd);
+    sendCommandContainer(cont, QString::fromStdString(cmd.GetDescriptor()->name()), OtherCommand);
+}
+
+void LoadGenClient::processServerMessage(const QByteArray &data)
+{
+    statistics->messageReceived(data.size());
+
+    ServerMessage message;
+    if (!message.ParseFromArray(data.data(), data.size()))
+        return;
+
+    switch (message.message_type()) {
+        case ServerMessage::RESPONSE:
+            processResponse(message.response());
+            break;
+        case ServerMessage::SESSION_EVENT:
+            processSessionEvent(message.session_event());
+            break;
+        case ServerMessage::GAME_EVENT_CONTAINER:
+            processGameEventContainer(message.game_event_container());
+            break;
+        case ServerMessage::ROOM_EVENT:
+            break;
+    }
+}
+
+void LoadGenClient::processResponse(const Response &response)
+{
+    const int cmdId = static_cast<int>(response.cmd_id());
+    if (!pendingCommands.contains(cmdId))
+        return;
+    const PendingCommand pending = pendingCommands.take(cmdId);
+    const bool success = response.response_code() == Response::RespOk;
+    statistics->recordResponse(pending.name, clock.nsecsElapsed() / 1000 - pending.sentAt, success);
+
+    switch (pending.kind) {
+        case LoginCommand:
+            if (!success) {
+                disconnectFromServer();
+                return;
+            }
+            loggedIn = true;
+            statistics->clientsLoggedIn.ref();
+            pingTimer->start();
+            sendSessionCommand(Command_ListRooms(), ListRoomsCommand);
+            break;
+        case ListRoomsCommand:
+            if (roomId != -1)
+                joinRoom(roomId);
+            break;
+        case JoinRoomCommand:
+            if (!success)
+                return;
+            scheduleChat();
+            if (isHost)
+                createGame();
+            break;
+        case CreateGameCommand:
+            if (!success)
+                QTimer::singleShot(1000, this, SLOT(createGame()));
+            break;
+        case JoinGameCommand:
+            if (!success && partner)
+                partner->partnerLeftGame();
+            break;
+        case OtherCommand:
+            break;
+    }
+}
+
+void LoadGenClient::processSessionEvent(const SessionEvent &event)
+{
+    if (event.HasExtension(Event_ServerIdentification::ext)) {
+        if (event.GetExtension(Event_ServerIdentification::ext).protocol_version() != protocolVersion) {
+            disconnectFromServer();
+            return;
+        }
+        Command_Login cmd;
+        cmd.set_user_name(QString("%1%2").arg(settings.userNamePrefix).arg(index).toStdString());
+        cmd.set_password(settings.password.toStdString());
+        cmd.set_clientid(QString("loadgen%1").arg(index).toStdString());
+        cmd.set_clientver(VERSION_STRING);
+        const QMap<QString, bool> features = FeatureSet().getDefaultFeatureList();
+        for (const QString &feature : features.keys())
+            cmd.add_clientfeatures(feature.toStdString());
+        sendSessionCommand(cmd, LoginCommand);
+    } else if (event.HasExtension(Event_ListRooms::ext)) {
+        const Event_ListRooms &listRooms = event.GetExtension(Event_ListRooms::ext);
+        for (int i = 0; i < listRooms.room_list_size(); ++i) {
+            const int id = listRooms.room_list(i).room_id();
+            if ((settings.roomId == -1 && roomId == -1) || (settings.roomId == id))
+                roomId = id;
+        }
+    } else if (event.HasExtension(Event_GameJoined::ext)) {
+        const Event_GameJoined &gameJoined = event.GetExtension(Event_GameJoined::ext);
+        if (gameId != -1)
+            return;
+        gameId = gameJoined.game_info().game_id();
+        playerId = gameJoined.player_id();
+        gameStarted = false;
+        gameActionsLeft = settings.gameActions;
+        statistics->clientsInGame.ref();
+
+        Command_DeckSelect deckSelect;
+        deckSelect.set_deck(settings.deck.toStdString());
+        sendGameCommand(deckSelect);
+        Command_ReadyStart readyStart;
+        readyStart.set_ready(true);
+        sendGameCommand(readyStart);
+
+        if (isHost && partner) {
+            partnerInGame = true;
+            partner->joinGame(gameId);
+        }
+    } else if (event.HasExtension(Event_ConnectionClosed::ext))
+        disconnectFromServer();
+}
+
+void LoadGenClient::processGameEventContainer(const GameEventContainer &cont)
+{
+    if (static_cast<int>(cont.game_id()) != gameId)
+        return;
+
+    for (int i = 0; i < cont.event_list_size(); ++i) {
+        const GameEvent &event = cont.event_list(i);
+        if (event.HasExtension(Event_GameStateChanged::ext)) {
+            if (event.GetExtension(Event_GameStateChanged::ext).game_started() && !gameStarted) {
+                gameStarted = true;
+                if (isHost)
+                    statistics->gamesStarted.fetchAndAddRelaxed(1);
+                gameActionTimer->start();
+            }
+        } else if ((getPbExtension(event) == GameEvent::GAME_CLOSED) || (getPbExtension(event) == GameEvent::KICKED)) {
+            gameLeft();
+            return;
+        }
+    }
+}
+
+void LoadGenClient::joinRoom(int _roomId)
+{
+    roomId = _roomId;
+    Command_JoinRoom cmd;
+    cmd.set_room_id(static_cast<google::protobuf::uint32>(roomId));
+    sendSessionCommand(cmd, JoinRoomCommand);
+}
+
+void LoadGenClient::createGame()
+{
+    if (!loggedIn || (gameId != -1) || partnerInGame)
+        return;
+
+    Command_CreateGame cmd;
+    cmd.set_description(QString("loadgen %1").arg(index).toStdString());
+    cmd.set_max_players(2);
+    cmd.set_spectators_allowed(true);
+    sendRoomCommand(cmd, CreateGameCommand);
+}
+
+void LoadGenClient::joinGame(int _gameId)
+{
+    if (!loggedIn || (gameId != -1)) {
+        if (partner)
+            partner->partnerLeftGame();
+        return;
+    }
+
+    Command_JoinGame cmd;
+    cmd.set_game_id(_gameId);
+    sendRoomCommand(cmd, JoinGameCommand);
+}
+
+void LoadGenClient::leaveGame()
+{
+    if (gameId == -1)
+        return;
+    sendGameCommand(Command_LeaveGame());
+    gameLeft();
+}
+
+void LoadGenClient::gameLeft()
+{
+    if (gameId == -1)
+        return;
+
+    gameActionTimer->stop();
+    gameId = -1;
+    gameStarted = false;
+    statistics->clientsInGame.deref();
+
+    if (isHost) {
+        if (!partnerInGame)
+            QTimer::singleShot(1000, this, SLOT(createGame()));
+    } else if (partner)
+        partner->partnerLeftGame();
+}
+
+void LoadGenClient::partnerLeftGame()
+{
+    if (!isHost) {
+        leaveGame();
+        return;
+    }
+
+    partnerInGame = false;
+    if (gameId == -1)
+        QTimer::singleShot(1000, this, SLOT(createGame()));
+    else if (!gameStarted)
+        // the game can't start without the partner
+        leaveGame();
+}
+
+void LoadGenClient::sendPing()
+{
+    sendSessionCommand(Command_Ping());
+}
+
+void LoadGenClient::scheduleChat()
+{
+    if (settings.chatInterval <= 0)
+        return;
+    // exponentially distributed intervals, so the messages of all clients don't arrive in bursts
+    const double uniform = (qrand() + 1.0) / (RAND_MAX + 2.0);
+    chatTimer->start(static_cast<int>(-log(uniform) * settings.chatInterval * 1000));
+}
+
+void LoadGenClient::sendRoomSay()
+{
+    if (roomId == -1)
+        return;
+    Command_RoomSay cmd;
+    cmd.set_message(QString("load test message %1 from client %2").arg(qrand()).arg(index).toStdString());
+    sendRoomCommand(cmd);
+    scheduleChat();
+}
+
+void LoadGenClient::sendGameAction()
+{
+    if ((gameId == -1) || !gameStarted)
+        return;
+    if (gameActionsLeft-- <= 0) {
+        leaveGame();
+        return;
+    }
+
+    switch (nextGameAction++ % 5) {
+        case 0: {
+            Command_DrawCards cmd;
+            cmd.set_number(1);
+            sendGameCommand(cmd);
+            break;
+        }
+        case 1: {
+            // the deck is a hidden zone, so the card id is its position
+            Command_MoveCard cmd;
+            cmd.set_start_player_id(playerId);
+            cmd.set_start_zone("deck");
+            cmd.mutable_cards_to_move()->add_card()->set_card_id(0);
+            cmd.set_target_player_id(playerId);
+            cmd.set_target_zone("grave");
+            cmd.set_x(0);
+            cmd.set_y(0);
+            sendGameCommand(cmd);
+            break;
+        }
+        case 2:
+            sendGameCommand(Command_Shuffle());
+            break;
+        case 3: {
+            Command_RollDie cmd;
+            cmd.set_sides(20);
+            sendGameCommand(cmd);
+            break;
+        }
+        default: {
+            Command_GameSay cmd;
+            cmd.set_message(QString("game message %1").arg(nextGameAction).toStdString());
+            sendGameCommand(cmd);
+            break;
+        }
+    }
+}
@@ -0,0 +1,123 @@
+#ifndef LOADGEN_CLIENT_H
+#define LOADGEN_CLIENT_H
+
+#include "pb/commands.pb.h"
+#include "pb/response.pb.h"
+#include <QAbstractSocket>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QObject>
+#include <QString>
+
+class LoadGenStatistics;
+class QTcpSocket;
+class QTimer;
+class QWebSocket;
+class ServerMessage;
+class SessionEvent;
+class GameEventContainer;
+
+struct LoadGenSettings
+{
+    QString host;
+    int port = 4747;
+    bool websocket = false;
+    QString userNamePrefix = "loadgen";
+    QString password;
+    int roomId = -1;           // -1: the first room the server lists
+    double chatInterval = 30;  // mean seconds between room messages of one client, 0 disables chatting
+    double gameActionRate = 1; // game commands per second of one player
+    int gameActions = 40;      // game commands of one player before it leaves the game and a new one is created
+    QString deck;              // deck in the native format
+};
+
+/*
+ * A synthetic client that logs in, joins a room, chats and, if it has a partner, plays games against it.
+ *
+ * The client that creates the games is the host; its partner joins every game the host creates. Both live in
+ * the same thread, so they can talk to each other directly.
+ */
+class LoadGenClient : public QObject
+{
+    Q_OBJECT
+public:
+    LoadGenClient(int _index, const LoadGenSettings &_settings, LoadGenStatistics *_statistics, QObject *parent = 0);
+    ~LoadGenClient();
+
+    void setPartner(LoadGenClient *_partner, bool _isHost);
+    void connectToServer();
+    void disconnectFromServer();
+
+private slots:
+    void socketConnected();
+    void socketError(QAbstractSocket::SocketError error);
+    void socketDisconnected();
+    void readTcpData();
+    void binaryMessageReceived(const QByteArray &message);
+    void sendPing();
+    void sendRoomSay();
+    void sendGameAction();
+    void createGame();
+
+private:
+    enum PendingCommandKind
+    {
+        OtherCommand,
+        LoginCommand,
+        ListRoomsCommand,
+        JoinRoomCommand,
+        CreateGameCommand,
+        JoinGameCommand
+    };
+    struct PendingCommand
+    {
+        QString name;
+        PendingCommandKind kind;
+        qint64 sentAt;
+    };
+
+    int index;
+    LoadGenSettings settings;
+    LoadGenStatistics *statistics;
+    LoadGenClient *partner;
+    bool isHost;
+
+    QTcpSocket *tcpSocket;
+    QWebSocket *webSocket;
+    QByteArray inputBuffer;
+    bool handshakeDone;
+    int messageLength;
+
+    QTimer *pingTimer, *chatTimer, *gameActionTimer;
+    QElapsedTimer clock;
+    QHash<int, PendingCommand> pendingCommands;
+    int nextCmdId;
+
+    bool connected, loggedIn;
+    int roomId;
+    int gameId; // -1 while not in a game
+    int playerId;
+    bool gameStarted;
+    int gameActionsLeft;
+    int nextGameAction;
+    bool partnerInGame;
+
+    void sendCommandContainer(CommandContainer &cont, const QString &name, PendingCommandKind kind);
+    void sendSessionCommand(const ::google::protobuf::Message &cmd, PendingCommandKind kind = OtherCommand);
+    void sendRoomCommand(const ::google::protobuf::Message &cmd, PendingCommandKind kind = OtherCommand);
+    void sendGameCommand(const ::google::protobuf::Message &cmd);
+
+    void processServerMessage(const QByteArray &data);
+    void processResponse(const Response &response);
+    void processSessionEvent(const SessionEvent &event);
+    void processGameEventContainer(const GameEventContainer &cont);
+
+    void joinRoom(int _roomId);
+    void joinGame(int _gameId);
+    void leaveGame();
+    void gameLeft();
+    void partnerLeftGame();
+    void scheduleChat();
+};
+
+#endif
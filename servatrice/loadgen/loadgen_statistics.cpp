@@ -0,0 +1,168 @@
+#include "loadgen_statistics.h"
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutexLocker>
+#include <algorithm>
+
+LoadGenStatistics::LoadGenStatistics()
+    : clientsConnected(0), clientsLoggedIn(0), clientsInGame(0), connectionErrors(0), disconnects(0),
+      gamesStarted(0), commandsSent(0), messagesReceived(0), responsesReceived(0), bytesSent(0), bytesReceived(0),
+      lastReportTime(0), lastCommandsSent(0), lastResponsesReceived(0), lastMessagesReceived(0), lastBytesSent(0),
+      lastBytesReceived(0)
+{
+    clock.start();
+}
+
+void LoadGenStatistics::recordResponse(const QString &command, qint64 usecs, bool success)
+{
+    responsesReceived.fetchAndAddRelaxed(1);
+    const quint32 latency = static_cast<quint32>(qBound(Q_INT64_C(0), usecs, Q_INT64_C(0xffffffff)));
+
+    QMutexLocker locker(&samplesMutex);
+    CommandSamples &commandSamples = samples[command];
+    commandSamples.latencies.append(latency);
+    if (!success)
+        ++commandSamples.errors;
+    intervalLatencies.append(latency);
+}
+
+// The latencies need to be sorted; returns milliseconds.
+static double percentile(const QVector<quint32> &sortedLatencies, double fraction)
+{
+    if (sortedLatencies.isEmpty())
+        return 0;
+    const int index = qMin(static_cast<int>(fraction * sortedLatencies.size()), sortedLatencies.size() - 1);
+    return sortedLatencies[index] / 1000.0;
+}
+
+QString LoadGenStatistics::takeIntervalReport()
+{
+    QVector<quint32> latencies;
+    {
+        QMutexLocker locker(&samplesMutex);
+        latencies.swap(intervalLatencies);
+    }
+    std::sort(latencies.begin(), latencies.end());
+
+    const qint64 now = clock.elapsed();
+    const double seconds = qMax(now - lastReportTime, Q_INT64_C(1)) / 1000.0;
+    const quint64 sent = commandsSent.load(), responses = responsesReceived.load(),
+                  messages = messagesReceived.load(), tx = bytesSent.load(), rx = bytesReceived.load();
+
+    const QString report = QString("t=%1s clients=%2 logged_in=%3 in_game=%4 | commands/s=%5 responses/s=%6 "
+                                   "messages/s=%7 tx=%8KB/s rx=%9KB/s | p50=%10ms p99=%11ms | errors: connect=%12 "
+                                   "disconnect=%13")
+                               .arg(now / 1000)
+                               .arg(clientsConnected.load())
+                               .arg(clientsLoggedIn.load())
+                               .arg(clientsInGame.load())
+                               .arg((sent - lastCommandsSent) / seconds, 0, 'f', 0)
+                               .arg((responses - lastResponsesReceived) / seconds, 0, 'f', 0)
+                               .arg((messages - lastMessagesReceived) / seconds, 0, 'f', 0)
+                               .arg((tx - lastBytesSent) / seconds / 1024, 0, 'f', 1)
+                               .arg((rx - lastBytesReceived) / seconds / 1024, 0, 'f', 1)
+                               .arg(percentile(latencies, 0.5), 0, 'f', 2)
+                               .arg(percentile(latencies, 0.99), 0, 'f', 2)
+                               .arg(connectionErrors.load())
+                               .arg(disconnects.load());
+
+    lastReportTime = now;
+    lastCommandsSent = sent;
+    lastResponsesReceived = responses;
+    lastMessagesReceived = messages;
+    lastBytesSent = tx;
+    lastBytesReceived = rx;
+    return report;
+}
+
+QList<LoadGenStatistics::CommandSummary> LoadGenStatistics::getSummary() const
+{
+    QMap<QString, CommandSamples> samplesCopy;
+    {
+        QMutexLocker locker(&samplesMutex);
+        samplesCopy = samples;
+    }
+
+    QList<CommandSummary> result;
+    for (auto i = samplesCopy.begin(); i != samplesCopy.end(); ++i) {
+        QVector<quint32> &latencies = i.value().latencies;
+        std::sort(latencies.begin(), latencies.end());
+
+        CommandSummary summary;
+        summary.command = i.key();
+        summary.count = static_cast<quint64>(latencies.size());
+        summary.errors = i.value().errors;
+        summary.p50 = percentile(latencies, 0.5);
+        summary.p90 = percentile(latencies, 0.9);
+        summary.p99 = percentile(latencies, 0.99);
+        summary.p999 = percentile(latencies, 0.999);
+        summary.max = latencies.isEmpty() ? 0 : latencies.last() / 1000.0;
+        result.append(summary);
+    }
+    return result;
+}
+
+QString LoadGenStatistics::getSummaryTable() const
+{
+    const double seconds = qMax(clock.elapsed(), Q_INT64_C(1)) / 1000.0;
+    QStringList lines;
+    lines.append(QString("%1 %2 %3 %4 %5 %6 %7 %8 %9")
+                     .arg("command", -28)
+                     .arg("count", 9)
+                     .arg("errors", 7)
+                     .arg("per sec", 9)
+                     .arg("p50 ms", 9)
+                     .arg("p90 ms", 9)
+                     .arg("p99 ms", 9)
+                     .arg("p99.9 ms", 9)
+                     .arg("max ms", 9));
+    for (const CommandSummary &summary : getSummary())
+        lines.append(QString("%1 %2 %3 %4 %5 %6 %7 %8 %9")
+                         .arg(summary.command, -28)
+                         .arg(summary.count, 9)
+                         .arg(summary.errors, 7)
+                         .arg(summary.count / seconds, 9, 'f', 1)
+                         .arg(summary.p50, 9, 'f', 2)
+                         .arg(summary.p90, 9, 'f', 2)
+                         .arg(summary.p99, 9, 'f', 2)
+                         .arg(summary.p999, 9, 'f', 2)
+                         .arg(summary.max, 9, 'f', 2));
+    lines.append(QString("games started: %1, bytes sent: %2, bytes received: %3")
+                     .arg(gamesStarted.load())
+                     .arg(bytesSent.load())
+                     .arg(bytesReceived.load()));
+    return lines.join("\n");
+}
+
+QByteArray LoadGenStatistics::getSummaryJson() const
+{
+    const double seconds = qMax(clock.elapsed(), Q_INT64_C(1)) / 1000.0;
+    QJsonArray commands;
+    for (const CommandSummary &summary : getSummary()) {
+        QJsonObject command;
+        command["command"] = summary.command;
+        command["count"] = static_cast<double>(summary.count);
+        command["errors"] = static_cast<double>(summary.errors);
+        command["per_second"] = summary.count / seconds;
+        command["p50_ms"] = summary.p50;
+        command["p90_ms"] = summary.p90;
+        command["p99_ms"] = summary.p99;
+        command["p999_ms"] = summary.p999;
+        command["max_ms"] = summary.max;
+        commands.append(command);
+    }
+
+    QJsonObject result;
+    result["duration_seconds"] = seconds;
+    result["commands_sent"] = static_cast<double>(commandsSent.load());
+    result["responses_received"] = static_cast<double>(responsesReceived.load());
+    result["messages_received"] = static_cast<double>(messagesReceived.load());
+    result["bytes_sent"] = static_cast<double>(bytesSent.load());
+    result["bytes_received"] = static_cast<double>(bytesReceived.load());
+    result["games_started"] = static_cast<double>(gamesStarted.load());
+    result["connection_errors"] = static_cast<double>(connectionErrors.load());
+    result["disconnects"] = static_cast<double>(disconnects.load());
+    result["commands"] = commands;
+    return QJsonDocument(result).toJson();
+}
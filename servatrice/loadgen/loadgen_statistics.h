@@ -0,0 +1,72 @@
+#ifndef LOADGEN_STATISTICS_H
+#define LOADGEN_STATISTICS_H
+
+#include <QAtomicInteger>
+#include <QElapsedTimer>
+#include <QMap>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+
+/*
+ * Everything the synthetic clients observe, shared by all worker threads.
+ *
+ * Latencies are kept as raw samples per command so that exact percentiles can be reported; at 4 bytes per
+ * sample a run with millions of commands still fits easily in memory.
+ */
+class LoadGenStatistics
+{
+public:
+    struct CommandSummary
+    {
+        QString command;
+        quint64 count;
+        quint64 errors;
+        double p50, p90, p99, p999, max; // milliseconds
+    };
+
+    LoadGenStatistics();
+
+    void recordResponse(const QString &command, qint64 usecs, bool success);
+    void commandSent(int bytes)
+    {
+        commandsSent.fetchAndAddRelaxed(1);
+        bytesSent.fetchAndAddRelaxed(bytes);
+    }
+    void messageReceived(int bytes)
+    {
+        messagesReceived.fetchAndAddRelaxed(1);
+        bytesReceived.fetchAndAddRelaxed(bytes);
+    }
+
+    QAtomicInt clientsConnected, clientsLoggedIn, clientsInGame;
+    QAtomicInteger<quint64> connectionErrors, disconnects, gamesStarted;
+
+    qint64 getElapsedMSecs() const
+    {
+        return clock.elapsed();
+    }
+    // One line with the rates and latencies since the previous call.
+    QString takeIntervalReport();
+    QList<CommandSummary> getSummary() const;
+    QString getSummaryTable() const;
+    QByteArray getSummaryJson() const;
+
+private:
+    struct CommandSamples
+    {
+        QVector<quint32> latencies; // microseconds
+        quint64 errors = 0;
+    };
+
+    mutable QMutex samplesMutex;
+    QMap<QString, CommandSamples> samples;
+    QVector<quint32> intervalLatencies; // all commands answered since the last interval report
+    QAtomicInteger<quint64> commandsSent, messagesReceived, responsesReceived, bytesSent, bytesReceived;
+
+    QElapsedTimer clock;
+    qint64 lastReportTime;
+    quint64 lastCommandsSent, lastResponsesReceived, lastMessagesReceived, lastBytesSent, lastBytesReceived;
+};
+
+#endif
@@ -0,0 +1,76 @@
+#include "loadgen_worker.h"
+#include <QDateTime>
+#include <QTimer>
+
+static const int spawnInterval = 50;
+
+LoadGenWorker::LoadGenWorker(int _firstIndex,
+                             int _clientCount,
+                             int _playerCount,
+                             double _rampRate,
+                             const LoadGenSettings &_settings,
+                             LoadGenStatistics *_statistics)
+    : QObject(), firstIndex(_firstIndex), clientCount(_clientCount), playerCount(_playerCount), rampRate(_rampRate),
+      settings(_settings), statistics(_statistics), spawnTimer(nullptr)
+{
+}
+
+LoadGenWorker::~LoadGenWorker()
+{
+    stop();
+}
+
+void LoadGenWorker::start()
+{
+    // qrand() is seeded per thread
+    qsrand(static_cast<uint>(QDateTime::currentMSecsSinceEpoch()) + static_cast<uint>(firstIndex));
+
+    // created here rather than in the constructor so the timer lives in the worker thread
+    spawnTimer = new QTimer(this);
+    spawnTimer->setInterval(spawnInterval);
+    connect(spawnTimer, SIGNAL(timeout()), this, SLOT(spawnClients()));
+    clock.start();
+    spawnTimer->start();
+    spawnClients();
+}
+
+void LoadGenWorker::stop()
+{
+    if (spawnTimer)
+        spawnTimer->stop();
+    // the partners may still refer to each other, so disconnect everybody before deleting anyone
+    for (LoadGenClient *client : clients)
+        client->disconnectFromServer();
+    qDeleteAll(clients);
+    clients.clear();
+}
+
+LoadGenClient *LoadGenWorker::createClient()
+{
+    LoadGenClient *client = new LoadGenClient(firstIndex + clients.size(), settings, statistics, this);
+    clients.append(client);
+    return client;
+}
+
+void LoadGenWorker::spawnClients()
+{
+    int target = clientCount;
+    if (rampRate > 0)
+        target = qMin(clientCount, static_cast<int>(clock.elapsed() * rampRate / 1000) + 1);
+
+    while (clients.size() < target) {
+        // players come in pairs: the host creates the games and its partner joins them
+        if ((clients.size() + 1 < playerCount) && (clients.size() + 1 < clientCount)) {
+            LoadGenClient *host = createClient();
+            LoadGenClient *guest = createClient();
+            host->setPartner(guest, true);
+            guest->setPartner(host, false);
+            host->connectToServer();
+            guest->connectToServer();
+        } else
+            createClient()->connectToServer();
+    }
+
+    if (clients.size() >= clientCount)
+        spawnTimer->stop();
+}
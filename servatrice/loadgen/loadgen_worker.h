@@ -0,0 +1,45 @@
+#ifndef LOADGEN_WORKER_H
+#define LOADGEN_WORKER_H
+
+#include "loadgen_client.h"
+#include <QElapsedTimer>
+#include <QList>
+#include <QObject>
+
+class QTimer;
+
+/*
+ * Owns the clients of one thread and connects them gradually, so the server isn't hit by all logins at once.
+ */
+class LoadGenWorker : public QObject
+{
+    Q_OBJECT
+public:
+    LoadGenWorker(int _firstIndex,
+                  int _clientCount,
+                  int _playerCount,
+                  double _rampRate,
+                  const LoadGenSettings &_settings,
+                  LoadGenStatistics *_statistics);
+    ~LoadGenWorker();
+
+public slots:
+    void start();
+    void stop();
+
+private slots:
+    void spawnClients();
+
+private:
+    int firstIndex, clientCount, playerCount;
+    double rampRate; // new connections per second of this worker
+    LoadGenSettings settings;
+    LoadGenStatistics *statistics;
+    QTimer *spawnTimer;
+    QList<LoadGenClient *> clients;
+    QElapsedTimer clock;
+
+    LoadGenClient *createClient();
+};
+
+#endif
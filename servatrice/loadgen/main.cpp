@@ -0,0 +1,156 @@
+#include "decklist.h"
+#include "loadgen_statistics.h"
+#include "loadgen_worker.h"
+#include "version_string.h"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QFile>
+#include <QFileInfo>
+#include <QTextStream>
+#include <QThread>
+#include <QTimer>
+#include <iostream>
+
+static QString loadDeck(const QString &fileName)
+{
+    DeckList deck;
+    if (fileName.isEmpty()) {
+        QString plainDeck("60 Island\n\nSB: 15 Island");
+        QTextStream stream(&plainDeck);
+        deck.loadFromStream_Plain(stream);
+        return deck.writeToString_Native();
+    }
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        std::cerr << "Could not open deck file " << fileName.toStdString() << std::endl;
+        return QString();
+    }
+    const bool loaded = QFileInfo(fileName).suffix().toLower() == "cod" ? deck.loadFromFile_Native(&file)
+                                                                        : deck.loadFromFile_Plain(&file);
+    if (!loaded) {
+        std::cerr << "Could not parse deck file " << fileName.toStdString() << std::endl;
+        return QString();
+    }
+    return deck.writeToString_Native();
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setOrganizationName("Cockatrice");
+    app.setApplicationName("servatrice_loadgen");
+    app.setApplicationVersion(VERSION_STRING);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Connects synthetic clients to a Servatrice server and reports the latencies "
+                                     "they observe. The server needs to accept the generated user names, e.g. by "
+                                     "running with authentication disabled.");
+    parser.addHelpOption();
+    parser.addVersionOption();
+
+    QCommandLineOption hostOpt("host", "Server host name", "host", "localhost");
+    QCommandLineOption portOpt("port", "Server port", "port", "4747");
+    QCommandLineOption websocketOpt("websocket", "Connect through websockets instead of tcp");
+    QCommandLineOption clientsOpt("clients", "Number of clients", "count", "100");
+    QCommandLineOption playersOpt("players", "Fraction of the clients that play games, the rest only chat", "fraction",
+                                  "0.5");
+    QCommandLineOption rampOpt("ramp", "New connections per second, 0 connects everybody at once", "rate", "50");
+    QCommandLineOption durationOpt("duration", "Seconds to run, 0 runs until interrupted", "seconds", "60");
+    QCommandLineOption threadsOpt("threads", "Number of client threads", "count", "1");
+    QCommandLineOption roomOpt("room", "Id of the room to join, by default the first one", "id", "-1");
+    QCommandLineOption chatIntervalOpt("chat-interval", "Mean seconds between room messages of one client, 0 disables",
+                                       "seconds", "30");
+    QCommandLineOption actionRateOpt("action-rate", "Game commands per second of one player", "rate", "1");
+    QCommandLineOption gameActionsOpt("game-actions", "Game commands of one player before the game is left", "count",
+                                      "40");
+    QCommandLineOption userPrefixOpt("user-prefix", "Prefix of the generated user names", "prefix", "loadgen");
+    QCommandLineOption passwordOpt("password", "Password of the generated users", "password", "");
+    QCommandLineOption deckOpt("deck", "Deck to play with (.cod or plain text)", "file", "");
+    QCommandLineOption reportIntervalOpt("report-interval", "Seconds between progress reports", "seconds", "5");
+    QCommandLineOption jsonOpt("json", "Also write the summary as json to <file>", "file", "");
+    parser.addOptions({hostOpt, portOpt, websocketOpt, clientsOpt, playersOpt, rampOpt, durationOpt, threadsOpt,
+                       roomOpt, chatIntervalOpt, actionRateOpt, gameActionsOpt, userPrefixOpt, passwordOpt, deckOpt,
+                       reportIntervalOpt, jsonOpt});
+    parser.process(app);
+
+    LoadGenSettings settings;
+    settings.host = parser.value(hostOpt);
+    settings.port = parser.value(portOpt).toInt();
+    settings.websocket = parser.isSet(websocketOpt);
+    settings.roomId = parser.value(roomOpt).toInt();
+    settings.chatInterval = parser.value(chatIntervalOpt).toDouble();
+    settings.gameActionRate = parser.value(actionRateOpt).toDouble();
+    settings.gameActions = parser.value(gameActionsOpt).toInt();
+    settings.userNamePrefix = parser.value(userPrefixOpt);
+    settings.password = parser.value(passwordOpt);
+    settings.deck = loadDeck(parser.value(deckOpt));
+    if (settings.deck.isEmpty())
+        return 1;
+
+#ifndef QT_WEBSOCKETS_LIB
+    if (settings.websocket) {
+        std::cerr << "This build doesn't support websockets" << std::endl;
+        return 1;
+    }
+#endif
+
+    const int clientCount = qMax(parser.value(clientsOpt).toInt(), 0);
+    const double playerFraction = qBound(0.0, parser.value(playersOpt).toDouble(), 1.0);
+    const int threadCount = qBound(1, parser.value(threadsOpt).toInt(), qMax(clientCount, 1));
+    const double rampRate = qMax(parser.value(rampOpt).toDouble(), 0.0);
+    const int duration = parser.value(durationOpt).toInt();
+    const QString jsonFileName = parser.value(jsonOpt);
+
+    LoadGenStatistics statistics;
+    QList<QThread *> threads;
+    QList<LoadGenWorker *> workers;
+    int firstIndex = 0;
+    for (int i = 0; i < threadCount; ++i) {
+        const int workerClients = clientCount / threadCount + (i < clientCount % threadCount ? 1 : 0);
+        const int workerPlayers = static_cast<int>(workerClients * playerFraction);
+        LoadGenWorker *worker =
+            new LoadGenWorker(firstIndex, workerClients, workerPlayers, rampRate / threadCount, settings, &statistics);
+        firstIndex += workerClients;
+
+        QThread *thread = new QThread;
+        thread->setObjectName(QString("loadgen_%1").arg(i));
+        worker->moveToThread(thread);
+        QObject::connect(thread, SIGNAL(started()), worker, SLOT(start()));
+        QObject::connect(thread, SIGNAL(finished()), worker, SLOT(deleteLater()));
+        threads.append(thread);
+        workers.append(worker);
+    }
+
+    std::cout << "Connecting " << clientCount << " clients to " << settings.host.toStdString() << ":"
+              << settings.port << " in " << threadCount << " threads" << std::endl;
+    for (QThread *thread : threads)
+        thread->start();
+
+    QTimer reportTimer;
+    QObject::connect(&reportTimer, &QTimer::timeout,
+                     [&statistics]() { std::cout << statistics.takeIntervalReport().toStdString() << std::endl; });
+    reportTimer.start(qMax(parser.value(reportIntervalOpt).toInt(), 1) * 1000);
+    if (duration > 0)
+        QTimer::singleShot(duration * 1000, &app, SLOT(quit()));
+
+    app.exec();
+
+    for (LoadGenWorker *worker : workers)
+        QMetaObject::invokeMethod(worker, "stop", Qt::BlockingQueuedConnection);
+    for (QThread *thread : threads) {
+        thread->quit();
+        thread->wait();
+        delete thread;
+    }
+
+    std::cout << std::endl << statistics.getSummaryTable().toStdString() << std::endl;
+    if (!jsonFileName.isEmpty()) {
+        QFile jsonFile(jsonFileName);
+        if (jsonFile.open(QIODevice::WriteOnly))
+            jsonFile.write(statistics.getSummaryJson());
+        else
+            std::cerr << "Could not write " << jsonFileName.toStdString() << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,77 @@
+#!/bin/bash
+
+# Starts several servatrice instances on this machine that are linked to each other over the inter server link
+# (ISL), for testing server networks locally. All nodes share one database, which needs the servatrice schema
+# loaded; the servers table is replaced with the test nodes.
+#
+# usage: isl_test_cluster.sh [number of nodes]
+# Stop the cluster with ctrl-c; the configs, certificates and logs stay in $WORKDIR.
+
+NODES=${1:-3}
+SERVATRICE="${SERVATRICE:-servatrice}"		#path to the servatrice binary
+WORKDIR="${WORKDIR:-/tmp/isl_test_cluster}"	#directory for the generated configs, certificates and logs
+DBNAME="servatrice"							#set this to the database name used
+TABLEPREFIX="cockatrice"					#set this to the prefix used for the table names in the database
+DBUSER="servatrice"							#database user, needs to match mysql.cnf
+DBPASSWORD="foobar"							#database password, needs to match mysql.cnf
+SQLCONFFILE="$(pwd)/mysql.cnf"				#set this to the path that contains the mysql.cnf file
+CLIENT_PORT=24747							#node n listens for clients on CLIENT_PORT + n
+ISL_PORT=34747								#node n listens for other servers on ISL_PORT + n
+
+set -e
+mkdir -p "$WORKDIR"
+cd "$WORKDIR"
+
+mysql --defaults-file="$SQLCONFFILE" -h localhost -e "delete from $DBNAME.${TABLEPREFIX}_servers"
+
+for i in $(seq 1 "$NODES"); do
+	openssl req -x509 -newkey rsa:2048 -nodes -days 7 -subj "/CN=node$i" \
+		-keyout "node$i.key" -out "node$i.pem" 2>/dev/null
+
+	mysql --defaults-file="$SQLCONFFILE" -h localhost -e "insert into $DBNAME.${TABLEPREFIX}_servers \
+		(id, ssl_cert, hostname, address, game_port, control_port) values \
+		($i, '$(cat "node$i.pem")', 'localhost', '127.0.0.1', $((CLIENT_PORT + i)), $((ISL_PORT + i)))"
+
+	cat > "node$i.ini" <<EOF
+[server]
+name="ISL test node $i"
+id=$i
+port=$((CLIENT_PORT + i))
+websocket_number_pools=0
+logfile=$WORKDIR/node$i.log
+
+[authentication]
+method=none
+
+[database]
+type=mysql
+prefix=$TABLEPREFIX
+hostname=localhost
+database=$DBNAME
+user=$DBUSER
+password=$DBPASSWORD
+
+[servernetwork]
+active=1
+port=$((ISL_PORT + i))
+ssl_cert=$WORKDIR/node$i.pem
+ssl_key=$WORKDIR/node$i.key
+EOF
+done
+
+PIDS=""
+trap 'kill $PIDS 2>/dev/null; exit' INT TERM EXIT
+
+for i in $(seq 1 "$NODES"); do
+	"$SERVATRICE" --config "$WORKDIR/node$i.ini" > "node$i.out" 2>&1 &
+	PIDS="$PIDS $!"
+	echo "node $i: clients on port $((CLIENT_PORT + i)), pid $!"
+done
+
+# every node has to link up with every other one
+sleep 10
+for i in $(seq 1 "$NODES"); do
+	echo "node $i: $(grep -c "Peer authenticated" "node$i.log" || true) incoming links"
+done
+
+wait
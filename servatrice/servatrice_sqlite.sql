@@ -0,0 +1,258 @@
+-- SQLite schema file for servatrice database.
+
+-- This is the SQLite counterpart of servatrice.sql, used by the "sqlite"
+-- database type. Servatrice creates it automatically in new (or :memory:)
+-- databases, replacing the default table prefix "cockatrice" by the one
+-- configured in servatrice.ini.
+
+-- Tables and column orders must match servatrice.sql. MySQL fills in
+-- missing values of NOT NULL columns on its own, which SQLite doesn't, so
+-- those columns have explicit defaults here.
+
+-- Every time the database schema changes, the schema version number
+-- must be incremented in both schema files. Also remember to update the
+-- corresponding number in servatrice/src/servatrice_database_interface.h
+-- The migrations are written for MySQL; SQLite databases from older versions
+-- need to be recreated.
+
+CREATE TABLE IF NOT EXISTS cockatrice_schema_version (
+  version integer NOT NULL PRIMARY KEY
+);
+
+INSERT INTO cockatrice_schema_version VALUES(26);
+
+-- users and user data tables
+CREATE TABLE IF NOT EXISTS cockatrice_users (
+  id integer PRIMARY KEY AUTOINCREMENT,
+  admin integer NOT NULL DEFAULT 0,
+  name varchar(35) NOT NULL UNIQUE,
+  realname varchar(255) NOT NULL DEFAULT '',
+  gender char(1) NOT NULL DEFAULT '',
+  password_sha512 char(120) NOT NULL DEFAULT '',
+  email varchar(255) NOT NULL DEFAULT '',
+  country char(2) NOT NULL DEFAULT '',
+  avatar_bmp blob NOT NULL DEFAULT '',
+  registrationDate datetime NOT NULL DEFAULT '0000-00-00 00:00:00',
+  active integer NOT NULL DEFAULT 0,
+  token binary(16),
+  clientid varchar(15) NOT NULL DEFAULT '',
+  privlevel varchar(7) NOT NULL DEFAULT 'NONE' CHECK (privlevel IN ('NONE', 'VIP', 'DONATOR')),
+  privlevelStartDate datetime NOT NULL DEFAULT '0000-00-00 00:00:00',
+  privlevelEndDate datetime NOT NULL DEFAULT '0000-00-00 00:00:00'
+);
+CREATE INDEX IF NOT EXISTS cockatrice_users_token ON cockatrice_users (token);
+CREATE INDEX IF NOT EXISTS cockatrice_users_email ON cockatrice_users (email);
+
+CREATE TABLE IF NOT EXISTS cockatrice_decklist_files (
+  id integer PRIMARY KEY AUTOINCREMENT,
+  id_folder integer NOT NULL DEFAULT 0,
+  id_user integer NULL REFERENCES cockatrice_users(id) ON DELETE CASCADE ON UPDATE CASCADE,
+  name varchar(50) NOT NULL DEFAULT '',
+  upload_time datetime NOT NULL DEFAULT '0000-00-00 00:00:00',
+  content text NOT NULL DEFAULT ''
+);
+CREATE INDEX IF NOT EXISTS cockatrice_decklist_files_folder_user ON cockatrice_decklist_files (id_folder, id_user);
+
+CREATE TABLE IF NOT EXISTS cockatrice_decklist_folders (
+  id integer PRIMARY KEY AUTOINCREMENT,
+  id_parent integer NOT NULL DEFAULT 0,
+  id_user integer NULL REFERENCES cockatrice_users(id) ON DELETE CASCADE ON UPDATE CASCADE,
+  name varchar(30) NOT NULL DEFAULT ''
+);
+CREATE INDEX IF NOT EXISTS cockatrice_decklist_folders_parent_user ON cockatrice_decklist_folders (id_parent, id_user);
+
+CREATE TABLE IF NOT EXISTS cockatrice_ignorelist (
+  id_user1 integer NOT NULL REFERENCES cockatrice_users(id) ON DELETE CASCADE ON UPDATE CASCADE,
+  id_user2 integer NOT NULL REFERENCES cockatrice_users(id) ON DELETE CASCADE ON UPDATE CASCADE,
+  UNIQUE (id_user1, id_user2)
+);
+
+CREATE TABLE IF NOT EXISTS cockatrice_buddylist (
+  id_user1 integer NOT NULL REFERENCES cockatrice_users(id) ON DELETE CASCADE ON UPDATE CASCADE,
+  id_user2 integer NOT NULL REFERENCES cockatrice_users(id) ON DELETE CASCADE ON UPDATE CASCADE,
+  UNIQUE (id_user1, id_user2)
+);
+
+-- rooms
+CREATE TABLE IF NOT EXISTS cockatrice_rooms (
+  id integer PRIMARY KEY AUTOINCREMENT,
+  name varchar(50) NOT NULL DEFAULT '',
+  descr varchar(255) NOT NULL DEFAULT '',
+  permissionlevel varchar(13) NOT NULL DEFAULT 'NONE'
+    CHECK (permissionlevel IN ('NONE', 'REGISTERED', 'MODERATOR', 'ADMINISTRATOR')),
+  privlevel varchar(10) NOT NULL DEFAULT 'NONE' CHECK (privlevel IN ('NONE', 'PRIVILEGED', 'VIP', 'DONATOR')),
+  auto_join integer DEFAULT 0,
+  join_message varchar(255) NOT NULL DEFAULT '',
+  chat_history_size integer NOT NULL DEFAULT 0,
+  id_server integer NOT NULL DEFAULT 1
+);
+
+CREATE TABLE IF NOT EXISTS cockatrice_rooms_gametypes (
+  id_room integer NOT NULL REFERENCES cockatrice_rooms(id) ON DELETE CASCADE ON UPDATE CASCADE,
+  name varchar(50) NOT NULL DEFAULT '',
+  id_server integer NOT NULL DEFAULT 1
+);
+
+-- games
+CREATE TABLE IF NOT EXISTS cockatrice_games (
+  room_name varchar(255) NOT NULL DEFAULT '',
+  id integer PRIMARY KEY AUTOINCREMENT,
+  descr varchar(50) DEFAULT NULL,
+  creator_name varchar(35) NOT NULL DEFAULT '',
+  password integer NOT NULL DEFAULT 0,
+  game_types varchar(255) NOT NULL DEFAULT '',
+  player_count integer NOT NULL DEFAULT 0,
+  time_started datetime DEFAULT NULL,
+  time_finished datetime DEFAULT NULL
+);
+
+CREATE TABLE IF NOT EXISTS cockatrice_games_players (
+  id_game integer NOT NULL REFERENCES cockatrice_games(id) ON DELETE CASCADE ON UPDATE CASCADE,
+  player_name varchar(35) NOT NULL DEFAULT ''
+);
+CREATE INDEX IF NOT EXISTS cockatrice_games_players_game ON cockatrice_games_players (id_game);
+
+-- Note: an empty row with id_game = NULL is created when the game is created,
+-- and then updated when the game ends with the full replay data.
+CREATE TABLE IF NOT EXISTS cockatrice_replays (
+  id integer PRIMARY KEY AUTOINCREMENT,
+  id_game integer NULL REFERENCES cockatrice_games(id) ON DELETE CASCADE ON UPDATE CASCADE,
+  duration integer NOT NULL DEFAULT 0,
+  replay blob NOT NULL DEFAULT ''
+);
+CREATE INDEX IF NOT EXISTS cockatrice_replays_game ON cockatrice_replays (id_game);
+
+CREATE TABLE IF NOT EXISTS cockatrice_replays_access (
+  id_game integer NOT NULL REFERENCES cockatrice_games(id) ON DELETE CASCADE ON UPDATE CASCADE,
+  id_player integer NOT NULL REFERENCES cockatrice_users(id) ON DELETE CASCADE ON UPDATE CASCADE,
+  replay_name varchar(255) NOT NULL DEFAULT '',
+  do_not_hide integer NOT NULL DEFAULT 0
+);
+CREATE INDEX IF NOT EXISTS cockatrice_replays_access_player ON cockatrice_replays_access (id_player);
+
+-- server administration
+
+-- Note: unused table
+CREATE TABLE IF NOT EXISTS cockatrice_servers (
+  id integer NOT NULL PRIMARY KEY,
+  ssl_cert text NOT NULL DEFAULT '',
+  hostname varchar(255) NOT NULL DEFAULT '',
+  address varchar(255) NOT NULL DEFAULT '',
+  game_port integer NOT NULL DEFAULT 0,
+  control_port integer NOT NULL DEFAULT 0
+);
+
+CREATE TABLE IF NOT EXISTS cockatrice_uptime (
+  id_server integer NOT NULL DEFAULT 0,
+  timest datetime NOT NULL DEFAULT '0000-00-00 00:00:00' PRIMARY KEY,
+  uptime integer NOT NULL DEFAULT 0,
+  users_count integer NOT NULL DEFAULT 0,
+  mods_count integer NOT NULL DEFAULT 0,
+  mods_list text,
+  games_count integer NOT NULL DEFAULT 0,
+  rx_bytes integer NOT NULL DEFAULT 0,
+  tx_bytes integer NOT NULL DEFAULT 0
+);
+
+CREATE TABLE IF NOT EXISTS cockatrice_servermessages (
+  id_server integer NOT NULL DEFAULT 1,
+  timest datetime NOT NULL DEFAULT '0000-00-00 00:00:00' PRIMARY KEY,
+  message text
+);
+
+CREATE TABLE IF NOT EXISTS cockatrice_sessions (
+  id integer PRIMARY KEY AUTOINCREMENT,
+  user_name varchar(35) NOT NULL DEFAULT '',
+  id_server integer NOT NULL DEFAULT 0,
+  ip_address varchar(45) NOT NULL DEFAULT '',
+  start_time datetime NOT NULL DEFAULT '0000-00-00 00:00:00',
+  end_time datetime DEFAULT NULL,
+  clientid varchar(15) NOT NULL DEFAULT '',
+  connection_type varchar(9) CHECK (connection_type IN ('tcp', 'websocket'))
+);
+CREATE INDEX IF NOT EXISTS cockatrice_sessions_username ON cockatrice_sessions (user_name);
+
+-- server moderation
+CREATE TABLE IF NOT EXISTS cockatrice_bans (
+  user_name varchar(35) NOT NULL DEFAULT '',
+  ip_address varchar(45) NOT NULL DEFAULT '',
+  id_admin integer NOT NULL REFERENCES cockatrice_users(id) ON DELETE CASCADE ON UPDATE CASCADE,
+  time_from datetime NOT NULL,
+  minutes integer NOT NULL DEFAULT 0,
+  reason text NOT NULL DEFAULT '',
+  visible_reason text NOT NULL DEFAULT '',
+  clientid varchar(15) NOT NULL DEFAULT '',
+  PRIMARY KEY (user_name, time_from)
+);
+CREATE INDEX IF NOT EXISTS cockatrice_bans_time_from ON cockatrice_bans (time_from, ip_address);
+CREATE INDEX IF NOT EXISTS cockatrice_bans_ip_address ON cockatrice_bans (ip_address);
+
+CREATE TABLE IF NOT EXISTS cockatrice_warnings (
+  user_id integer NOT NULL,
+  user_name varchar(35) NOT NULL DEFAULT '',
+  mod_name varchar(35) NOT NULL DEFAULT '',
+  reason text NOT NULL DEFAULT '',
+  time_of datetime NOT NULL,
+  clientid varchar(15) NOT NULL DEFAULT '',
+  PRIMARY KEY (user_id, time_of)
+);
+
+CREATE TABLE IF NOT EXISTS cockatrice_log (
+  log_time datetime NOT NULL,
+  sender_id integer NULL REFERENCES cockatrice_users(id) ON DELETE CASCADE ON UPDATE CASCADE,
+  sender_name varchar(35) NOT NULL DEFAULT '',
+  sender_ip varchar(45) NOT NULL DEFAULT '',
+  log_message text NOT NULL DEFAULT '',
+  target_type varchar(4) CHECK (target_type IN ('room', 'game', 'chat')),
+  -- No FK on target_id, it can be zero
+  target_id integer NULL,
+  target_name varchar(50) NOT NULL DEFAULT ''
+);
+CREATE INDEX IF NOT EXISTS cockatrice_log_sender_name ON cockatrice_log (sender_name);
+CREATE INDEX IF NOT EXISTS cockatrice_log_sender_ip ON cockatrice_log (sender_ip);
+CREATE INDEX IF NOT EXISTS cockatrice_log_target_type ON cockatrice_log (target_type);
+CREATE INDEX IF NOT EXISTS cockatrice_log_target_id ON cockatrice_log (target_id);
+CREATE INDEX IF NOT EXISTS cockatrice_log_target_name ON cockatrice_log (target_name);
+
+CREATE TABLE IF NOT EXISTS cockatrice_activation_emails (
+  name varchar(35) NOT NULL REFERENCES cockatrice_users(name) ON DELETE CASCADE ON UPDATE CASCADE
+);
+
+CREATE TABLE IF NOT EXISTS cockatrice_user_analytics (
+  id integer NOT NULL PRIMARY KEY REFERENCES cockatrice_users(id) ON DELETE CASCADE ON UPDATE CASCADE,
+  client_ver varchar(35) NOT NULL DEFAULT '',
+  last_login datetime NOT NULL DEFAULT '0000-00-00 00:00:00',
+  notes varchar(255) NOT NULL DEFAULT ''
+);
+
+CREATE TABLE IF NOT EXISTS cockatrice_donations (
+  id integer PRIMARY KEY AUTOINCREMENT,
+  username varchar(35) DEFAULT NULL,
+  email varchar(255) DEFAULT NULL,
+  payment_pre_fee double DEFAULT NULL,
+  payment_post_fee double DEFAULT NULL,
+  term_length integer DEFAULT NULL,
+  date varchar(255) DEFAULT NULL,
+  pp_type varchar(255) DEFAULT NULL
+);
+
+CREATE TABLE IF NOT EXISTS cockatrice_forgot_password (
+  id integer PRIMARY KEY AUTOINCREMENT,
+  name varchar(35) NOT NULL DEFAULT '',
+  requestDate datetime NOT NULL DEFAULT '0000-00-00 00:00:00',
+  emailed integer NOT NULL DEFAULT 0
+);
+CREATE INDEX IF NOT EXISTS cockatrice_forgot_password_user_name ON cockatrice_forgot_password (name);
+
+CREATE TABLE IF NOT EXISTS cockatrice_audit (
+  id integer PRIMARY KEY AUTOINCREMENT,
+  id_server integer NOT NULL DEFAULT 0,
+  name varchar(35) NOT NULL DEFAULT '',
+  ip_address varchar(45) NOT NULL DEFAULT '',
+  clientid varchar(15) NOT NULL DEFAULT '',
+  incidentDate datetime NOT NULL DEFAULT '0000-00-00 00:00:00',
+  action varchar(35) NOT NULL DEFAULT '',
+  results varchar(7) NOT NULL DEFAULT 'fail' CHECK (results IN ('fail', 'success')),
+  details varchar(255) NOT NULL DEFAULT ''
+);
+CREATE INDEX IF NOT EXISTS cockatrice_audit_user_name ON cockatrice_audit (name);
@@ -4,6 +4,7 @@
 #include "server_protocolhandler.h"
 #include "server_room.h"
 #include <QSslSocket>
+#include <QTimer>
 
 #include "get_pb_extension.h"
 #include "pb/event_game_joined.pb.h"
@@ -18,23 +19,62 @@
 #include "pb/isl_message.pb.h"
 #include <google/protobuf/descriptor.h>
 
+// Set in the length prefix of a frame that holds zlib compressed, length prefixed messages.
+static const quint32 compressedFrameFlag = 0x80000000;
+// Batches smaller than this are not worth compressing.
+static const int compressionThreshold = 256;
+// How long an incoming link waits for the other server to announce its link options, in milliseconds.
+static const int linkOptionsTimeout = 2000;
+// Tag of IslMessage::link_sequence (field 11, varint).
+static const char linkSequenceTag = (11 << 3) | 0;
+
+static quint32 readFrameHeader(const char *data)
+{
+    return (((quint32)(unsigned char)data[0]) << 24) + (((quint32)(unsigned char)data[1]) << 16) +
+           (((quint32)(unsigned char)data[2]) << 8) + ((quint32)(unsigned char)data[3]);
+}
+
+static void writeFrameHeader(char *data, quint32 value)
+{
+    data[3] = (unsigned char)value;
+    data[2] = (unsigned char)(value >> 8);
+    data[1] = (unsigned char)(value >> 16);
+    data[0] = (unsigned char)(value >> 24);
+}
+
 void IslInterface::sharedCtor(const QSslCertificate &cert, const QSslKey &privateKey)
 {
     socket = new QSslSocket(this);
     socket->setLocalCertificate(cert);
     socket->setPrivateKey(privateKey);
 
+    flushTimer = new QTimer(this);
+    flushTimer->setSingleShot(true);
+    flushTimer->setInterval(server->getISLNetworkFlushInterval());
+
+    digestTimer = new QTimer(this);
+    digestTimer->setInterval(server->getISLNetworkDigestInterval() * 1000);
+
+    linkOptionsTimer = new QTimer(this);
+    linkOptionsTimer->setSingleShot(true);
+    linkOptionsTimer->setInterval(linkOptionsTimeout);
+
     connect(socket, SIGNAL(readyRead()), this, SLOT(readClient()), Qt::QueuedConnection);
     connect(socket, SIGNAL(error(QAbstractSocket::SocketError)), this,
             SLOT(catchSocketError(QAbstractSocket::SocketError)));
-    connect(this, SIGNAL(outputBufferChanged()), this, SLOT(flushOutputBuffer()), Qt::QueuedConnection);
+    connect(this, SIGNAL(outputBufferChanged()), this, SLOT(scheduleFlush()), Qt::QueuedConnection);
+    connect(flushTimer, SIGNAL(timeout()), this, SLOT(flushOutputBuffer()));
+    connect(digestTimer, SIGNAL(timeout()), this, SLOT(sendStateDigest()));
+    connect(linkOptionsTimer, SIGNAL(timeout()), this, SLOT(linkOptionsTimedOut()));
 }
 
 IslInterface::IslInterface(int _socketDescriptor,
                            const QSslCertificate &cert,
                            const QSslKey &privateKey,
                            Servatrice *_server)
-    : QObject(), socketDescriptor(_socketDescriptor), server(_server), messageInProgress(false)
+    : QObject(), serverId(-1), socketDescriptor(_socketDescriptor), server(_server), messageInProgress(false),
+      messageCompressed(false), compressOutput(false), peerStateSync(false), linkOptionsPending(false),
+      peerMulticastGameEvents(false), nextSequence(1), lastReceivedSequence(0)
 {
     sharedCtor(cert, privateKey);
 }
@@ -48,7 +88,9 @@ IslInterface::IslInterface(int _serverId,
                            const QSslKey &privateKey,
                            Servatrice *_server)
     : QObject(), serverId(_serverId), peerHostName(_peerHostName), peerAddress(_peerAddress), peerPort(_peerPort),
-      peerCert(_peerCert), server(_server), messageInProgress(false)
+      peerCert(_peerCert), server(_server), messageInProgress(false), messageCompressed(false),
+      compressOutput(false), peerStateSync(false), linkOptionsPending(false), peerMulticastGameEvents(false),
+      nextSequence(1), lastReceivedSequence(0)
 {
     sharedCtor(cert, privateKey);
 }
@@ -59,32 +101,9 @@ IslInterface::~IslInterface()
 
     flushOutputBuffer();
 
-    // As these signals are connected with Qt::QueuedConnection implicitly,
-    // we don't need to worry about them modifying the lists while we're iterating.
-
-    server->roomsLock.lockForRead();
-    QMapIterator<int, Server_Room *> roomIterator(server->getRooms());
-    while (roomIterator.hasNext()) {
-        Server_Room *room = roomIterator.next().value();
-        room->usersLock.lockForRead();
-        QMapIterator<QString, ServerInfo_User_Container> roomUsers(room->getExternalUsers());
-        while (roomUsers.hasNext()) {
-            roomUsers.next();
-            if (roomUsers.value().getUserInfo()->server_id() == serverId)
-                emit externalRoomUserLeft(room->getId(), roomUsers.key());
-        }
-        room->usersLock.unlock();
-    }
-    server->roomsLock.unlock();
-
-    server->clientsLock.lockForRead();
-    QMapIterator<QString, Server_AbstractUserInterface *> extUsers(server->getExternalUsers());
-    while (extUsers.hasNext()) {
-        extUsers.next();
-        if (extUsers.value()->getUserInfo()->server_id() == serverId)
-            emit externalUserLeft(extUsers.key());
-    }
-    server->clientsLock.unlock();
+    // The users and games of the other server are kept for a while in case the link comes back.
+    if (serverId != -1)
+        QMetaObject::invokeMethod(server, "islLinkLost", Qt::QueuedConnection, Q_ARG(int, serverId));
 }
 
 void IslInterface::initServer()
@@ -94,13 +113,13 @@ void IslInterface::initServer()
     logger->logMessage(QString("[ISL] incoming connection: %1").arg(socket->peerAddress().toString()));
 
     QList<ServerProperties> serverList = server->getServerList();
-    int listIndex = -1;
+    bool addressKnown = false;
     for (int i = 0; i < serverList.size(); ++i)
         if (serverList[i].address == socket->peerAddress()) {
-            listIndex = i;
+            addressKnown = true;
             break;
         }
-    if (listIndex == -1) {
+    if (!addressKnown) {
         logger->logMessage(
             QString("[ISL] address %1 unknown, terminating connection").arg(socket->peerAddress().toString()));
         deleteLater();
@@ -118,7 +137,14 @@ void IslInterface::initServer()
         return;
     }
 
-    if (serverList[listIndex].cert == socket->peerCertificate())
+    // several servers may share an address (e.g. when running on the same host), the certificate tells them apart
+    int listIndex = -1;
+    for (int i = 0; i < serverList.size(); ++i)
+        if ((serverList[i].address == socket->peerAddress()) && (serverList[i].cert == socket->peerCertificate())) {
+            listIndex = i;
+            break;
+        }
+    if (listIndex != -1)
         logger->logMessage(QString("[ISL] Peer authenticated as " + serverList[listIndex].hostname));
     else {
         logger->logMessage(QString("[ISL] Authentication failed, terminating connection"));
@@ -127,21 +153,58 @@ void IslInterface::initServer()
     }
     serverId = serverList[listIndex].id;
 
+    // Servers that keep their state in sync by digests don't need the complete list, which matters when a link
+    // comes back after a short interruption and both sides still know most of each other's state. Whether the
+    // other server is one of them is only known once its first message has arrived (see readLinkOptions()).
+    linkOptionsPending = true;
+    linkOptionsTimer->start();
+    if (socket->bytesAvailable() > 0)
+        readClient();
+}
+
+void IslInterface::linkOptionsTimedOut()
+{
+    if (linkOptionsPending && finishInitServer() && !inputBuffer.isEmpty())
+        readClient();
+}
+
+bool IslInterface::finishInitServer()
+{
+    linkOptionsPending = false;
+    linkOptionsTimer->stop();
+
+    if (peerStateSync) {
+        server->islLock.lockForWrite();
+        const bool duplicate = server->islConnectionExists(serverId);
+        if (duplicate) {
+            qDebug() << "[ISL] Duplicate connection to #" << serverId << "terminating connection";
+            deleteLater();
+        } else {
+            sendLinkOptions();
+            server->addIslInterface(serverId, this);
+        }
+        server->islLock.unlock();
+
+        if (!duplicate)
+            sendStateDigest();
+        return !duplicate;
+    }
+
     Event_ServerCompleteList event;
     event.set_server_id(server->getServerID());
 
-    server->clientsLock.lockForRead();
+    server->clientsLock.lockForRead(SERVER_LOCK_SITE);
     QMapIterator<QString, Server_ProtocolHandler *> userIterator(server->getUsers());
     while (userIterator.hasNext())
-        event.add_user_list()->CopyFrom(userIterator.next().value()->copyUserInfo(true, true));
+        event.add_user_list()->CopyFrom(userIterator.next().value()->copyUserInfo(true, true, true));
     server->clientsLock.unlock();
 
-    server->roomsLock.lockForRead();
+    server->roomsLock.lockForRead(SERVER_LOCK_SITE);
     QMapIterator<int, Server_Room *> roomIterator(server->getRooms());
     while (roomIterator.hasNext()) {
         Server_Room *room = roomIterator.next().value();
         room->usersLock.lockForRead();
-        room->gamesLock.lockForRead();
+        room->gamesLock.lockForRead(SERVER_LOCK_SITE);
         room->getInfo(*event.add_room_list(), true, true, false);
     }
 
@@ -153,10 +216,12 @@ void IslInterface::initServer()
         ->CopyFrom(event);
 
     server->islLock.lockForWrite();
-    if (server->islConnectionExists(serverId)) {
+    const bool duplicate = server->islConnectionExists(serverId);
+    if (duplicate) {
         qDebug() << "[ISL] Duplicate connection to #" << serverId << "terminating connection";
         deleteLater();
     } else {
+        sendLinkOptions();
         transmitMessage(message);
         server->addIslInterface(serverId, this);
     }
@@ -169,6 +234,8 @@ void IslInterface::initServer()
         roomIterator.value()->usersLock.unlock();
     }
     server->roomsLock.unlock();
+
+    return !duplicate;
 }
 
 void IslInterface::initClient()
@@ -202,18 +269,158 @@ void IslInterface::initClient()
         return;
     }
 
+    sendLinkOptions();
     server->addIslInterface(serverId, this);
     server->islLock.unlock();
 }
 
+void IslInterface::sendLinkOptions()
+{
+    IslMessage message;
+    message.set_message_type(IslMessage::SESSION_EVENT);
+    message.mutable_session_event();
+    message.mutable_link_options()->set_compression(server->getISLNetworkCompression());
+    message.mutable_link_options()->set_state_sync(true);
+    message.mutable_link_options()->set_multicast_game_events(true);
+    transmitMessage(message);
+}
+
+// Servers that announce link options do so with their first message, anything else means that the other server
+// doesn't know about them. Returns false as long as the messages in the input buffer have to wait.
+bool IslInterface::readLinkOptions()
+{
+    if (inputBuffer.size() < 4)
+        return false;
+    const quint32 header = readFrameHeader(inputBuffer.constData());
+    if (!(header & compressedFrameFlag)) {
+        if (inputBuffer.size() < 4 + (int)header)
+            return false;
+
+        IslMessage message;
+        if (message.ParseFromArray(inputBuffer.constData() + 4, header) && message.has_link_options()) {
+            inputBuffer.remove(0, 4 + header);
+            lastReceivedSequence = message.link_sequence();
+            applyLinkOptions(message.link_options());
+        }
+    }
+    return finishInitServer();
+}
+
+void IslInterface::applyLinkOptions(const IslLinkOptions &options)
+{
+    outputBufferMutex.lock();
+    compressOutput = options.compression() && server->getISLNetworkCompression();
+    peerMulticastGameEvents = options.multicast_game_events();
+    outputBufferMutex.unlock();
+
+    peerStateSync = options.state_sync();
+    if (peerStateSync && (digestTimer->interval() > 0))
+        digestTimer->start();
+}
+
+void IslInterface::sendStateDigest()
+{
+    IslMessage message;
+    message.set_message_type(IslMessage::SESSION_EVENT);
+    message.mutable_session_event();
+    server->getLocalStateDigest(*message.mutable_state_digest());
+    transmitMessage(message);
+}
+
+void IslInterface::sendResyncRequest(const IslResyncRequest &request)
+{
+    IslMessage message;
+    message.set_message_type(IslMessage::SESSION_EVENT);
+    message.mutable_session_event();
+    message.mutable_resync_request()->CopyFrom(request);
+    transmitMessage(message);
+}
+
+void IslInterface::processStateDigest(const IslStateDigest &digest)
+{
+    IslStateDigest replicated;
+    server->getExternalStateDigest(serverId, replicated);
+
+    QMap<int, quint64> replicatedRooms;
+    for (const IslStateDigest::RoomDigest &roomDigest : replicated.room_digests())
+        replicatedRooms.insert(roomDigest.room_id(), roomDigest.digest());
+
+    // only the parts that differ are requested again
+    IslResyncRequest request;
+    if (digest.user_digest() != replicated.user_digest())
+        request.set_users(true);
+    for (const IslStateDigest::RoomDigest &roomDigest : digest.room_digests())
+        if (replicatedRooms.contains(roomDigest.room_id()) &&
+            (replicatedRooms.value(roomDigest.room_id()) != roomDigest.digest()))
+            request.add_room_ids(roomDigest.room_id());
+
+    if (request.users() || request.room_ids_size()) {
+        logger->logMessage(QString("[ISL] State of #%1 differs in %2 rooms%3, resyncing")
+                               .arg(serverId)
+                               .arg(request.room_ids_size())
+                               .arg(request.users() ? " and the user list" : ""),
+                           this);
+        sendResyncRequest(request);
+    }
+}
+
+void IslInterface::processResyncRequest(const IslResyncRequest &request)
+{
+    if (request.send_digest())
+        sendStateDigest();
+    if (!request.users() && !request.room_ids_size())
+        return;
+
+    IslMessage message;
+    message.set_message_type(IslMessage::SESSION_EVENT);
+    message.mutable_session_event();
+    IslResync *resync = message.mutable_resync();
+
+    if (request.users()) {
+        resync->set_users_included(true);
+        Server_ReadLocker clientsLocker(&server->clientsLock, SERVER_LOCK_SITE);
+        QMapIterator<QString, Server_ProtocolHandler *> userIterator(server->getUsers());
+        while (userIterator.hasNext())
+            resync->add_user_list()->CopyFrom(userIterator.next().value()->copyUserInfo(true, true, true));
+    }
+
+    Server_ReadLocker roomsLocker(&server->roomsLock, SERVER_LOCK_SITE);
+    for (int roomId : request.room_ids()) {
+        Server_Room *room = server->getRooms().value(roomId);
+        if (room)
+            room->getInfo(*resync->add_room_list(), true, false, false);
+    }
+    roomsLocker.unlock();
+
+    transmitMessage(message);
+}
+
+void IslInterface::scheduleFlush()
+{
+    // Messages queued until the timer fires go out as one write (and one compressed frame).
+    if (flushTimer->interval() <= 0)
+        flushOutputBuffer();
+    else if (!flushTimer->isActive())
+        flushTimer->start();
+}
+
 void IslInterface::flushOutputBuffer()
 {
     QMutexLocker locker(&outputBufferMutex);
     if (outputBuffer.isEmpty())
         return;
+
+    if (compressOutput && (outputBuffer.size() >= compressionThreshold)) {
+        const QByteArray compressed = qCompress(outputBuffer);
+        QByteArray frame;
+        frame.resize(4);
+        writeFrameHeader(frame.data(), (quint32)compressed.size() | compressedFrameFlag);
+        frame.append(compressed);
+        outputBuffer = frame;
+    }
+
     server->incTxBytes(outputBuffer.size());
     socket->write(outputBuffer);
-    socket->flush();
     outputBuffer.clear();
 }
 
@@ -223,13 +430,15 @@ void IslInterface::readClient()
     server->incRxBytes(data.size());
     inputBuffer.append(data);
 
-    do {
+    if (linkOptionsPending && !readLinkOptions())
+        return;
+
+    while (!inputBuffer.isEmpty()) {
         if (!messageInProgress) {
             if (inputBuffer.size() >= 4) {
-                messageLength = (((quint32)(unsigned char)inputBuffer[0]) << 24) +
-                                (((quint32)(unsigned char)inputBuffer[1]) << 16) +
-                                (((quint32)(unsigned char)inputBuffer[2]) << 8) +
-                                ((quint32)(unsigned char)inputBuffer[3]);
+                const quint32 header = readFrameHeader(inputBuffer.constData());
+                messageCompressed = header & compressedFrameFlag;
+                messageLength = header & ~compressedFrameFlag;
                 inputBuffer.remove(0, 4);
                 messageInProgress = true;
             } else
@@ -238,13 +447,43 @@ void IslInterface::readClient()
         if (inputBuffer.size() < messageLength)
             return;
 
-        IslMessage newMessage;
-        newMessage.ParseFromArray(inputBuffer.data(), messageLength);
+        const QByteArray frame = inputBuffer.left(messageLength);
         inputBuffer.remove(0, messageLength);
         messageInProgress = false;
 
+        if (messageCompressed)
+            processCompressedFrame(frame);
+        else {
+            IslMessage newMessage;
+            newMessage.ParseFromArray(frame.data(), frame.size());
+            processMessage(newMessage);
+        }
+    }
+}
+
+void IslInterface::processCompressedFrame(const QByteArray &frame)
+{
+    const QByteArray batch = qUncompress(frame);
+    if (batch.isEmpty()) {
+        qDebug() << "[ISL] Invalid compressed frame from #" << serverId;
+        return;
+    }
+
+    int pos = 0;
+    while (pos + 4 <= batch.size()) {
+        const int length = readFrameHeader(batch.constData() + pos);
+        pos += 4;
+        if ((length < 0) || (pos + length > batch.size())) {
+            qDebug() << "[ISL] Truncated message in compressed frame from #" << serverId;
+            return;
+        }
+
+        IslMessage newMessage;
+        newMessage.ParseFromArray(batch.data() + pos, length);
+        pos += length;
+
         processMessage(newMessage);
-    } while (!inputBuffer.isEmpty());
+    }
 }
 
 void IslInterface::catchSocketError(QAbstractSocket::SocketError socketError)
@@ -258,43 +497,74 @@ void IslInterface::catchSocketError(QAbstractSocket::SocketError socketError)
     deleteLater();
 }
 
-void IslInterface::transmitMessage(const IslMessage &item)
+QByteArray IslInterface::encodeMessage(const IslMessage &item)
 {
     QByteArray buf;
     unsigned int size = item.ByteSize();
-    buf.resize(size + 4);
-    item.SerializeToArray(buf.data() + 4, size);
-    buf.data()[3] = (unsigned char)size;
-    buf.data()[2] = (unsigned char)(size >> 8);
-    buf.data()[1] = (unsigned char)(size >> 16);
-    buf.data()[0] = (unsigned char)(size >> 24);
+    buf.resize(size);
+    item.SerializeToArray(buf.data(), size);
+    return buf;
+}
+
+void IslInterface::transmitMessage(const IslMessage &item)
+{
+    if (item.session_ids_size() > 0) {
+        outputBufferMutex.lock();
+        const bool multicast = peerMulticastGameEvents;
+        outputBufferMutex.unlock();
+
+        // servers that don't know about several sessions per message get a copy for each of them
+        if (!multicast) {
+            IslMessage singleSessionItem(item);
+            singleSessionItem.clear_session_ids();
+            for (google::protobuf::uint64 sessionId : item.session_ids()) {
+                singleSessionItem.set_session_id(sessionId);
+                transmitFrame(encodeMessage(singleSessionItem));
+            }
+            return;
+        }
+    }
+    transmitFrame(encodeMessage(item));
+}
+
+void IslInterface::transmitFrame(const QByteArray &frame)
+{
+    // The sequence number is appended as an extra field; protobuf merges it into the already encoded message.
+    char sequenceField[11];
+    int sequenceFieldSize = 0;
+    sequenceField[sequenceFieldSize++] = linkSequenceTag;
 
     outputBufferMutex.lock();
-    outputBuffer.append(buf);
+    quint64 sequence = nextSequence++;
+    while (sequence >= 0x80) {
+        sequenceField[sequenceFieldSize++] = (char)((sequence & 0x7f) | 0x80);
+        sequence >>= 7;
+    }
+    sequenceField[sequenceFieldSize++] = (char)sequence;
+
+    char header[4];
+    writeFrameHeader(header, frame.size() + sequenceFieldSize);
+
+    const bool wasEmpty = outputBuffer.isEmpty();
+    outputBuffer.append(header, 4);
+    outputBuffer.append(frame);
+    outputBuffer.append(sequenceField, sequenceFieldSize);
     outputBufferMutex.unlock();
-    emit outputBufferChanged();
+
+    // the buffer is flushed as a whole, so only the first message of a batch needs to schedule it
+    if (wasEmpty)
+        emit outputBufferChanged();
 }
 
 void IslInterface::sessionEvent_ServerCompleteList(const Event_ServerCompleteList &event)
 {
-    for (int i = 0; i < event.user_list_size(); ++i) {
-        ServerInfo_User temp(event.user_list(i));
-        temp.set_server_id(serverId);
-        emit externalUserJoined(temp);
-    }
-    for (int i = 0; i < event.room_list_size(); ++i) {
-        const ServerInfo_Room &room = event.room_list(i);
-        for (int j = 0; j < room.user_list_size(); ++j) {
-            ServerInfo_User userInfo(room.user_list(j));
-            userInfo.set_server_id(serverId);
-            emit externalRoomUserJoined(room.room_id(), userInfo);
-        }
-        for (int j = 0; j < room.game_list_size(); ++j) {
-            ServerInfo_Game gameInfo(room.game_list(j));
-            gameInfo.set_server_id(serverId);
-            emit externalRoomGameListChanged(room.room_id(), gameInfo);
-        }
-    }
+    // The state of a server whose link came back within the reconnect grace period is still known, so the complete
+    // list is compared with it like a resync instead of being added on top.
+    IslResync resync;
+    resync.set_users_included(true);
+    resync.mutable_user_list()->CopyFrom(event.user_list());
+    resync.mutable_room_list()->CopyFrom(event.room_list());
+    emit stateResyncReceived(serverId, resync);
 }
 
 void IslInterface::sessionEvent_UserJoined(const Event_UserJoined &event)
@@ -353,7 +623,7 @@ void IslInterface::processSessionEvent(const SessionEvent &event, qint64 session
             sessionEvent_UserLeft(event.GetExtension(Event_UserLeft::ext));
             break;
         case SessionEvent::GAME_JOINED: {
-            QReadLocker clientsLocker(&server->clientsLock);
+            Server_ReadLocker clientsLocker(&server->clientsLock, SERVER_LOCK_SITE);
             Server_AbstractUserInterface *client = server->getUsersBySessionId().value(sessionId);
             if (!client) {
                 qDebug() << "IslInterface::processSessionEvent: session id" << sessionId << "not found";
@@ -367,7 +637,7 @@ void IslInterface::processSessionEvent(const SessionEvent &event, qint64 session
         }
         case SessionEvent::USER_MESSAGE:
         case SessionEvent::REPLAY_ADDED: {
-            QReadLocker clientsLocker(&server->clientsLock);
+            Server_ReadLocker clientsLocker(&server->clientsLock, SERVER_LOCK_SITE);
             Server_AbstractUserInterface *client = server->getUsersBySessionId().value(sessionId);
             if (!client) {
                 qDebug() << "IslInterface::processSessionEvent: session id" << sessionId << "not found";
@@ -417,6 +687,35 @@ void IslInterface::processMessage(const IslMessage &item)
 {
     qDebug() << QString::fromStdString(item.DebugString());
 
+    if (item.has_link_sequence()) {
+        if (lastReceivedSequence && (item.link_sequence() != lastReceivedSequence + 1) && peerStateSync) {
+            logger->logMessage(QString("[ISL] Lost messages from #%1, requesting digest").arg(serverId), this);
+            IslResyncRequest request;
+            request.set_send_digest(true);
+            sendResyncRequest(request);
+        }
+        lastReceivedSequence = item.link_sequence();
+    }
+
+    if (item.has_link_options()) {
+        applyLinkOptions(item.link_options());
+        if (peerStateSync)
+            sendStateDigest();
+        return;
+    }
+    if (item.has_state_digest()) {
+        processStateDigest(item.state_digest());
+        return;
+    }
+    if (item.has_resync_request()) {
+        processResyncRequest(item.resync_request());
+        return;
+    }
+    if (item.has_resync()) {
+        emit stateResyncReceived(serverId, item.resync());
+        return;
+    }
+
     switch (item.message_type()) {
         case IslMessage::ROOM_COMMAND_CONTAINER: {
             processRoomCommand(item.room_command(), item.session_id());
@@ -435,7 +734,11 @@ void IslInterface::processMessage(const IslMessage &item)
             break;
         }
         case IslMessage::GAME_EVENT_CONTAINER: {
-            emit gameEventContainerReceived(item.game_event_container(), item.session_id());
+            if (item.session_ids_size() > 0) {
+                for (google::protobuf::uint64 sessionId : item.session_ids())
+                    emit gameEventContainerReceived(item.game_event_container(), static_cast<qint64>(sessionId));
+            } else
+                emit gameEventContainerReceived(item.game_event_container(), item.session_id());
             break;
         }
         case IslMessage::ROOM_EVENT: {
@@ -1,6 +1,7 @@
 #ifndef ISL_INTERFACE_H
 #define ISL_INTERFACE_H
 
+#include "pb/isl_message.pb.h"
 #include "pb/serverinfo_game.pb.h"
 #include "pb/serverinfo_room.pb.h"
 #include "pb/serverinfo_user.pb.h"
@@ -11,7 +12,7 @@
 class Servatrice;
 class QSslSocket;
 class QSslKey;
-class IslMessage;
+class QTimer;
 
 class Event_ServerCompleteList;
 class Event_UserMessage;
@@ -30,6 +31,9 @@ private slots:
     void readClient();
     void catchSocketError(QAbstractSocket::SocketError socketError);
     void flushOutputBuffer();
+    void scheduleFlush();
+    void sendStateDigest();
+    void linkOptionsTimedOut();
 signals:
     void outputBufferChanged();
 
@@ -43,6 +47,7 @@ signals:
     void gameCommandContainerReceived(const CommandContainer &cont, int playerId, int serverId, qint64 sessionId);
     void responseReceived(const Response &resp, qint64 sessionId);
     void gameEventContainerReceived(const GameEventContainer &cont, qint64 sessionId);
+    void stateResyncReceived(int serverId, IslResync resync);
 
 private:
     int serverId;
@@ -54,10 +59,18 @@ private:
     QMutex outputBufferMutex;
     Servatrice *server;
     QSslSocket *socket;
+    QTimer *flushTimer, *digestTimer, *linkOptionsTimer;
 
     QByteArray inputBuffer, outputBuffer;
-    bool messageInProgress;
+    bool messageInProgress, messageCompressed;
     int messageLength;
+    bool compressOutput;
+    bool peerStateSync;
+    // set while an incoming link waits for the link options of the other server
+    bool linkOptionsPending;
+    // guarded by outputBufferMutex
+    bool peerMulticastGameEvents;
+    quint64 nextSequence, lastReceivedSequence;
 
     void sessionEvent_ServerCompleteList(const Event_ServerCompleteList &event);
     void sessionEvent_UserJoined(const Event_UserJoined &event);
@@ -75,6 +88,14 @@ private:
     void processRoomCommand(const CommandContainer &cont, qint64 sessionId);
 
     void processMessage(const IslMessage &item);
+    void processCompressedFrame(const QByteArray &frame);
+    void sendLinkOptions();
+    bool readLinkOptions();
+    bool finishInitServer();
+    void applyLinkOptions(const IslLinkOptions &options);
+    void processStateDigest(const IslStateDigest &digest);
+    void processResyncRequest(const IslResyncRequest &request);
+    void sendResyncRequest(const IslResyncRequest &request);
     void sharedCtor(const QSslCertificate &cert, const QSslKey &privateKey);
 public slots:
     void initServer();
@@ -93,6 +114,10 @@ public:
     ~IslInterface();
 
     void transmitMessage(const IslMessage &item);
+    // Queues a message encoded with encodeMessage(), so that broadcasts are only serialized once.
+    // Each link numbers the messages it sends.
+    void transmitFrame(const QByteArray &frame);
+    static QByteArray encodeMessage(const IslMessage &item);
 };
 
 #endif
@@ -27,20 +27,62 @@
 #include "pb/event_server_shutdown.pb.h"
 #include "servatrice_connection_pool.h"
 #include "servatrice_database_interface.h"
+#include "servatrice_handoff.h"
 #include "server_logger.h"
 #include "server_room.h"
 #include "serversocketinterface.h"
 #include "settingscache.h"
 #include "smtpclient.h"
+#include <QCryptographicHash>
 #include <QDateTime>
 #include <QDebug>
 #include <QFile>
+#include <QSet>
 #include <QSqlQuery>
 #include <QString>
 #include <QStringList>
+#include <QTcpSocket>
 #include <QTimer>
+#include <QtEndian>
 #include <iostream>
 
+#ifdef Q_OS_LINUX
+#include <cerrno>
+#include <cstring>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+// What a client adds to the load of a pool until the load is updated
+static const double clientLoad = 0.001;
+// Difference of the load of two pools from which on idle clients are moved, and how many at most at once
+static const double rebalanceThreshold = 0.25;
+static const int maxRebalancedClients = 50;
+// Seconds without an action after which a client counts as idle
+static const int rebalanceIdleTime = 60;
+// Milliseconds between the attempts to hand over the clients to a new server process
+static const int handoffInterval = 1000;
+// Minutes the players of the games still running are warned before the old process shuts down
+static const int handoffShutdownMinutes = 5;
+
+// Takes over the listening socket of the server process this one replaces, if there is one, or listens itself.
+template <class ListeningServer>
+static bool listenOrTakeOver(ListeningServer *listeningServer,
+                             Servatrice_Handoff *handoff,
+                             HandoffMessage::Listener listener,
+                             const QHostAddress &address,
+                             quint16 port)
+{
+    const int socketDescriptor = handoff ? handoff->takeListener(listener) : -1;
+    if (socketDescriptor == -1)
+        return listeningServer->listen(address, port);
+    if (listeningServer->setSocketDescriptor(socketDescriptor))
+        return true;
+    Servatrice_Handoff::closeSocket(socketDescriptor);
+    return false;
+}
+
 Servatrice_GameServer::Servatrice_GameServer(Servatrice *_server,
                                              int _numberPools,
                                              const QSqlDatabase &_sqlDatabase,
@@ -49,7 +91,7 @@ Servatrice_GameServer::Servatrice_GameServer(Servatrice *_server,
 {
     for (int i = 0; i < _numberPools; ++i) {
         auto newDatabaseInterface = new Servatrice_DatabaseInterface(i, server);
-        auto newPool = new Servatrice_ConnectionPool(newDatabaseInterface);
+        auto newPool = new Servatrice_ConnectionPool(newDatabaseInterface, server->getMetrics().getPoolMetrics(i));
 
         auto newThread = new QThread;
         newThread->setObjectName("pool_" + QString::number(i));
@@ -60,13 +102,25 @@ Servatrice_GameServer::Servatrice_GameServer(Servatrice *_server,
         newThread->start();
         QMetaObject::invokeMethod(newDatabaseInterface, "initDatabase", Qt::BlockingQueuedConnection,
                                   Q_ARG(QSqlDatabase, _sqlDatabase));
+        QMetaObject::invokeMethod(newPool, "startLoadTracking", Qt::QueuedConnection);
 
         connectionPools.append(newPool);
     }
+
+    const int rebalanceInterval = server->getPoolRebalanceInterval();
+    if ((rebalanceInterval > 0) && (connectionPools.size() > 1)) {
+        auto rebalanceTimer = new QTimer(this);
+        connect(rebalanceTimer, SIGNAL(timeout()), this, SLOT(rebalancePools()));
+        rebalanceTimer->start(rebalanceInterval * 1000);
+    }
 }
 
 Servatrice_GameServer::~Servatrice_GameServer()
 {
+    // the listeners are deleted in their pool threads before the pools
+    for (auto listener : poolListeners)
+        listener->deleteLater();
+
     for (int i = 0; i < connectionPools.size(); ++i) {
         logger->logMessage(QString("Closing pool %1...").arg(i));
         QThread *poolThread = connectionPools[i]->thread();
@@ -75,33 +129,175 @@ Servatrice_GameServer::~Servatrice_GameServer()
     }
 }
 
+void Servatrice_GameServer::restoreConnection(int socketDescriptor, const QByteArray &session)
+{
+    Servatrice_ConnectionPool *pool = findLeastUsedConnectionPool();
+
+    auto ssi = new TcpServerSocketInterface(server, pool->getDatabaseInterface());
+    ssi->moveToThread(pool->thread());
+    pool->addClient(ssi);
+
+    QMetaObject::invokeMethod(ssi, "restoreConnection", Qt::QueuedConnection, Q_ARG(int, socketDescriptor),
+                              Q_ARG(QByteArray, session));
+}
+
 void Servatrice_GameServer::incomingConnection(qintptr socketDescriptor)
 {
     Servatrice_ConnectionPool *pool = findLeastUsedConnectionPool();
 
     auto ssi = new TcpServerSocketInterface(server, pool->getDatabaseInterface());
     ssi->moveToThread(pool->thread());
-    pool->addClient();
-    connect(ssi, SIGNAL(destroyed()), pool, SLOT(removeClient()));
+    pool->addClient(ssi);
 
     QMetaObject::invokeMethod(ssi, "initConnection", Qt::QueuedConnection, Q_ARG(int, socketDescriptor));
 }
 
+bool Servatrice_GameServer::listenInPools(const QHostAddress &address, quint16 port)
+{
+    for (auto pool : connectionPools) {
+        auto listener = new Servatrice_PoolListener(server, pool, address, port);
+        listener->setMaxPendingConnections(maxPendingConnections());
+        listener->moveToThread(pool->thread());
+        poolListeners.append(listener);
+
+        bool listening = false;
+        QMetaObject::invokeMethod(listener, "startListening", Qt::BlockingQueuedConnection,
+                                  Q_RETURN_ARG(bool, listening));
+        if (!listening)
+            return false;
+    }
+    return true;
+}
+
+void Servatrice_GameServer::stopListening()
+{
+    close();
+    for (auto listener : poolListeners)
+        QMetaObject::invokeMethod(listener, "stopListening", Qt::BlockingQueuedConnection);
+}
+
+// The load of the pools is only updated once a second. Every client adds a little to it, so that the connections of
+// a burst are spread among the pools of about the same load in the meantime.
 Servatrice_ConnectionPool *Servatrice_GameServer::findLeastUsedConnectionPool()
 {
-    int minClientCount = -1;
-    int poolIndex = -1;
-    QStringList debugStr;
-    for (int i = 0; i < connectionPools.size(); ++i) {
-        const int clientCount = connectionPools[i]->getClientCount();
-        if ((poolIndex == -1) || (clientCount < minClientCount)) {
-            minClientCount = clientCount;
-            poolIndex = i;
+    Servatrice_ConnectionPool *result = nullptr;
+    double minLoad = 0;
+    for (auto pool : connectionPools) {
+        const double load = pool->getLoad() + pool->getClientCount() * clientLoad;
+        if (!result || (load < minLoad)) {
+            minLoad = load;
+            result = pool;
         }
-        debugStr.append(QString::number(clientCount));
     }
-    qDebug() << "Pool utilisation:" << debugStr;
-    return connectionPools[poolIndex];
+    return result;
+}
+
+// Moves a few idle clients from the busiest to the least busy pool; idle clients still cost their pool for every
+// message broadcast to them.
+void Servatrice_GameServer::rebalancePools()
+{
+    Servatrice_ConnectionPool *busiestPool = nullptr;
+    Servatrice_ConnectionPool *idlestPool = nullptr;
+    for (auto pool : connectionPools) {
+        if (!busiestPool || (pool->getLoad() > busiestPool->getLoad()))
+            busiestPool = pool;
+        if (!idlestPool || (pool->getLoad() < idlestPool->getLoad()))
+            idlestPool = pool;
+    }
+    if ((busiestPool == idlestPool) || (busiestPool->getLoad() - idlestPool->getLoad() < rebalanceThreshold))
+        return;
+
+    const int maxCount = qMin(busiestPool->getClientCount() / 10, maxRebalancedClients);
+    if (maxCount > 0)
+        QMetaObject::invokeMethod(busiestPool, "moveIdleClients", Qt::QueuedConnection,
+                                  Q_ARG(QObject *, idlestPool), Q_ARG(int, maxCount), Q_ARG(int, rebalanceIdleTime));
+}
+
+Servatrice_PoolListener::Servatrice_PoolListener(Servatrice *_server,
+                                                 Servatrice_ConnectionPool *_pool,
+                                                 const QHostAddress &_address,
+                                                 quint16 _port)
+    : QTcpServer(), server(_server), pool(_pool), address(_address), port(_port)
+{
+}
+
+bool Servatrice_PoolListener::isSupported()
+{
+    // other systems accept SO_REUSEPORT as well, but don't spread the connections among the sockets
+#ifdef Q_OS_LINUX
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool Servatrice_PoolListener::startListening()
+{
+#ifdef Q_OS_LINUX
+    // QTcpServer::listen() can't set socket options before binding, so the socket is set up here and handed over
+    sockaddr_storage socketAddress;
+    memset(&socketAddress, 0, sizeof(socketAddress));
+    socklen_t socketAddressLength;
+    if (address.protocol() == QAbstractSocket::IPv4Protocol) {
+        auto ipv4Address = reinterpret_cast<sockaddr_in *>(&socketAddress);
+        ipv4Address->sin_family = AF_INET;
+        ipv4Address->sin_port = htons(port);
+        ipv4Address->sin_addr.s_addr = htonl(address.toIPv4Address());
+        socketAddressLength = sizeof(sockaddr_in);
+    } else {
+        // "any" listens on IPv6 and IPv4, like QTcpServer does
+        const Q_IPV6ADDR ipv6 = address == QHostAddress::Any ? QHostAddress(QHostAddress::AnyIPv6).toIPv6Address()
+                                                              : address.toIPv6Address();
+        auto ipv6Address = reinterpret_cast<sockaddr_in6 *>(&socketAddress);
+        ipv6Address->sin6_family = AF_INET6;
+        ipv6Address->sin6_port = htons(port);
+        memcpy(&ipv6Address->sin6_addr, &ipv6, sizeof(ipv6));
+        socketAddressLength = sizeof(sockaddr_in6);
+    }
+
+    const int socketDescriptor = ::socket(socketAddress.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (socketDescriptor == -1) {
+        qDebug() << "Pool listener: socket() failed:" << strerror(errno);
+        return false;
+    }
+
+    const int on = 1;
+    const int off = 0;
+    if (::setsockopt(socketDescriptor, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) == -1 ||
+        ::setsockopt(socketDescriptor, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) == -1 ||
+        (address == QHostAddress::Any &&
+         ::setsockopt(socketDescriptor, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off)) == -1) ||
+        ::bind(socketDescriptor, reinterpret_cast<sockaddr *>(&socketAddress), socketAddressLength) == -1 ||
+        ::listen(socketDescriptor, maxPendingConnections()) == -1) {
+        qDebug() << "Pool listener: setting up the socket failed:" << strerror(errno);
+        ::close(socketDescriptor);
+        return false;
+    }
+
+    if (!setSocketDescriptor(socketDescriptor)) {
+        qDebug() << "Pool listener: setSocketDescriptor() failed:" << errorString();
+        ::close(socketDescriptor);
+        return false;
+    }
+    return true;
+#else
+    qDebug() << "Pool listener: SO_REUSEPORT is not supported on this system";
+    return false;
+#endif
+}
+
+void Servatrice_PoolListener::stopListening()
+{
+    close();
+}
+
+void Servatrice_PoolListener::incomingConnection(qintptr socketDescriptor)
+{
+    // this runs in the pool thread already, the connection doesn't need to be moved
+    auto ssi = new TcpServerSocketInterface(server, pool->getDatabaseInterface());
+    pool->addClient(ssi);
+
+    QMetaObject::invokeMethod(ssi, "initConnection", Qt::QueuedConnection, Q_ARG(int, socketDescriptor));
 }
 
 #ifdef QT_WEBSOCKETS_LIB
@@ -115,10 +311,12 @@ Servatrice_WebsocketGameServer::Servatrice_WebsocketGameServer(Servatrice *_serv
 {
     // Qt limitation: websockets can't be moved to another thread
     auto newDatabaseInterface = new Servatrice_DatabaseInterface(WEBSOCKET_POOL_NUMBER, server);
-    auto newPool = new Servatrice_ConnectionPool(newDatabaseInterface);
+    auto newPool =
+        new Servatrice_ConnectionPool(newDatabaseInterface, server->getMetrics().getPoolMetrics(WEBSOCKET_POOL_NUMBER));
 
     server->addDatabaseInterface(thread(), newDatabaseInterface);
     newDatabaseInterface->initDatabase(_sqlDatabase);
+    newPool->startLoadTracking();
 
     connectionPools.append(newPool);
 
@@ -141,8 +339,7 @@ void Servatrice_WebsocketGameServer::onNewConnection()
 
     auto ssi = new WebsocketServerSocketInterface(server, pool->getDatabaseInterface());
     //    ssi->moveToThread(pool->thread());
-    pool->addClient();
-    connect(ssi, SIGNAL(destroyed()), pool, SLOT(removeClient()));
+    pool->addClient(ssi);
 
     QMetaObject::invokeMethod(ssi, "initConnection", Qt::QueuedConnection, Q_ARG(void *, nextPendingConnection()));
 }
@@ -179,18 +376,23 @@ void Servatrice_IslServer::incomingConnection(qintptr socketDescriptor)
 }
 
 Servatrice::Servatrice(QObject *parent)
-    : Server(parent), authenticationMethod(AuthenticationNone), uptime(0), shutdownTimer(nullptr),
+    : Server(parent), authenticationMethod(AuthenticationNone), gameServer(nullptr), islServer(nullptr),
+      metricsServer(nullptr), handoff(nullptr), handoffTimer(nullptr), uptime(0), shutdownTimer(nullptr),
       isFirstShutdownMessage(true)
 {
+#ifdef QT_WEBSOCKETS_LIB
+    websocketGameServer = nullptr;
+#endif
     qRegisterMetaType<QSqlDatabase>("QSqlDatabase");
 }
 
 Servatrice::~Servatrice()
 {
-    gameServer->close();
+    if (gameServer)
+        gameServer->stopListening();
 
     // clients live in other threads, we need to lock them
-    clientsLock.lockForRead();
+    clientsLock.lockForRead(SERVER_LOCK_SITE);
     for (auto client : clients)
         QMetaObject::invokeMethod(client, "prepareDestroy", Qt::QueuedConnection);
     clientsLock.unlock();
@@ -209,7 +411,7 @@ Servatrice::~Servatrice()
 
     do {
         SleeperThread::msleep(10);
-        clientsLock.lockForRead();
+        clientsLock.lockForRead(SERVER_LOCK_SITE);
         if (clients.isEmpty())
             done = true;
         clientsLock.unlock();
@@ -248,6 +450,20 @@ bool Servatrice::initServer()
     }
 
     qDebug() << "Accept registered users only: " << getRegOnlyServerEnabled();
+    updateRateLimits();
+    getTrafficRecorder().setup(getTrafficRecordPath(), getTrafficRecordAnonymize());
+    if (getTrafficRecorder().isEnabled())
+        qDebug() << "Recording client traffic to: " << getTrafficRecordPath()
+                 << "anonymized: " << getTrafficRecordAnonymize();
+    Server_LockProfiler::setEnabled(getLockProfilingEnabled());
+    qDebug() << "Lock profiling enabled: " << Server_LockProfiler::isEnabled();
+    getAvatarCache().setMaxSize(qMax(getAvatarCacheSize(), 0) * 1024);
+    qDebug() << "Avatar cache size (KB): " << getAvatarCacheSize();
+    if (getSpectatorRelayEnabled()) {
+        startSpectatorRelay(getSpectatorRelayIsl());
+        qDebug() << "Spectator relay enabled, delay (seconds): " << getSpectatorDelay()
+                 << "grouping ISL spectators: " << getSpectatorRelayIsl();
+    }
     qDebug() << "Registration enabled: " << getRegistrationEnabled();
     if (getRegistrationEnabled()) {
         QStringList emailBlackListFilters = getEmailBlackList().split(",", QString::SkipEmptyParts);
@@ -280,23 +496,41 @@ bool Servatrice::initServer()
 
     if (getDBTypeString() == "mysql") {
         databaseType = DatabaseMySql;
+    } else if (getDBTypeString() == "sqlite") {
+        databaseType = DatabaseSqlite;
     } else {
         databaseType = DatabaseNone;
     }
+
+    if (!getHandoffSocketPath().isEmpty()) {
+        if (Servatrice_Handoff::isSupported()) {
+            handoff = new Servatrice_Handoff(getHandoffSocketPath(), this);
+            if (handoff->connectToServer()) {
+                qDebug() << "Taking over from the server running at" << getHandoffSocketPath();
+                handoffPlayersInGamesChanged();
+            }
+        } else
+            qDebug() << "handoff_socket is not supported on this system";
+    }
+
     servatriceDatabaseInterface = new Servatrice_DatabaseInterface(-1, this);
     setDatabaseInterface(servatriceDatabaseInterface);
 
     if (databaseType != DatabaseNone) {
         dbPrefix = getDBPrefixString();
         bool dbOpened = servatriceDatabaseInterface->initDatabase(
-            "QMYSQL", getDBHostNameString(), getDBDatabaseNameString(), getDBUserNameString(), getDBPasswordString());
+            databaseType == DatabaseSqlite ? "QSQLITE" : "QMYSQL", getDBHostNameString(), getDBDatabaseNameString(),
+            getDBUserNameString(), getDBPasswordString());
         if (!dbOpened) {
             qDebug() << "Failed to open database";
             return false;
         }
         updateServerList();
-        qDebug() << "Clearing previous sessions...";
-        servatriceDatabaseInterface->clearSessionTables();
+        // the sessions of the clients that are handed over go on
+        if (!handoff || !handoff->isReceiving()) {
+            qDebug() << "Clearing previous sessions...";
+            servatriceDatabaseInterface->clearSessionTables();
+        }
     }
 
     if (getRoomsMethodString() == "sql") {
@@ -395,7 +629,8 @@ bool Servatrice::initServer()
 
             qDebug() << "Starting ISL server on port" << getISLNetworkPort();
             islServer = new Servatrice_IslServer(this, cert, key, this);
-            if (islServer->listen(QHostAddress::Any, static_cast<quint16>(getISLNetworkPort())))
+            if (listenOrTakeOver(islServer, handoff, HandoffMessage::ISL, QHostAddress::Any,
+                                 static_cast<quint16>(getISLNetworkPort())))
                 qDebug() << "ISL server listening.";
             else
                 throw QString("islServer->listen()");
@@ -405,9 +640,14 @@ bool Servatrice::initServer()
         return false;
     }
 
-    pingClock = new QTimer(this);
-    connect(pingClock, SIGNAL(timeout()), this, SIGNAL(pingClockTimeout()));
-    pingClock->start(getClientKeepAlive() * 1000);
+    if (getMetricsPort() > 0) {
+        metricsServer = new QTcpServer(this);
+        connect(metricsServer, SIGNAL(newConnection()), this, SLOT(metricsConnectionReceived()));
+        qDebug() << "Starting metrics endpoint on host" << getMetricsHost().toString() << "port" << getMetricsPort();
+        if (!listenOrTakeOver(metricsServer, handoff, HandoffMessage::METRICS, getMetricsHost(),
+                              static_cast<quint16>(getMetricsPort())))
+            qDebug() << "metricsServer->listen(): Error:" << metricsServer->errorString();
+    }
 
     statusUpdateClock = new QTimer(this);
     connect(statusUpdateClock, SIGNAL(timeout()), this, SLOT(statusUpdate()));
@@ -423,11 +663,25 @@ bool Servatrice::initServer()
         gameServer->setMaxPendingConnections(1000);
         QHostAddress tcpHost = getServerTCPHost();
         qDebug() << "Starting server on host" << tcpHost.toString() << "port" << getServerTCPPort();
-        if (gameServer->listen(tcpHost, static_cast<quint16>(getServerTCPPort())))
-            qDebug() << "Server listening.";
-        else {
-            qDebug() << "gameServer->listen(): Error:" << gameServer->errorString();
-            return false;
+        // the pools can't share the listening socket of a server that didn't use reuse_port
+        const bool takeOverListener = handoff && handoff->hasListener(HandoffMessage::GAME);
+        if (getServerTCPReusePort() && Servatrice_PoolListener::isSupported() && !takeOverListener) {
+            if (gameServer->listenInPools(tcpHost, static_cast<quint16>(getServerTCPPort())))
+                qDebug() << "Server listening in" << getNumberOfTCPPools() << "pools.";
+            else {
+                qDebug() << "gameServer->listenInPools(): Error";
+                return false;
+            }
+        } else {
+            if (getServerTCPReusePort() && !takeOverListener)
+                qDebug() << "reuse_port is not supported on this system, accepting connections in the main thread";
+            if (listenOrTakeOver(gameServer, handoff, HandoffMessage::GAME, tcpHost,
+                                 static_cast<quint16>(getServerTCPPort())))
+                qDebug() << "Server listening.";
+            else {
+                qDebug() << "gameServer->listen(): Error:" << gameServer->errorString();
+                return false;
+            }
         }
     }
 
@@ -440,7 +694,8 @@ bool Servatrice::initServer()
         QHostAddress webSocketHost = getServerWebSocketHost();
         qDebug() << "Starting websocket server on host" << webSocketHost.toString() << "port"
                  << getServerWebSocketPort();
-        if (websocketGameServer->listen(webSocketHost, static_cast<quint16>(getServerWebSocketPort())))
+        if (listenOrTakeOver(websocketGameServer, handoff, HandoffMessage::WEBSOCKET, webSocketHost,
+                             static_cast<quint16>(getServerWebSocketPort())))
             qDebug() << "Websocket server listening.";
         else {
             qDebug() << "websocketGameServer->listen(): Error:" << websocketGameServer->errorString();
@@ -458,6 +713,18 @@ bool Servatrice::initServer()
                         "client and short time out values will remove these players.";
     }
 
+    if (handoff) {
+        connect(handoff, SIGNAL(handoffRequested()), this, SLOT(startHandoff()));
+        connect(handoff, SIGNAL(listenersTaken()), this, SLOT(handoffListenersTaken()));
+        connect(handoff, SIGNAL(sessionReceived(int, QByteArray)), this,
+                SLOT(handoffSessionReceived(int, QByteArray)));
+        connect(handoff, SIGNAL(playersInGamesChanged()), this, SLOT(handoffPlayersInGamesChanged()));
+        if (handoff->isReceiving())
+            handoff->startReceiving();
+        else
+            handoff->listen();
+    }
+
     setRequiredFeatures(getRequiredFeatures());
     return true;
 }
@@ -505,22 +772,18 @@ QList<ServerProperties> Servatrice::getServerList() const
 
 int Servatrice::getUsersWithAddress(const QHostAddress &address) const
 {
-    int result = 0;
-    QReadLocker locker(&clientsLock);
-    for (auto client : clients)
-        if (static_cast<AbstractServerSocketInterface *>(client)->getPeerAddress() == address)
-            ++result;
-
-    return result;
+    if (address.isNull())
+        return 0;
+    return getClientCountWithAddress(address.toString());
 }
 
 QList<AbstractServerSocketInterface *> Servatrice::getUsersWithAddressAsList(const QHostAddress &address) const
 {
     QList<AbstractServerSocketInterface *> result;
-    QReadLocker locker(&clientsLock);
-    for (auto client : clients)
-        if (static_cast<AbstractServerSocketInterface *>(client)->getPeerAddress() == address)
-            result.append(static_cast<AbstractServerSocketInterface *>(client));
+    if (address.isNull())
+        return result;
+    for (auto client : getClientsWithAddress(address.toString()))
+        result.append(static_cast<AbstractServerSocketInterface *>(client));
     return result;
 }
 
@@ -565,6 +828,18 @@ void Servatrice::setRequiredFeatures(const QString featureList)
 
 void Servatrice::statusUpdate()
 {
+    const QMap<QString, quint64> rateLimitStatistics = getRateLimitStatistics();
+    if (rateLimitStatistics != lastRateLimitStatistics) {
+        QStringList limitsFired;
+        QMapIterator<QString, quint64> limitIterator(rateLimitStatistics);
+        while (limitIterator.hasNext()) {
+            limitIterator.next();
+            limitsFired.append(QString("%1=%2").arg(limitIterator.key()).arg(limitIterator.value()));
+        }
+        logger->logMessage(QString("Flood protection rejections: %1").arg(limitsFired.join(", ")));
+        lastRateLimitStatistics = rateLimitStatistics;
+    }
+
     if (!servatriceDatabaseInterface->checkSql())
         return;
 
@@ -668,6 +943,7 @@ void Servatrice::incTxBytes(quint64 num)
     txBytesMutex.lock();
     txBytes += num;
     txBytesMutex.unlock();
+    getMetrics().addTxBytes(num);
 }
 
 void Servatrice::incRxBytes(quint64 num)
@@ -675,6 +951,62 @@ void Servatrice::incRxBytes(quint64 num)
     rxBytesMutex.lock();
     rxBytes += num;
     rxBytesMutex.unlock();
+    getMetrics().addRxBytes(num);
+}
+
+QString Servatrice::getMetricsText()
+{
+    QStringList lines;
+    lines.append("# HELP servatrice_users Users logged in to this server.");
+    lines.append("# TYPE servatrice_users gauge");
+    lines.append(QString("servatrice_users{connection=\"tcp\"} %1").arg(getTCPUserCount()));
+    lines.append(QString("servatrice_users{connection=\"websocket\"} %1").arg(getWebSocketUserCount()));
+    lines.append("# HELP servatrice_games Games running on this server.");
+    lines.append("# TYPE servatrice_games gauge");
+    lines.append(QString("servatrice_games %1").arg(getGamesCount()));
+
+    lines.append("# HELP servatrice_rate_limit_rejections_total Requests rejected by the flood protection.");
+    lines.append("# TYPE servatrice_rate_limit_rejections_total counter");
+    const QMap<QString, quint64> rateLimitStatistics = getRateLimitStatistics();
+    for (auto i = rateLimitStatistics.constBegin(); i != rateLimitStatistics.constEnd(); ++i)
+        lines.append(
+            QString("servatrice_rate_limit_rejections_total{limiter=\"%1\"} %2").arg(i.key()).arg(i.value()));
+
+    lines.append("# HELP servatrice_log_dropped_total Log messages dropped because the log buffer was full.");
+    lines.append("# TYPE servatrice_log_dropped_total counter");
+    lines.append(QString("servatrice_log_dropped_total %1").arg(logger->getDroppedCount()));
+
+    return lines.join("\n") + "\n" + getMetrics().toPrometheusText();
+}
+
+void Servatrice::metricsConnectionReceived()
+{
+    while (metricsServer->hasPendingConnections()) {
+        QTcpSocket *socket = metricsServer->nextPendingConnection();
+        connect(socket, SIGNAL(readyRead()), this, SLOT(metricsRequestReceived()));
+        connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+        // don't let idle connections pile up
+        QTimer::singleShot(10000, socket, [socket]() { socket->abort(); });
+    }
+}
+
+void Servatrice::metricsRequestReceived()
+{
+    auto *socket = static_cast<QTcpSocket *>(sender());
+
+    // Every request is answered with the metrics, so it only needs to be read up to the end of its headers.
+    const QByteArray request = socket->peek(socket->bytesAvailable());
+    if (!request.contains("\r\n\r\n")) {
+        if (request.size() > 8192)
+            socket->abort();
+        return;
+    }
+    disconnect(socket, SIGNAL(readyRead()), this, SLOT(metricsRequestReceived()));
+
+    const QByteArray body = getMetricsText().toUtf8();
+    socket->write("HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " +
+                  QByteArray::number(body.size()) + "\r\nConnection: close\r\n\r\n" + body);
+    socket->disconnectFromHost();
 }
 
 void Servatrice::shutdownTimeout()
@@ -696,7 +1028,7 @@ void Servatrice::shutdownTimeout()
             se = Server_ProtocolHandler::prepareSessionEvent(event);
         }
 
-        clientsLock.lockForRead();
+        clientsLock.lockForRead(SERVER_LOCK_SITE);
         for (auto &client : clients)
             client->sendProtocolItem(*se);
         clientsLock.unlock();
@@ -708,6 +1040,103 @@ void Servatrice::shutdownTimeout()
     shutdownMinutes--;
 }
 
+void Servatrice::startHandoff()
+{
+    logger->logMessage("Handing the server over to a new process");
+    if (gameServer && gameServer->isListening())
+        handoff->sendListener(HandoffMessage::GAME, static_cast<int>(gameServer->socketDescriptor()));
+#ifdef QT_WEBSOCKETS_LIB
+    if (websocketGameServer && websocketGameServer->isListening())
+        handoff->sendListener(HandoffMessage::WEBSOCKET, static_cast<int>(websocketGameServer->socketDescriptor()));
+#endif
+    if (islServer && islServer->isListening())
+        handoff->sendListener(HandoffMessage::ISL, static_cast<int>(islServer->socketDescriptor()));
+    if (metricsServer && metricsServer->isListening())
+        handoff->sendListener(HandoffMessage::METRICS, static_cast<int>(metricsServer->socketDescriptor()));
+    // the players of the games here can't log in to the new process until their games have ended
+    handoff->sendPlayersInGames(getPersistentPlayerNames());
+    handoff->finishListeners();
+}
+
+void Servatrice::handoffListenersTaken()
+{
+    // the new process accepts the connections from now on
+    if (gameServer)
+        gameServer->stopListening();
+#ifdef QT_WEBSOCKETS_LIB
+    if (websocketGameServer)
+        websocketGameServer->close();
+#endif
+    if (islServer)
+        islServer->close();
+    if (metricsServer)
+        metricsServer->close();
+    closeGames();
+
+    handoffDrainTimer.start();
+    handoffTimer = new QTimer(this);
+    connect(handoffTimer, SIGNAL(timeout()), this, SLOT(handOverClients()));
+    handoffTimer->start(handoffInterval);
+    handOverClients();
+}
+
+// Clients in games are handed over once their games are over, the others right away. Websocket connections can't be
+// handed over, they are closed once nothing else is left.
+void Servatrice::handOverClients()
+{
+    if (!handoff->isHandingOver()) {
+        handoffTimer->stop();
+        return;
+    }
+
+    if ((getGamesCount() == 0) && (getTCPUserCount() == 0)) {
+        handoffTimer->stop();
+        logger->logMessage("All clients have been handed over, shutting down");
+
+        Event_ConnectionClosed event;
+        event.set_reason(Event_ConnectionClosed::SERVER_SHUTDOWN);
+        SessionEvent *se = Server_ProtocolHandler::prepareSessionEvent(event);
+        clientsLock.lockForRead(SERVER_LOCK_SITE);
+        for (auto &client : clients)
+            client->sendProtocolItem(*se);
+        clientsLock.unlock();
+        delete se;
+
+        handoff->finish();
+        deleteLater();
+        return;
+    }
+
+    handoff->sendPlayersInGames(getPersistentPlayerNames());
+
+    // games that don't end are ended by shutting this process down
+    const int maxDrainTime = getHandoffMaxDrainTime();
+    if ((maxDrainTime > 0) && !shutdownTimer && handoffDrainTimer.hasExpired(maxDrainTime * 60000LL)) {
+        logger->logMessage("The remaining games haven't ended in time, shutting down");
+        scheduleShutdown("The server is being restarted", handoffShutdownMinutes);
+    }
+
+    // clients live in other threads
+    clientsLock.lockForRead(SERVER_LOCK_SITE);
+    for (auto client : clients)
+        if (client->getConnectionType() == "tcp")
+            QMetaObject::invokeMethod(client, "handOver", Qt::QueuedConnection);
+    clientsLock.unlock();
+}
+
+void Servatrice::handoffSessionReceived(int socketDescriptor, const QByteArray &session)
+{
+    if (gameServer)
+        gameServer->restoreConnection(socketDescriptor, session);
+    else
+        Servatrice_Handoff::closeSocket(socketDescriptor);
+}
+
+void Servatrice::handoffPlayersInGamesChanged()
+{
+    setPreviousProcessPlayers(handoff->getPlayersInGames());
+}
+
 bool Servatrice::islConnectionExists(int serverId) const
 {
     // Only call with islLock locked at least for reading
@@ -735,6 +1164,7 @@ void Servatrice::addIslInterface(int serverId, IslInterface *interface)
             SLOT(externalResponseReceived(Response, qint64)));
     connect(interface, SIGNAL(gameEventContainerReceived(GameEventContainer, qint64)), this,
             SLOT(externalGameEventContainerReceived(GameEventContainer, qint64)));
+    connect(interface, SIGNAL(stateResyncReceived(int, IslResync)), this, SLOT(externalStateResync(int, IslResync)));
 }
 
 void Servatrice::removeIslInterface(int serverId)
@@ -745,14 +1175,297 @@ void Servatrice::removeIslInterface(int serverId)
     islInterfaces.remove(serverId);
 }
 
+void Servatrice::islLinkLost(int serverId)
+{
+    islLinkLostTimes.insert(serverId, QDateTime::currentMSecsSinceEpoch());
+
+    const int reconnectGrace = getISLNetworkReconnectGrace();
+    if (reconnectGrace > 0)
+        QTimer::singleShot(reconnectGrace * 1000, this, SLOT(expireIslServerStates()));
+    else
+        expireIslServerStates();
+}
+
+void Servatrice::expireIslServerStates()
+{
+    const qint64 deadline = QDateTime::currentMSecsSinceEpoch() - getISLNetworkReconnectGrace() * 1000;
+    QMutableMapIterator<int, qint64> lostIterator(islLinkLostTimes);
+    while (lostIterator.hasNext()) {
+        lostIterator.next();
+        if (lostIterator.value() > deadline)
+            continue;
+        const int serverId = lostIterator.key();
+        lostIterator.remove();
+
+        islLock.lockForRead();
+        const bool reconnected = islConnectionExists(serverId);
+        islLock.unlock();
+        if (!reconnected)
+            removeExternalServerState(serverId);
+    }
+}
+
+void Servatrice::removeExternalGame(int roomId, int gameId, int serverId)
+{
+    // a game info without player count removes the game
+    ServerInfo_Game gameInfo;
+    gameInfo.set_room_id(roomId);
+    gameInfo.set_game_id(gameId);
+    gameInfo.set_server_id(serverId);
+    externalRoomGameListChanged(roomId, gameInfo);
+}
+
+void Servatrice::removeExternalServerState(int serverId)
+{
+    QList<QPair<int, QString>> roomUsers;
+    QList<QPair<int, int>> roomGames;
+    roomsLock.lockForRead(SERVER_LOCK_SITE);
+    QMapIterator<int, Server_Room *> roomIterator(getRooms());
+    while (roomIterator.hasNext()) {
+        Server_Room *room = roomIterator.next().value();
+        room->usersLock.lockForRead();
+        QMapIterator<QString, ServerInfo_User_Container> userIterator(room->getExternalUsers());
+        while (userIterator.hasNext()) {
+            userIterator.next();
+            if (userIterator.value().getUserInfo()->server_id() == serverId)
+                roomUsers.append(QPair<int, QString>(room->getId(), userIterator.key()));
+        }
+        room->usersLock.unlock();
+
+        room->gamesLock.lockForRead(SERVER_LOCK_SITE);
+        QMapIterator<int, ServerInfo_Game> gameIterator(room->getExternalGames());
+        while (gameIterator.hasNext()) {
+            gameIterator.next();
+            if (gameIterator.value().server_id() == serverId)
+                roomGames.append(QPair<int, int>(room->getId(), gameIterator.key()));
+        }
+        room->gamesLock.unlock();
+    }
+    roomsLock.unlock();
+
+    QStringList users;
+    clientsLock.lockForRead(SERVER_LOCK_SITE);
+    QMapIterator<QString, Server_AbstractUserInterface *> userIterator(getExternalUsers());
+    while (userIterator.hasNext()) {
+        userIterator.next();
+        if (userIterator.value()->getUserInfo()->server_id() == serverId)
+            users.append(userIterator.key());
+    }
+    clientsLock.unlock();
+
+    logger->logMessage(QString("[ISL] Removing %1 users and %2 games of server #%3")
+                           .arg(users.size())
+                           .arg(roomGames.size())
+                           .arg(serverId));
+
+    for (const QPair<int, QString> &roomUser : roomUsers)
+        externalRoomUserLeft(roomUser.first, roomUser.second);
+    for (const QPair<int, int> &roomGame : roomGames)
+        removeExternalGame(roomGame.first, roomGame.second, serverId);
+    for (const QString &userName : users)
+        externalUserLeft(userName);
+}
+
+// Order independent digest of a list of state entries. It has to be the same on every server, so qHash()
+// (which is seeded per process) can't be used.
+static quint64 getStateDigest(QStringList entries)
+{
+    entries.sort();
+    const QByteArray hash = QCryptographicHash::hash(entries.join("\n").toUtf8(), QCryptographicHash::Md5);
+    return qFromBigEndian<quint64>(reinterpret_cast<const uchar *>(hash.constData()));
+}
+
+static QString getGameDigestEntry(const ServerInfo_Game &gameInfo)
+{
+    return QString("g:%1:%2:%3").arg(gameInfo.game_id()).arg(gameInfo.player_count()).arg(gameInfo.started());
+}
+
+// Users are compared by everything the other servers know about them, so that a user who logged in again with a
+// new session (or changed the avatar, ...) in the meantime is noticed as well.
+static QString getUserDigestEntry(const ServerInfo_User &userInfo)
+{
+    return QString("u:%1:%2:%3:%4:%5:%6:%7")
+        .arg(QString::fromStdString(userInfo.name()))
+        .arg(userInfo.session_id())
+        .arg(userInfo.user_level())
+        .arg(QString::fromStdString(userInfo.privlevel()))
+        .arg(QString::fromStdString(userInfo.country()))
+        .arg(userInfo.gender())
+        .arg(QString::fromLatin1(QByteArray::fromStdString(userInfo.avatar_hash()).toHex()));
+}
+
+void Servatrice::externalStateResync(int serverId, const IslResync &resync)
+{
+    // This function is always called from the main thread via signal/slot, after all earlier updates from the
+    // same server, so the difference computed here is exact.
+    if (resync.users_included()) {
+        QMap<QString, QString> currentUsers;
+        clientsLock.lockForRead(SERVER_LOCK_SITE);
+        QMapIterator<QString, Server_AbstractUserInterface *> userIterator(getExternalUsers());
+        while (userIterator.hasNext()) {
+            userIterator.next();
+            const ServerInfo_User *userInfo = userIterator.value()->getUserInfo();
+            if (userInfo->server_id() == serverId)
+                currentUsers.insert(userIterator.key(), getUserDigestEntry(*userInfo));
+        }
+        clientsLock.unlock();
+
+        for (const ServerInfo_User &user : resync.user_list()) {
+            const QString userName = QString::fromStdString(user.name());
+            const QString currentEntry = currentUsers.take(userName);
+            if (currentEntry == getUserDigestEntry(user))
+                continue;
+            if (!currentEntry.isEmpty())
+                externalUserLeft(userName);
+            ServerInfo_User userInfo(user);
+            userInfo.set_server_id(serverId);
+            externalUserJoined(userInfo);
+        }
+        for (const QString &userName : currentUsers.keys())
+            externalUserLeft(userName);
+    }
+
+    for (const ServerInfo_Room &roomInfo : resync.room_list()) {
+        const int roomId = roomInfo.room_id();
+        QMap<QString, QString> currentUsers;
+        QSet<int> currentGames;
+
+        roomsLock.lockForRead(SERVER_LOCK_SITE);
+        Server_Room *room = getRooms().value(roomId);
+        if (room) {
+            room->usersLock.lockForRead();
+            QMapIterator<QString, ServerInfo_User_Container> userIterator(room->getExternalUsers());
+            while (userIterator.hasNext()) {
+                userIterator.next();
+                const ServerInfo_User *userInfo = userIterator.value().getUserInfo();
+                if (userInfo->server_id() == serverId)
+                    currentUsers.insert(userIterator.key(), getUserDigestEntry(*userInfo));
+            }
+            room->usersLock.unlock();
+
+            room->gamesLock.lockForRead(SERVER_LOCK_SITE);
+            QMapIterator<int, ServerInfo_Game> gameIterator(room->getExternalGames());
+            while (gameIterator.hasNext()) {
+                gameIterator.next();
+                if (gameIterator.value().server_id() == serverId)
+                    currentGames.insert(gameIterator.key());
+            }
+            room->gamesLock.unlock();
+        }
+        roomsLock.unlock();
+        if (!room)
+            continue;
+
+        for (const ServerInfo_User &user : roomInfo.user_list()) {
+            const QString userName = QString::fromStdString(user.name());
+            const QString currentEntry = currentUsers.take(userName);
+            if (currentEntry == getUserDigestEntry(user))
+                continue;
+            if (!currentEntry.isEmpty())
+                externalRoomUserLeft(roomId, userName);
+            ServerInfo_User userInfo(user);
+            userInfo.set_server_id(serverId);
+            externalRoomUserJoined(roomId, userInfo);
+        }
+        for (const QString &userName : currentUsers.keys())
+            externalRoomUserLeft(roomId, userName);
+
+        QSet<int> updatedGames;
+        for (const ServerInfo_Game &game : roomInfo.game_list()) {
+            if (game.closed())
+                continue;
+            updatedGames.insert(game.game_id());
+            ServerInfo_Game gameInfo(game);
+            gameInfo.set_server_id(serverId);
+            externalRoomGameListChanged(roomId, gameInfo);
+        }
+        for (int gameId : currentGames - updatedGames)
+            removeExternalGame(roomId, gameId, serverId);
+    }
+}
+
+void Servatrice::getLocalStateDigest(IslStateDigest &digest)
+{
+    QStringList users;
+    clientsLock.lockForRead(SERVER_LOCK_SITE);
+    for (Server_ProtocolHandler *user : getUsers())
+        users.append(getUserDigestEntry(user->copyUserInfo(true, true, true)));
+    clientsLock.unlock();
+    digest.set_user_digest(getStateDigest(users));
+
+    Server_ReadLocker roomsLocker(&roomsLock, SERVER_LOCK_SITE);
+    QMapIterator<int, Server_Room *> roomIterator(getRooms());
+    while (roomIterator.hasNext()) {
+        ServerInfo_Room roomInfo;
+        roomIterator.next().value()->getInfo(roomInfo, true, false, false);
+
+        QStringList entries;
+        for (const ServerInfo_User &user : roomInfo.user_list())
+            entries.append(getUserDigestEntry(user));
+        for (const ServerInfo_Game &game : roomInfo.game_list())
+            if (!game.closed())
+                entries.append(getGameDigestEntry(game));
+
+        IslStateDigest::RoomDigest *roomDigest = digest.add_room_digests();
+        roomDigest->set_room_id(roomInfo.room_id());
+        roomDigest->set_digest(getStateDigest(entries));
+    }
+}
+
+void Servatrice::getExternalStateDigest(int serverId, IslStateDigest &digest)
+{
+    QStringList users;
+    clientsLock.lockForRead(SERVER_LOCK_SITE);
+    QMapIterator<QString, Server_AbstractUserInterface *> userIterator(getExternalUsers());
+    while (userIterator.hasNext()) {
+        userIterator.next();
+        const ServerInfo_User *userInfo = userIterator.value()->getUserInfo();
+        if (userInfo->server_id() == serverId)
+            users.append(getUserDigestEntry(*userInfo));
+    }
+    clientsLock.unlock();
+    digest.set_user_digest(getStateDigest(users));
+
+    Server_ReadLocker roomsLocker(&roomsLock, SERVER_LOCK_SITE);
+    QMapIterator<int, Server_Room *> roomIterator(getRooms());
+    while (roomIterator.hasNext()) {
+        Server_Room *room = roomIterator.next().value();
+        QStringList entries;
+
+        room->usersLock.lockForRead();
+        QMapIterator<QString, ServerInfo_User_Container> roomUserIterator(room->getExternalUsers());
+        while (roomUserIterator.hasNext()) {
+            roomUserIterator.next();
+            const ServerInfo_User *userInfo = roomUserIterator.value().getUserInfo();
+            if (userInfo->server_id() == serverId)
+                entries.append(getUserDigestEntry(*userInfo));
+        }
+        room->usersLock.unlock();
+
+        room->gamesLock.lockForRead(SERVER_LOCK_SITE);
+        QMapIterator<int, ServerInfo_Game> gameIterator(room->getExternalGames());
+        while (gameIterator.hasNext()) {
+            const ServerInfo_Game &game = gameIterator.next().value();
+            if (game.server_id() == serverId)
+                entries.append(getGameDigestEntry(game));
+        }
+        room->gamesLock.unlock();
+
+        IslStateDigest::RoomDigest *roomDigest = digest.add_room_digests();
+        roomDigest->set_room_id(room->getId());
+        roomDigest->set_digest(getStateDigest(entries));
+    }
+}
+
 void Servatrice::doSendIslMessage(const IslMessage &msg, int serverId)
 {
     QReadLocker locker(&islLock);
 
     if (serverId == -1) {
+        const QByteArray frame = IslInterface::encodeMessage(msg);
         QMapIterator<int, IslInterface *> islIterator(islInterfaces);
         while (islIterator.hasNext())
-            islIterator.next().value()->transmitMessage(msg);
+            islIterator.next().value()->transmitFrame(frame);
     } else {
         IslInterface *interface = islInterfaces.value(serverId);
         if (interface)
@@ -917,6 +1630,39 @@ int Servatrice::getMaxCommandCountPerInterval() const
     return settingsCache->value("game/max_command_count_per_interval", 20).toInt();
 }
 
+int Servatrice::getMaxMessageCountPerIntervalPerAddress() const
+{
+    return settingsCache->value("security/max_message_count_per_interval_per_address", 0).toInt();
+}
+
+int Servatrice::getMaxCommandCountPerIntervalPerAddress() const
+{
+    return settingsCache->value("game/max_command_count_per_interval_per_address", 0).toInt();
+}
+
+QString Servatrice::getGameCommandCosts() const
+{
+    return settingsCache
+        ->value("game/command_costs", "DRAW_CARDS=0,UNDO_DRAW=0,CREATE_ARROW=0,DELETE_ARROW=0,SET_CARD_ATTR=0,"
+                                      "INC_COUNTER=0,MULLIGAN=0,MOVE_CARD=0")
+        .toString();
+}
+
+bool Servatrice::getSpectatorRelayEnabled() const
+{
+    return settingsCache->value("game/spectator_relay", false).toBool();
+}
+
+int Servatrice::getSpectatorDelay() const
+{
+    return settingsCache->value("game/spectator_delay", 0).toInt();
+}
+
+bool Servatrice::getSpectatorRelayIsl() const
+{
+    return settingsCache->value("game/spectator_relay_isl", true).toBool();
+}
+
 int Servatrice::getServerStatusUpdateTime() const
 {
     return settingsCache->value("server/statusupdate", 15000).toInt();
@@ -927,6 +1673,26 @@ int Servatrice::getNumberOfTCPPools() const
     return settingsCache->value("server/number_pools", 1).toInt();
 }
 
+int Servatrice::getPoolRebalanceInterval() const
+{
+    return settingsCache->value("server/pool_rebalance_interval", 0).toInt();
+}
+
+bool Servatrice::getServerTCPReusePort() const
+{
+    return settingsCache->value("server/reuse_port", false).toBool();
+}
+
+QString Servatrice::getHandoffSocketPath() const
+{
+    return settingsCache->value("server/handoff_socket", "").toString();
+}
+
+int Servatrice::getHandoffMaxDrainTime() const
+{
+    return settingsCache->value("server/handoff_max_drain", 120).toInt();
+}
+
 QHostAddress Servatrice::getServerTCPHost() const
 {
     QString host = settingsCache->value("server/host", "any").toString();
@@ -955,6 +1721,36 @@ QHostAddress Servatrice::getServerWebSocketHost() const
         return QHostAddress(host);
 }
 
+int Servatrice::getMetricsPort() const
+{
+    return settingsCache->value("server/metrics_port", 0).toInt();
+}
+
+QHostAddress Servatrice::getMetricsHost() const
+{
+    return QHostAddress(settingsCache->value("server/metrics_host", "127.0.0.1").toString());
+}
+
+QString Servatrice::getTrafficRecordPath() const
+{
+    return settingsCache->value("server/traffic_record_path").toString();
+}
+
+bool Servatrice::getTrafficRecordAnonymize() const
+{
+    return settingsCache->value("server/traffic_record_anonymize", true).toBool();
+}
+
+bool Servatrice::getLockProfilingEnabled() const
+{
+    return settingsCache->value("server/lock_profiling", false).toBool();
+}
+
+int Servatrice::getAvatarCacheSize() const
+{
+    return settingsCache->value("server/avatar_cache_size", 16384).toInt();
+}
+
 int Servatrice::getServerWebSocketPort() const
 {
     return settingsCache->value("server/websocket_port", 4748).toInt();
@@ -980,6 +1776,26 @@ int Servatrice::getISLNetworkPort() const
     return settingsCache->value("servernetwork/port", 14747).toInt();
 }
 
+int Servatrice::getISLNetworkFlushInterval() const
+{
+    return settingsCache->value("servernetwork/flush_interval", 20).toInt();
+}
+
+bool Servatrice::getISLNetworkCompression() const
+{
+    return settingsCache->value("servernetwork/compression", true).toBool();
+}
+
+int Servatrice::getISLNetworkDigestInterval() const
+{
+    return settingsCache->value("servernetwork/digest_interval", 60).toInt();
+}
+
+int Servatrice::getISLNetworkReconnectGrace() const
+{
+    return settingsCache->value("servernetwork/reconnect_grace", 60).toInt();
+}
+
 int Servatrice::getIdleClientTimeout() const
 {
     return settingsCache->value("server/idleclienttimeout", 3600).toInt();
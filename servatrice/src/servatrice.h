@@ -24,7 +24,10 @@
 #ifdef QT_WEBSOCKETS_LIB
 #include <QWebSocketServer>
 #endif
+#include "pb/isl_message.pb.h"
+#include "pb/session_handoff.pb.h"
 #include "server.h"
+#include <QElapsedTimer>
 #include <QHostAddress>
 #include <QMetaType>
 #include <QMutex>
@@ -43,16 +46,48 @@ class GameReplay;
 class Servatrice;
 class Servatrice_ConnectionPool;
 class Servatrice_DatabaseInterface;
+class Servatrice_Handoff;
 class AbstractServerSocketInterface;
 class IslInterface;
 class FeatureSet;
 
+/*
+ * Listening socket of a single connection pool. All of them are bound to the same port with SO_REUSEPORT and the
+ * kernel spreads the incoming connections among them, so that every pool thread accepts its own connections.
+ */
+class Servatrice_PoolListener : public QTcpServer
+{
+    Q_OBJECT
+private:
+    Servatrice *server;
+    Servatrice_ConnectionPool *pool;
+    QHostAddress address;
+    quint16 port;
+
+public:
+    Servatrice_PoolListener(Servatrice *_server,
+                            Servatrice_ConnectionPool *_pool,
+                            const QHostAddress &_address,
+                            quint16 _port);
+    static bool isSupported();
+public slots:
+    // These must be called from the thread of the pool.
+    bool startListening();
+    void stopListening();
+
+protected:
+    void incomingConnection(qintptr socketDescriptor) override;
+};
+
 class Servatrice_GameServer : public QTcpServer
 {
     Q_OBJECT
 private:
     Servatrice *server;
     QList<Servatrice_ConnectionPool *> connectionPools;
+    QList<Servatrice_PoolListener *> poolListeners;
+private slots:
+    void rebalancePools();
 
 public:
     Servatrice_GameServer(Servatrice *_server,
@@ -60,6 +95,11 @@ public:
                           const QSqlDatabase &_sqlDatabase,
                           QObject *parent = nullptr);
     ~Servatrice_GameServer() override;
+    // Lets every pool accept its connections itself instead of this server in the main thread.
+    bool listenInPools(const QHostAddress &address, quint16 port);
+    void stopListening();
+    // Continues a connection handed over by the server process this one replaces.
+    void restoreConnection(int socketDescriptor, const QByteArray &session);
 
 protected:
     void incomingConnection(qintptr socketDescriptor) override;
@@ -144,6 +184,16 @@ public:
 private slots:
     void statusUpdate();
     void shutdownTimeout();
+    void islLinkLost(int serverId);
+    void expireIslServerStates();
+    void externalStateResync(int serverId, const IslResync &resync);
+    void metricsConnectionReceived();
+    void metricsRequestReceived();
+    void startHandoff();
+    void handoffListenersTaken();
+    void handOverClients();
+    void handoffSessionReceived(int socketDescriptor, const QByteArray &session);
+    void handoffPlayersInGamesChanged();
 
 protected:
     void doSendIslMessage(const IslMessage &msg, int serverId) override;
@@ -152,16 +202,21 @@ private:
     enum DatabaseType
     {
         DatabaseNone,
-        DatabaseMySql
+        DatabaseMySql,
+        DatabaseSqlite
     };
     AuthenticationMethod authenticationMethod;
     DatabaseType databaseType;
-    QTimer *pingClock, *statusUpdateClock;
+    QTimer *statusUpdateClock;
     Servatrice_GameServer *gameServer;
 #ifdef QT_WEBSOCKETS_LIB
     Servatrice_WebsocketGameServer *websocketGameServer;
 #endif
     Servatrice_IslServer *islServer;
+    QTcpServer *metricsServer;
+    Servatrice_Handoff *handoff;
+    QTimer *handoffTimer;
+    QElapsedTimer handoffDrainTimer;
     mutable QMutex loginMessageMutex;
     QString loginMessage;
     QString dbPrefix;
@@ -173,6 +228,7 @@ private:
     int uptime;
     QMutex txBytesMutex, rxBytesMutex;
     quint64 txBytes, rxBytes;
+    QMap<QString, quint64> lastRateLimitStatistics;
 
     QString shutdownReason;
     int shutdownMinutes;
@@ -185,6 +241,9 @@ private:
     void updateServerList();
 
     QMap<int, IslInterface *> islInterfaces;
+    QMap<int, qint64> islLinkLostTimes;
+    void removeExternalServerState(int serverId);
+    void removeExternalGame(int roomId, int gameId, int serverId);
 
     QString getDBPrefixString() const;
     QString getDBHostNameString() const;
@@ -196,14 +255,30 @@ private:
     QString getISLNetworkSSLKeyFile() const;
     int getServerStatusUpdateTime() const;
     int getNumberOfTCPPools() const;
+    int getPoolRebalanceInterval() const;
+    bool getServerTCPReusePort() const;
     int getServerTCPPort() const;
     int getNumberOfWebSocketPools() const;
     int getServerWebSocketPort() const;
     int getISLNetworkPort() const;
+    int getISLNetworkFlushInterval() const;
+    bool getISLNetworkCompression() const;
+    int getISLNetworkDigestInterval() const;
+    int getISLNetworkReconnectGrace() const;
     bool getISLNetworkEnabled() const;
     bool getEnableInternalSMTPClient() const;
     QHostAddress getServerTCPHost() const;
     QHostAddress getServerWebSocketHost() const;
+    int getMetricsPort() const;
+    QHostAddress getMetricsHost() const;
+    QString getTrafficRecordPath() const;
+    bool getTrafficRecordAnonymize() const;
+    bool getLockProfilingEnabled() const;
+    int getAvatarCacheSize() const;
+    bool getSpectatorRelayEnabled() const;
+    bool getSpectatorRelayIsl() const;
+    QString getHandoffSocketPath() const;
+    int getHandoffMaxDrainTime() const;
 
 public slots:
     void scheduleShutdown(const QString &reason, int minutes);
@@ -273,6 +348,10 @@ public:
     int getMaxGamesPerUser() const override;
     int getCommandCountingInterval() const override;
     int getMaxCommandCountPerInterval() const override;
+    int getMaxMessageCountPerIntervalPerAddress() const override;
+    int getMaxCommandCountPerIntervalPerAddress() const override;
+    QString getGameCommandCosts() const override;
+    int getSpectatorDelay() const override;
     int getMaxUserTotal() const override;
     int getMaxTcpUserLimit() const;
     int getMaxWebSocketUserLimit() const;
@@ -282,12 +361,19 @@ public:
     QList<AbstractServerSocketInterface *> getUsersWithAddressAsList(const QHostAddress &address) const;
     void incTxBytes(quint64 num);
     void incRxBytes(quint64 num);
+    QString getMetricsText();
     void addDatabaseInterface(QThread *thread, Servatrice_DatabaseInterface *databaseInterface);
+    Servatrice_Handoff *getHandoff() const
+    {
+        return handoff;
+    }
 
     bool islConnectionExists(int serverId) const;
     void addIslInterface(int serverId, IslInterface *interface);
     void removeIslInterface(int serverId);
     QReadWriteLock islLock;
+    void getLocalStateDigest(IslStateDigest &digest);
+    void getExternalStateDigest(int serverId, IslStateDigest &digest);
 
     QList<ServerProperties> getServerList() const;
 };
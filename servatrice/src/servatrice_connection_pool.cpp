@@ -1,9 +1,15 @@
 #include "servatrice_connection_pool.h"
 #include "servatrice_database_interface.h"
+#include "server_metrics.h"
+#include "serversocketinterface.h"
+#include <QDebug>
 #include <QThread>
+#include <QTimer>
 
-Servatrice_ConnectionPool::Servatrice_ConnectionPool(Servatrice_DatabaseInterface *_databaseInterface)
-    : databaseInterface(_databaseInterface), threaded(false), clientCount(0)
+Servatrice_ConnectionPool::Servatrice_ConnectionPool(Servatrice_DatabaseInterface *_databaseInterface,
+                                                     Server_PoolMetrics *_metrics)
+    : databaseInterface(_databaseInterface), metrics(_metrics), threaded(false), loadTimer(nullptr),
+      lastReceivedMessages(0), lastCommandTime(0), load(0)
 {
 }
 
@@ -12,3 +18,90 @@ Servatrice_ConnectionPool::~Servatrice_ConnectionPool()
     delete databaseInterface;
     thread()->quit();
 }
+
+double Servatrice_ConnectionPool::getLoad() const
+{
+    return metrics->load.load() / 1000.0;
+}
+
+void Servatrice_ConnectionPool::addClient(AbstractServerSocketInterface *client)
+{
+    {
+        QMutexLocker locker(&clientsMutex);
+        clients.append(client);
+        metrics->clients.store(clients.size());
+    }
+    connect(client, SIGNAL(destroyed(QObject *)), this, SLOT(removeClient(QObject *)), Qt::DirectConnection);
+}
+
+void Servatrice_ConnectionPool::removeClient(QObject *client)
+{
+    // the client is being destroyed, only its address is used
+    QMutexLocker locker(&clientsMutex);
+    clients.removeOne(static_cast<AbstractServerSocketInterface *>(client));
+    metrics->clients.store(clients.size());
+}
+
+void Servatrice_ConnectionPool::startLoadTracking()
+{
+    lastReceivedMessages = metrics->receivedMessages.load();
+    lastCommandTime = metrics->commandTime.load();
+    loadClock.start();
+
+    loadTimer = new QTimer(this);
+    connect(loadTimer, SIGNAL(timeout()), this, SLOT(updateLoad()));
+    loadTimer->start(loadInterval);
+}
+
+// The load adds up what keeps the thread of the pool busy. Each part is about 1 when it alone would take all of
+// the thread's time: the time spent processing messages, the event loop lag, the rate of received messages (1000
+// per second) and the size of the messages waiting to be written to the clients (1 MB).
+void Servatrice_ConnectionPool::updateLoad()
+{
+    const qint64 elapsed = qMax<qint64>(loadClock.restart(), 1);
+    // the timer fires late by as long as the events queued before it took
+    const qint64 lag = qMax<qint64>(elapsed - loadInterval, 0) * 1000;
+    metrics->eventLoopLag.store(lag);
+
+    const quint64 receivedMessages = metrics->receivedMessages.load();
+    const quint64 commandTime = metrics->commandTime.load();
+    const double busyTime = (commandTime - lastCommandTime) / (elapsed * 1000.0);
+    const double messageRate = (receivedMessages - lastReceivedMessages) * 1000.0 / elapsed;
+    lastReceivedMessages = receivedMessages;
+    lastCommandTime = commandTime;
+
+    const double currentLoad =
+        busyTime + lag / 1000000.0 + messageRate / 1000.0 + metrics->queuedBytes.load() / (1024.0 * 1024.0);
+    // smoothed, so that a single burst doesn't send all new connections elsewhere
+    load = (load + currentLoad) / 2;
+    metrics->load.store(qRound(load * 1000));
+}
+
+void Servatrice_ConnectionPool::moveIdleClients(QObject *target, int maxCount, int minIdleTime)
+{
+    auto targetPool = qobject_cast<Servatrice_ConnectionPool *>(target);
+    if (!targetPool || (targetPool == this))
+        return;
+
+    // clients are only deleted from the event loop of this thread, so they stay valid during this function
+    QList<AbstractServerSocketInterface *> idleClients;
+    {
+        QMutexLocker locker(&clientsMutex);
+        for (int i = 0; (i < clients.size()) && (idleClients.size() < maxCount); ++i)
+            if ((clients[i]->thread() == thread()) && clients[i]->isIdle(minIdleTime))
+                idleClients.append(clients[i]);
+    }
+
+    for (auto client : idleClients) {
+        {
+            QMutexLocker locker(&clientsMutex);
+            clients.removeOne(client);
+            metrics->clients.store(clients.size());
+        }
+        disconnect(client, SIGNAL(destroyed(QObject *)), this, SLOT(removeClient(QObject *)));
+        targetPool->addClient(client);
+        client->moveToPool(targetPool);
+    }
+    if (!idleClients.isEmpty())
+        qDebug() << "Moved" << idleClients.size() << "idle clients to another pool";
+}
@@ -1,46 +1,63 @@
 #ifndef SERVATRICE_CONNECTION_POOL_H
 #define SERVATRICE_CONNECTION_POOL_H
 
+#include <QElapsedTimer>
+#include <QList>
 #include <QMutex>
 #include <QMutexLocker>
 #include <QObject>
 
+class AbstractServerSocketInterface;
+class QTimer;
 class Servatrice_DatabaseInterface;
+struct Server_PoolMetrics;
 
 class Servatrice_ConnectionPool : public QObject
 {
     Q_OBJECT
 private:
     Servatrice_DatabaseInterface *databaseInterface;
+    Server_PoolMetrics *metrics;
     bool threaded;
-    mutable QMutex clientCountMutex;
-    int clientCount;
+    mutable QMutex clientsMutex;
+    QList<AbstractServerSocketInterface *> clients;
+
+    QTimer *loadTimer;
+    QElapsedTimer loadClock;
+    quint64 lastReceivedMessages, lastCommandTime;
+    double load;
+private slots:
+    void updateLoad();
 
 public:
-    Servatrice_ConnectionPool(Servatrice_DatabaseInterface *_databaseInterface);
+    static const int loadInterval = 1000;
+
+    Servatrice_ConnectionPool(Servatrice_DatabaseInterface *_databaseInterface, Server_PoolMetrics *_metrics);
     ~Servatrice_ConnectionPool();
 
     Servatrice_DatabaseInterface *getDatabaseInterface() const
     {
         return databaseInterface;
     }
-
-    int getClientCount() const
+    Server_PoolMetrics *getMetrics() const
     {
-        QMutexLocker locker(&clientCountMutex);
-        return clientCount;
+        return metrics;
     }
-    void addClient()
+
+    int getClientCount() const
     {
-        QMutexLocker locker(&clientCountMutex);
-        ++clientCount;
+        QMutexLocker locker(&clientsMutex);
+        return clients.size();
     }
+    // The load of the last second; 1 is about what keeps the thread of the pool busy.
+    double getLoad() const;
+    void addClient(AbstractServerSocketInterface *client);
 public slots:
-    void removeClient()
-    {
-        QMutexLocker locker(&clientCountMutex);
-        --clientCount;
-    }
+    // This must be called from the thread of the pool.
+    void startLoadTracking();
+    void removeClient(QObject *client);
+    // Moves up to maxCount clients that have been idle for minIdleTime seconds to the pool target.
+    void moveIdleClients(QObject *target, int maxCount, int minIdleTime);
 };
 
 #endif
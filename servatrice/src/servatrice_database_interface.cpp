@@ -3,16 +3,27 @@
 #include "passwordhasher.h"
 #include "pb/game_replay.pb.h"
 #include "servatrice.h"
+#include "server_avatarcache.h"
 #include "serversocketinterface.h"
 #include "settingscache.h"
 #include <QChar>
 #include <QDateTime>
 #include <QDebug>
+#include <QFile>
+#include <QRegularExpression>
+#include <QSqlDriver>
 #include <QSqlError>
 #include <QSqlQuery>
+#include <QThread>
+
+// SQLite connections wait this long for each other's writes before a query fails
+static const int sqliteBusyTimeout = 5000;
+// The busy timeout doesn't apply to the table locks of a shared cache, queries that hit one are retried a few times
+static const int sqliteLockedRetries = 10;
 
 Servatrice_DatabaseInterface::Servatrice_DatabaseInterface(int _instanceId, Servatrice *_server)
-    : instanceId(_instanceId), sqlDatabase(QSqlDatabase()), server(_server)
+    : instanceId(_instanceId), sqlDatabase(QSqlDatabase()), server(_server),
+      poolMetrics(_server->getMetrics().getPoolMetrics(_instanceId))
 {
 }
 
@@ -40,6 +51,18 @@ bool Servatrice_DatabaseInterface::initDatabase(const QString &type,
                                                 const QString &password)
 {
     sqlDatabase = QSqlDatabase::addDatabase(type, "main");
+    if (type == "QSQLITE") {
+        QString connectOptions = QString("QSQLITE_BUSY_TIMEOUT=%1").arg(sqliteBusyTimeout);
+        if (databaseName == ":memory:") {
+            // the connection pool clones this connection, so all of them need to see the same in-memory database
+            sqlDatabase.setDatabaseName("file:servatrice?mode=memory&cache=shared");
+            connectOptions += ";QSQLITE_OPEN_URI";
+        } else
+            sqlDatabase.setDatabaseName(databaseName);
+        sqlDatabase.setConnectOptions(connectOptions);
+        return openDatabase();
+    }
+
     sqlDatabase.setHostName(hostName);
     sqlDatabase.setDatabaseName(databaseName);
     sqlDatabase.setUserName(userName);
@@ -48,6 +71,96 @@ bool Servatrice_DatabaseInterface::initDatabase(const QString &type,
     return openDatabase();
 }
 
+bool Servatrice_DatabaseInterface::isSqlite() const
+{
+    return sqlDatabase.driverName() == "QSQLITE";
+}
+
+bool Servatrice_DatabaseInterface::initSqliteDatabase()
+{
+    const bool inMemory = sqlDatabase.databaseName().startsWith("file:");
+    // connections to a shared in-memory database lock whole tables and don't wait for each other; without read
+    // locks only writers can collide, which execSqlQuery retries
+    QStringList pragmas;
+    pragmas << "pragma foreign_keys = on";
+    if (inMemory)
+        pragmas << "pragma read_uncommitted = 1";
+    else
+        pragmas << "pragma journal_mode = wal";
+    for (const QString &pragma : pragmas) {
+        QSqlQuery query = sqlDatabase.exec(pragma);
+        if (query.lastError().isValid()) {
+            qCritical() << "Error initializing sqlite database:" << query.lastError().text();
+            return false;
+        }
+    }
+
+    const QString prefix = server->getDbPrefix();
+    if (sqlDatabase.tables().contains(prefix + "_schema_version"))
+        return true;
+
+    // new databases get the schema right away, so that e.g. ":memory:" works without any setup
+    QFile schemaFile(":/servatrice_sqlite.sql");
+    if (!schemaFile.open(QIODevice::ReadOnly)) {
+        qCritical() << "Error initializing sqlite database: unable to load the schema";
+        return false;
+    }
+    QStringList schemaLines;
+    for (const QString &line : QString::fromUtf8(schemaFile.readAll()).split('\n'))
+        if (!line.trimmed().startsWith("--"))
+            schemaLines.append(line);
+    QString schema = schemaLines.join('\n');
+    schema.replace("cockatrice_", prefix + "_");
+
+    qDebug() << "Creating sqlite database schema...";
+    sqlDatabase.transaction();
+    for (const QString &statement : schema.split(';')) {
+        if (statement.trimmed().isEmpty())
+            continue;
+        QSqlQuery query = sqlDatabase.exec(statement);
+        if (query.lastError().isValid()) {
+            qCritical() << "Error creating sqlite database schema:" << query.lastError().text();
+            sqlDatabase.rollback();
+            return false;
+        }
+    }
+    return sqlDatabase.commit();
+}
+
+/*
+ * The queries are written for MySQL; the few MySQL specific constructs they use are rewritten for SQLite. Times are
+ * kept in local time like MySQL's now() does.
+ */
+static QString toSqliteDialect(QString queryText)
+{
+    static const QRegularExpression timestampDiff(
+        "timestampdiff\\(second, now\\(\\), date_add\\(([\\w.]+), interval ([\\w.:]+) (\\w+)\\)\\)",
+        QRegularExpression::CaseInsensitiveOption);
+    static const QRegularExpression dateAdd("date_add\\(([\\w.]+), interval ([\\w.:]+) (\\w+)\\)",
+                                            QRegularExpression::CaseInsensitiveOption);
+    static const QRegularExpression dateSub("date_sub\\(now\\(\\), interval ([\\w.:]+) (\\w+)\\)",
+                                            QRegularExpression::CaseInsensitiveOption);
+    static const QRegularExpression nowMinus("\\(now\\(\\) - interval ([\\w.:]+) (\\w+)\\)",
+                                             QRegularExpression::CaseInsensitiveOption);
+    static const QRegularExpression now("\\bnow\\(\\)", QRegularExpression::CaseInsensitiveOption);
+    static const QRegularExpression utcTimestamp("\\butc_timestamp\\(\\)", QRegularExpression::CaseInsensitiveOption);
+    static const QRegularExpression lockTables("^lock tables .*$", QRegularExpression::CaseInsensitiveOption);
+
+    queryText.replace(timestampDiff,
+                      "(strftime('%s', \\1, '+' || \\2 || ' \\3s') - strftime('%s', datetime('now', 'localtime')))");
+    queryText.replace(dateAdd, "datetime(\\1, '+' || \\2 || ' \\3s')");
+    queryText.replace(dateSub, "datetime('now', 'localtime', '-' || \\1 || ' \\2s')");
+    queryText.replace(nowMinus, "datetime('now', 'localtime', '-' || \\1 || ' \\2s')");
+    queryText.replace(now, "datetime('now', 'localtime')");
+    queryText.replace(utcTimestamp, "datetime('now')");
+    queryText.replace("<=>", "is");
+    // table locks only guard the session tables; an immediate transaction serializes the writers the same way
+    queryText.replace(lockTables, "begin immediate");
+    if (queryText.compare("unlock tables", Qt::CaseInsensitive) == 0)
+        queryText = "commit";
+    return queryText;
+}
+
 bool Servatrice_DatabaseInterface::openDatabase()
 {
     if (sqlDatabase.isOpen())
@@ -59,6 +172,8 @@ bool Servatrice_DatabaseInterface::openDatabase()
         qCritical() << QString("[%1] Error opening database: %2").arg(poolStr).arg(sqlDatabase.lastError().text());
         return false;
     }
+    if (isSqlite() && !initSqliteDatabase())
+        return false;
 
     QSqlQuery *versionQuery = prepareQuery("select version from {prefix}_schema_version limit 1");
     if (!execSqlQuery(versionQuery)) {
@@ -116,6 +231,8 @@ QSqlQuery *Servatrice_DatabaseInterface::prepareQuery(const QString &queryText)
 
     QString prefixedQueryText = queryText;
     prefixedQueryText.replace("{prefix}", server->getDbPrefix());
+    if (isSqlite())
+        prefixedQueryText = toSqliteDialect(prefixedQueryText);
     QSqlQuery *query = new QSqlQuery(sqlDatabase);
     query->prepare(prefixedQueryText);
 
@@ -125,13 +242,31 @@ QSqlQuery *Servatrice_DatabaseInterface::prepareQuery(const QString &queryText)
 
 bool Servatrice_DatabaseInterface::execSqlQuery(QSqlQuery *query)
 {
-    if (query->exec())
+    const qint64 startTime = Server_Metrics::currentTime();
+    bool success = query->exec();
+    // a shared in-memory sqlite database reports conflicting writes at once instead of waiting for them
+    for (int retry = 0; !success && retry < sqliteLockedRetries; ++retry) {
+        if (!isSqliteLockedError(query->lastError()))
+            break;
+        QThread::msleep(1);
+        success = query->exec();
+    }
+    poolMetrics->databaseQueries.record(Server_Metrics::currentTime() - startTime);
+    if (success)
         return true;
     const QString poolStr = instanceId == -1 ? QString("main") : QString("pool %1").arg(instanceId);
     qCritical() << QString("[%1] Error executing query: %2").arg(poolStr).arg(query->lastError().text());
     return false;
 }
 
+bool Servatrice_DatabaseInterface::isSqliteLockedError(const QSqlError &error) const
+{
+    if (!isSqlite())
+        return false;
+    // SQLITE_LOCKED, including its extended codes; SQLITE_BUSY has already waited for the busy timeout
+    return (error.nativeErrorCode().toInt() & 0xff) == 6;
+}
+
 bool Servatrice_DatabaseInterface::usernameIsValid(const QString &user, QString &error)
 {
     int minNameLength = settingsCache->value("users/minnamelength", 6).toInt();
@@ -283,20 +418,36 @@ AuthenticationResult Servatrice_DatabaseInterface::checkUserPassword(Server_Prot
                                                                      const QString &clientId,
                                                                      QString &reasonStr,
                                                                      int &banSecondsLeft)
+{
+    ServerInfo_User userData;
+    return authenticateUser(handler, user, password, clientId, reasonStr, banSecondsLeft, userData);
+}
+
+AuthenticationResult Servatrice_DatabaseInterface::authenticateUser(Server_ProtocolHandler *handler,
+                                                                    const QString &user,
+                                                                    const QString &password,
+                                                                    const QString &clientId,
+                                                                    QString &reasonStr,
+                                                                    int &banSecondsLeft,
+                                                                    ServerInfo_User &userData)
 {
     switch (server->getAuthenticationMethod()) {
         case Servatrice::AuthenticationNone:
+            userData = getUserData(user, true);
             return UnknownUser;
         case Servatrice::AuthenticationPassword: {
-            QString configPassword = settingsCache->value("authentication/password").toString();
-            if (configPassword == password)
+            if (settingsCache->getSnapshot()->authenticationPassword == password) {
+                userData = getUserData(user, true);
                 return PasswordRight;
+            }
 
             return NotLoggedIn;
         }
         case Servatrice::AuthenticationSql: {
-            if (!checkSql())
+            if (!checkSql()) {
+                userData = getUserData(user, true);
                 return UnknownUser;
+            }
 
             if (!usernameIsValid(user, reasonStr))
                 return UsernameInvalid;
@@ -304,8 +455,11 @@ AuthenticationResult Servatrice_DatabaseInterface::checkUserPassword(Server_Prot
             if (checkUserIsBanned(handler->getAddress(), user, clientId, reasonStr, banSecondsLeft))
                 return UserIsBanned;
 
+            // the user data is fetched along with the password, so that a login needs no query of its own for it
             QSqlQuery *passwordQuery =
-                prepareQuery("select password_sha512, active from {prefix}_users where name = :name");
+                prepareQuery("select id, name, admin, country, privlevel, gender, realname, avatar_bmp, "
+                             "registrationDate, email, clientid, password_sha512, active from {prefix}_users "
+                             "where name = :name");
             passwordQuery->bindValue(":name", user);
             if (!execSqlQuery(passwordQuery)) {
                 qDebug("Login denied: SQL error");
@@ -313,14 +467,15 @@ AuthenticationResult Servatrice_DatabaseInterface::checkUserPassword(Server_Prot
             }
 
             if (passwordQuery->next()) {
-                const QString correctPassword = passwordQuery->value(0).toString();
-                const bool userIsActive = passwordQuery->value(1).toBool();
+                const QString correctPassword = passwordQuery->value(11).toString();
+                const bool userIsActive = passwordQuery->value(12).toBool();
                 if (!userIsActive) {
                     qDebug("Login denied: user not active");
                     return UserIsInactive;
                 }
                 if (correctPassword == PasswordHasher::computeHash(password, correctPassword.left(16))) {
                     qDebug("Login accepted: password right");
+                    userData = evalUserQueryResult(passwordQuery, true, true);
                     return PasswordRight;
                 } else {
                     qDebug("Login denied: password wrong");
@@ -328,6 +483,8 @@ AuthenticationResult Servatrice_DatabaseInterface::checkUserPassword(Server_Prot
                 }
             } else {
                 qDebug("Login accepted: unknown user");
+                userData.set_name(user.toStdString());
+                userData.set_user_level(ServerInfo_User::IsUser);
                 return UnknownUser;
             }
         }
@@ -349,20 +506,10 @@ bool Servatrice_DatabaseInterface::checkUserIsBanned(const QString &ipAddress,
         return false;
     }
 
-    return checkUserIsIpBanned(ipAddress, banReason, banSecondsRemaining) ||
-           checkUserIsNameBanned(userName, banReason, banSecondsRemaining) ||
-           checkUserIsIdBanned(clientId, banReason, banSecondsRemaining);
-}
-
-bool Servatrice_DatabaseInterface::checkUserIsIdBanned(const QString &clientId,
-                                                       QString &banReason,
-                                                       int &banSecondsRemaining)
-{
-    if (clientId.isEmpty())
-        return false;
-
-    QSqlQuery *idBanQuery =
-        prepareQuery("select"
+    // The latest ban of the address, the name and the client id are looked up at once. Like before they were
+    // checked one after another, a ban of the address takes precedence over one of the name and so on.
+    QSqlQuery *banQuery =
+        prepareQuery("select 0,"
                      " timestampdiff(second, now(), date_add(b.time_from, interval b.minutes minute)),"
                      " b.minutes <=> 0,"
                      " b.visible_reason"
@@ -370,63 +517,10 @@ bool Servatrice_DatabaseInterface::checkUserIsIdBanned(const QString &clientId,
                      " where"
                      " b.time_from = (select max(c.time_from)"
                      " from {prefix}_bans c"
-                     " where c.clientid = :id)"
-                     " and b.clientid = :id2");
-
-    idBanQuery->bindValue(":id", clientId);
-    idBanQuery->bindValue(":id2", clientId);
-    if (!execSqlQuery(idBanQuery)) {
-        qDebug() << "Id ban check failed: SQL error." << idBanQuery->lastError();
-        return false;
-    }
-
-    if (idBanQuery->next()) {
-        const int secondsLeft = idBanQuery->value(0).toInt();
-        const bool permanentBan = idBanQuery->value(1).toInt();
-        if ((secondsLeft > 0) || permanentBan) {
-            banReason = idBanQuery->value(2).toString();
-            banSecondsRemaining = permanentBan ? 0 : secondsLeft;
-            qDebug() << "User is banned by client id" << clientId;
-            return true;
-        }
-    }
-    return false;
-}
-
-bool Servatrice_DatabaseInterface::checkUserIsNameBanned(const QString &userName,
-                                                         QString &banReason,
-                                                         int &banSecondsRemaining)
-{
-    QSqlQuery *nameBanQuery =
-        prepareQuery("select timestampdiff(second, now(), date_add(b.time_from, interval b.minutes minute)), b.minutes "
-                     "<=> 0, b.visible_reason from {prefix}_bans b where b.time_from = (select max(c.time_from) from "
-                     "{prefix}_bans c where c.user_name = :name2) and b.user_name = :name1");
-    nameBanQuery->bindValue(":name1", userName);
-    nameBanQuery->bindValue(":name2", userName);
-    if (!execSqlQuery(nameBanQuery)) {
-        qDebug() << "Name ban check failed: SQL error" << nameBanQuery->lastError();
-        return false;
-    }
-
-    if (nameBanQuery->next()) {
-        const int secondsLeft = nameBanQuery->value(0).toInt();
-        const bool permanentBan = nameBanQuery->value(1).toInt();
-        if ((secondsLeft > 0) || permanentBan) {
-            banReason = nameBanQuery->value(2).toString();
-            banSecondsRemaining = permanentBan ? 0 : secondsLeft;
-            qDebug() << "Username" << userName << "is banned by name";
-            return true;
-        }
-    }
-    return false;
-}
-
-bool Servatrice_DatabaseInterface::checkUserIsIpBanned(const QString &ipAddress,
-                                                       QString &banReason,
-                                                       int &banSecondsRemaining)
-{
-    QSqlQuery *ipBanQuery =
-        prepareQuery("select"
+                     " where c.ip_address = :address)"
+                     " and b.ip_address = :address2"
+                     " union all"
+                     " select 1,"
                      " timestampdiff(second, now(), date_add(b.time_from, interval b.minutes minute)),"
                      " b.minutes <=> 0,"
                      " b.visible_reason"
@@ -434,27 +528,58 @@ bool Servatrice_DatabaseInterface::checkUserIsIpBanned(const QString &ipAddress,
                      " where"
                      " b.time_from = (select max(c.time_from)"
                      " from {prefix}_bans c"
-                     " where c.ip_address = :address)"
-                     " and b.ip_address = :address2");
+                     " where c.user_name = :name)"
+                     " and b.user_name = :name2"
+                     " union all"
+                     " select 2,"
+                     " timestampdiff(second, now(), date_add(b.time_from, interval b.minutes minute)),"
+                     " b.minutes <=> 0,"
+                     " b.visible_reason"
+                     " from {prefix}_bans b"
+                     " where"
+                     " b.time_from = (select max(c.time_from)"
+                     " from {prefix}_bans c"
+                     " where c.clientid = :id)"
+                     " and b.clientid = :id2");
 
-    ipBanQuery->bindValue(":address", ipAddress);
-    ipBanQuery->bindValue(":address2", ipAddress);
-    if (!execSqlQuery(ipBanQuery)) {
-        qDebug() << "IP ban check failed: SQL error." << ipBanQuery->lastError();
+    // an empty client id (e.g. of an outdated client) must not match the bans that were made without one
+    const QVariant clientIdValue = clientId.isEmpty() ? QVariant(QVariant::String) : QVariant(clientId);
+    banQuery->bindValue(":address", ipAddress);
+    banQuery->bindValue(":address2", ipAddress);
+    banQuery->bindValue(":name", userName);
+    banQuery->bindValue(":name2", userName);
+    banQuery->bindValue(":id", clientIdValue);
+    banQuery->bindValue(":id2", clientIdValue);
+    if (!execSqlQuery(banQuery)) {
+        qDebug() << "Ban check failed: SQL error." << banQuery->lastError();
         return false;
     }
 
-    if (ipBanQuery->next()) {
-        const int secondsLeft = ipBanQuery->value(0).toInt();
-        const bool permanentBan = ipBanQuery->value(1).toInt();
-        if ((secondsLeft > 0) || permanentBan) {
-            banReason = ipBanQuery->value(2).toString();
+    int banKind = -1;
+    while (banQuery->next()) {
+        const int kind = banQuery->value(0).toInt();
+        const int secondsLeft = banQuery->value(1).toInt();
+        const bool permanentBan = banQuery->value(2).toInt();
+        if ((secondsLeft > 0 || permanentBan) && (banKind == -1 || kind < banKind)) {
+            banKind = kind;
+            banReason = banQuery->value(3).toString();
             banSecondsRemaining = permanentBan ? 0 : secondsLeft;
+        }
+    }
+
+    switch (banKind) {
+        case 0:
             qDebug() << "User is banned by address" << ipAddress;
             return true;
-        }
+        case 1:
+            qDebug() << "Username" << userName << "is banned by name";
+            return true;
+        case 2:
+            qDebug() << "User is banned by client id" << clientId;
+            return true;
+        default:
+            return false;
     }
-    return false;
 }
 
 bool Servatrice_DatabaseInterface::activeUserExists(const QString &user)
@@ -575,8 +700,11 @@ ServerInfo_User Servatrice_DatabaseInterface::evalUserQueryResult(const QSqlQuer
             result.set_real_name(realName.toStdString());
 
         const QByteArray avatarBmp = query->value(7).toByteArray();
-        if (avatarBmp.size())
+        if (avatarBmp.size()) {
             result.set_avatar_bmp(avatarBmp.data(), avatarBmp.size());
+            const QByteArray avatarHash = Server_AvatarCache::hashAvatar(avatarBmp);
+            result.set_avatar_hash(avatarHash.data(), avatarHash.size());
+        }
 
         const QDateTime regDate = query->value(8).toDateTime();
         if (!regDate.toString(Qt::ISODate).isEmpty()) {
@@ -776,7 +904,7 @@ void Servatrice_DatabaseInterface::storeGameInformation(const QString &roomName,
     if (!checkSql())
         return;
 
-    if (!settingsCache->value("game/store_replays", 1).toBool())
+    if (!settingsCache->getSnapshot()->storeReplays)
         return;
 
     QVariantList gameIds1, playerNames, gameIds2, userIds, replayNames;
@@ -879,22 +1007,22 @@ void Servatrice_DatabaseInterface::logMessage(const int senderId,
     QString targetTypeString;
     switch (targetType) {
         case MessageTargetRoom:
-            if (!settingsCache->value("logging/log_user_msg_room", 0).toBool())
+            if (!settingsCache->getSnapshot()->logUserMsgRoom)
                 return;
             targetTypeString = "room";
             break;
         case MessageTargetGame:
-            if (!settingsCache->value("logging/log_user_msg_game", 0).toBool())
+            if (!settingsCache->getSnapshot()->logUserMsgGame)
                 return;
             targetTypeString = "game";
             break;
         case MessageTargetChat:
-            if (!settingsCache->value("logging/log_user_msg_chat", 0).toBool())
+            if (!settingsCache->getSnapshot()->logUserMsgChat)
                 return;
             targetTypeString = "chat";
             break;
         case MessageTargetIslRoom:
-            if (!settingsCache->value("logging/log_user_msg_isl", 0).toBool())
+            if (!settingsCache->getSnapshot()->logUserMsgIsl)
                 return;
             targetTypeString = "room";
             break;
@@ -1001,44 +1129,22 @@ void Servatrice_DatabaseInterface::updateUsersLastLoginData(const QString &userN
     if (!checkSql())
         return;
 
-    int usersID = 0;
-
-    QSqlQuery *query = prepareQuery("select id from {prefix}_users where name = :user_name");
+    // a single upsert instead of looking up the user id and whether the analytics row exists first
+    QSqlQuery *query;
+    if (isSqlite())
+        query = prepareQuery("insert into {prefix}_user_analytics (id, client_ver, last_login)"
+                             " select id, :client_ver, NOW() from {prefix}_users where name = :user_name"
+                             " on conflict(id) do update set client_ver = excluded.client_ver,"
+                             " last_login = excluded.last_login");
+    else
+        query = prepareQuery("insert into {prefix}_user_analytics (id, client_ver, last_login)"
+                             " select id, :client_ver, NOW() from {prefix}_users where name = :user_name"
+                             " on duplicate key update client_ver = values(client_ver),"
+                             " last_login = values(last_login)");
+    query->bindValue(":client_ver", clientVersion);
     query->bindValue(":user_name", userName);
-    if (!execSqlQuery(query)) {
-        qDebug("Failed to locate user id when updating users last login data: SQL Error");
-        return;
-    }
-
-    if (query->next()) {
-        usersID = query->value(0).toInt();
-    }
-
-    if (usersID) {
-        int userCount = 0;
-        query = prepareQuery("select count(id) from {prefix}_user_analytics where id = :user_id");
-        query->bindValue(":user_id", usersID);
-        if (!execSqlQuery(query))
-            return;
-
-        if (query->next()) {
-            userCount = query->value(0).toInt();
-        }
-
-        if (!userCount) {
-            query = prepareQuery(
-                "insert into {prefix}_user_analytics (id,client_ver,last_login) values (:user_id,:client_ver,NOW())");
-            query->bindValue(":user_id", usersID);
-            query->bindValue(":client_ver", clientVersion);
-            execSqlQuery(query);
-        } else {
-            query = prepareQuery(
-                "update {prefix}_user_analytics set last_login = NOW(), client_ver = :client_ver where id = :user_id");
-            query->bindValue(":client_ver", clientVersion);
-            query->bindValue(":user_id", usersID);
-            execSqlQuery(query);
-        }
-    }
+    if (!execSqlQuery(query))
+        qDebug("Failed to update users last login data: SQL Error");
 }
 
 QList<ServerInfo_Ban> Servatrice_DatabaseInterface::getUserBanHistory(const QString userName)
@@ -5,6 +5,7 @@
 #include <QHash>
 #include <QObject>
 #include <QSqlDatabase>
+#include <QSqlError>
 
 #include "server.h"
 #include "server_database_interface.h"
@@ -21,13 +22,12 @@ private:
     QSqlDatabase sqlDatabase;
     QHash<QString, QSqlQuery *> preparedStatements;
     Servatrice *server;
+    Server_PoolMetrics *poolMetrics;
+    bool isSqlite() const;
+    /** Sets up a new sqlite connection and creates the schema if the database is empty. */
+    bool initSqliteDatabase();
+    bool isSqliteLockedError(const QSqlError &error) const;
     ServerInfo_User evalUserQueryResult(const QSqlQuery *query, bool complete, bool withId = false);
-    /** Must be called after checkSql and server is known to be in auth mode. */
-    bool checkUserIsIdBanned(const QString &clientId, QString &banReason, int &banSecondsRemaining);
-    /** Must be called after checkSql and server is known to be in auth mode. */
-    bool checkUserIsIpBanned(const QString &ipAddress, QString &banReason, int &banSecondsRemaining);
-    /** Must be called after checkSql and server is known to be in auth mode. */
-    bool checkUserIsNameBanned(QString const &userName, QString &banReason, int &banSecondsRemaining);
 
 protected:
     AuthenticationResult checkUserPassword(Server_ProtocolHandler *handler,
@@ -36,6 +36,13 @@ protected:
                                            const QString &clientId,
                                            QString &reasonStr,
                                            int &secondsLeft);
+    AuthenticationResult authenticateUser(Server_ProtocolHandler *handler,
+                                          const QString &user,
+                                          const QString &password,
+                                          const QString &clientId,
+                                          QString &reasonStr,
+                                          int &secondsLeft,
+                                          ServerInfo_User &userData);
 
 public slots:
     void initDatabase(const QSqlDatabase &_sqlDatabase);
@@ -56,6 +63,10 @@ public:
     {
         return sqlDatabase;
     }
+    int getInstanceId() const
+    {
+        return instanceId;
+    }
 
     bool activeUserExists(const QString &user);
     bool userExists(const QString &user);
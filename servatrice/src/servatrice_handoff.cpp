@@ -0,0 +1,461 @@
+#include "servatrice_handoff.h"
+#include <QDebug>
+#include <QSocketNotifier>
+#include <QtEndian>
+
+#ifdef Q_OS_LINUX
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+// Largest message accepted over the handoff socket; a session contains the avatar of the user and what the client
+// has sent that hasn't been processed yet.
+static const quint32 maxMessageSize = 16 * 1024 * 1024;
+// Seconds the new process waits for the listening sockets of the old one
+static const int listenerTimeout = 10;
+
+static QSet<QString> getPlayerNames(const HandoffMessage &message)
+{
+    QSet<QString> result;
+    for (const std::string &name : message.player_names())
+        result.insert(QString::fromStdString(name));
+    return result;
+}
+
+Servatrice_Handoff::Servatrice_Handoff(const QString &_path, QObject *parent)
+    : QObject(parent), path(_path), listenDescriptor(-1), connectionDescriptor(-1), listenNotifier(nullptr),
+      connectionNotifier(nullptr), receiving(false), pendingDescriptor(-1)
+{
+}
+
+Servatrice_Handoff::~Servatrice_Handoff()
+{
+    closeConnection();
+    for (int socketDescriptor : listeners)
+        closeSocket(socketDescriptor);
+#ifdef Q_OS_LINUX
+    if (listenDescriptor != -1) {
+        ::close(listenDescriptor);
+        ::unlink(path.toLocal8Bit().constData());
+    }
+#endif
+}
+
+bool Servatrice_Handoff::isSupported()
+{
+#ifdef Q_OS_LINUX
+    return true;
+#else
+    return false;
+#endif
+}
+
+void Servatrice_Handoff::closeSocket(int socketDescriptor)
+{
+#ifdef Q_OS_LINUX
+    if (socketDescriptor != -1)
+        ::close(socketDescriptor);
+#else
+    Q_UNUSED(socketDescriptor);
+#endif
+}
+
+bool Servatrice_Handoff::connectToServer()
+{
+#ifdef Q_OS_LINUX
+    const QByteArray localPath = path.toLocal8Bit();
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    if (localPath.size() >= static_cast<int>(sizeof(address.sun_path))) {
+        qDebug() << "Handoff: socket path too long:" << path;
+        return false;
+    }
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, localPath.constData(), static_cast<size_t>(localPath.size()));
+
+    const int socketDescriptor = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (socketDescriptor == -1)
+        return false;
+    // no server is running if nobody listens
+    if (::connect(socketDescriptor, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == -1) {
+        ::close(socketDescriptor);
+        return false;
+    }
+    timeval timeout = {listenerTimeout, 0};
+    ::setsockopt(socketDescriptor, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    connectionDescriptor = socketDescriptor;
+    receiving = true;
+
+    HandoffMessage message;
+    int listenerDescriptor;
+    while (readMessage(message, listenerDescriptor, true) == MessageComplete) {
+        if (message.message_type() == HandoffMessage::LISTENERS_SENT) {
+            timeout = {0, 0};
+            ::setsockopt(socketDescriptor, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            return true;
+        }
+        if ((message.message_type() == HandoffMessage::LISTENER) && (listenerDescriptor != -1))
+            listeners.insert(message.listener(), listenerDescriptor);
+        else
+            closeSocket(listenerDescriptor);
+        // sent before LISTENERS_SENT, so that they are known before anybody can log in
+        if (message.message_type() == HandoffMessage::PLAYERS_IN_GAMES)
+            playersInGames = getPlayerNames(message);
+    }
+
+    qDebug() << "Handoff: the running server didn't send its listening sockets";
+    for (int descriptor : listeners)
+        closeSocket(descriptor);
+    listeners.clear();
+    playersInGames.clear();
+    closeConnection();
+    receiving = false;
+#endif
+    return false;
+}
+
+int Servatrice_Handoff::takeListener(HandoffMessage::Listener listener)
+{
+    return listeners.contains(listener) ? listeners.take(listener) : -1;
+}
+
+void Servatrice_Handoff::startReceiving()
+{
+    // the listening sockets this process doesn't use are closed
+    for (int socketDescriptor : listeners)
+        closeSocket(socketDescriptor);
+    listeners.clear();
+
+    if (!receiving)
+        return;
+    HandoffMessage message;
+    message.set_message_type(HandoffMessage::LISTENING);
+    sendMessage(message);
+
+    connectionNotifier = new QSocketNotifier(connectionDescriptor, QSocketNotifier::Read, this);
+    connect(connectionNotifier, SIGNAL(activated(int)), this, SLOT(readMessages()));
+}
+
+bool Servatrice_Handoff::listen()
+{
+#ifdef Q_OS_LINUX
+    const QByteArray localPath = path.toLocal8Bit();
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    if (localPath.size() >= static_cast<int>(sizeof(address.sun_path))) {
+        qDebug() << "Handoff: socket path too long:" << path;
+        return false;
+    }
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, localPath.constData(), static_cast<size_t>(localPath.size()));
+
+    // left over by a server that hasn't exited cleanly; a running one would have been connected to
+    ::unlink(localPath.constData());
+
+    const int socketDescriptor = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (socketDescriptor == -1 ||
+        ::bind(socketDescriptor, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == -1 ||
+        ::listen(socketDescriptor, 1) == -1) {
+        qDebug() << "Handoff: listening failed:" << strerror(errno);
+        closeSocket(socketDescriptor);
+        return false;
+    }
+    listenDescriptor = socketDescriptor;
+    listenNotifier = new QSocketNotifier(listenDescriptor, QSocketNotifier::Read, this);
+    connect(listenNotifier, SIGNAL(activated(int)), this, SLOT(acceptConnection()));
+    qDebug() << "Handoff: waiting for a new server on" << path;
+    return true;
+#else
+    return false;
+#endif
+}
+
+void Servatrice_Handoff::acceptConnection()
+{
+#ifdef Q_OS_LINUX
+    const int socketDescriptor = ::accept4(listenDescriptor, nullptr, nullptr, SOCK_CLOEXEC);
+    if (socketDescriptor == -1)
+        return;
+
+    // nobody else can connect anymore, the new process listens on the path once it has taken over
+    listenNotifier->setEnabled(false);
+    listenNotifier->deleteLater();
+    listenNotifier = nullptr;
+    ::close(listenDescriptor);
+    listenDescriptor = -1;
+    ::unlink(path.toLocal8Bit().constData());
+
+    connectionDescriptor = socketDescriptor;
+    connectionNotifier = new QSocketNotifier(connectionDescriptor, QSocketNotifier::Read, this);
+    connect(connectionNotifier, SIGNAL(activated(int)), this, SLOT(readMessages()));
+
+    qDebug() << "Handoff: a new server has connected";
+    emit handoffRequested();
+#endif
+}
+
+void Servatrice_Handoff::sendListener(HandoffMessage::Listener listener, int socketDescriptor)
+{
+    HandoffMessage message;
+    message.set_message_type(HandoffMessage::LISTENER);
+    message.set_listener(listener);
+    sendMessage(message, socketDescriptor);
+}
+
+void Servatrice_Handoff::sendPlayersInGames(const QSet<QString> &names)
+{
+    if (names == playersInGames)
+        return;
+    playersInGames = names;
+
+    HandoffMessage message;
+    message.set_message_type(HandoffMessage::PLAYERS_IN_GAMES);
+    for (const QString &name : names)
+        message.add_player_names(name.toStdString());
+    sendMessage(message);
+}
+
+void Servatrice_Handoff::finishListeners()
+{
+    HandoffMessage message;
+    message.set_message_type(HandoffMessage::LISTENERS_SENT);
+    sendMessage(message);
+}
+
+bool Servatrice_Handoff::sendSession(const SessionHandoff &session, int socketDescriptor)
+{
+    HandoffMessage message;
+    message.set_message_type(HandoffMessage::SESSION);
+    message.mutable_session()->CopyFrom(session);
+    return sendMessage(message, socketDescriptor);
+}
+
+void Servatrice_Handoff::finish()
+{
+    HandoffMessage message;
+    message.set_message_type(HandoffMessage::FINISHED);
+    sendMessage(message);
+    closeConnection();
+}
+
+void Servatrice_Handoff::readMessages()
+{
+    // until the connection is closed, by a FINISHED message, too
+    while (connectionDescriptor != -1)
+        if (!processMessage())
+            return;
+}
+
+// Returns false if no whole message has arrived yet.
+bool Servatrice_Handoff::processMessage()
+{
+    HandoffMessage message;
+    int socketDescriptor;
+    const ReadResult result = readMessage(message, socketDescriptor, false);
+    if (result == MessageIncomplete)
+        return false;
+    if (result == ReadFailed) {
+        closeConnection();
+        if (receiving) {
+            qDebug() << "Handoff: the old server has gone away";
+            receiving = false;
+            setPlayersInGames(QSet<QString>());
+            listen();
+        } else
+            qDebug() << "Handoff: the new server has gone away, the remaining clients stay with this one";
+        return false;
+    }
+
+    switch (message.message_type()) {
+        case HandoffMessage::LISTENING:
+            if (!receiving)
+                emit listenersTaken();
+            break;
+        case HandoffMessage::SESSION:
+            if (receiving && (socketDescriptor != -1)) {
+                const std::string session = message.session().SerializeAsString();
+                emit sessionReceived(socketDescriptor, QByteArray(session.data(), static_cast<int>(session.size())));
+                socketDescriptor = -1;
+            }
+            break;
+        case HandoffMessage::PLAYERS_IN_GAMES:
+            if (receiving)
+                setPlayersInGames(getPlayerNames(message));
+            break;
+        case HandoffMessage::FINISHED:
+            if (receiving) {
+                // the next server takes over from this one
+                qDebug() << "Handoff: the old server has handed over all its clients";
+                closeConnection();
+                receiving = false;
+                setPlayersInGames(QSet<QString>());
+                listen();
+            }
+            break;
+        default:
+            break;
+    }
+    closeSocket(socketDescriptor);
+    return true;
+}
+
+// Messages are sent at once, with the socket passed along attached to their first byte.
+bool Servatrice_Handoff::sendMessage(const HandoffMessage &message, int socketDescriptor)
+{
+#ifdef Q_OS_LINUX
+    const auto size = static_cast<quint32>(message.ByteSize());
+    if (size > maxMessageSize)
+        return false;
+    QByteArray buffer(static_cast<int>(size) + 4, 0);
+    qToBigEndian<quint32>(size, reinterpret_cast<uchar *>(buffer.data()));
+    message.SerializeToArray(buffer.data() + 4, static_cast<int>(size));
+
+    iovec data;
+    data.iov_base = buffer.data();
+    data.iov_len = static_cast<size_t>(buffer.size());
+    msghdr header;
+    memset(&header, 0, sizeof(header));
+    header.msg_iov = &data;
+    header.msg_iovlen = 1;
+    char control[CMSG_SPACE(sizeof(int))];
+    if (socketDescriptor != -1) {
+        memset(control, 0, sizeof(control));
+        header.msg_control = control;
+        header.msg_controllen = sizeof(control);
+        cmsghdr *controlHeader = CMSG_FIRSTHDR(&header);
+        controlHeader->cmsg_level = SOL_SOCKET;
+        controlHeader->cmsg_type = SCM_RIGHTS;
+        controlHeader->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(controlHeader), &socketDescriptor, sizeof(int));
+    }
+
+    QMutexLocker locker(&sendMutex);
+    if (connectionDescriptor == -1)
+        return false;
+    ssize_t sent;
+    do
+        sent = ::sendmsg(connectionDescriptor, &header, MSG_NOSIGNAL);
+    while (sent == -1 && errno == EINTR);
+    for (int offset = static_cast<int>(sent); (sent != -1) && (offset < buffer.size()); offset += sent) {
+        sent = ::send(connectionDescriptor, buffer.constData() + offset, static_cast<size_t>(buffer.size() - offset),
+                      MSG_NOSIGNAL);
+        if (sent == -1 && errno == EINTR)
+            sent = 0;
+    }
+    if (sent == -1) {
+        qDebug() << "Handoff: sending failed:" << strerror(errno);
+        return false;
+    }
+    return true;
+#else
+    Q_UNUSED(message);
+    Q_UNUSED(socketDescriptor);
+    return false;
+#endif
+}
+
+// Reads the message being received up to its end, without blocking unless wait is set; the socket passed along with
+// it is -1 if there is none. It is attached to the first byte of the message, so it is received along with the length
+// of the message and isn't mixed up with the socket of the next one.
+Servatrice_Handoff::ReadResult
+Servatrice_Handoff::readMessage(HandoffMessage &message, int &socketDescriptor, bool wait)
+{
+    socketDescriptor = -1;
+#ifdef Q_OS_LINUX
+    for (;;) {
+        int size = 4;
+        if (readBuffer.size() >= size) {
+            const auto *length = reinterpret_cast<const uchar *>(readBuffer.constData());
+            const quint32 messageSize = qFromBigEndian<quint32>(length);
+            if (messageSize > maxMessageSize)
+                return ReadFailed;
+            size += static_cast<int>(messageSize);
+        }
+        const int offset = readBuffer.size();
+        if (offset == size)
+            break;
+        readBuffer.resize(size);
+
+        iovec data;
+        data.iov_base = readBuffer.data() + offset;
+        data.iov_len = static_cast<size_t>(size - offset);
+        char control[CMSG_SPACE(4 * sizeof(int))];
+        msghdr header;
+        memset(&header, 0, sizeof(header));
+        header.msg_iov = &data;
+        header.msg_iovlen = 1;
+        header.msg_control = control;
+        header.msg_controllen = sizeof(control);
+
+        ssize_t received;
+        do
+            received = ::recvmsg(connectionDescriptor, &header, MSG_CMSG_CLOEXEC | (wait ? MSG_WAITALL : MSG_DONTWAIT));
+        while (received == -1 && errno == EINTR);
+        const int error = errno;
+        readBuffer.resize(offset + static_cast<int>(qMax<ssize_t>(received, 0)));
+
+        // only one socket is passed along with a message, any others are closed
+        for (cmsghdr *controlHeader = CMSG_FIRSTHDR(&header); controlHeader;
+             controlHeader = CMSG_NXTHDR(&header, controlHeader)) {
+            if (controlHeader->cmsg_level != SOL_SOCKET || controlHeader->cmsg_type != SCM_RIGHTS)
+                continue;
+            const size_t count = (controlHeader->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            for (size_t i = 0; i < count; ++i) {
+                int descriptor;
+                memcpy(&descriptor, CMSG_DATA(controlHeader) + i * sizeof(int), sizeof(int));
+                if (pendingDescriptor == -1)
+                    pendingDescriptor = descriptor;
+                else
+                    closeSocket(descriptor);
+            }
+        }
+
+        if (received == -1 && !wait && (error == EAGAIN || error == EWOULDBLOCK))
+            return MessageIncomplete;
+        if (received <= 0)
+            return ReadFailed;
+    }
+
+    const bool parsed = message.ParseFromArray(readBuffer.constData() + 4, readBuffer.size() - 4);
+    readBuffer.clear();
+    socketDescriptor = pendingDescriptor;
+    pendingDescriptor = -1;
+    if (!parsed) {
+        closeSocket(socketDescriptor);
+        socketDescriptor = -1;
+        return ReadFailed;
+    }
+    return MessageComplete;
+#else
+    Q_UNUSED(message);
+    Q_UNUSED(wait);
+    return ReadFailed;
+#endif
+}
+
+void Servatrice_Handoff::setPlayersInGames(const QSet<QString> &names)
+{
+    if (names == playersInGames)
+        return;
+    playersInGames = names;
+    emit playersInGamesChanged();
+}
+
+void Servatrice_Handoff::closeConnection()
+{
+    QMutexLocker locker(&sendMutex);
+    if (connectionNotifier) {
+        // this may be called from a slot connected to the notifier
+        connectionNotifier->setEnabled(false);
+        connectionNotifier->deleteLater();
+        connectionNotifier = nullptr;
+    }
+    closeSocket(connectionDescriptor);
+    connectionDescriptor = -1;
+    readBuffer.clear();
+    closeSocket(pendingDescriptor);
+    pendingDescriptor = -1;
+}
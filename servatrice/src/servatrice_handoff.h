@@ -0,0 +1,112 @@
+#ifndef SERVATRICE_HANDOFF_H
+#define SERVATRICE_HANDOFF_H
+
+#include "pb/session_handoff.pb.h"
+#include <QByteArray>
+#include <QMap>
+#include <QMutex>
+#include <QObject>
+#include <QSet>
+#include <QString>
+
+class QSocketNotifier;
+
+/*
+ * Hands the listening sockets and the client connections of a running server over to the server process replacing
+ * it, so that a restart doesn't disconnect anybody.
+ *
+ * The running server listens on a local socket. The new one connects to it on startup and takes over the listening
+ * sockets. Once it accepts connections, the old server passes it the connections of its clients one by one along
+ * with the state of their sessions, see Server_ProtocolHandler::getSessionState(). Clients in games stay with the
+ * old server until their games have ended, no new games are started there. The new server listens on the local
+ * socket once the old one is done.
+ *
+ * The two processes don't share their users: until the old process has exited, users only see the changes made by the
+ * users of their own process, and the user and room join events aren't repeated for clients that are handed over.
+ * Players of the games still running on the old process can't log in to the new one, their sessions stay with the
+ * old process.
+ */
+class Servatrice_Handoff : public QObject
+{
+    Q_OBJECT
+signals:
+    // old process: a new process waits for the listening sockets, see sendListener()
+    void handoffRequested();
+    // old process: the new process accepts connections now
+    void listenersTaken();
+    // new process
+    void sessionReceived(int socketDescriptor, const QByteArray &session);
+    void playersInGamesChanged();
+
+private:
+    QString path;
+    int listenDescriptor, connectionDescriptor;
+    QSocketNotifier *listenNotifier, *connectionNotifier;
+    bool receiving;
+    // the message being received and the socket passed along with it
+    QByteArray readBuffer;
+    int pendingDescriptor;
+    QMutex sendMutex;
+    // listening sockets received from the old process, by HandoffMessage::Listener
+    QMap<int, int> listeners;
+    // the users with a seat in a game of the old process, as last sent by it
+    QSet<QString> playersInGames;
+
+    enum ReadResult
+    {
+        MessageIncomplete,
+        MessageComplete,
+        ReadFailed
+    };
+
+    bool sendMessage(const HandoffMessage &message, int socketDescriptor = -1);
+    ReadResult readMessage(HandoffMessage &message, int &socketDescriptor, bool wait);
+    bool processMessage();
+    void closeConnection();
+    void setPlayersInGames(const QSet<QString> &names);
+private slots:
+    void acceptConnection();
+    void readMessages();
+
+public:
+    explicit Servatrice_Handoff(const QString &_path, QObject *parent = nullptr);
+    ~Servatrice_Handoff() override;
+    static bool isSupported();
+    static void closeSocket(int socketDescriptor);
+
+    // New process: takes over the listening sockets of the server running at the path, if there is one.
+    bool connectToServer();
+    bool isReceiving() const
+    {
+        return receiving;
+    }
+    bool hasListener(HandoffMessage::Listener listener) const
+    {
+        return listeners.contains(listener);
+    }
+    // Returns -1 if the old process doesn't have the listening socket.
+    int takeListener(HandoffMessage::Listener listener);
+    // They can't log in to this process until their games have ended.
+    const QSet<QString> &getPlayersInGames() const
+    {
+        return playersInGames;
+    }
+    // Tells the old process to hand over its clients now.
+    void startReceiving();
+
+    // Old process: waits for the process replacing this one.
+    bool listen();
+    bool isHandingOver() const
+    {
+        return !receiving && (connectionDescriptor != -1);
+    }
+    void sendListener(HandoffMessage::Listener listener, int socketDescriptor);
+    void finishListeners();
+    // Sent only if they have changed.
+    void sendPlayersInGames(const QSet<QString> &names);
+    // This is thread safe. The connection is kept open by the new process, the caller closes it.
+    bool sendSession(const SessionHandoff &session, int socketDescriptor);
+    void finish();
+};
+
+#endif
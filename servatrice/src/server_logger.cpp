@@ -4,11 +4,16 @@
 #include <QDir>
 #include <QFile>
 #include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonObject>
 #include <QTextStream>
 #include <iostream>
 
 ServerLogger::ServerLogger(bool _logToConsole, QObject *parent)
-    : QObject(parent), logToConsole(_logToConsole), flushRunning(false)
+    : QObject(parent), logToConsole(_logToConsole),
+      jsonLines(settingsCache->value("server/logformat", "text").toString() == "json"),
+      buffer(settingsCache->value("server/logbuffersize", 65536).toInt()), flushPending(0), droppedRecords(0),
+      reportedDroppedRecords(0)
 {
 }
 
@@ -48,62 +53,92 @@ void ServerLogger::logMessage(QString message, void *caller)
     if (!logFile)
         return;
 
-    QString callerString;
-    if (caller)
-        callerString = QString::number((qulonglong)caller, 16) + " ";
-
     // filter out all log entries based on values in configuration file
-    bool shouldWeWriteLog = settingsCache->value("server/writelog", 1).toBool();
-    QString logFilters = settingsCache->value("server/logfilters").toString();
-    QStringList listlogFilters = logFilters.split(",", QString::SkipEmptyParts);
-    bool shouldWeSkipLine = false;
-
-    if (!shouldWeWriteLog)
+    const SettingsSnapshot *settings = settingsCache->getSnapshot();
+    if (!settings->writeLog)
         return;
 
-    if (!logFilters.trimmed().isEmpty()) {
-        shouldWeSkipLine = true;
-        foreach (QString logFilter, listlogFilters) {
-            if (message.contains(logFilter, Qt::CaseInsensitive)) {
+    if (!settings->logFilters.isEmpty()) {
+        bool shouldWeSkipLine = true;
+        for (const QStringMatcher &logFilter : settings->logFilters) {
+            if (logFilter.indexIn(message) != -1) {
                 shouldWeSkipLine = false;
                 break;
             }
         }
+        if (shouldWeSkipLine)
+            return;
     }
 
-    if (shouldWeSkipLine)
+    ServerLogRecord record;
+    record.time = QDateTime::currentMSecsSinceEpoch();
+    record.caller = (quintptr)caller;
+    record.message = message;
+    if (!buffer.push(record)) {
+        droppedRecords.fetchAndAddRelaxed(1);
         return;
+    }
+
+    // only wake up the logger thread if it is not about to flush anyway
+    if (flushPending.testAndSetOrdered(0, 1))
+        emit sigFlushBuffer();
+}
 
-    bufferMutex.lock();
-    buffer.append(QDateTime::currentDateTime().toString() + " " + callerString + message);
-    bufferMutex.unlock();
-    emit sigFlushBuffer();
+QString ServerLogger::formatRecord(const ServerLogRecord &record) const
+{
+    const QDateTime time = QDateTime::fromMSecsSinceEpoch(record.time);
+    const QString callerString = record.caller ? QString::number((qulonglong)record.caller, 16) : QString();
+
+    if (jsonLines) {
+        QJsonObject object;
+        object.insert("time", time.toString("yyyy-MM-ddTHH:mm:ss.zzz"));
+        if (record.caller)
+            object.insert("caller", callerString);
+        object.insert("message", record.message);
+        return QString::fromUtf8(QJsonDocument(object).toJson(QJsonDocument::Compact));
+    }
+
+    if (callerString.isEmpty())
+        return time.toString() + " " + record.message;
+    return time.toString() + " " + callerString + " " + record.message;
 }
 
 void ServerLogger::flushBuffer()
 {
-    if (flushRunning)
+    if (!logFile)
         return;
 
-    flushRunning = true;
-    QTextStream stream(logFile);
-    forever
-    {
-        bufferMutex.lock();
-        if (buffer.isEmpty()) {
-            bufferMutex.unlock();
-            flushRunning = false;
-            return;
-        }
-        QString message = buffer.takeFirst();
-        bufferMutex.unlock();
+    // cleared before draining, so messages queued from now on trigger another flush
+    flushPending.store(0);
 
-        stream << message << "\n";
-        stream.flush();
+    QTextStream stream(logFile);
+    std::string consoleOutput;
+
+    const quint64 dropped = droppedRecords.load();
+    if (dropped != reportedDroppedRecords) {
+        ServerLogRecord record;
+        record.time = QDateTime::currentMSecsSinceEpoch();
+        record.caller = 0;
+        record.message = QString("Log buffer full, dropped %1 messages").arg(dropped - reportedDroppedRecords);
+        reportedDroppedRecords = dropped;
+
+        const QString line = formatRecord(record);
+        stream << line << "\n";
+        if (logToConsole)
+            consoleOutput += line.toStdString() + "\n";
+    }
 
+    ServerLogRecord record;
+    while (buffer.pop(record)) {
+        const QString line = formatRecord(record);
+        stream << line << "\n";
         if (logToConsole)
-            std::cout << message.toStdString() << std::endl;
+            consoleOutput += line.toStdString() + "\n";
     }
+    stream.flush();
+
+    if (!consoleOutput.empty())
+        std::cout << consoleOutput << std::flush;
 }
 
 void ServerLogger::rotateLogs()
@@ -111,6 +146,12 @@ void ServerLogger::rotateLogs()
     if (!logFile)
         return;
 
+    // the queue must only be drained by the logger thread
+    if (QThread::currentThread() != thread()) {
+        QMetaObject::invokeMethod(this, "rotateLogs", Qt::QueuedConnection);
+        return;
+    }
+
     flushBuffer();
 
     logFile->close();
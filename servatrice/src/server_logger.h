@@ -1,21 +1,39 @@
 #ifndef SERVER_LOGGER_H
 #define SERVER_LOGGER_H
 
-#include <QMutex>
+#include "server_logringbuffer.h"
+#include <QAtomicInt>
+#include <QAtomicInteger>
 #include <QObject>
-#include <QStringList>
+#include <QString>
 #include <QThread>
-#include <QWaitCondition>
 
 class QFile;
 class Server_ProtocolHandler;
 
+struct ServerLogRecord
+{
+    qint64 time;
+    quintptr caller;
+    QString message;
+};
+
+/*
+ * Log messages may be submitted from any thread. They are filtered in the
+ * calling thread and queued without locking; the logger thread writes them
+ * out in batches. If the queue is full, messages are dropped and counted
+ * instead of blocking the caller.
+ */
 class ServerLogger : public QObject
 {
     Q_OBJECT
 public:
     ServerLogger(bool _logToConsole, QObject *parent = 0);
     ~ServerLogger();
+    quint64 getDroppedCount() const
+    {
+        return droppedRecords.load();
+    }
 public slots:
     void startLog(const QString &logFileName);
     void logMessage(QString message, void *caller = 0);
@@ -27,10 +45,14 @@ signals:
 
 private:
     bool logToConsole;
+    bool jsonLines;
     static QFile *logFile;
-    bool flushRunning;
-    QStringList buffer;
-    QMutex bufferMutex;
+    Server_LogRingBuffer<ServerLogRecord> buffer;
+    QAtomicInt flushPending;
+    QAtomicInteger<quint64> droppedRecords;
+    quint64 reportedDroppedRecords;
+
+    QString formatRecord(const ServerLogRecord &record) const;
 };
 
 #endif
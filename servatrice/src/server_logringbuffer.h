@@ -0,0 +1,86 @@
+#ifndef SERVER_LOGRINGBUFFER_H
+#define SERVER_LOGRINGBUFFER_H
+
+#include <QAtomicInteger>
+#include <QVector>
+
+/*
+ * Bounded lock-free queue for many producers and a single consumer.
+ *
+ * Every slot carries a sequence number telling whether it is free for the
+ * producer claiming that position or ready for the consumer, so producers
+ * only contend on one compare-and-swap and never wait for each other.
+ * push() fails instead of blocking when the queue is full.
+ */
+template <typename T> class Server_LogRingBuffer
+{
+private:
+    struct Cell
+    {
+        QAtomicInteger<quint64> sequence;
+        T data;
+    };
+
+    QVector<Cell> cells;
+    quint64 mask;
+    QAtomicInteger<quint64> enqueuePos;
+    quint64 dequeuePos;
+
+public:
+    // capacity is rounded up to a power of two
+    explicit Server_LogRingBuffer(int capacity) : enqueuePos(0), dequeuePos(0)
+    {
+        int size = 2;
+        while (size < capacity)
+            size <<= 1;
+        cells.resize(size);
+        mask = size - 1;
+        for (int i = 0; i < size; ++i)
+            cells[i].sequence.store(i);
+    }
+
+    int getCapacity() const
+    {
+        return cells.size();
+    }
+
+    // May be called from any thread.
+    bool push(const T &item)
+    {
+        quint64 pos = enqueuePos.load();
+        Cell *cell;
+        forever
+        {
+            cell = &cells[pos & mask];
+            const qint64 diff = (qint64)cell->sequence.loadAcquire() - (qint64)pos;
+            if (diff == 0) {
+                if (enqueuePos.testAndSetRelaxed(pos, pos + 1))
+                    break;
+                pos = enqueuePos.load();
+            } else if (diff < 0)
+                return false;
+            else
+                pos = enqueuePos.load();
+        }
+
+        cell->data = item;
+        cell->sequence.storeRelease(pos + 1);
+        return true;
+    }
+
+    // Must only be called from the consumer thread.
+    bool pop(T &item)
+    {
+        Cell *cell = &cells[dequeuePos & mask];
+        if (cell->sequence.loadAcquire() != dequeuePos + 1)
+            return false;
+
+        item = cell->data;
+        cell->data = T();
+        cell->sequence.storeRelease(dequeuePos + mask + 1);
+        ++dequeuePos;
+        return true;
+    }
+};
+
+#endif
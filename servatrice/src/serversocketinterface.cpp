@@ -44,6 +44,8 @@
 #include "pb/response_deck_list.pb.h"
 #include "pb/response_deck_upload.pb.h"
 #include "pb/response_forgotpasswordrequest.pb.h"
+#include "pb/response_get_lock_profile.pb.h"
+#include "pb/response_get_metrics.pb.h"
 #include "pb/response_register.pb.h"
 #include "pb/response_replay_download.pb.h"
 #include "pb/response_replay_list.pb.h"
@@ -56,7 +58,9 @@
 #include "pb/serverinfo_replay.pb.h"
 #include "pb/serverinfo_user.pb.h"
 #include "servatrice.h"
+#include "servatrice_connection_pool.h"
 #include "servatrice_database_interface.h"
+#include "servatrice_handoff.h"
 #include "server_logger.h"
 #include "server_player.h"
 #include "server_response_containers.h"
@@ -67,6 +71,8 @@
 #include <QSqlError>
 #include <QSqlQuery>
 #include <QString>
+#include <QtEndian>
+#include <climits>
 #include <iostream>
 
 #include "version_string.h"
@@ -74,6 +80,8 @@
 #include <string>
 
 static const int protocolVersion = 14;
+static const int maxReplayListPageSize = 500;
+static const int maxReplayChunkSize = 1024 * 1024;
 
 AbstractServerSocketInterface::AbstractServerSocketInterface(Servatrice *_server,
                                                              Servatrice_DatabaseInterface *_databaseInterface,
@@ -81,6 +89,8 @@ AbstractServerSocketInterface::AbstractServerSocketInterface(Servatrice *_server
     : Server_ProtocolHandler(_server, _databaseInterface, parent), servatrice(_server),
       sqlInterface(reinterpret_cast<Servatrice_DatabaseInterface *>(databaseInterface))
 {
+    poolMetrics = _server->getMetrics().getPoolMetrics(sqlInterface->getInstanceId());
+
     // Never call flushOutputQueue directly from outputQueueChanged. In case of a socket error,
     // it could lead to this object being destroyed while another function is still on the call stack. -> mutex
     // deadlocks etc.
@@ -98,8 +108,7 @@ bool AbstractServerSocketInterface::initSession()
     delete identSe;
 
     // allow unlimited number of connections from the trusted sources
-    QString trustedSources = settingsCache->value("security/trusted_sources", "127.0.0.1,::1").toString();
-    if (trustedSources.contains(getAddress(), Qt::CaseInsensitive))
+    if (settingsCache->getSnapshot()->trustedSources.contains(getAddress().toLower()))
         return true;
 
     int maxUsers = servatrice->getMaxUsersPerAddress();
@@ -124,13 +133,54 @@ void AbstractServerSocketInterface::catchSocketError(QAbstractSocket::SocketErro
 
 void AbstractServerSocketInterface::transmitProtocolItem(const ServerMessage &item)
 {
+    const int size = item.ByteSize();
     outputQueueMutex.lock();
     outputQueue.append(item);
+    // counted with the mutex held, moveToPool() may switch the pool in the meantime otherwise
+    poolMetrics->queuedMessages.ref();
+    poolMetrics->queuedBytes.fetchAndAddRelaxed(size);
     outputQueueMutex.unlock();
 
     emit outputQueueChanged();
 }
 
+void AbstractServerSocketInterface::processClientMessage(const CommandContainer &cont)
+{
+    const qint64 startTime = Server_Metrics::currentTime();
+    processCommandContainer(cont);
+    poolMetrics->receivedMessages.ref();
+    poolMetrics->commandTime.fetchAndAddRelaxed(static_cast<quint64>(Server_Metrics::currentTime() - startTime));
+}
+
+bool AbstractServerSocketInterface::isIdle(int minIdleTime) const
+{
+    return !deleted && (getLastActionTime() >= minIdleTime);
+}
+
+void AbstractServerSocketInterface::moveToPool(Servatrice_ConnectionPool *pool)
+{
+    stopTimers();
+    sqlInterface = pool->getDatabaseInterface();
+    databaseInterface = sqlInterface;
+
+    {
+        // whatever is still queued is sent by the new pool
+        QMutexLocker locker(&outputQueueMutex);
+        qint64 queuedBytes = 0;
+        for (const ServerMessage &item : outputQueue)
+            queuedBytes += item.ByteSize();
+        poolMetrics->queuedMessages.fetchAndAddRelaxed(-outputQueue.size());
+        poolMetrics->queuedBytes.fetchAndAddRelaxed(-queuedBytes);
+        poolMetrics = pool->getMetrics();
+        poolMetrics->queuedMessages.fetchAndAddRelaxed(outputQueue.size());
+        poolMetrics->queuedBytes.fetchAndAddRelaxed(queuedBytes);
+    }
+
+    // the socket is a child of this object and moves along
+    moveToThread(pool->thread());
+    QMetaObject::invokeMethod(this, "startTimers", Qt::QueuedConnection);
+}
+
 void AbstractServerSocketInterface::logDebugMessage(const QString &message)
 {
     logger->logMessage(message, this);
@@ -225,6 +275,10 @@ AbstractServerSocketInterface::processExtendedAdminCommand(int cmdType, const Ad
             return cmdReloadConfig(cmd.GetExtension(Command_ReloadConfig::ext), rc);
         case AdminCommand::ADJUST_MOD:
             return cmdAdjustMod(cmd.GetExtension(Command_AdjustMod::ext), rc);
+        case AdminCommand::GET_METRICS:
+            return cmdGetMetrics(cmd.GetExtension(Command_GetMetrics::ext), rc);
+        case AdminCommand::GET_LOCK_PROFILE:
+            return cmdGetLockProfile(cmd.GetExtension(Command_GetLockProfile::ext), rc);
         default:
             return Response::RespFunctionNotAllowed;
     }
@@ -576,7 +630,7 @@ Response::ResponseCode AbstractServerSocketInterface::cmdDeckDownload(const Comm
     return Response::RespOk;
 }
 
-Response::ResponseCode AbstractServerSocketInterface::cmdReplayList(const Command_ReplayList & /*cmd*/,
+Response::ResponseCode AbstractServerSocketInterface::cmdReplayList(const Command_ReplayList &cmd,
                                                                     ResponseContainer &rc)
 {
     if (authState != PasswordRight)
@@ -584,13 +638,29 @@ Response::ResponseCode AbstractServerSocketInterface::cmdReplayList(const Comman
 
     Response_ReplayList *re = new Response_ReplayList;
 
+    // The players and replays of all listed matches are fetched with one query each, restricted to the range of
+    // game ids of the page, so the number of queries doesn't depend on the number of matches.
+    const int pageSize = cmd.page_size() ? qMin(static_cast<int>(cmd.page_size()), maxReplayListPageSize) : -1;
     QSqlQuery *query1 = sqlInterface->prepareQuery(
         "select a.id_game, a.replay_name, b.room_name, b.time_started, b.time_finished, b.descr, a.do_not_hide from "
         "{prefix}_replays_access a left join {prefix}_games b on b.id = a.id_game where a.id_player = :id_player and "
-        "(a.do_not_hide = 1 or date_add(b.time_started, interval 7 day) > now())");
+        "a.id_game < :before_game_id and (a.do_not_hide = 1 or date_add(b.time_started, interval 7 day) > now()) "
+        "order by a.id_game desc limit :limit");
     query1->bindValue(":id_player", userInfo->id());
-    sqlInterface->execSqlQuery(query1);
+    query1->bindValue(":before_game_id", cmd.before_game_id() == -1 ? INT_MAX : cmd.before_game_id());
+    query1->bindValue(":limit", pageSize == -1 ? INT_MAX : pageSize + 1);
+    if (!sqlInterface->execSqlQuery(query1)) {
+        delete re;
+        return Response::RespInternalError;
+    }
+
+    QHash<int, ServerInfo_ReplayMatch *> matches;
+    QHash<int, QString> replayNames;
     while (query1->next()) {
+        if (matches.size() == pageSize) {
+            re->set_more_matches(true);
+            break;
+        }
         ServerInfo_ReplayMatch *matchInfo = re->add_match_list();
 
         const int gameId = query1->value(0).toInt();
@@ -601,28 +671,51 @@ Response::ResponseCode AbstractServerSocketInterface::cmdReplayList(const Comman
         matchInfo->set_time_started(timeStarted);
         matchInfo->set_length(timeFinished - timeStarted);
         matchInfo->set_game_name(query1->value(5).toString().toStdString());
-        const QString replayName = query1->value(1).toString();
+        replayNames.insert(gameId, query1->value(1).toString());
         matchInfo->set_do_not_hide(query1->value(6).toBool());
+        matches.insert(gameId, matchInfo);
+    }
+    if (matches.isEmpty()) {
+        rc.setResponseExtension(re);
+        return Response::RespOk;
+    }
 
-        {
-            QSqlQuery *query2 =
-                sqlInterface->prepareQuery("select player_name from {prefix}_games_players where id_game = :id_game");
-            query2->bindValue(":id_game", gameId);
-            sqlInterface->execSqlQuery(query2);
-            while (query2->next())
-                matchInfo->add_player_names(query2->value(0).toString().toStdString());
+    // matches are ordered by descending game id
+    const int firstGameId = re->match_list(re->match_list_size() - 1).game_id();
+    const int lastGameId = re->match_list(0).game_id();
+    {
+        QSqlQuery *query2 = sqlInterface->prepareQuery(
+            "select p.id_game, p.player_name from {prefix}_replays_access a join {prefix}_games_players p on "
+            "p.id_game = a.id_game where a.id_player = :id_player and a.id_game between :first_game_id and "
+            ":last_game_id");
+        query2->bindValue(":id_player", userInfo->id());
+        query2->bindValue(":first_game_id", firstGameId);
+        query2->bindValue(":last_game_id", lastGameId);
+        sqlInterface->execSqlQuery(query2);
+        while (query2->next()) {
+            ServerInfo_ReplayMatch *matchInfo = matches.value(query2->value(0).toInt());
+            if (matchInfo)
+                matchInfo->add_player_names(query2->value(1).toString().toStdString());
         }
-        {
-            QSqlQuery *query3 =
-                sqlInterface->prepareQuery("select id, duration from {prefix}_replays where id_game = :id_game");
-            query3->bindValue(":id_game", gameId);
-            sqlInterface->execSqlQuery(query3);
-            while (query3->next()) {
-                ServerInfo_Replay *replayInfo = matchInfo->add_replay_list();
-                replayInfo->set_replay_id(query3->value(0).toInt());
-                replayInfo->set_replay_name(replayName.toStdString());
-                replayInfo->set_duration(query3->value(1).toInt());
-            }
+    }
+    {
+        QSqlQuery *query3 = sqlInterface->prepareQuery(
+            "select r.id_game, r.id, r.duration from {prefix}_replays_access a join {prefix}_replays r on "
+            "r.id_game = a.id_game where a.id_player = :id_player and a.id_game between :first_game_id and "
+            ":last_game_id");
+        query3->bindValue(":id_player", userInfo->id());
+        query3->bindValue(":first_game_id", firstGameId);
+        query3->bindValue(":last_game_id", lastGameId);
+        sqlInterface->execSqlQuery(query3);
+        while (query3->next()) {
+            const int gameId = query3->value(0).toInt();
+            ServerInfo_ReplayMatch *matchInfo = matches.value(gameId);
+            if (!matchInfo)
+                continue;
+            ServerInfo_Replay *replayInfo = matchInfo->add_replay_list();
+            replayInfo->set_replay_id(query3->value(1).toInt());
+            replayInfo->set_replay_name(replayNames.value(gameId).toStdString());
+            replayInfo->set_duration(query3->value(2).toInt());
         }
     }
 
@@ -648,6 +741,28 @@ Response::ResponseCode AbstractServerSocketInterface::cmdReplayDownload(const Co
             return Response::RespAccessDenied;
     }
 
+    if (cmd.has_length()) {
+        // only the requested part of the replay is read from the database
+        QSqlQuery *query = sqlInterface->prepareQuery(
+            "select substr(replay, :offset, :length), length(replay) from {prefix}_replays where id = :id_replay");
+        query->bindValue(":offset", static_cast<qint64>(cmd.offset()) + 1);
+        query->bindValue(":length", qMin(cmd.length(), static_cast<quint32>(maxReplayChunkSize)));
+        query->bindValue(":id_replay", cmd.replay_id());
+        if (!sqlInterface->execSqlQuery(query))
+            return Response::RespInternalError;
+        if (!query->next())
+            return Response::RespNameNotFound;
+
+        QByteArray data = query->value(0).toByteArray();
+
+        Response_ReplayDownload *re = new Response_ReplayDownload;
+        re->set_replay_data(data.data(), data.size());
+        re->set_total_size(query->value(1).toUInt());
+        rc.setResponseExtension(re);
+
+        return Response::RespOk;
+    }
+
     QSqlQuery *query = sqlInterface->prepareQuery("select replay from {prefix}_replays where id = :id_replay");
     query->bindValue(":id_replay", cmd.replay_id());
     if (!sqlInterface->execSqlQuery(query))
@@ -839,7 +954,7 @@ Response::ResponseCode AbstractServerSocketInterface::cmdWarnUser(const Command_
     QString sendingModerator = QString::fromStdString(userInfo->name()).simplified();
 
     if (sqlInterface->addWarning(userName, sendingModerator, warningReason, clientID)) {
-        servatrice->clientsLock.lockForRead();
+        servatrice->clientsLock.lockForRead(SERVER_LOCK_SITE);
         AbstractServerSocketInterface *user =
             static_cast<AbstractServerSocketInterface *>(server->getUsers().value(userName));
         QList<QString> moderatorList = server->getOnlineModeratorList();
@@ -898,7 +1013,7 @@ Response::ResponseCode AbstractServerSocketInterface::cmdBanFromServer(const Com
     query->bindValue(":client_id", QString::fromStdString(cmd.clientid()));
     sqlInterface->execSqlQuery(query);
 
-    servatrice->clientsLock.lockForRead();
+    servatrice->clientsLock.lockForRead(SERVER_LOCK_SITE);
     QList<QString> moderatorList = server->getOnlineModeratorList();
     QList<AbstractServerSocketInterface *> userList = servatrice->getUsersWithAddressAsList(QHostAddress(address));
 
@@ -1211,6 +1326,12 @@ Response::ResponseCode AbstractServerSocketInterface::cmdAccountImage(const Comm
         return Response::RespInternalError;
 
     userInfo->set_avatar_bmp(cmd.image().c_str(), cmd.image().length());
+    const QByteArray avatarHash = Server_AvatarCache::hashAvatar(image);
+    if (avatarHash.isEmpty())
+        userInfo->clear_avatar_hash();
+    else
+        userInfo->set_avatar_hash(avatarHash.data(), avatarHash.size());
+    server->getAvatarCache().insert(avatarHash, image);
     return Response::RespOk;
 }
 
@@ -1411,10 +1532,32 @@ Response::ResponseCode AbstractServerSocketInterface::cmdReloadConfig(const Comm
 {
     logDebugMessage("Received admin command: reloading configuration");
     settingsCache->sync();
+    settingsCache->reloadSnapshot();
+    server->updateRateLimits();
     QMetaObject::invokeMethod(server, "setRequiredFeatures", Q_ARG(QString, server->getRequiredFeatures()));
     return Response::RespOk;
 }
 
+Response::ResponseCode AbstractServerSocketInterface::cmdGetMetrics(const Command_GetMetrics & /* cmd */,
+                                                                    ResponseContainer &rc)
+{
+    Response_GetMetrics *re = new Response_GetMetrics;
+    re->set_metrics(servatrice->getMetricsText().toStdString());
+    rc.setResponseExtension(re);
+    return Response::RespOk;
+}
+
+Response::ResponseCode AbstractServerSocketInterface::cmdGetLockProfile(const Command_GetLockProfile &cmd,
+                                                                        ResponseContainer &rc)
+{
+    Response_GetLockProfile *re = new Response_GetLockProfile;
+    re->set_profile(Server_LockProfiler::getReport().toStdString());
+    if (cmd.reset())
+        Server_LockProfiler::reset();
+    rc.setResponseExtension(re);
+    return Response::RespOk;
+}
+
 Response::ResponseCode AbstractServerSocketInterface::cmdAdjustMod(const Command_AdjustMod &cmd,
                                                                    ResponseContainer & /*rc*/)
 {
@@ -1493,15 +1636,84 @@ TcpServerSocketInterface::~TcpServerSocketInterface()
 
 void TcpServerSocketInterface::initConnection(int socketDescriptor)
 {
+    socket->setSocketDescriptor(socketDescriptor);
+
     // Add this object to the server's list of connections before it can receive socket events.
     // Otherwise, in case a of a socket error, it could be removed from the list before it is added.
+    // Socket events are only delivered once we return to the event loop, and the server needs the
+    // peer address to index the connection.
     server->addClient(this);
 
-    socket->setSocketDescriptor(socketDescriptor);
     logger->logMessage(QString("Incoming connection: %1").arg(socket->peerAddress().toString()), this);
     initSessionDeprecated();
 }
 
+void TcpServerSocketInterface::handOver()
+{
+    Servatrice_Handoff *handoff = servatrice->getHandoff();
+    if (deleted || !handoff || !getGames().isEmpty())
+        return;
+    // games the user can rejoin stay with this process
+    if (userInfo && !server->getPersistentPlayerReferences(QString::fromStdString(userInfo->name())).isEmpty())
+        return;
+
+    // the new process can't know what is still to be sent, the client is tried again later
+    flushOutputQueue();
+    if (deleted || socket->bytesToWrite() > 0)
+        return;
+
+    // what has been received is continued by the new process, starting at the beginning of a message
+    inputBuffer.append(socket->readAll());
+    if (messageInProgress) {
+        QByteArray length(4, 0);
+        qToBigEndian<quint32>(static_cast<quint32>(messageLength), reinterpret_cast<uchar *>(length.data()));
+        inputBuffer.prepend(length);
+        messageInProgress = false;
+    }
+
+    SessionHandoff state;
+    getSessionState(state);
+    state.set_handshake_started(handshakeStarted);
+    state.set_input_buffer(inputBuffer.constData(), static_cast<size_t>(inputBuffer.size()));
+    if (!handoff->sendSession(state, static_cast<int>(socket->socketDescriptor()))) {
+        readClient();
+        return;
+    }
+
+    logger->logMessage("Connection handed over", this);
+    // the connection stays open in the new process
+    handedOver = true;
+    disconnect(socket, nullptr, this, nullptr);
+    socket->abort();
+    prepareDestroy();
+}
+
+void TcpServerSocketInterface::restoreConnection(int socketDescriptor, const QByteArray &session)
+{
+    SessionHandoff state;
+    const bool sessionValid = state.ParseFromArray(session.constData(), session.size());
+
+    socket->setSocketDescriptor(socketDescriptor);
+    // see initConnection()
+    server->addClient(this);
+
+    logger->logMessage(QString("Connection handed over: %1").arg(socket->peerAddress().toString()), this);
+    if (!sessionValid) {
+        logger->logMessage("Invalid session handed over, closing the connection", this);
+        prepareDestroy();
+        return;
+    }
+    handshakeStarted = state.handshake_started();
+    inputBuffer = QByteArray(state.input_buffer().data(), static_cast<int>(state.input_buffer().size()));
+    if (!restoreSession(state)) {
+        prepareDestroy();
+        return;
+    }
+
+    // including whatever the client has sent in the meantime
+    readClient();
+}
+
 void TcpServerSocketInterface::initSessionDeprecated()
 {
     // dirty hack to make v13 client display the correct error message
@@ -1522,9 +1734,11 @@ void TcpServerSocketInterface::flushOutputQueue()
     while (!outputQueue.isEmpty()) {
         ServerMessage item = outputQueue.takeFirst();
         locker.unlock();
+        poolMetrics->queuedMessages.deref();
 
         QByteArray buf;
         unsigned int size = item.ByteSize();
+        poolMetrics->queuedBytes.fetchAndAddRelaxed(-static_cast<qint64>(size));
         buf.resize(size + 4);
         item.SerializeToArray(buf.data() + 4, size);
         buf.data()[3] = (unsigned char)size;
@@ -1593,7 +1807,7 @@ void TcpServerSocketInterface::readClient()
 
         // dirty hack to make v13 client display the correct error message
         if (handshakeStarted)
-            processCommandContainer(newCommandContainer);
+            processClientMessage(newCommandContainer);
         else if (!newCommandContainer.has_cmd_id()) {
             handshakeStarted = true;
             if (!initTcpSession())
@@ -1699,9 +1913,11 @@ void WebsocketServerSocketInterface::flushOutputQueue()
     while (!outputQueue.isEmpty()) {
         ServerMessage item = outputQueue.takeFirst();
         locker.unlock();
+        poolMetrics->queuedMessages.deref();
 
         QByteArray buf;
         unsigned int size = item.ByteSize();
+        poolMetrics->queuedBytes.fetchAndAddRelaxed(-static_cast<qint64>(size));
         buf.resize(size);
         item.SerializeToArray(buf.data(), size);
         // In case socket->write() calls catchSocketError(), the mutex must not be locked during this call.
@@ -1744,7 +1960,7 @@ void WebsocketServerSocketInterface::binaryMessageReceived(const QByteArray &mes
         qDebug() << "Message coming from:" << getAddress();
     }
 
-    processCommandContainer(newCommandContainer);
+    processClientMessage(newCommandContainer);
 }
 
 #endif
\ No newline at end of file
@@ -29,6 +29,7 @@
 #include <QMutex>
 
 class Servatrice;
+class Servatrice_ConnectionPool;
 class Servatrice_DatabaseInterface;
 class DeckList;
 class ServerInfo_DeckStorage_Folder;
@@ -54,6 +55,8 @@ class Command_ReloadConfig;
 class Command_AccountEdit;
 class Command_AccountImage;
 class Command_AccountPassword;
+class Command_GetMetrics;
+class Command_GetLockProfile;
 
 class AbstractServerSocketInterface : public Server_ProtocolHandler
 {
@@ -70,10 +73,13 @@ protected:
 
     virtual void writeToSocket(QByteArray &data) = 0;
     virtual void flushSocket() = 0;
+    // processes a message of the client and accounts it to the load of the pool
+    void processClientMessage(const CommandContainer &cont);
 
     Servatrice *servatrice;
     QList<ServerMessage> outputQueue;
     QMutex outputQueueMutex;
+    Server_PoolMetrics *poolMetrics;
 
 private:
     Servatrice_DatabaseInterface *sqlInterface;
@@ -108,6 +114,8 @@ private:
     Response::ResponseCode cmdActivateAccount(const Command_Activate &cmd, ResponseContainer & /* rc */);
     Response::ResponseCode cmdReloadConfig(const Command_ReloadConfig & /* cmd */, ResponseContainer & /*rc*/);
     Response::ResponseCode cmdAdjustMod(const Command_AdjustMod &cmd, ResponseContainer & /*rc*/);
+    Response::ResponseCode cmdGetMetrics(const Command_GetMetrics &cmd, ResponseContainer &rc);
+    Response::ResponseCode cmdGetLockProfile(const Command_GetLockProfile &cmd, ResponseContainer &rc);
     Response::ResponseCode cmdForgotPasswordRequest(const Command_ForgotPasswordRequest &cmd, ResponseContainer &rc);
     Response::ResponseCode cmdForgotPasswordReset(const Command_ForgotPasswordReset &cmd, ResponseContainer &rc);
     Response::ResponseCode cmdForgotPasswordChallenge(const Command_ForgotPasswordChallenge &cmd,
@@ -132,6 +140,10 @@ public:
     virtual QString getAddress() const = 0;
 
     void transmitProtocolItem(const ServerMessage &item);
+
+    bool isIdle(int minIdleTime) const;
+    // This must be called from the thread this object lives in.
+    void moveToPool(Servatrice_ConnectionPool *pool);
 };
 
 class TcpServerSocketInterface : public AbstractServerSocketInterface
@@ -179,6 +191,10 @@ protected slots:
     void flushOutputQueue();
 public slots:
     void initConnection(int socketDescriptor);
+    // Passes the connection on to the server process replacing this one, unless the client takes part in games.
+    void handOver();
+    // Continues a connection that has been handed over, see Servatrice_Handoff.
+    void restoreConnection(int socketDescriptor, const QByteArray &session);
 };
 
 #ifdef QT_WEBSOCKETS_LIB
@@ -5,7 +5,7 @@
 #include <QStandardPaths>
 
 SettingsCache::SettingsCache(const QString &fileName, QSettings::Format format, QObject *parent)
-    : QSettings(fileName, format, parent)
+    : QSettings(fileName, format, parent), snapshot(nullptr)
 {
     // first, figure out if we are running in portable mode
     isPortableBuild = QFile::exists(qApp->applicationDirPath() + "/portable.dat");
@@ -16,6 +16,41 @@ SettingsCache::SettingsCache(const QString &fileName, QSettings::Format format,
     for (const QString &regExpStr : disallowedRegExpStr) {
         disallowedRegExp.append(QRegExp(regExpStr));
     }
+
+    reloadSnapshot();
+}
+
+SettingsCache::~SettingsCache()
+{
+    delete snapshot.loadAcquire();
+    qDeleteAll(retiredSnapshots);
+}
+
+void SettingsCache::reloadSnapshot()
+{
+    SettingsSnapshot *newSnapshot = new SettingsSnapshot;
+
+    for (const QString &source : value("security/trusted_sources", "127.0.0.1,::1")
+                                     .toString()
+                                     .split(",", QString::SkipEmptyParts))
+        newSnapshot->trustedSources.insert(source.trimmed().toLower());
+
+    newSnapshot->writeLog = value("server/writelog", 1).toBool();
+    const QString logFilters = value("server/logfilters").toString();
+    if (!logFilters.trimmed().isEmpty())
+        for (const QString &logFilter : logFilters.split(",", QString::SkipEmptyParts))
+            newSnapshot->logFilters.append(QStringMatcher(logFilter, Qt::CaseInsensitive));
+    newSnapshot->logUserMsgRoom = value("logging/log_user_msg_room", 0).toBool();
+    newSnapshot->logUserMsgGame = value("logging/log_user_msg_game", 0).toBool();
+    newSnapshot->logUserMsgChat = value("logging/log_user_msg_chat", 0).toBool();
+    newSnapshot->logUserMsgIsl = value("logging/log_user_msg_isl", 0).toBool();
+    newSnapshot->storeReplays = value("game/store_replays", 1).toBool();
+    newSnapshot->authenticationPassword = value("authentication/password").toString();
+
+    QMutexLocker locker(&reloadMutex);
+    const SettingsSnapshot *oldSnapshot = snapshot.fetchAndStoreOrdered(newSnapshot);
+    if (oldSnapshot)
+        retiredSnapshots.append(oldSnapshot);
 }
 
 QString SettingsCache::guessConfigurationPath(QString &specificPath)
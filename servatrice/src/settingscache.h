@@ -1,27 +1,57 @@
 #ifndef SERVATRICE_SETTINGSCACHE_H
 #define SERVATRICE_SETTINGSCACHE_H
 
+#include <QAtomicPointer>
 #include <QList>
+#include <QMutex>
 #include <QRegExp>
+#include <QSet>
 #include <QSettings>
 #include <QString>
+#include <QStringMatcher>
+#include <QVector>
+
+/*
+ * Typed copy of the settings that are read for every connection, message or game.
+ * A snapshot is never modified once published; reloading the configuration
+ * publishes a new one.
+ */
+struct SettingsSnapshot
+{
+    QSet<QString> trustedSources;
+    bool writeLog;
+    QVector<QStringMatcher> logFilters;
+    bool logUserMsgRoom, logUserMsgGame, logUserMsgChat, logUserMsgIsl;
+    bool storeReplays;
+    QString authenticationPassword;
+};
 
 class SettingsCache : public QSettings
 {
     Q_OBJECT
 private:
     bool isPortableBuild;
+    QAtomicPointer<const SettingsSnapshot> snapshot;
+    // Callers keep plain pointers to the snapshot they read, so replaced snapshots are only freed on exit.
+    QList<const SettingsSnapshot *> retiredSnapshots;
+    QMutex reloadMutex;
 
 public:
     SettingsCache(const QString &fileName = "servatrice.ini",
                   QSettings::Format format = QSettings::IniFormat,
                   QObject *parent = 0);
+    ~SettingsCache();
     static QString guessConfigurationPath(QString &specificPath);
     QList<QRegExp> disallowedRegExp;
     bool getIsPortableBuild() const
     {
         return isPortableBuild;
     }
+    const SettingsSnapshot *getSnapshot() const
+    {
+        return snapshot.loadAcquire();
+    }
+    void reloadSnapshot();
 };
 
 extern SettingsCache *settingsCache;
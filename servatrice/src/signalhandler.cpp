@@ -1,6 +1,8 @@
 #include <QSocketNotifier>
+#include <QStringList>
 
 #include "main.h"
+#include "server_lock.h"
 #include "server_logger.h"
 #include "settingscache.h"
 #include "signalhandler.h"
@@ -18,8 +20,9 @@
 #define SIGSEGV_TRACE_LINES 40
 
 int SignalHandler::sigHupFD[2];
+int SignalHandler::sigUsr1FD[2];
 
-SignalHandler::SignalHandler(QObject *parent) : QObject(parent), snHup(nullptr)
+SignalHandler::SignalHandler(QObject *parent) : QObject(parent), snHup(nullptr), snUsr1(nullptr)
 {
 #ifdef Q_OS_UNIX
     ::socketpair(AF_UNIX, SOCK_STREAM, 0, sigHupFD);
@@ -34,6 +37,17 @@ SignalHandler::SignalHandler(QObject *parent) : QObject(parent), snHup(nullptr)
     hup.sa_flags |= SA_RESTART;
     sigaction(SIGHUP, &hup, 0);
 
+    ::socketpair(AF_UNIX, SOCK_STREAM, 0, sigUsr1FD);
+
+    snUsr1 = new QSocketNotifier(sigUsr1FD[1], QSocketNotifier::Read, this);
+    connect(snUsr1, SIGNAL(activated(int)), this, SLOT(internalSigUsr1Handler()));
+
+    struct sigaction usr1;
+    usr1.sa_handler = SignalHandler::sigUsr1Handler;
+    sigemptyset(&usr1.sa_mask);
+    usr1.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &usr1, 0);
+
     struct sigaction segv;
     segv.sa_handler = SignalHandler::sigSegvHandler;
     segv.sa_flags = SA_RESETHAND;
@@ -68,10 +82,40 @@ void SignalHandler::internalSigHupHandler()
     logger->rotateLogs();
 
     settingsCache->sync();
+    settingsCache->reloadSnapshot();
+    Server_LockProfiler::setEnabled(settingsCache->value("server/lock_profiling", false).toBool());
 
     snHup->setEnabled(true);
 }
 
+void SignalHandler::sigUsr1Handler(int /* sig */)
+{
+#ifdef Q_OS_UNIX
+    char a = 1;
+    ssize_t writeValue = ::write(sigUsr1FD[0], &a, sizeof(a));
+    Q_UNUSED(writeValue);
+#endif
+}
+
+void SignalHandler::internalSigUsr1Handler()
+{
+    snUsr1->setEnabled(false);
+#ifdef Q_OS_UNIX
+    char tmp;
+    ssize_t readValue = ::read(sigUsr1FD[1], &tmp, sizeof(tmp));
+    Q_UNUSED(readValue);
+#endif
+    const QString report = Server_LockProfiler::getReport();
+#ifdef Q_OS_UNIX
+    std::cerr << "Received SIGUSR1" << std::endl << report.toStdString();
+#endif
+    logger->logMessage("Received SIGUSR1, writing the lock profile", this);
+    for (const QString &line : report.split("\n", QString::SkipEmptyParts))
+        logger->logMessage(line, this);
+
+    snUsr1->setEnabled(true);
+}
+
 void SignalHandler::sigSegvHandler(int sig)
 {
 #ifdef Q_OS_UNIX
@@ -12,13 +12,16 @@ public:
     SignalHandler(QObject *parent = 0);
     ~SignalHandler(){};
     static void sigHupHandler(int /* sig */);
+    static void sigUsr1Handler(int /* sig */);
     static void sigSegvHandler(int sig);
 
 private:
     static int sigHupFD[2];
-    QSocketNotifier *snHup;
+    static int sigUsr1FD[2];
+    QSocketNotifier *snHup, *snUsr1;
 private slots:
     void internalSigHupHandler();
+    void internalSigUsr1Handler();
 };
 
 #endif
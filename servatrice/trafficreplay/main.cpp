@@ -0,0 +1,119 @@
+#include "loadgen_statistics.h"
+#include "trafficreplay_session.h"
+#include "version_string.h"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QTimer>
+#include <iostream>
+
+static QStringList recordingFiles(const QStringList &arguments)
+{
+    QStringList result;
+    for (const QString &argument : arguments) {
+        const QFileInfo info(argument);
+        if (!info.isDir()) {
+            result.append(argument);
+            continue;
+        }
+        const QDir dir(argument);
+        for (const QString &fileName : dir.entryList(QStringList("*.ctrf"), QDir::Files, QDir::Name))
+            result.append(dir.filePath(fileName));
+    }
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setOrganizationName("Cockatrice");
+    app.setApplicationName("servatrice_trafficreplay");
+    app.setApplicationVersion(VERSION_STRING);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Replays traffic recorded by Servatrice (see traffic_record_path) against a "
+                                     "server and reports the latencies it observes. Recorded logins are replayed "
+                                     "as they are, so the server usually needs to run with authentication disabled.");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.addPositionalArgument("recordings", "Recorded sessions (.ctrf files or directories containing them)",
+                                 "<recordings...>");
+
+    QCommandLineOption hostOpt("host", "Server host name", "host", "localhost");
+    QCommandLineOption portOpt("port", "Server port", "port", "4747");
+    QCommandLineOption speedOpt("speed", "Replay speed, 2 replays twice as fast as recorded", "factor", "1");
+    QCommandLineOption passwordOpt("password", "Password to log in with instead of the recorded one", "password",
+                                   "");
+    QCommandLineOption reportIntervalOpt("report-interval", "Seconds between progress reports", "seconds", "5");
+    QCommandLineOption jsonOpt("json", "Also write the summary as json to <file>", "file", "");
+    parser.addOptions({hostOpt, portOpt, speedOpt, passwordOpt, reportIntervalOpt, jsonOpt});
+    parser.process(app);
+
+    TrafficReplaySettings settings;
+    settings.host = parser.value(hostOpt);
+    settings.port = parser.value(portOpt).toInt();
+    settings.speed = parser.value(speedOpt).toDouble();
+    settings.password = parser.value(passwordOpt);
+    if (settings.speed <= 0) {
+        std::cerr << "The speed needs to be positive" << std::endl;
+        return 1;
+    }
+    const QString jsonFileName = parser.value(jsonOpt);
+
+    LoadGenStatistics statistics;
+    TrafficReplayIds ids;
+    QList<TrafficReplaySession *> sessions;
+    qint64 firstSessionStart = -1;
+    int commandCount = 0;
+    for (const QString &fileName : recordingFiles(parser.positionalArguments())) {
+        TrafficReplaySession *session = new TrafficReplaySession(settings, &ids, &statistics, &app);
+        if (!session->load(fileName)) {
+            std::cerr << "Could not read recording " << fileName.toStdString() << std::endl;
+            delete session;
+            continue;
+        }
+        if (firstSessionStart == -1 || session->getSessionStart() < firstSessionStart)
+            firstSessionStart = session->getSessionStart();
+        commandCount += session->getCommandCount();
+        sessions.append(session);
+    }
+    if (sessions.isEmpty()) {
+        std::cerr << "No recordings to replay" << std::endl;
+        return 1;
+    }
+
+    // the sessions start with the same offsets to each other as when they were recorded
+    int sessionsLeft = sessions.size();
+    for (TrafficReplaySession *session : sessions) {
+        QObject::connect(session, &TrafficReplaySession::finished, [&sessionsLeft, &app]() {
+            if (--sessionsLeft == 0)
+                app.quit();
+        });
+        const qint64 offset = static_cast<qint64>((session->getSessionStart() - firstSessionStart) / settings.speed);
+        QTimer::singleShot(static_cast<int>(offset), session, SLOT(start()));
+    }
+
+    std::cout << "Replaying " << sessions.size() << " sessions with " << commandCount << " commands against "
+              << settings.host.toStdString() << ":" << settings.port << " at " << settings.speed << "x speed"
+              << std::endl;
+
+    QTimer reportTimer;
+    QObject::connect(&reportTimer, &QTimer::timeout,
+                     [&statistics]() { std::cout << statistics.takeIntervalReport().toStdString() << std::endl; });
+    reportTimer.start(qMax(parser.value(reportIntervalOpt).toInt(), 1) * 1000);
+
+    app.exec();
+    qDeleteAll(sessions);
+
+    std::cout << std::endl << statistics.getSummaryTable().toStdString() << std::endl;
+    if (!jsonFileName.isEmpty()) {
+        QFile jsonFile(jsonFileName);
+        if (jsonFile.open(QIODevice::WriteOnly))
+            jsonFile.write(statistics.getSummaryJson());
+        else
+            std::cerr << "Could not write " << jsonFileName.toStdString() << std::endl;
+    }
+    return 0;
+}
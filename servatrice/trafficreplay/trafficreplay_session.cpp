@@ -0,0 +1,544 @@
+#include "trafficreplay_session.h"
+#include "get_pb_extension.h"
+#include "loadgen_statistics.h"
+#include "pb/commands.pb.h"
+#include "pb/event_draw_cards.pb.h"
+#include "pb/event_game_joined.pb.h"
+#include "pb/event_move_card.pb.h"
+#include "pb/game_event.pb.h"
+#include "pb/game_event_container.pb.h"
+#include "pb/response.pb.h"
+#include "pb/room_commands.pb.h"
+#include "pb/server_message.pb.h"
+#include "pb/serverinfo_card.pb.h"
+#include "pb/serverinfo_game.pb.h"
+#include "pb/session_commands.pb.h"
+#include "pb/session_event.pb.h"
+#include <QTcpSocket>
+#include <QTimer>
+#include <google/protobuf/descriptor.h>
+#include <iostream>
+
+// how long a command waits for the joins and reveals it depends on before it is sent anyway
+static const qint64 idWaitTimeout = 5000000;
+
+TrafficReplaySession::TrafficReplaySession(const TrafficReplaySettings &_settings,
+                                           TrafficReplayIds *_ids,
+                                           LoadGenStatistics *_statistics,
+                                           QObject *parent)
+    : QObject(parent), settings(_settings), ids(_ids), statistics(_statistics), nextRecord(0), sessionStart(0),
+      commandCount(0), blockedSince(-1), socket(nullptr), handshakeDone(false), messageLength(-1), connected(false),
+      loggedIn(false), finishing(false), done(false), matchedJoins(0)
+{
+    recordTimer = new QTimer(this);
+    recordTimer->setSingleShot(true);
+    connect(recordTimer, SIGNAL(timeout()), this, SLOT(processRecords()));
+}
+
+TrafficReplaySession::~TrafficReplaySession()
+{
+    if (connected)
+        statistics->clientsConnected.deref();
+    if (loggedIn)
+        statistics->clientsLoggedIn.deref();
+}
+
+bool TrafficReplaySession::load(const QString &fileName)
+{
+    Server_TrafficRecordReader reader;
+    if (!reader.open(fileName))
+        return false;
+    sessionStart = reader.getSessionStart();
+
+    Record record;
+    while (reader.readRecord(record.type, record.usecs, record.payload)) {
+        if (record.type == Server_TrafficRecorder::CommandRecord)
+            ++commandCount;
+        else if (record.type != Server_TrafficRecorder::ServerMessageRecord)
+            continue;
+        records.append(record);
+    }
+    return true;
+}
+
+void TrafficReplaySession::start()
+{
+    socket = new QTcpSocket(this);
+    socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+    connect(socket, SIGNAL(connected()), this, SLOT(socketConnected()));
+    connect(socket, SIGNAL(error(QAbstractSocket::SocketError)), this,
+            SLOT(socketError(QAbstractSocket::SocketError)));
+    connect(socket, SIGNAL(disconnected()), this, SLOT(socketDisconnected()));
+    connect(socket, SIGNAL(readyRead()), this, SLOT(readTcpData()));
+    socket->connectToHost(settings.host, static_cast<quint16>(settings.port));
+}
+
+void TrafficReplaySession::socketConnected()
+{
+    connected = true;
+    statistics->clientsConnected.ref();
+
+    // the recording starts after the handshake, which is an empty command container
+    CommandContainer handshake;
+    sendCommandContainer(handshake);
+
+    clock.start();
+    processRecords();
+}
+
+void TrafficReplaySession::socketError(QAbstractSocket::SocketError /* error */)
+{
+    if (!connected) {
+        statistics->connectionErrors.ref();
+        finish();
+    }
+}
+
+void TrafficReplaySession::socketDisconnected()
+{
+    if (!connected)
+        return;
+    connected = false;
+    statistics->clientsConnected.deref();
+    if (loggedIn) {
+        loggedIn = false;
+        statistics->clientsLoggedIn.deref();
+    }
+    if (!finishing)
+        statistics->disconnects.ref();
+    finish();
+}
+
+void TrafficReplaySession::disconnectFromServer()
+{
+    if (connected)
+        socket->disconnectFromHost();
+    else
+        finish();
+}
+
+void TrafficReplaySession::finish()
+{
+    if (done)
+        return;
+    done = finishing = true;
+    recordTimer->stop();
+    emit finished();
+}
+
+void TrafficReplaySession::readTcpData()
+{
+    inputBuffer.append(socket->readAll());
+
+    // the server greets tcp clients with an xml header for compatibility with very old clients
+    if (!handshakeDone) {
+        if (inputBuffer.size() < 60)
+            return;
+        if (inputBuffer.startsWith("<?xm"))
+            inputBuffer.remove(0, 60);
+        handshakeDone = true;
+    }
+
+    while (!done) {
+        if (messageLength == -1) {
+            if (inputBuffer.size() < 4)
+                return;
+            messageLength = (((quint32)(unsigned char)inputBuffer[0]) << 24) +
+                            (((quint32)(unsigned char)inputBuffer[1]) << 16) +
+                            (((quint32)(unsigned char)inputBuffer[2]) << 8) + ((quint32)(unsigned char)inputBuffer[3]);
+            inputBuffer.remove(0, 4);
+        }
+        if (inputBuffer.size() < messageLength)
+            return;
+
+        const QByteArray message = inputBuffer.left(messageLength);
+        inputBuffer.remove(0, messageLength);
+        messageLength = -1;
+        processLiveServerMessage(message);
+    }
+}
+
+void TrafficReplaySession::processRecords()
+{
+    if (finishing)
+        return;
+
+    while (nextRecord < records.size()) {
+        const Record &record = records[nextRecord];
+        const qint64 now = clock.nsecsElapsed() / 1000;
+        const qint64 due = static_cast<qint64>(record.usecs / settings.speed);
+        if (due > now) {
+            recordTimer->start(static_cast<int>((due - now) / 1000));
+            return;
+        }
+
+        if (record.type == Server_TrafficRecorder::ServerMessageRecord) {
+            processRecordedServerMessage(record.payload);
+            ++nextRecord;
+            continue;
+        }
+
+        CommandContainer cont;
+        if (!cont.ParseFromArray(record.payload.constData(), record.payload.size())) {
+            ++nextRecord;
+            continue;
+        }
+        if (!isWaitingForIds(cont))
+            blockedSince = -1;
+        else if (blockedSince == -1 || now - blockedSince < idWaitTimeout) {
+            if (blockedSince == -1)
+                blockedSince = now;
+            recordTimer->start(10);
+            return;
+        } else {
+            std::cerr << "Ids of the recording didn't show up in time, replaying without them" << std::endl;
+            giveUpWaiting(cont);
+            blockedSince = -1;
+        }
+
+        sendCommandContainer(cont);
+        ++nextRecord;
+    }
+
+    finishing = true;
+    // give the server some time to answer the last commands
+    QTimer::singleShot(1000, this, SLOT(disconnectFromServer()));
+}
+
+void TrafficReplaySession::processRecordedServerMessage(const QByteArray &payload)
+{
+    ServerMessage message;
+    if (!message.ParseFromArray(payload.constData(), payload.size()))
+        return;
+
+    if (message.message_type() == ServerMessage::SESSION_EVENT) {
+        const SessionEvent &event = message.session_event();
+        if (!event.HasExtension(Event_GameJoined::ext))
+            return;
+        const Event_GameJoined &gameJoined = event.GetExtension(Event_GameJoined::ext);
+        recordedJoins.append(qMakePair(static_cast<int>(gameJoined.game_info().game_id()), gameJoined.player_id()));
+        matchJoins();
+    } else if (message.message_type() == ServerMessage::GAME_EVENT_CONTAINER) {
+        const GameEventContainer &cont = message.game_event_container();
+        // the recorder only keeps the events of the session's own player
+        appendRevealedCards(cont, -1, recordedReveals[cont.game_id()]);
+        matchReveals(cont.game_id());
+    }
+}
+
+void TrafficReplaySession::processLiveServerMessage(const QByteArray &data)
+{
+    statistics->messageReceived(data.size());
+
+    ServerMessage message;
+    if (!message.ParseFromArray(data.data(), data.size()))
+        return;
+
+    switch (message.message_type()) {
+        case ServerMessage::RESPONSE: {
+            const Response &response = message.response();
+            if (!pendingCommands.contains(response.cmd_id()))
+                break;
+            const PendingCommand pending = pendingCommands.take(response.cmd_id());
+            const bool success = response.response_code() == Response::RespOk;
+            statistics->recordResponse(pending.name, clock.nsecsElapsed() / 1000 - pending.sentAt, success);
+            if (success && !loggedIn && pending.name == QString::fromStdString(Command_Login::descriptor()->name())) {
+                loggedIn = true;
+                statistics->clientsLoggedIn.ref();
+            }
+            break;
+        }
+        case ServerMessage::SESSION_EVENT: {
+            const SessionEvent &event = message.session_event();
+            if (!event.HasExtension(Event_GameJoined::ext))
+                break;
+            const Event_GameJoined &gameJoined = event.GetExtension(Event_GameJoined::ext);
+            const int gameId = static_cast<int>(gameJoined.game_info().game_id());
+            liveJoins.append(qMakePair(gameId, gameJoined.player_id()));
+            liveOwnPlayers.insert(gameId, gameJoined.player_id());
+            matchJoins();
+            break;
+        }
+        case ServerMessage::GAME_EVENT_CONTAINER: {
+            const GameEventContainer &cont = message.game_event_container();
+            const int gameId = static_cast<int>(cont.game_id());
+            if (!liveOwnPlayers.contains(gameId))
+                break;
+            QList<RevealedCard> &reveals = liveReveals[gameId];
+            const int revealCount = reveals.size();
+            appendRevealedCards(cont, liveOwnPlayers.value(gameId), reveals);
+            if (reveals.size() != revealCount) {
+                for (auto it = ids->games.constBegin(); it != ids->games.constEnd(); ++it)
+                    if (it.value() == gameId && recordedReveals.contains(it.key()))
+                        matchReveals(it.key());
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+// Collects the card ids the server told the player, in the same way the recorder filters the events.
+void TrafficReplaySession::appendRevealedCards(const GameEventContainer &cont,
+                                               int ownPlayerId,
+                                               QList<RevealedCard> &reveals)
+{
+    for (int i = 0; i < cont.event_list_size(); ++i) {
+        const GameEvent &event = cont.event_list(i);
+        if (ownPlayerId != -1 && event.player_id() != ownPlayerId)
+            continue;
+
+        const int eventType = getPbExtension(event);
+        if (eventType == GameEvent::DRAW_CARDS) {
+            const Event_DrawCards &drawCards = event.GetExtension(Event_DrawCards::ext);
+            for (int j = 0; j < drawCards.cards_size(); ++j)
+                reveals.append({event.player_id(), drawCards.cards(j).id()});
+        } else if (eventType == GameEvent::MOVE_CARD) {
+            const Event_MoveCard &moveCard = event.GetExtension(Event_MoveCard::ext);
+            if (moveCard.new_card_id() < 0)
+                continue;
+            const int ownerId = moveCard.target_player_id() >= 0 ? moveCard.target_player_id() : event.player_id();
+            reveals.append({ownerId, moveCard.new_card_id()});
+        }
+    }
+}
+
+// The k-th game the recorded session joined is the k-th game the replayed session joins.
+void TrafficReplaySession::matchJoins()
+{
+    const int count = qMin(recordedJoins.size(), liveJoins.size());
+    for (; matchedJoins < count; ++matchedJoins) {
+        const QPair<int, int> &recorded = recordedJoins[matchedJoins];
+        const QPair<int, int> &live = liveJoins[matchedJoins];
+        if (live.first == -1)
+            continue;
+        ids->games.insert(recorded.first, live.first);
+        ids->players.insert(qMakePair(live.first, recorded.second), live.second);
+        if (recordedReveals.contains(recorded.first))
+            matchReveals(recorded.first);
+    }
+}
+
+// Within a game, the k-th card id revealed in the recording is the k-th one revealed live.
+void TrafficReplaySession::matchReveals(int recordedGameId)
+{
+    const int liveGameId = ids->games.value(recordedGameId, -1);
+    if (liveGameId == -1)
+        return;
+
+    const QList<RevealedCard> &recorded = recordedReveals[recordedGameId];
+    const QList<RevealedCard> &live = liveReveals[liveGameId];
+    int &matched = matchedReveals[recordedGameId];
+    const int count = qMin(recorded.size(), live.size());
+    for (; matched < count; ++matched) {
+        if (live[matched].playerId == -1)
+            continue;
+        ids->cards[qMakePair(liveGameId, live[matched].playerId)].insert(recorded[matched].cardId,
+                                                                           live[matched].cardId);
+    }
+}
+
+bool TrafficReplaySession::isWaitingForIds(const CommandContainer &cont) const
+{
+    if (matchedJoins < recordedJoins.size())
+        return true;
+    for (auto it = recordedReveals.constBegin(); it != recordedReveals.constEnd(); ++it)
+        if (matchedReveals.value(it.key()) < it.value().size())
+            return true;
+
+    // games other sessions joined, e.g. the one this session is about to join
+    if (cont.has_game_id() && !ids->games.contains(static_cast<int>(cont.game_id())) &&
+        !abandonedGames.contains(static_cast<int>(cont.game_id())))
+        return true;
+    for (int i = 0; i < cont.room_command_size(); ++i) {
+        const RoomCommand &roomCommand = cont.room_command(i);
+        if (!roomCommand.HasExtension(Command_JoinGame::ext))
+            continue;
+        const int gameId = static_cast<int>(roomCommand.GetExtension(Command_JoinGame::ext).game_id());
+        if (!ids->games.contains(gameId) && !abandonedGames.contains(gameId))
+            return true;
+    }
+    return false;
+}
+
+// Fills the unmatched expectations with placeholders so the following commands don't wait for them again.
+void TrafficReplaySession::giveUpWaiting(const CommandContainer &cont)
+{
+    while (liveJoins.size() < recordedJoins.size())
+        liveJoins.append(qMakePair(-1, -1));
+    matchJoins();
+
+    for (auto it = recordedReveals.constBegin(); it != recordedReveals.constEnd(); ++it) {
+        int &matched = matchedReveals[it.key()];
+        const int liveGameId = ids->games.value(it.key(), -1);
+        if (liveGameId != -1) {
+            QList<RevealedCard> &live = liveReveals[liveGameId];
+            while (live.size() < it.value().size())
+                live.append({-1, -1});
+        }
+        matched = it.value().size();
+    }
+
+    if (cont.has_game_id() && !ids->games.contains(static_cast<int>(cont.game_id())))
+        abandonedGames.insert(static_cast<int>(cont.game_id()));
+    for (int i = 0; i < cont.room_command_size(); ++i)
+        if (cont.room_command(i).HasExtension(Command_JoinGame::ext))
+            abandonedGames.insert(static_cast<int>(cont.room_command(i).GetExtension(Command_JoinGame::ext).game_id()));
+}
+
+// Commands are named after the type of their first command, e.g. "Command_Login".
+static QString commandName(const CommandContainer &cont)
+{
+    const ::google::protobuf::Message *command = nullptr;
+    if (cont.session_command_size())
+        command = &cont.session_command(0);
+    else if (cont.game_command_size())
+        command = &cont.game_command(0);
+    else if (cont.room_command_size())
+        command = &cont.room_command(0);
+    else if (cont.moderator_command_size())
+        command = &cont.moderator_command(0);
+    else if (cont.admin_command_size())
+        command = &cont.admin_command(0);
+    if (!command)
+        return QString();
+
+    std::vector<const ::google::protobuf::FieldDescriptor *> fields;
+    command->GetReflection()->ListFields(*command, &fields);
+    for (const ::google::protobuf::FieldDescriptor *field : fields)
+        if (field->is_extension() && field->message_type())
+            return QString::fromStdString(field->message_type()->name());
+    return QString();
+}
+
+void TrafficReplaySession::sendCommandContainer(CommandContainer &cont)
+{
+    if (cont.has_game_id()) {
+        const int liveGameId = ids->mapGame(static_cast<int>(cont.game_id()));
+        cont.set_game_id(static_cast<google::protobuf::uint32>(liveGameId));
+        RewriteContext context;
+        context.liveGameId = liveGameId;
+        context.ownPlayerId = liveOwnPlayers.value(liveGameId, -1);
+        context.startPlayerId = context.ownPlayerId;
+        for (int i = 0; i < cont.game_command_size(); ++i)
+            rewriteIds(*cont.mutable_game_command(i), context);
+    }
+    for (int i = 0; i < cont.room_command_size(); ++i)
+        rewriteIds(*cont.mutable_room_command(i), RewriteContext());
+    if (!settings.password.isEmpty()) {
+        for (int i = 0; i < cont.session_command_size(); ++i)
+            if (cont.session_command(i).HasExtension(Command_Login::ext))
+                cont.mutable_session_command(i)->MutableExtension(Command_Login::ext)->set_password(
+                    settings.password.toStdString());
+    }
+
+    if (cont.has_cmd_id()) {
+        PendingCommand pending;
+        pending.name = commandName(cont);
+        pending.sentAt = clock.nsecsElapsed() / 1000;
+        pendingCommands.insert(cont.cmd_id(), pending);
+    }
+
+    QByteArray buf;
+    const int size = cont.ByteSize();
+    buf.resize(size + 4);
+    cont.SerializeToArray(buf.data() + 4, size);
+    buf.data()[3] = (unsigned char)size;
+    buf.data()[2] = (unsigned char)(size >> 8);
+    buf.data()[1] = (unsigned char)(size >> 16);
+    buf.data()[0] = (unsigned char)(size >> 24);
+    socket->write(buf);
+    statistics->commandSent(buf.size());
+}
+
+static bool isHiddenZone(const std::string &zoneName)
+{
+    // commands address cards in these zones by position, not by id
+    return zoneName == "deck" || zoneName == "sb";
+}
+
+static const ::google::protobuf::FieldDescriptor *findField(const ::google::protobuf::Message &message,
+                                                             const char *name)
+{
+    const ::google::protobuf::FieldDescriptor *field = message.GetDescriptor()->FindFieldByName(name);
+    if (!field || field->is_repeated() || !message.GetReflection()->HasField(message, field))
+        return nullptr;
+    return field;
+}
+
+static std::string stringField(const ::google::protobuf::Message &message, const char *name)
+{
+    const ::google::protobuf::FieldDescriptor *field = findField(message, name);
+    if (!field || field->cpp_type() != ::google::protobuf::FieldDescriptor::CPPTYPE_STRING)
+        return std::string();
+    return message.GetReflection()->GetString(message, field);
+}
+
+// Walks all set fields like the recorder's anonymization, so new commands are mapped without changes here.
+void TrafficReplaySession::rewriteIds(::google::protobuf::Message &message, const RewriteContext &parentContext)
+{
+    const ::google::protobuf::Reflection *reflection = message.GetReflection();
+
+    // the player and zone of a card are given next to it, or in the enclosing message for the cards of a move
+    RewriteContext context(parentContext);
+    const ::google::protobuf::FieldDescriptor *startPlayerField = findField(message, "start_player_id");
+    if (startPlayerField && reflection->GetInt32(message, startPlayerField) >= 0)
+        context.startPlayerId = ids->mapPlayer(context.liveGameId, reflection->GetInt32(message, startPlayerField));
+    if (findField(message, "start_zone"))
+        context.startZone = stringField(message, "start_zone");
+    int targetPlayerId = context.ownPlayerId;
+    const ::google::protobuf::FieldDescriptor *targetPlayerField = findField(message, "target_player_id");
+    if (targetPlayerField && reflection->GetInt32(message, targetPlayerField) >= 0)
+        targetPlayerId = ids->mapPlayer(context.liveGameId, reflection->GetInt32(message, targetPlayerField));
+    std::string zone = stringField(message, "zone");
+    if (zone.empty())
+        zone = stringField(message, "zone_name");
+
+    std::vector<const ::google::protobuf::FieldDescriptor *> fields;
+    reflection->ListFields(message, &fields);
+    for (const ::google::protobuf::FieldDescriptor *field : fields) {
+        if (field->cpp_type() == ::google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE) {
+            if (field->is_repeated()) {
+                for (int i = 0; i < reflection->FieldSize(message, field); ++i)
+                    rewriteIds(*reflection->MutableRepeatedMessage(&message, field, i), context);
+            } else
+                rewriteIds(*reflection->MutableMessage(&message, field), context);
+            continue;
+        }
+        if (field->is_repeated() || (field->cpp_type() != ::google::protobuf::FieldDescriptor::CPPTYPE_INT32 &&
+                                     field->cpp_type() != ::google::protobuf::FieldDescriptor::CPPTYPE_UINT32))
+            continue;
+
+        const std::string &name = field->name();
+        const bool isUnsigned = field->cpp_type() == ::google::protobuf::FieldDescriptor::CPPTYPE_UINT32;
+        const int value = isUnsigned ? static_cast<int>(reflection->GetUInt32(message, field))
+                                     : reflection->GetInt32(message, field);
+        if (value < 0)
+            continue;
+
+        int newValue = value;
+        if (name == "game_id")
+            newValue = ids->mapGame(value);
+        else if (name == "player_id" || name == "start_player_id" || name == "target_player_id")
+            newValue = ids->mapPlayer(context.liveGameId, value);
+        else if (name == "start_card_id") {
+            if (!isHiddenZone(context.startZone))
+                newValue = ids->mapCard(context.liveGameId, context.startPlayerId, value);
+        } else if (name == "target_card_id") {
+            if (!isHiddenZone(stringField(message, "target_zone")))
+                newValue = ids->mapCard(context.liveGameId, targetPlayerId, value);
+        } else if (name == "card_id") {
+            const std::string &cardZone = zone.empty() ? context.startZone : zone;
+            if (!isHiddenZone(cardZone))
+                newValue = ids->mapCard(context.liveGameId, context.startPlayerId, value);
+        }
+        if (newValue == value)
+            continue;
+
+        if (isUnsigned)
+            reflection->SetUInt32(&message, field, static_cast<google::protobuf::uint32>(newValue));
+        else
+            reflection->SetInt32(&message, field, newValue);
+    }
+}
@@ -0,0 +1,166 @@
+#ifndef TRAFFICREPLAY_SESSION_H
+#define TRAFFICREPLAY_SESSION_H
+
+#include "server_trafficrecorder.h"
+#include <QAbstractSocket>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QPair>
+#include <QSet>
+#include <string>
+
+class CommandContainer;
+class GameEventContainer;
+class LoadGenStatistics;
+class QTcpSocket;
+class QTimer;
+namespace google
+{
+namespace protobuf
+{
+class Message;
+}
+} // namespace google
+
+/*
+ * Translation of the ids in a recording to the ones the live server assigned, shared by all sessions because
+ * they refer to each other's games and cards.
+ */
+struct TrafficReplayIds
+{
+    QHash<int, int> games;                          // recorded game id -> live game id
+    QHash<QPair<int, int>, int> players;            // (live game id, recorded player id) -> live player id
+    QHash<QPair<int, int>, QHash<int, int>> cards;  // (live game id, live player id) -> recorded card id -> live
+
+    int mapGame(int recordedGameId) const
+    {
+        return games.value(recordedGameId, recordedGameId);
+    }
+    int mapPlayer(int liveGameId, int recordedPlayerId) const
+    {
+        return players.value(qMakePair(liveGameId, recordedPlayerId), recordedPlayerId);
+    }
+    int mapCard(int liveGameId, int livePlayerId, int recordedCardId) const
+    {
+        return cards.value(qMakePair(liveGameId, livePlayerId)).value(recordedCardId, recordedCardId);
+    }
+};
+
+struct TrafficReplaySettings
+{
+    QString host;
+    int port = 4747;
+    double speed = 1;
+    QString password; // replaces the recorded (usually removed) login passwords if set
+};
+
+/*
+ * Replays one recorded session over a new connection, with the original timing divided by the speed factor.
+ *
+ * The server assigns game ids, player ids and, through shuffling, the ids of drawn cards differently than in the
+ * recording. The session matches the game joins and card reveals in the recording with the ones the live server
+ * sends, in order, and rewrites the ids in the commands it sends. A command that depends on a join or reveal the
+ * live server didn't send yet is held back for a moment.
+ */
+class TrafficReplaySession : public QObject
+{
+    Q_OBJECT
+signals:
+    void finished();
+
+public:
+    TrafficReplaySession(const TrafficReplaySettings &_settings,
+                         TrafficReplayIds *_ids,
+                         LoadGenStatistics *_statistics,
+                         QObject *parent = 0);
+    ~TrafficReplaySession();
+
+    bool load(const QString &fileName);
+    qint64 getSessionStart() const
+    {
+        return sessionStart;
+    }
+    int getCommandCount() const
+    {
+        return commandCount;
+    }
+
+public slots:
+    void start();
+
+private slots:
+    void socketConnected();
+    void socketError(QAbstractSocket::SocketError error);
+    void socketDisconnected();
+    void readTcpData();
+    void processRecords();
+    void disconnectFromServer();
+
+private:
+    struct Record
+    {
+        Server_TrafficRecorder::RecordType type;
+        qint64 usecs;
+        QByteArray payload;
+    };
+    struct RevealedCard
+    {
+        int playerId;
+        int cardId;
+    };
+    struct PendingCommand
+    {
+        QString name;
+        qint64 sentAt;
+    };
+    struct RewriteContext
+    {
+        int liveGameId = -1;
+        int ownPlayerId = -1;
+        int startPlayerId = -1; // the owner of the cards named by card_id and start_card_id
+        std::string startZone;
+    };
+
+    TrafficReplaySettings settings;
+    TrafficReplayIds *ids;
+    LoadGenStatistics *statistics;
+
+    QList<Record> records;
+    int nextRecord;
+    qint64 sessionStart;
+    int commandCount;
+    QTimer *recordTimer;
+    QElapsedTimer clock;
+    qint64 blockedSince;
+
+    QTcpSocket *socket;
+    QByteArray inputBuffer;
+    bool handshakeDone;
+    int messageLength;
+    bool connected, loggedIn, finishing, done;
+    QHash<quint64, PendingCommand> pendingCommands;
+
+    QList<QPair<int, int>> recordedJoins, liveJoins; // (game id, player id)
+    int matchedJoins;
+    QHash<int, int> liveOwnPlayers;                  // live game id -> own player id
+    QHash<int, QList<RevealedCard>> recordedReveals; // keyed by the recorded game id
+    QHash<int, QList<RevealedCard>> liveReveals;     // keyed by the live game id
+    QHash<int, int> matchedReveals;                  // keyed by the recorded game id
+    QSet<int> abandonedGames;                        // recorded games that never showed up live
+
+    void processRecordedServerMessage(const QByteArray &payload);
+    void processLiveServerMessage(const QByteArray &data);
+    static void appendRevealedCards(const GameEventContainer &cont, int ownPlayerId, QList<RevealedCard> &reveals);
+    void matchJoins();
+    void matchReveals(int recordedGameId);
+    bool isWaitingForIds(const CommandContainer &cont) const;
+    void giveUpWaiting(const CommandContainer &cont);
+
+    void sendCommandContainer(CommandContainer &cont);
+    void rewriteIds(::google::protobuf::Message &message, const RewriteContext &parentContext);
+    void finish();
+};
+
+#endif
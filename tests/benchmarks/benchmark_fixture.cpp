@@ -0,0 +1,100 @@
+#include "benchmark_fixture.h"
+#include "decklist.h"
+#include "pb/command_deck_select.pb.h"
+#include "pb/command_ready_start.pb.h"
+#include "pb/game_event_container.pb.h"
+#include "pb/room_event.pb.h"
+#include "pb/session_event.pb.h"
+#include "server_game.h"
+#include "server_player.h"
+#include "server_response_containers.h"
+#include "server_room.h"
+#include <QStringList>
+#include <QTextStream>
+
+BenchmarkUserInterface::BenchmarkUserInterface(Server *_server, const QString &name)
+    : Server_AbstractUserInterface(_server), bytesSent(0)
+{
+    ServerInfo_User userInfo;
+    userInfo.set_name(name.toStdString());
+    setUserInfo(userInfo);
+}
+
+void BenchmarkUserInterface::sendProtocolItem(const Response &item)
+{
+    bytesSent += item.SerializeAsString().size();
+}
+
+void BenchmarkUserInterface::sendProtocolItem(const SessionEvent &item)
+{
+    bytesSent += item.SerializeAsString().size();
+}
+
+void BenchmarkUserInterface::sendProtocolItem(const GameEventContainer &item)
+{
+    bytesSent += item.SerializeAsString().size();
+}
+
+void BenchmarkUserInterface::sendProtocolItem(const RoomEvent &item)
+{
+    bytesSent += item.SerializeAsString().size();
+}
+
+BenchmarkGame::BenchmarkGame(int playerCount, int spectatorCount, const QString &deck)
+{
+    server.setDatabaseInterface(&databaseInterface);
+    room = new Server_Room(0, 100, "benchmark", QString(), QString(), QString(), false, QString(), QStringList(),
+                           &server);
+
+    for (int i = 0; i < playerCount + spectatorCount; ++i)
+        users.append(new BenchmarkUserInterface(&server, QString("user%1").arg(i)));
+
+    game = new Server_Game(*users.first()->getUserInfo(), 1, "benchmark", QString(), playerCount, QList<int>(), false,
+                           false, true, false, true, false, room);
+
+    Server_MutexLocker locker(&game->gameMutex, SERVER_LOCK_SITE);
+    for (int i = 0; i < users.size(); ++i) {
+        ResponseContainer rc(-1);
+        game->addPlayer(users[i], rc, i >= playerCount, false);
+    }
+
+    Command_DeckSelect deckSelect;
+    deckSelect.set_deck(deck.toStdString());
+    Command_ReadyStart readyStart;
+    readyStart.set_ready(true);
+    for (int i = 0; i < playerCount; ++i) {
+        ResponseContainer rc(-1);
+        GameEventStorage ges;
+        Server_Player *player = getPlayer(i);
+        player->cmdDeckSelect(deckSelect, rc, ges);
+        player->cmdReadyStart(readyStart, rc, ges);
+    }
+    // startGameIfReady() would start the game from the event loop
+    QMetaObject::invokeMethod(game, "doStartGameIfReady", Qt::DirectConnection);
+}
+
+BenchmarkGame::~BenchmarkGame()
+{
+    delete game;
+    delete room;
+    qDeleteAll(users);
+}
+
+Server_Player *BenchmarkGame::getPlayer(int playerId) const
+{
+    return game->getPlayers().value(playerId);
+}
+
+QString benchmarkDeck()
+{
+    QString plainDeck("4 Lightning Bolt\n4 Monastery Swiftspear\n4 Goblin Guide\n4 Eidolon of the Great Revel\n"
+                      "4 Lava Spike\n4 Rift Bolt\n4 Skewer the Critics\n4 Boros Charm\n4 Lightning Helix\n"
+                      "2 Skullcrack\n2 Searing Blaze\n4 Inspiring Vantage\n4 Sacred Foundry\n4 Arid Mesa\n"
+                      "4 Bloodstained Mire\n4 Mountain\n\n"
+                      "SB: 3 Path to Exile\nSB: 2 Rest in Peace\nSB: 3 Smash to Smithereens\n"
+                      "SB: 2 Deflecting Palm\nSB: 3 Kor Firewalker\nSB: 2 Exquisite Firecraft");
+    QTextStream stream(&plainDeck);
+    DeckList deck;
+    deck.loadFromStream_Plain(stream);
+    return deck.writeToString_Native();
+}
@@ -0,0 +1,169 @@
+#ifndef BENCHMARK_FIXTURE_H
+#define BENCHMARK_FIXTURE_H
+
+#include "server.h"
+#include "server_abstractuserinterface.h"
+#include "server_database_interface.h"
+#include "server_protocolhandler.h"
+#include <QList>
+#include <QThread>
+
+class Server_Game;
+class Server_Player;
+class Server_Room;
+
+// Answers without a database; the queries of the login can be given a round trip time to wait for.
+class BenchmarkDatabaseInterface : public Server_DatabaseInterface
+{
+    Q_OBJECT
+private:
+    int nextGameId, nextReplayId;
+    unsigned long queryLatency;
+
+    void waitForQuery() const
+    {
+        if (queryLatency)
+            QThread::usleep(queryLatency);
+    }
+
+public:
+    BenchmarkDatabaseInterface() : nextGameId(0), nextReplayId(0), queryLatency(0)
+    {
+    }
+    void setQueryLatency(unsigned long microseconds)
+    {
+        queryLatency = microseconds;
+    }
+    AuthenticationResult checkUserPassword(Server_ProtocolHandler * /* handler */,
+                                           const QString & /* user */,
+                                           const QString & /* password */,
+                                           const QString & /* clientId */,
+                                           QString & /* reasonStr */,
+                                           int & /* secondsLeft */) override
+    {
+        waitForQuery();
+        return UnknownUser;
+    }
+    // Like the SQL implementation: one query for the bans, one for the password and the user data.
+    AuthenticationResult authenticateUser(Server_ProtocolHandler *handler,
+                                          const QString &user,
+                                          const QString & /* password */,
+                                          const QString &clientId,
+                                          QString &reasonStr,
+                                          int &secondsLeft,
+                                          ServerInfo_User &userData) override
+    {
+        if (checkUserIsBanned(handler->getAddress(), user, clientId, reasonStr, secondsLeft))
+            return UserIsBanned;
+        waitForQuery();
+        userData.set_name(user.toStdString());
+        userData.set_user_level(ServerInfo_User::IsUser);
+        return UnknownUser;
+    }
+    bool checkUserIsBanned(const QString & /* ipAddress */,
+                           const QString & /* userName */,
+                           const QString & /* clientId */,
+                           QString & /* banReason */,
+                           int & /* banSecondsRemaining */) override
+    {
+        waitForQuery();
+        return false;
+    }
+    bool activeUserExists(const QString & /* user */) override
+    {
+        waitForQuery();
+        return false;
+    }
+    ServerInfo_User getUserData(const QString &name, bool /* withId */ = false) override
+    {
+        waitForQuery();
+        ServerInfo_User result;
+        result.set_name(name.toStdString());
+        return result;
+    }
+    bool userSessionExists(const QString & /* userName */) override
+    {
+        waitForQuery();
+        return false;
+    }
+    qint64 startSession(const QString & /* userName */,
+                        const QString & /* address */,
+                        const QString & /* clientId */,
+                        const QString & /* connectionType */) override
+    {
+        waitForQuery();
+        return 0;
+    }
+    void updateUsersClientID(const QString & /* userName */, const QString & /* userClientID */) override
+    {
+        waitForQuery();
+    }
+    void updateUsersLastLoginData(const QString & /* userName */, const QString & /* clientVersion */) override
+    {
+        waitForQuery();
+    }
+    int getNextGameId() override
+    {
+        return ++nextGameId;
+    }
+    int getNextReplayId() override
+    {
+        return ++nextReplayId;
+    }
+    int getActiveUserCount(QString /* connectionType */ = QString()) override
+    {
+        return 0;
+    }
+};
+
+// Stands in for a connected client; serializes what it is sent, like a real connection would.
+class BenchmarkUserInterface : public Server_AbstractUserInterface
+{
+private:
+    qint64 bytesSent;
+
+public:
+    BenchmarkUserInterface(Server *_server, const QString &name);
+
+    qint64 getBytesSent() const
+    {
+        return bytesSent;
+    }
+    int getLastCommandTime() const override
+    {
+        return 0;
+    }
+    void sendProtocolItem(const Response &item) override;
+    void sendProtocolItem(const SessionEvent &item) override;
+    void sendProtocolItem(const GameEventContainer &item) override;
+    void sendProtocolItem(const RoomEvent &item) override;
+};
+
+/*
+ * A started game with real decks, set up the way the server would after all players selected a deck and
+ * declared they're ready.
+ */
+class BenchmarkGame
+{
+private:
+    BenchmarkDatabaseInterface databaseInterface;
+    Server server;
+    Server_Room *room;
+    QList<BenchmarkUserInterface *> users;
+    Server_Game *game;
+
+public:
+    BenchmarkGame(int playerCount, int spectatorCount, const QString &deck);
+    ~BenchmarkGame();
+
+    Server_Game *getGame() const
+    {
+        return game;
+    }
+    Server_Player *getPlayer(int playerId) const;
+};
+
+// A constructed 60 card deck with a 15 card sideboard, in the native format.
+QString benchmarkDeck();
+
+#endif
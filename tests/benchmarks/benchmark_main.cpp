@@ -0,0 +1,25 @@
+#include "rng_sfmt.h"
+#include <QCoreApplication>
+#include <benchmark/benchmark.h>
+
+RNG_Abstract *rng;
+
+static void silentMessageOutput(QtMsgType /* type */, const QMessageLogContext &, const QString & /* msg */)
+{
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    // the game engine logs a lot of debug output, which would distort the numbers
+    qInstallMessageHandler(silentMessageOutput);
+    rng = new RNG_SFMT;
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+        return 1;
+    benchmark::RunSpecifiedBenchmarks();
+
+    delete rng;
+    return 0;
+}
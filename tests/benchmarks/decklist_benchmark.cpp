@@ -0,0 +1,57 @@
+#include "decklist.h"
+#include <QTextStream>
+#include <benchmark/benchmark.h>
+
+// A plain text deck with the given number of different cards, e.g. 60 for a singleton or 100 for a commander deck.
+static QString plainDeck(int cardNames)
+{
+    QString result;
+    for (int i = 0; i < cardNames; ++i)
+        result += QString("1 Benchmark Card %1\n").arg(i);
+    result += "\nSB: 1 Benchmark Sideboard Card\n";
+    return result;
+}
+
+static void BM_DeckListLoadNative(benchmark::State &state)
+{
+    QString plain = plainDeck(static_cast<int>(state.range(0)));
+    QTextStream stream(&plain);
+    DeckList source;
+    source.loadFromStream_Plain(stream);
+    const QString native = source.writeToString_Native();
+
+    for (auto _ : state) {
+        DeckList deck;
+        deck.loadFromString_Native(native);
+    }
+    state.SetBytesProcessed(state.iterations() * native.size());
+}
+BENCHMARK(BM_DeckListLoadNative)->Arg(20)->Arg(100);
+
+static void BM_DeckListLoadPlain(benchmark::State &state)
+{
+    const QString plain = plainDeck(static_cast<int>(state.range(0)));
+
+    for (auto _ : state) {
+        QString input(plain);
+        QTextStream stream(&input);
+        DeckList deck;
+        deck.loadFromStream_Plain(stream);
+    }
+    state.SetBytesProcessed(state.iterations() * plain.size());
+}
+BENCHMARK(BM_DeckListLoadPlain)->Arg(20)->Arg(100);
+
+static void BM_DeckListUpdateDeckHash(benchmark::State &state)
+{
+    QString plain = plainDeck(static_cast<int>(state.range(0)));
+    QTextStream stream(&plain);
+    DeckList deck;
+    deck.loadFromStream_Plain(stream);
+
+    for (auto _ : state) {
+        deck.updateDeckHash();
+        benchmark::DoNotOptimize(deck.getDeckHash());
+    }
+}
+BENCHMARK(BM_DeckListUpdateDeckHash)->Arg(20)->Arg(100);
@@ -0,0 +1,146 @@
+#include "benchmark_fixture.h"
+#include "pb/command_move_card.pb.h"
+#include "pb/command_reveal_cards.pb.h"
+#include "pb/command_shuffle.pb.h"
+#include "pb/event_game_say.pb.h"
+#include "pb/serverinfo_zone.pb.h"
+#include "server_card.h"
+#include "server_cardzone.h"
+#include "server_game.h"
+#include "server_player.h"
+#include "server_response_containers.h"
+#include <benchmark/benchmark.h>
+
+// Moves the top card of the library onto the battlefield and back again.
+static void BM_MoveCard(benchmark::State &state)
+{
+    BenchmarkGame fixture(2, static_cast<int>(state.range(0)), benchmarkDeck());
+    Server_Player *player = fixture.getPlayer(0);
+    Server_CardZone *deck = player->getZones().value("deck");
+    Server_CardZone *table = player->getZones().value("table");
+
+    CardToMove fromDeck;
+    fromDeck.set_card_id(0);
+    const QList<const CardToMove *> fromDeckList{&fromDeck};
+    CardToMove fromTable;
+    const QList<const CardToMove *> fromTableList{&fromTable};
+
+    for (auto _ : state) {
+        GameEventStorage ges;
+        Server_Card *card = deck->getCards().first();
+        player->moveCard(ges, deck, fromDeckList, table, 0, 0);
+        fromTable.set_card_id(card->getId());
+        player->moveCard(ges, table, fromTableList, deck, 0, 0);
+        ges.sendToGame(fixture.getGame());
+    }
+    state.SetItemsProcessed(state.iterations() * 2);
+}
+BENCHMARK(BM_MoveCard)->Arg(0)->Arg(10);
+
+// Draws an opening hand and puts it back on top of the library.
+static void BM_DrawCards(benchmark::State &state)
+{
+    BenchmarkGame fixture(2, 0, benchmarkDeck());
+    Server_Player *player = fixture.getPlayer(0);
+    Server_CardZone *deck = player->getZones().value("deck");
+    Server_CardZone *hand = player->getZones().value("hand");
+    const int number = static_cast<int>(state.range(0));
+
+    for (auto _ : state) {
+        GameEventStorage ges;
+        player->drawCards(ges, number);
+
+        state.PauseTiming();
+        QList<CardToMove> cards;
+        for (Server_Card *card : hand->getCards()) {
+            CardToMove cardToMove;
+            cardToMove.set_card_id(card->getId());
+            cards.append(cardToMove);
+        }
+        QList<const CardToMove *> cardList;
+        for (const CardToMove &cardToMove : cards)
+            cardList.append(&cardToMove);
+        GameEventStorage undoGes;
+        player->moveCard(undoGes, hand, cardList, deck, 0, 0);
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * number);
+}
+BENCHMARK(BM_DrawCards)->Arg(1)->Arg(7);
+
+static void BM_Shuffle(benchmark::State &state)
+{
+    BenchmarkGame fixture(2, 0, benchmarkDeck());
+    Server_Player *player = fixture.getPlayer(0);
+    const Command_Shuffle cmd;
+
+    for (auto _ : state) {
+        ResponseContainer rc(-1);
+        GameEventStorage ges;
+        player->cmdShuffle(cmd, rc, ges);
+    }
+}
+BENCHMARK(BM_Shuffle);
+
+// Reveals the whole library to the opponent, like a tutor effect would.
+static void BM_RevealCards(benchmark::State &state)
+{
+    BenchmarkGame fixture(2, 0, benchmarkDeck());
+    Server_Player *player = fixture.getPlayer(0);
+    Command_RevealCards cmd;
+    cmd.set_zone_name("deck");
+    cmd.set_player_id(1);
+
+    for (auto _ : state) {
+        ResponseContainer rc(-1);
+        GameEventStorage ges;
+        player->cmdRevealCards(cmd, rc, ges);
+        ges.sendToGame(fixture.getGame());
+    }
+}
+BENCHMARK(BM_RevealCards);
+
+// The zone information that is part of every game state a joining player or spectator receives.
+static void BM_CardZoneGetInfo(benchmark::State &state)
+{
+    BenchmarkGame fixture(2, 0, benchmarkDeck());
+    Server_Player *player = fixture.getPlayer(0);
+    Server_Player *opponent = fixture.getPlayer(1);
+    Server_CardZone *deck = player->getZones().value("deck");
+    Server_CardZone *table = player->getZones().value("table");
+
+    // put some permanents on the table
+    const int tableCards = static_cast<int>(state.range(0));
+    CardToMove fromDeck;
+    fromDeck.set_card_id(0);
+    const QList<const CardToMove *> fromDeckList{&fromDeck};
+    for (int i = 0; i < tableCards; ++i) {
+        GameEventStorage ges;
+        player->moveCard(ges, deck, fromDeckList, table, i, 0);
+    }
+
+    for (auto _ : state) {
+        ServerInfo_Zone ownerInfo, opponentInfo;
+        deck->getInfo(&ownerInfo, player, false);
+        table->getInfo(&ownerInfo, player, false);
+        table->getInfo(&opponentInfo, opponent, false);
+        benchmark::DoNotOptimize(opponentInfo.card_list_size());
+    }
+}
+BENCHMARK(BM_CardZoneGetInfo)->Arg(5)->Arg(30);
+
+// Fans a typical batch of game events out to the players and spectators.
+static void BM_GameEventStorageSendToGame(benchmark::State &state)
+{
+    BenchmarkGame fixture(2, static_cast<int>(state.range(0)), benchmarkDeck());
+    Event_GameSay event;
+    event.set_message("Do you want to keep your hand?");
+
+    for (auto _ : state) {
+        GameEventStorage ges;
+        for (int i = 0; i < 4; ++i)
+            ges.enqueueGameEvent(event, 0);
+        ges.sendToGame(fixture.getGame());
+    }
+}
+BENCHMARK(BM_GameEventStorageSendToGame)->Arg(0)->Arg(10)->Arg(50);
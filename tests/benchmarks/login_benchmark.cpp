@@ -0,0 +1,57 @@
+#include "benchmark_fixture.h"
+#include "server_protocolhandler.h"
+#include <QCoreApplication>
+#include <benchmark/benchmark.h>
+
+// Stands in for a client connection; nothing is sent, the login is done by calling Server::loginUser() directly.
+class BenchmarkConnection : public Server_ProtocolHandler
+{
+public:
+    BenchmarkConnection(Server *_server, Server_DatabaseInterface *_databaseInterface)
+        : Server_ProtocolHandler(_server, _databaseInterface)
+    {
+    }
+    QString getAddress() const override
+    {
+        return "127.0.0.1";
+    }
+    QString getConnectionType() const override
+    {
+        return "benchmark";
+    }
+
+protected:
+    void transmitProtocolItem(const ServerMessage & /* item */) override
+    {
+    }
+};
+
+// Logs a user in, with every database query the login waits for taking the given number of microseconds. What is
+// queued for after the login response is not part of the measured time.
+static void BM_LoginUser(benchmark::State &state)
+{
+    BenchmarkDatabaseInterface databaseInterface;
+    databaseInterface.setQueryLatency(static_cast<unsigned long>(state.range(0)));
+    Server server;
+    server.setDatabaseInterface(&databaseInterface);
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto connection = new BenchmarkConnection(&server, &databaseInterface);
+        server.addClient(connection);
+        QString name = "user";
+        QString reasonStr, clientId = "benchmark", clientVersion = "benchmark", connectionType = "benchmark";
+        int secondsLeft = 0;
+        state.ResumeTiming();
+
+        server.loginUser(connection, name, QString(), reasonStr, secondsLeft, clientId, clientVersion,
+                         connectionType);
+
+        state.PauseTiming();
+        QCoreApplication::sendPostedEvents();
+        server.removeClient(connection);
+        delete connection;
+        state.ResumeTiming();
+    }
+}
+BENCHMARK(BM_LoginUser)->Arg(0)->Arg(500)->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,83 @@
+#include "../../servatrice/src/server_logringbuffer.h"
+#include "gtest/gtest.h"
+#include <QVector>
+#include <thread>
+#include <vector>
+
+TEST(LogRingBufferTest, CapacityIsRoundedUp)
+{
+    Server_LogRingBuffer<int> buffer(100);
+    EXPECT_EQ(buffer.getCapacity(), 128);
+}
+
+TEST(LogRingBufferTest, KeepsOrder)
+{
+    Server_LogRingBuffer<int> buffer(8);
+    for (int i = 0; i < 5; ++i)
+        EXPECT_TRUE(buffer.push(i));
+
+    int item;
+    for (int i = 0; i < 5; ++i) {
+        ASSERT_TRUE(buffer.pop(item));
+        EXPECT_EQ(item, i);
+    }
+    EXPECT_FALSE(buffer.pop(item));
+}
+
+TEST(LogRingBufferTest, RejectsWhenFull)
+{
+    Server_LogRingBuffer<int> buffer(4);
+    for (int i = 0; i < 4; ++i)
+        EXPECT_TRUE(buffer.push(i));
+    EXPECT_FALSE(buffer.push(4));
+
+    int item;
+    ASSERT_TRUE(buffer.pop(item));
+    EXPECT_EQ(item, 0);
+    EXPECT_TRUE(buffer.push(4));
+}
+
+TEST(LogRingBufferTest, WrapsAround)
+{
+    Server_LogRingBuffer<int> buffer(4);
+    int item;
+    for (int i = 0; i < 100; ++i) {
+        ASSERT_TRUE(buffer.push(i));
+        ASSERT_TRUE(buffer.pop(item));
+        EXPECT_EQ(item, i);
+    }
+}
+
+TEST(LogRingBufferTest, ConcurrentProducers)
+{
+    const int producerCount = 4;
+    const int itemsPerProducer = 20000;
+    Server_LogRingBuffer<int> buffer(1024);
+
+    std::vector<std::thread> producers;
+    for (int p = 0; p < producerCount; ++p)
+        producers.emplace_back([&buffer, p]() {
+            for (int i = 0; i < itemsPerProducer; ++i)
+                while (!buffer.push(p * itemsPerProducer + i))
+                    std::this_thread::yield();
+        });
+
+    // items of each producer must arrive complete and in the order they were pushed
+    QVector<int> lastSeen(producerCount, -1);
+    int received = 0;
+    int item;
+    while (received < producerCount * itemsPerProducer) {
+        if (!buffer.pop(item)) {
+            std::this_thread::yield();
+            continue;
+        }
+        const int producer = item / itemsPerProducer;
+        EXPECT_GT(item % itemsPerProducer, lastSeen[producer]);
+        lastSeen[producer] = item % itemsPerProducer;
+        ++received;
+    }
+
+    for (std::thread &producer : producers)
+        producer.join();
+    EXPECT_FALSE(buffer.pop(item));
+}
@@ -0,0 +1,79 @@
+#include "../../common/server_ratelimiter.h"
+#include "gtest/gtest.h"
+#include <QThread>
+
+TEST(RateLimiterTest, DisabledLimitAllowsEverything)
+{
+    Server_RateLimiter limiter("test");
+    qint64 arrivalTime = 0;
+    EXPECT_FALSE(limiter.isEnabled());
+    EXPECT_TRUE(limiter.consume(arrivalTime, 1000000));
+
+    limiter.setLimit(0, 10);
+    EXPECT_TRUE(limiter.consume(arrivalTime, 1000000));
+    EXPECT_EQ(limiter.getRejectedCount(), 0u);
+}
+
+TEST(RateLimiterTest, BurstUpToLimit)
+{
+    Server_RateLimiter limiter("test");
+    limiter.setLimit(20, 10);
+    qint64 arrivalTime = 0;
+
+    for (int i = 0; i < 20; ++i)
+        EXPECT_TRUE(limiter.consume(arrivalTime, 1));
+    EXPECT_FALSE(limiter.consume(arrivalTime, 1));
+    EXPECT_EQ(limiter.getRejectedCount(), 1u);
+}
+
+TEST(RateLimiterTest, BulkCost)
+{
+    Server_RateLimiter limiter("test");
+    limiter.setLimit(20, 10);
+    qint64 arrivalTime = 0;
+
+    EXPECT_FALSE(limiter.consume(arrivalTime, 21));
+    EXPECT_TRUE(limiter.consume(arrivalTime, 15));
+    EXPECT_FALSE(limiter.consume(arrivalTime, 6));
+    EXPECT_TRUE(limiter.consume(arrivalTime, 5));
+    EXPECT_TRUE(limiter.consume(arrivalTime, 0));
+    EXPECT_EQ(limiter.getRejectedCount(), 2u);
+}
+
+TEST(RateLimiterTest, Refill)
+{
+    Server_RateLimiter limiter("test");
+    limiter.setLimit(1000, 1);
+    qint64 arrivalTime = 0;
+
+    EXPECT_TRUE(limiter.consume(arrivalTime, 1000));
+    EXPECT_FALSE(limiter.consume(arrivalTime, 1));
+    QThread::msleep(50);
+    EXPECT_TRUE(limiter.consume(arrivalTime, 10));
+}
+
+TEST(RateLimiterTest, KeysAreIndependent)
+{
+    Server_RateLimiter limiter("test");
+    limiter.setLimit(2, 10);
+
+    EXPECT_TRUE(limiter.consume(QString("127.0.0.1"), 2));
+    EXPECT_FALSE(limiter.consume(QString("127.0.0.1"), 1));
+    EXPECT_TRUE(limiter.consume(QString("::1"), 2));
+}
+
+TEST(RateLimiterTest, Refund)
+{
+    Server_RateLimiter limiter("test");
+    limiter.setLimit(10, 10);
+    qint64 arrivalTime = 0;
+
+    EXPECT_TRUE(limiter.consume(arrivalTime, 10));
+    limiter.refund(arrivalTime, 4);
+    EXPECT_TRUE(limiter.consume(arrivalTime, 4));
+    EXPECT_FALSE(limiter.consume(arrivalTime, 1));
+
+    EXPECT_TRUE(limiter.consume(QString("127.0.0.1"), 10));
+    limiter.refund(QString("127.0.0.1"), 10);
+    EXPECT_TRUE(limiter.consume(QString("127.0.0.1"), 10));
+}
@@ -0,0 +1,44 @@
+#include "../../common/server_avatarcache.h"
+#include "gtest/gtest.h"
+
+TEST(ServerAvatarCacheTest, AvatarsAreFoundByHash)
+{
+    Server_AvatarCache cache;
+    const QByteArray avatar("some image");
+    const QByteArray hash = Server_AvatarCache::hashAvatar(avatar);
+    EXPECT_EQ(hash.size(), 20);
+    EXPECT_EQ(hash, Server_AvatarCache::hashAvatar(std::string("some image")));
+    EXPECT_TRUE(Server_AvatarCache::hashAvatar(QByteArray()).isEmpty());
+
+    EXPECT_TRUE(cache.find(hash).isNull());
+    cache.insert(hash, avatar);
+    EXPECT_EQ(cache.find(hash), avatar);
+    EXPECT_EQ(cache.getSize(), avatar.size());
+    EXPECT_TRUE(cache.find(Server_AvatarCache::hashAvatar(QByteArray("other image"))).isNull());
+}
+
+TEST(ServerAvatarCacheTest, LeastRecentlyUsedAvatarsAreDropped)
+{
+    Server_AvatarCache cache(30);
+    const QByteArray first(10, 'a'), second(10, 'b'), third(10, 'c'), fourth(10, 'd');
+    cache.insert("1", first);
+    cache.insert("2", second);
+    cache.insert("3", third);
+    EXPECT_EQ(cache.getSize(), 30);
+
+    // using the first avatar makes the second one the least recently used
+    EXPECT_EQ(cache.find("1"), first);
+    cache.insert("4", fourth);
+    EXPECT_EQ(cache.getSize(), 30);
+    EXPECT_EQ(cache.find("1"), first);
+    EXPECT_TRUE(cache.find("2").isNull());
+    EXPECT_EQ(cache.find("3"), third);
+    EXPECT_EQ(cache.find("4"), fourth);
+
+    // too big for the cache
+    cache.insert("5", QByteArray(31, 'e'));
+    EXPECT_TRUE(cache.find("5").isNull());
+
+    cache.setMaxSize(10);
+    EXPECT_LE(cache.getSize(), 10);
+}
@@ -0,0 +1,80 @@
+#include "../../common/server_lock.h"
+#include "gtest/gtest.h"
+
+TEST(ServerLockTest, SitesRecordAcquisitions)
+{
+    Server_LockProfiler::setEnabled(true);
+    Server_ReadWriteLock lock("test", Server_LockProfiler::RoomsRank);
+    Server_LockSite *site = SERVER_LOCK_SITE;
+    for (int i = 0; i < 3; ++i) {
+        Server_WriteLocker locker(&lock, site);
+    }
+    {
+        Server_ReadLocker locker(&lock, site);
+        locker.unlock();
+        locker.relock();
+    }
+
+    EXPECT_EQ(site->waits.getCount(), 5u);
+    EXPECT_EQ(site->holds.getCount(), 5u);
+    EXPECT_EQ(site->contendedCount.load(), 0u);
+    EXPECT_STREQ(site->getLockName(), "test");
+    EXPECT_TRUE(site->getName().startsWith("server_lock_test.cpp:"));
+    EXPECT_TRUE(Server_LockProfiler::getReport().contains(site->getName()));
+
+    Server_LockProfiler::reset();
+    EXPECT_EQ(site->waits.getCount(), 0u);
+    EXPECT_FALSE(Server_LockProfiler::getReport().contains(site->getName()));
+}
+
+TEST(ServerLockTest, DisabledProfilingRecordsNothing)
+{
+    Server_LockProfiler::setEnabled(false);
+    Server_Mutex mutex("test", Server_LockProfiler::GameRank);
+    Server_LockSite *site = SERVER_LOCK_SITE;
+    {
+        Server_MutexLocker locker(&mutex, site);
+    }
+    EXPECT_EQ(site->waits.getCount(), 0u);
+    EXPECT_EQ(site->holds.getCount(), 0u);
+}
+
+TEST(ServerLockTest, MetricsAreUpdated)
+{
+    Server_Metrics metrics;
+    Server_Mutex mutex("game", Server_LockProfiler::GameRank, QMutex::Recursive);
+    mutex.setMetrics(&metrics, Server_Metrics::GameMutex);
+    {
+        Server_MutexLocker first(&mutex);
+        Server_MutexLocker second(&mutex);
+    }
+    EXPECT_TRUE(metrics.toPrometheusText().contains("servatrice_lock_wait_seconds_count{lock=\"game\"} 2"));
+}
+
+TEST(ServerLockTest, LockOrderViolations)
+{
+    if (!Server_LockProfiler::checksOrder())
+        return;
+
+    Server_ReadWriteLock rooms("rooms", Server_LockProfiler::RoomsRank);
+    Server_ReadWriteLock clients("clients", Server_LockProfiler::ClientsRank);
+    Server_ReadWriteLock games("games", Server_LockProfiler::GamesRank, QReadWriteLock::Recursive);
+    Server_LockSite *wrongOrder = SERVER_LOCK_SITE;
+    Server_LockSite *rightOrder = SERVER_LOCK_SITE;
+    Server_LockSite *recursive = SERVER_LOCK_SITE;
+    {
+        Server_ReadLocker clientsLocker(&clients);
+        Server_ReadLocker roomsLocker(&rooms, wrongOrder);
+    }
+    {
+        Server_ReadLocker roomsLocker(&rooms);
+        Server_ReadLocker clientsLocker(&clients, rightOrder);
+    }
+    {
+        Server_ReadLocker first(&games);
+        Server_ReadLocker second(&games, recursive);
+    }
+    EXPECT_EQ(wrongOrder->orderViolations.load(), 1u);
+    EXPECT_EQ(rightOrder->orderViolations.load(), 0u);
+    EXPECT_EQ(recursive->orderViolations.load(), 0u);
+}
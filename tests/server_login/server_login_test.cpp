@@ -0,0 +1,134 @@
+#include "../../common/rng_abstract.h"
+#include "../../common/server.h"
+#include "../../common/server_database_interface.h"
+#include "../../common/server_protocolhandler.h"
+#include "gtest/gtest.h"
+
+// the game code links against it, logging in doesn't use it
+RNG_Abstract *rng = nullptr;
+
+namespace
+{
+// Every user is registered; counts the sessions in the sessions table.
+class SessionCountingDatabaseInterface : public Server_DatabaseInterface
+{
+private:
+    int sessionCount;
+
+public:
+    explicit SessionCountingDatabaseInterface(int _sessionCount) : sessionCount(_sessionCount)
+    {
+    }
+    int getSessionCount() const
+    {
+        return sessionCount;
+    }
+    AuthenticationResult checkUserPassword(Server_ProtocolHandler * /* handler */,
+                                           const QString & /* user */,
+                                           const QString & /* password */,
+                                           const QString & /* clientId */,
+                                           QString & /* reasonStr */,
+                                           int & /* secondsLeft */) override
+    {
+        return PasswordRight;
+    }
+    ServerInfo_User getUserData(const QString &name, bool /* withId */ = false) override
+    {
+        ServerInfo_User result;
+        result.set_name(name.toStdString());
+        result.set_user_level(ServerInfo_User::IsUser | ServerInfo_User::IsRegistered);
+        return result;
+    }
+    bool userSessionExists(const QString & /* userName */) override
+    {
+        return sessionCount > 0;
+    }
+    qint64 startSession(const QString & /* userName */,
+                        const QString & /* address */,
+                        const QString & /* clientId */,
+                        const QString & /* connectionType */) override
+    {
+        return ++sessionCount;
+    }
+    int getNextGameId() override
+    {
+        return 0;
+    }
+    int getNextReplayId() override
+    {
+        return 0;
+    }
+    int getActiveUserCount(QString /* connectionType */ = QString()) override
+    {
+        return 0;
+    }
+};
+
+class TestConnection : public Server_ProtocolHandler
+{
+public:
+    TestConnection(Server *_server, Server_DatabaseInterface *_databaseInterface)
+        : Server_ProtocolHandler(_server, _databaseInterface)
+    {
+    }
+    QString getAddress() const override
+    {
+        return "127.0.0.1";
+    }
+    QString getConnectionType() const override
+    {
+        return "test";
+    }
+
+protected:
+    void transmitProtocolItem(const ServerMessage & /* item */) override
+    {
+    }
+};
+
+AuthenticationResult login(Server &server, TestConnection &connection, const QString &userName, QString &reasonStr)
+{
+    QString name = userName;
+    QString clientId = "test", clientVersion = "test", connectionType = "test";
+    int secondsLeft = 0;
+    return server.loginUser(&connection, name, QString(), reasonStr, secondsLeft, clientId, clientVersion,
+                            connectionType);
+}
+} // namespace
+
+// The player has lost the connection to the server process that is being replaced, which still has its seat and
+// its session, and comes back through the new process.
+TEST(ServerLoginTest, PlayersOfThePreviousProcessAreRefused)
+{
+    SessionCountingDatabaseInterface databaseInterface(1);
+    Server server;
+    server.setDatabaseInterface(&databaseInterface);
+    server.setPreviousProcessPlayers(QSet<QString>() << "player");
+    TestConnection connection(&server, &databaseInterface);
+    server.addClient(&connection);
+
+    QString reasonStr;
+    EXPECT_EQ(login(server, connection, "player", reasonStr), WouldOverwriteOldSession);
+    EXPECT_FALSE(reasonStr.isEmpty());
+    EXPECT_EQ(databaseInterface.getSessionCount(), 1);
+    EXPECT_TRUE(server.getUsers().isEmpty());
+
+    server.removeClient(&connection);
+}
+
+TEST(ServerLoginTest, OtherUsersLogInDuringAHandoff)
+{
+    SessionCountingDatabaseInterface databaseInterface(0);
+    Server server;
+    server.setDatabaseInterface(&databaseInterface);
+    server.setPreviousProcessPlayers(QSet<QString>() << "player");
+    TestConnection connection(&server, &databaseInterface);
+    server.addClient(&connection);
+
+    QString reasonStr;
+    EXPECT_EQ(login(server, connection, "other", reasonStr), PasswordRight);
+    EXPECT_EQ(databaseInterface.getSessionCount(), 1);
+    EXPECT_TRUE(server.getUsers().contains("other"));
+
+    server.removeClient(&connection);
+}
@@ -0,0 +1,77 @@
+#include "../../common/server_metrics.h"
+#include "gtest/gtest.h"
+
+TEST(ServerMetricsTest, HistogramBuckets)
+{
+    Server_MetricsHistogram histogram;
+    histogram.record(0);
+    histogram.record(50);
+    histogram.record(51);
+    histogram.record(5000000);
+
+    EXPECT_EQ(histogram.getCumulativeCount(0), 2u);
+    EXPECT_EQ(histogram.getCumulativeCount(1), 3u);
+    EXPECT_EQ(histogram.getCumulativeCount(Server_MetricsHistogram::bucketCount - 1), 3u);
+    EXPECT_EQ(histogram.getCumulativeCount(Server_MetricsHistogram::bucketCount), 4u);
+    EXPECT_EQ(histogram.getCount(), 4u);
+    EXPECT_EQ(histogram.getSum(), 5000101u);
+}
+
+TEST(ServerMetricsTest, CommandsAreNamed)
+{
+    Server_Metrics metrics;
+    metrics.recordCommand(Server_Metrics::SessionCommands, 1001, 120); // LOGIN
+    metrics.recordCommand(Server_Metrics::GameCommands, 123456, 10);
+
+    const QString text = metrics.toPrometheusText();
+    EXPECT_TRUE(text.contains("servatrice_command_duration_seconds_count{category=\"session\",command=\"LOGIN\"} 1"));
+    EXPECT_TRUE(text.contains("servatrice_command_duration_seconds_count{category=\"game\",command=\"UNKNOWN\"} 1"));
+    // commands that were never received are left out
+    EXPECT_FALSE(text.contains("command=\"PING\""));
+}
+
+TEST(ServerMetricsTest, PoolMetricsAreStable)
+{
+    Server_Metrics metrics;
+    Server_PoolMetrics *pool = metrics.getPoolMetrics(3);
+    EXPECT_EQ(metrics.getPoolMetrics(3), pool);
+    EXPECT_NE(metrics.getPoolMetrics(-1), pool);
+
+    pool->queuedMessages.ref();
+    pool->queuedMessages.ref();
+    pool->databaseQueries.record(1500);
+    const QString text = metrics.toPrometheusText();
+    EXPECT_TRUE(text.contains("servatrice_output_queue_messages{pool=\"3\"} 2"));
+    EXPECT_TRUE(text.contains("servatrice_output_queue_messages{pool=\"main\"} 0"));
+    EXPECT_TRUE(text.contains("servatrice_database_query_duration_seconds_count{pool=\"3\"} 1"));
+}
+
+TEST(ServerMetricsTest, PoolLoadIsExported)
+{
+    Server_Metrics metrics;
+    Server_PoolMetrics *pool = metrics.getPoolMetrics(1);
+    pool->queuedBytes.fetchAndAddRelaxed(300);
+    pool->receivedMessages.fetchAndAddRelaxed(5);
+    pool->commandTime.fetchAndAddRelaxed(2500000);
+    pool->clients.store(7);
+    pool->eventLoopLag.store(1500);
+    pool->load.store(250);
+    const QString text = metrics.toPrometheusText();
+    EXPECT_TRUE(text.contains("servatrice_output_queue_bytes{pool=\"1\"} 300"));
+    EXPECT_TRUE(text.contains("servatrice_pool_received_messages_total{pool=\"1\"} 5"));
+    EXPECT_TRUE(text.contains("servatrice_pool_command_seconds_total{pool=\"1\"} 2.500000"));
+    EXPECT_TRUE(text.contains("servatrice_pool_clients{pool=\"1\"} 7"));
+    EXPECT_TRUE(text.contains("servatrice_pool_event_loop_lag_seconds{pool=\"1\"} 0.001500"));
+    EXPECT_TRUE(text.contains("servatrice_pool_load{pool=\"1\"} 0.250"));
+}
+
+TEST(ServerMetricsTest, LockWaits)
+{
+    Server_Metrics metrics;
+    metrics.recordLockWait(Server_Metrics::RoomsLock, 0);
+    metrics.recordLockWait(Server_Metrics::RoomsLock, 0);
+    metrics.recordLockWait(Server_Metrics::RoomsLock, 10);
+
+    const QString text = metrics.toPrometheusText();
+    EXPECT_TRUE(text.contains("servatrice_lock_wait_seconds_bucket{lock=\"rooms\",le=\"5e-05\"} 3"));
+}
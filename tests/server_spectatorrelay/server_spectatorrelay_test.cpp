@@ -0,0 +1,146 @@
+#include "../../common/server_spectatorrelay.h"
+#include "../../common/pb/game_event_container.pb.h"
+#include "../../common/rng_abstract.h"
+#include "../../common/server.h"
+#include "../../common/server_abstractuserinterface.h"
+#include "../../common/server_player.h"
+#include "gtest/gtest.h"
+#include <QElapsedTimer>
+#include <QMutexLocker>
+#include <QThread>
+
+// the game code links against it, the relay doesn't use it
+RNG_Abstract *rng = nullptr;
+
+namespace
+{
+// Remembers the sequence numbers of the game events it is sent; the relay sends from its own thread.
+class RecordingUserInterface : public Server_AbstractUserInterface
+{
+private:
+    mutable QMutex mutex;
+    QList<quint64> eventSequences;
+
+public:
+    explicit RecordingUserInterface(Server *_server) : Server_AbstractUserInterface(_server)
+    {
+    }
+    QList<quint64> getEventSequences() const
+    {
+        QMutexLocker locker(&mutex);
+        return eventSequences;
+    }
+    int getLastCommandTime() const override
+    {
+        return 0;
+    }
+    void sendProtocolItem(const Response & /* item */) override
+    {
+    }
+    void sendProtocolItem(const SessionEvent & /* item */) override
+    {
+    }
+    void sendProtocolItem(const GameEventContainer &item) override
+    {
+        QMutexLocker locker(&mutex);
+        eventSequences.append(item.event_sequence());
+    }
+    void sendProtocolItem(const RoomEvent & /* item */) override
+    {
+    }
+};
+
+GameEventContainer event(quint64 sequence)
+{
+    GameEventContainer cont;
+    cont.set_game_id(1);
+    cont.set_event_sequence(sequence);
+    return cont;
+}
+
+bool waitForEvents(const RecordingUserInterface &user, int count)
+{
+    QElapsedTimer timer;
+    timer.start();
+    while (user.getEventSequences().size() < count) {
+        if (timer.hasExpired(5000))
+            return false;
+        QThread::msleep(5);
+    }
+    return true;
+}
+
+ServerInfo_User spectatorInfo(int sessionId)
+{
+    ServerInfo_User info;
+    info.set_name(QString("spectator%1").arg(sessionId).toStdString());
+    info.set_session_id(sessionId);
+    return info;
+}
+} // namespace
+
+TEST(ServerSpectatorRelayTest, SpectatorsOnlyReceiveEventsQueuedAfterJoining)
+{
+    Server server;
+    Server_SpectatorRelay relay(&server, false);
+    RecordingUserInterface firstUser(&server), secondUser(&server);
+    Server_Player first(nullptr, 1, spectatorInfo(1), true, &firstUser);
+    Server_Player second(nullptr, 2, spectatorInfo(2), true, &secondUser);
+
+    relay.addGame(1, 0);
+    relay.addSpectator(1, &first);
+    relay.sendGameEvent(1, event(1), -1);
+    relay.addSpectator(1, &second);
+    relay.sendGameEvent(1, event(2), -1);
+    relay.sendGameEvent(1, event(3), 1);
+
+    ASSERT_TRUE(waitForEvents(secondUser, 2));
+    ASSERT_TRUE(waitForEvents(firstUser, 2));
+    EXPECT_EQ(firstUser.getEventSequences(), QList<quint64>({1, 2}));
+    EXPECT_EQ(secondUser.getEventSequences(), QList<quint64>({2, 3}));
+
+    relay.removeGame(1);
+}
+
+TEST(ServerSpectatorRelayTest, EventsAreHeldBackForTheDelay)
+{
+    Server server;
+    Server_SpectatorRelay relay(&server, false);
+    RecordingUserInterface user(&server);
+    Server_Player spectator(nullptr, 1, spectatorInfo(1), true, &user);
+
+    relay.addGame(1, 300);
+    relay.addSpectator(1, &spectator);
+    QElapsedTimer timer;
+    timer.start();
+    relay.sendGameEvent(1, event(1), -1);
+
+    QThread::msleep(100);
+    EXPECT_TRUE(user.getEventSequences().isEmpty());
+    ASSERT_TRUE(waitForEvents(user, 1));
+    EXPECT_GE(timer.elapsed(), 300);
+
+    relay.removeGame(1);
+}
+
+TEST(ServerSpectatorRelayTest, RemovingTheGameSendsWhatIsQueued)
+{
+    Server server;
+    Server_SpectatorRelay relay(&server, false);
+    RecordingUserInterface user(&server);
+    Server_Player spectator(nullptr, 1, spectatorInfo(1), true, &user);
+
+    relay.addGame(1, 60000);
+    relay.addSpectator(1, &spectator);
+    relay.sendGameEvent(1, event(1), -1);
+    relay.sendGameEvent(1, event(2), -1);
+    EXPECT_TRUE(user.getEventSequences().isEmpty());
+
+    relay.removeGame(1);
+    EXPECT_EQ(user.getEventSequences(), QList<quint64>({1, 2}));
+
+    // events of a removed game are dropped
+    relay.sendGameEvent(1, event(3), -1);
+    QThread::msleep(50);
+    EXPECT_EQ(user.getEventSequences().size(), 2);
+}
@@ -0,0 +1,58 @@
+#include "../../common/server_userdirectory.h"
+#include "gtest/gtest.h"
+
+namespace
+{
+ServerInfo_User user(const std::string &name)
+{
+    ServerInfo_User info;
+    info.set_name(name);
+    return info;
+}
+} // namespace
+
+TEST(ServerUserDirectoryTest, ChangesAreCollapsedPerUser)
+{
+    Server_UserDirectory directory;
+    EXPECT_NE(directory.getId(), 0u);
+    EXPECT_EQ(directory.userJoined(user("alice")), 1u);
+    EXPECT_EQ(directory.userJoined(user("bob")), 2u);
+    EXPECT_EQ(directory.userLeft("alice"), 3u);
+    EXPECT_EQ(directory.userJoined(user("carol")), 4u);
+    EXPECT_EQ(directory.userLeft("carol"), 5u);
+    EXPECT_EQ(directory.userJoined(user("carol")), 6u);
+
+    google::protobuf::RepeatedPtrField<ServerInfo_User> joined;
+    google::protobuf::RepeatedPtrField<std::string> left;
+    ASSERT_TRUE(directory.getChanges(1, joined, left));
+    ASSERT_EQ(joined.size(), 2);
+    EXPECT_EQ(joined.Get(0).name(), "bob");
+    EXPECT_EQ(joined.Get(1).name(), "carol");
+    ASSERT_EQ(left.size(), 1);
+    EXPECT_EQ(left.Get(0), "alice");
+
+    joined.Clear();
+    left.Clear();
+    EXPECT_TRUE(directory.getChanges(6, joined, left));
+    EXPECT_EQ(joined.size(), 0);
+    EXPECT_EQ(left.size(), 0);
+}
+
+TEST(ServerUserDirectoryTest, VersionsOutsideTheHistoryNeedAFullList)
+{
+    Server_UserDirectory directory(2);
+    directory.userJoined(user("alice"));
+    directory.userJoined(user("bob"));
+    directory.userJoined(user("carol"));
+
+    google::protobuf::RepeatedPtrField<ServerInfo_User> joined;
+    google::protobuf::RepeatedPtrField<std::string> left;
+    EXPECT_FALSE(directory.getChanges(0, joined, left));
+    EXPECT_FALSE(directory.getChanges(4, joined, left));
+    EXPECT_TRUE(directory.getChanges(1, joined, left));
+    EXPECT_EQ(joined.size(), 2);
+
+    directory.setHistorySize(0);
+    EXPECT_FALSE(directory.getChanges(2, joined, left));
+    EXPECT_TRUE(directory.getChanges(3, joined, left));
+}